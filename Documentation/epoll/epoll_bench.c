@@ -0,0 +1,284 @@
+/*
+ * epoll_bench - epoll event rate and wake-up benchmark
+ *
+ * Rate mode (default): -p producer threads each write single bytes to
+ * their own -f pipes, and one consumer thread epoll_wait()s on the read
+ * ends of all of them and drains what is ready.  With several producers,
+ * ep_poll_callback() runs on several CPUs at once for the same epoll file.
+ * The number of events returned by epoll_wait() per second is reported.
+ *
+ * Herd mode (-w N): N threads each wait on their own epoll file for the
+ * read end of one shared pipe.  The main thread writes one byte at a time
+ * and counts how many waiters wake up for each byte.  Without EPOLLEXCLUSIVE
+ * (-x) all of them do, with it ideally one.  A waiter that finds the byte
+ * already taken may go back to sleep inside epoll_wait(), so wake-ups are
+ * counted as voluntary context switches of the waiter threads, read from
+ * /proc/self/task/<tid>/status.
+ *
+ * Build: gcc -O2 -o epoll_bench epoll_bench.c -lpthread
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1 << 28)
+#endif
+
+static int producers = 4;
+static int pipes_per_producer = 16;
+static int seconds = 5;
+static int waiters;
+static int exclusive;
+static int iterations = 1000;
+
+static volatile int stop;
+static int epfd;
+static int (*pipefds)[2];
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static void make_pipe(int fds[2])
+{
+	if (pipe(fds) < 0)
+		die("pipe");
+	if (fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0 ||
+	    fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0)
+		die("fcntl");
+}
+
+static void *producer(void *arg)
+{
+	int first = (long)arg * pipes_per_producer;
+	unsigned long writes = 0;
+	int i = 0;
+
+	while (!stop) {
+		if (write(pipefds[first + i][1], "x", 1) == 1)
+			writes++;
+		if (++i == pipes_per_producer)
+			i = 0;
+	}
+	return (void *)writes;
+}
+
+static void rate(void)
+{
+	int npipes = producers * pipes_per_producer;
+	struct epoll_event ev, events[64];
+	unsigned long nevents = 0, writes = 0;
+	pthread_t *threads;
+	char buf[4096];
+	double start, end;
+	int i, n;
+
+	pipefds = calloc(npipes, sizeof(*pipefds));
+	threads = calloc(producers, sizeof(*threads));
+	if (!pipefds || !threads)
+		die("calloc");
+
+	epfd = epoll_create(npipes);
+	if (epfd < 0)
+		die("epoll_create");
+	for (i = 0; i < npipes; i++) {
+		make_pipe(pipefds[i]);
+		ev.events = EPOLLIN;
+		ev.data.fd = pipefds[i][0];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, pipefds[i][0], &ev) < 0)
+			die("epoll_ctl");
+	}
+
+	for (i = 0; i < producers; i++)
+		if (pthread_create(&threads[i], NULL, producer, (void *)(long)i))
+			die("pthread_create");
+
+	start = now();
+	end = start + seconds;
+	while (now() < end) {
+		n = epoll_wait(epfd, events, 64, 100);
+		if (n < 0 && errno != EINTR)
+			die("epoll_wait");
+		for (i = 0; i < n; i++)
+			while (read(events[i].data.fd, buf, sizeof(buf)) > 0)
+				;
+		if (n > 0)
+			nevents += n;
+	}
+	end = now();
+	stop = 1;
+
+	for (i = 0; i < producers; i++) {
+		void *ret;
+
+		pthread_join(threads[i], &ret);
+		writes += (unsigned long)ret;
+	}
+
+	printf("producers %d, pipes %d, %.1f s\n", producers, npipes,
+	       end - start);
+	printf("writes/s      %12.0f\n", writes / (end - start));
+	printf("events/s      %12.0f\n", nevents / (end - start));
+}
+
+static int herd_rfd;
+static volatile unsigned long consumed;
+
+struct waiter {
+	pthread_t thread;
+	volatile int tid;
+};
+
+static long voluntary_switches(int tid)
+{
+	char path[64], line[128];
+	long n = -1;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+	f = fopen(path, "r");
+	if (!f)
+		die(path);
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "voluntary_ctxt_switches: %ld", &n) == 1)
+			break;
+	fclose(f);
+	if (n < 0) {
+		fprintf(stderr, "no voluntary_ctxt_switches in %s\n", path);
+		exit(1);
+	}
+	return n;
+}
+
+static void *waiter(void *arg)
+{
+	struct waiter *w = arg;
+	struct epoll_event ev;
+	int fd, n;
+	char c;
+
+	fd = epoll_create(1);
+	if (fd < 0)
+		die("epoll_create");
+	ev.events = EPOLLIN | EPOLLET | (exclusive ? EPOLLEXCLUSIVE : 0);
+	ev.data.fd = herd_rfd;
+	if (epoll_ctl(fd, EPOLL_CTL_ADD, herd_rfd, &ev) < 0)
+		die("epoll_ctl");
+
+	w->tid = syscall(SYS_gettid);
+	for (;;) {
+		n = epoll_wait(fd, &ev, 1, -1);
+		if (n > 0 && read(herd_rfd, &c, 1) == 1)
+			__sync_fetch_and_add(&consumed, 1);
+	}
+	return NULL;
+}
+
+static void herd(void)
+{
+	struct waiter *w;
+	long wakeups = 0;
+	long *csw;
+	int fds[2], i;
+
+	w = calloc(waiters, sizeof(*w));
+	csw = calloc(waiters, sizeof(*csw));
+	if (!w || !csw)
+		die("calloc");
+	make_pipe(fds);
+	herd_rfd = fds[0];
+
+	for (i = 0; i < waiters; i++)
+		if (pthread_create(&w[i].thread, NULL, waiter, &w[i]))
+			die("pthread_create");
+	/* Let all of them block in epoll_wait() */
+	usleep(200000);
+	for (i = 0; i < waiters; i++)
+		csw[i] = voluntary_switches(w[i].tid);
+
+	for (i = 0; i < iterations; i++) {
+		if (write(fds[1], "x", 1) != 1)
+			die("write");
+		while (consumed <= (unsigned long)i)
+			usleep(100);
+		/* Give the other waiters time to wake up too */
+		usleep(1000);
+	}
+
+	for (i = 0; i < waiters; i++) {
+		wakeups += voluntary_switches(w[i].tid) - csw[i];
+		pthread_cancel(w[i].thread);
+		pthread_join(w[i].thread, NULL);
+	}
+
+	printf("waiters %d, %s, %d writes\n", waiters,
+	       exclusive ? "EPOLLEXCLUSIVE" : "shared", iterations);
+	printf("wake-ups per write %8.2f\n", (double)wakeups / iterations);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-p producers] [-f pipes/producer] [-t seconds]\n"
+		"       %s -w waiters [-x] [-n writes]\n", prog, prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "p:f:t:w:xn:")) != -1) {
+		switch (c) {
+		case 'p':
+			producers = atoi(optarg);
+			break;
+		case 'f':
+			pipes_per_producer = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'w':
+			waiters = atoi(optarg);
+			break;
+		case 'x':
+			exclusive = 1;
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (producers < 1 || pipes_per_producer < 1 || seconds < 1 ||
+	    waiters < 0 || iterations < 1)
+		usage(argv[0]);
+
+	if (waiters)
+		herd();
+	else
+		rate();
+	return 0;
+}
@@ -0,0 +1,173 @@
+#!/bin/sh
+#
+# crofs-test.sh - build crofs images of a test tree and check them mounted
+#
+# Usage: crofs-test.sh [path to mkcrofs]
+#
+# Creates a tree with empty, small, block sized, sparse, compressible and
+# incompressible files, hard links, symlinks, special files and a big
+# directory, packs it with mkcrofs at several block sizes with and
+# without fragments, loop mounts every image and compares it with the
+# tree: file types, modes, owners, link counts, mtimes, symlink targets
+# and contents, reads at odd offsets, and parallel readers of one file.
+# Must be run as root on a kernel with crofs support.
+#
+# This program is released under the GPL.
+
+MKCROFS=${1:-./mkcrofs}
+TMP=$(mktemp -d /tmp/crofs-test.XXXXXX) || exit 1
+SRC=$TMP/src
+MNT=$TMP/mnt
+export LC_ALL=C
+
+cleanup()
+{
+	umount $MNT 2>/dev/null
+	rm -rf $TMP
+}
+trap cleanup EXIT
+
+# also called from subshells, so failures are recorded in a file
+fail()
+{
+	echo "FAIL: $*"
+	echo "$*" >> $TMP/failed
+}
+
+if [ "$(id -u)" != 0 ]; then
+	echo "crofs-test: must be run as root, to loop mount the images"
+	exit 1
+fi
+if ! grep -qw crofs /proc/filesystems && ! modprobe crofs; then
+	echo "crofs-test: no crofs support in this kernel"
+	exit 1
+fi
+
+# 4KiB of random data, repeated: compresses well at any block size
+rand4k()
+{
+	dd if=/dev/urandom bs=4096 count=1 2>/dev/null
+}
+
+make_tree()
+{
+	mkdir -p $SRC/dir/sub/deeper $SRC/big $SRC/empty-dir $MNT
+
+	: > $SRC/empty
+	echo hello > $SRC/small
+	rand4k > $TMP/r4k
+	for n in 4095 4096 4097 131071 131072 131073 1048575 1048576 \
+		 1048577 3000000; do
+		yes "line $n of compressible text" | head -c $n > $SRC/text.$n
+		dd if=/dev/urandom of=$SRC/random.$n bs=$n count=1 \
+			2>/dev/null
+	done
+	for i in 0 1 2 3 4 5 6 7; do cat $TMP/r4k; done > $SRC/repeated
+
+	# a hole of 2MiB between two data blocks, and a file of zeroes
+	dd if=$TMP/r4k of=$SRC/sparse bs=4096 count=1 2>/dev/null
+	dd if=$TMP/r4k of=$SRC/sparse bs=4096 seek=513 count=1 \
+		conv=notrunc 2>/dev/null
+	dd if=/dev/zero of=$SRC/zeroes bs=65536 count=5 2>/dev/null
+
+	ln $SRC/small $SRC/dir/hardlink
+	ln $SRC/small $SRC/dir/sub/hardlink2
+	ln -s small $SRC/symlink
+	ln -s ../../../dir/sub $SRC/dir/sub/deeper/up
+	ln -s $(head -c 4000 /dev/zero | tr '\0' x) $SRC/longlink
+	mkfifo $SRC/fifo
+	mknod $SRC/chardev c 1 3
+	mknod $SRC/blockdev b 259 1048575
+	chown 1234:5678 $SRC/dir/sub
+	chown 4000000000:4000000001 $SRC/text.4095
+	chmod 4755 $SRC/random.4095
+	chmod 1777 $SRC/dir
+	touch -d @0 $SRC/dir/hardlink
+	touch -d @2000000000 $SRC/empty
+
+	# tails of many files share fragments, lookups walk a big directory
+	for i in $(seq 1 1500); do
+		echo "file $i" > $SRC/big/f$i
+	done
+	echo x > "$SRC/big/name with spaces"
+	echo x > "$SRC/big/$(head -c 255 /dev/zero | tr '\0' n)"
+	echo x > $SRC/big/$(printf '\351\370')
+}
+
+# one line per name, with everything crofs keeps; mtimes in seconds
+list_tree()
+{
+	dir=$1
+	shift
+	(cd $dir && find . "$@" -printf '%p %y %m %U %G %n %s %l %T@\n' |
+		sed 's/\.[0-9]*$//' | sort)
+}
+
+check_image()
+{
+	opts="$1"
+
+	$MKCROFS $opts -n test $SRC $TMP/image || {
+		fail "mkcrofs $opts"
+		return
+	}
+	if ! mount -t crofs -o loop,ro $TMP/image $MNT; then
+		fail "mount, mkcrofs $opts"
+		return
+	fi
+
+	# the size of a directory is that of its entries in the image
+	list_tree $SRC ! -type d > $TMP/list.src
+	list_tree $MNT ! -type d > $TMP/list.img
+	diff -u $TMP/list.src $TMP/list.img > $TMP/list.diff ||
+		fail "metadata differs, mkcrofs $opts: $(head -20 $TMP/list.diff)"
+	list_tree $SRC -type d | cut -d' ' -f1-6,9 > $TMP/dirs.src
+	list_tree $MNT -type d | cut -d' ' -f1-6,9 > $TMP/dirs.img
+	cmp -s $TMP/dirs.src $TMP/dirs.img ||
+		fail "directories differ, mkcrofs $opts"
+	[ "$(stat -c %t:%T $MNT/blockdev)" = "103:fffff" ] ||
+		fail "device number, mkcrofs $opts"
+
+	(cd $SRC && find . -type f) | while read f; do
+		cmp -s "$SRC/$f" "$MNT/$f" || fail "$f differs, mkcrofs $opts"
+	done
+
+	# reads starting in the middle of blocks, from a cold cache
+	umount $MNT && mount -t crofs -o loop,ro $TMP/image $MNT
+	for skip in 1 4095 4097 131071 131073 1000001 2999999; do
+		a=$(dd if=$SRC/text.3000000 bs=1 skip=$skip count=7 2>/dev/null |
+			od -An -tx1)
+		b=$(dd if=$MNT/text.3000000 bs=1 skip=$skip count=7 2>/dev/null |
+			od -An -tx1)
+		[ "$a" = "$b" ] || fail "read at $skip, mkcrofs $opts"
+	done
+
+	# parallel readers of the same blocks
+	umount $MNT && mount -t crofs -o loop,ro $TMP/image $MNT
+	sum=$(md5sum < $SRC/random.3000000)
+	for i in 1 2 3 4 5 6 7 8; do
+		md5sum < $MNT/random.3000000 > $TMP/sum.$i &
+	done
+	wait
+	for i in 1 2 3 4 5 6 7 8; do
+		[ "$(cat $TMP/sum.$i)" = "$sum" ] ||
+			fail "parallel reader $i, mkcrofs $opts"
+	done
+
+	umount $MNT
+	echo "checked: mkcrofs $opts, $(stat -c %s $TMP/image) bytes"
+}
+
+make_tree
+for opts in "-b 12" "-b 12 -F" "-b 17" "-b 17 -F" "-b 17 -u" "-b 20" \
+	    "-b 20 -F"; do
+	[ "$(getconf PAGESIZE)" -gt 4096 ] && [ "${opts#-b 12}" != "$opts" ] &&
+		continue
+	check_image "$opts"
+done
+
+if [ -e $TMP/failed ]; then
+	echo "crofs-test: FAILED"
+	exit 1
+fi
+echo "crofs-test: all tests passed"
@@ -0,0 +1,546 @@
+/* mkcrofs.c
+ *
+ * Create a crofs image from a directory tree.  The image format is
+ * described in Documentation/filesystems/crofs.txt.
+ *
+ * This program is released under the GPL.
+ *
+ * Compile with
+ *	gcc -I/usr/src/linux/usr/include mkcrofs.c -o mkcrofs -lz
+ *
+ * Blocks are compressed with zlib, or stored when that does not make
+ * them smaller.  Blocks of zeroes become holes.
+ */
+
+#define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <zlib.h>
+
+#include <linux/crofs_fs.h>
+
+#define err(fmt, arg...)						\
+	do {								\
+		fprintf(stderr, "mkcrofs: " fmt "\n", ##arg);		\
+		exit(1);						\
+	} while (0)
+
+struct entry {
+	char *name;
+	char *path;
+	struct stat st;
+	uint32_t ino;
+	uint32_t nlink;
+	struct entry *parent;
+	struct entry **children;
+	unsigned int nr_children;
+	struct entry *link;		/* earlier name of a hard link */
+	uint64_t start;
+	uint64_t size;
+	uint32_t fragment;
+	uint32_t frag_offset;
+};
+
+static unsigned int block_log = CROFS_DEFAULT_BLOCK_LOG;
+static unsigned int block_size;
+static int compress_blocks = 1;
+static int use_fragments = 1;
+static int squash_owner;
+static int verbose;
+
+static int out_fd;
+static uint64_t pos;			/* next free byte of the image */
+
+static struct entry **inodes;		/* by inode number - 1 */
+static uint32_t nr_inodes;
+
+static unsigned char *block_buf;
+static unsigned char *compr_buf;
+static unsigned long compr_size;
+
+static unsigned char *frag_buf;
+static unsigned int frag_used;
+static struct crofs_fragment *frags;
+static uint32_t nr_frags;
+
+static uint64_t bytes_in, nr_holes, nr_stored;
+
+static void *xmalloc(size_t size)
+{
+	void *p = calloc(1, size ? size : 1);
+
+	if (!p)
+		err("out of memory");
+	return p;
+}
+
+static void *xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (!p)
+		err("out of memory");
+	return p;
+}
+
+static void write_at(const void *buf, size_t len, uint64_t off)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = pwrite(out_fd, p, len, off);
+		if (n < 0)
+			err("write: %s", strerror(errno));
+		p += n;
+		off += n;
+		len -= n;
+	}
+}
+
+static void append(const void *buf, size_t len)
+{
+	write_at(buf, len, pos);
+	pos += len;
+}
+
+/*
+ * Write one data or fragment block of @len bytes from @data and return
+ * its block word.  Blocks of zeroes are not written at all.
+ */
+static uint32_t write_block(const unsigned char *data, unsigned int len)
+{
+	unsigned long clen = compr_size;
+	unsigned int i;
+
+	for (i = 0; i < len && !data[i]; i++)
+		;
+	if (i == len) {
+		nr_holes++;
+		return 0;
+	}
+
+	if (compress_blocks &&
+	    compress2(compr_buf, &clen, data, len, Z_BEST_COMPRESSION) ==
+	    Z_OK && clen < len) {
+		append(compr_buf, clen);
+		return clen | CROFS_COMPR_ZLIB << CROFS_BLOCK_COMPR_SHIFT;
+	}
+
+	nr_stored++;
+	append(data, len);
+	return len | CROFS_COMPR_NONE << CROFS_BLOCK_COMPR_SHIFT;
+}
+
+static void flush_fragment(void)
+{
+	uint64_t start = pos;
+	uint32_t word;
+
+	if (!frag_used)
+		return;
+
+	word = write_block(frag_buf, frag_used);
+	frags = xrealloc(frags, (nr_frags + 1) * sizeof(*frags));
+	frags[nr_frags].f_start = htole64(start);
+	frags[nr_frags].f_size = htole32(word);
+	frags[nr_frags].f_unused = 0;
+	nr_frags++;
+	frag_used = 0;
+}
+
+static void read_full(int fd, const char *path, unsigned char *buf,
+		      unsigned int len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = read(fd, buf, len);
+		if (n < 0)
+			err("%s: %s", path, strerror(errno));
+		if (!n)
+			err("%s: file shrank while reading", path);
+		buf += n;
+		len -= n;
+	}
+}
+
+static void write_file(struct entry *e)
+{
+	uint64_t size = e->st.st_size;
+	uint64_t nr = size >> block_log;
+	unsigned int tail = size & (block_size - 1);
+	uint32_t *words;
+	uint64_t i;
+	int fd;
+
+	e->size = size;
+	e->fragment = CROFS_NO_FRAGMENT;
+	if (tail && !use_fragments)
+		nr++;
+	if (nr > UINT32_MAX)
+		err("%s: too many blocks", e->path);
+
+	fd = open(e->path, O_RDONLY);
+	if (fd < 0)
+		err("%s: %s", e->path, strerror(errno));
+
+	if (nr) {
+		words = xmalloc(nr * sizeof(*words));
+		e->start = pos;
+		pos += nr * sizeof(*words);
+
+		for (i = 0; i < nr; i++) {
+			unsigned int len = block_size;
+
+			if (i == nr - 1 && tail && !use_fragments)
+				len = tail;
+			read_full(fd, e->path, block_buf, len);
+			words[i] = htole32(write_block(block_buf, len));
+		}
+		write_at(words, nr * sizeof(*words), e->start);
+		free(words);
+	}
+
+	if (tail && use_fragments) {
+		if (frag_used + tail > block_size)
+			flush_fragment();
+		read_full(fd, e->path, frag_buf + frag_used, tail);
+		e->fragment = nr_frags;
+		e->frag_offset = frag_used;
+		frag_used += tail;
+	}
+
+	bytes_in += size;
+	close(fd);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	const struct entry *ea = *(const struct entry **)a;
+	const struct entry *eb = *(const struct entry **)b;
+
+	/* strcmp() compares as unsigned char, like the kernel's memcmp() */
+	return strcmp(ea->name, eb->name);
+}
+
+static struct entry *find_link(struct entry *e)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr_inodes; i++) {
+		struct entry *o = inodes[i];
+
+		if (!S_ISDIR(o->st.st_mode) && o->st.st_nlink > 1 &&
+		    o->st.st_dev == e->st.st_dev &&
+		    o->st.st_ino == e->st.st_ino)
+			return o;
+	}
+	return NULL;
+}
+
+static void add_inode(struct entry *e)
+{
+	if (nr_inodes == UINT32_MAX)
+		err("too many inodes");
+	inodes = xrealloc(inodes, (nr_inodes + 1) * sizeof(*inodes));
+	inodes[nr_inodes++] = e;
+	e->ino = nr_inodes;
+	e->nlink = S_ISDIR(e->st.st_mode) ? 2 : 1;
+}
+
+/*
+ * Read the entries of directory @dir, sorted, give each new inode the
+ * next inode number and descend into subdirectories.
+ */
+static void scan_dir(struct entry *dir)
+{
+	struct dirent *de;
+	unsigned int i;
+	DIR *d;
+
+	d = opendir(dir->path);
+	if (!d)
+		err("%s: %s", dir->path, strerror(errno));
+
+	while ((de = readdir(d))) {
+		struct entry *e;
+
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		if (strlen(de->d_name) > CROFS_MAX_NAMELEN)
+			err("%s/%s: name too long", dir->path, de->d_name);
+
+		e = xmalloc(sizeof(*e));
+		e->name = strdup(de->d_name);
+		if (asprintf(&e->path, "%s/%s", dir->path, de->d_name) < 0)
+			err("out of memory");
+		if (lstat(e->path, &e->st))
+			err("%s: %s", e->path, strerror(errno));
+		e->parent = dir;
+
+		dir->children = xrealloc(dir->children,
+				(dir->nr_children + 1) * sizeof(e));
+		dir->children[dir->nr_children++] = e;
+	}
+	closedir(d);
+
+	qsort(dir->children, dir->nr_children, sizeof(struct entry *),
+	      compare_entries);
+
+	for (i = 0; i < dir->nr_children; i++) {
+		struct entry *e = dir->children[i];
+
+		if (!S_ISDIR(e->st.st_mode) && e->st.st_nlink > 1)
+			e->link = find_link(e);
+		if (e->link) {
+			e->link->nlink++;
+			continue;
+		}
+		add_inode(e);
+		if (S_ISDIR(e->st.st_mode))
+			dir->nlink++;
+	}
+
+	for (i = 0; i < dir->nr_children; i++)
+		if (S_ISDIR(dir->children[i]->st.st_mode))
+			scan_dir(dir->children[i]);
+}
+
+static unsigned char *dir_table;
+static uint64_t dir_size;
+
+static void dir_append(const void *data, size_t len)
+{
+	dir_table = xrealloc(dir_table, dir_size + len);
+	memcpy(dir_table + dir_size, data, len);
+	dir_size += len;
+}
+
+/*
+ * Lay out the directory table, which starts at @base in the image, and
+ * fill in i_start and i_size of directories and symlinks.
+ */
+static void build_dir_table(uint64_t base)
+{
+	static const char zero[4];
+	uint32_t i;
+	unsigned int j;
+
+	for (i = 0; i < nr_inodes; i++) {
+		struct entry *e = inodes[i];
+
+		if (S_ISLNK(e->st.st_mode)) {
+			char target[4096];
+			ssize_t len;
+
+			len = readlink(e->path, target, sizeof(target));
+			if (len < 0)
+				err("%s: %s", e->path, strerror(errno));
+			if (len >= (ssize_t)sizeof(target))
+				err("%s: symlink target too long", e->path);
+			e->start = base + dir_size;
+			e->size = len;
+			dir_append(target, len);
+			dir_append(zero, (4 - (len & 3)) & 3);
+		} else if (S_ISDIR(e->st.st_mode)) {
+			e->start = base + dir_size;
+			for (j = 0; j < e->nr_children; j++) {
+				struct entry *c = e->children[j];
+				struct entry *t = c->link ? c->link : c;
+				struct crofs_dirent de;
+				size_t len = strlen(c->name);
+
+				de.d_ino = htole32(t->ino);
+				de.d_name_len = htole16(len);
+				de.d_type = (t->st.st_mode & S_IFMT) >> 12;
+				de.d_unused = 0;
+				dir_append(&de, sizeof(de));
+				dir_append(c->name, len);
+				dir_append(zero, (4 - (len & 3)) & 3);
+			}
+			e->size = base + dir_size - e->start;
+		}
+	}
+}
+
+static uint32_t encode_dev(dev_t dev)
+{
+	unsigned int ma = major(dev), mi = minor(dev);
+
+	/* the kernel's new_encode_dev() */
+	return (mi & 0xff) | (ma << 8) | ((mi & ~0xff) << 12);
+}
+
+static void write_inode_table(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr_inodes; i++) {
+		struct entry *e = inodes[i];
+		struct crofs_inode raw;
+
+		if (e->nlink > 0xffff)
+			err("%s: too many links", e->path);
+
+		memset(&raw, 0, sizeof(raw));
+		raw.i_mode = htole16(e->st.st_mode);
+		raw.i_nlink = htole16(e->nlink);
+		raw.i_uid = htole32(squash_owner ? 0 : e->st.st_uid);
+		raw.i_gid = htole32(squash_owner ? 0 : e->st.st_gid);
+		raw.i_mtime = htole32(e->st.st_mtime);
+		raw.i_fragment = htole32(CROFS_NO_FRAGMENT);
+
+		switch (e->st.st_mode & S_IFMT) {
+		case S_IFREG:
+			raw.i_fragment = htole32(e->fragment);
+			raw.i_frag_offset = htole32(e->frag_offset);
+			/* fall through */
+		case S_IFDIR:
+		case S_IFLNK:
+			raw.i_size = htole64(e->size);
+			raw.i_start = htole64(e->start);
+			break;
+		case S_IFCHR:
+		case S_IFBLK:
+			raw.i_rdev = htole32(encode_dev(e->st.st_rdev));
+			break;
+		}
+		if (S_ISDIR(e->st.st_mode))
+			raw.i_parent = htole32(e->parent->ino);
+
+		append(&raw, sizeof(raw));
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: mkcrofs [options] <directory> <image>\n"
+		"  -b <log>   log2 of the block size, %d to %d (default %d)\n"
+		"  -n <name>  volume name\n"
+		"  -u         store blocks uncompressed\n"
+		"  -F         no fragments, file tails get their own block\n"
+		"  -r         make all files owned by root\n"
+		"  -v         print statistics\n",
+		CROFS_MIN_BLOCK_LOG, CROFS_MAX_BLOCK_LOG,
+		CROFS_DEFAULT_BLOCK_LOG);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct crofs_super_block sb;
+	struct entry root;
+	const char *name = "";
+	uint64_t inode_table, dir_base, frag_table;
+	uint32_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:n:uFrv")) != -1) {
+		switch (opt) {
+		case 'b':
+			block_log = atoi(optarg);
+			break;
+		case 'n':
+			name = optarg;
+			break;
+		case 'u':
+			compress_blocks = 0;
+			break;
+		case 'F':
+			use_fragments = 0;
+			break;
+		case 'r':
+			squash_owner = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind != 2)
+		usage();
+	if (block_log < CROFS_MIN_BLOCK_LOG || block_log > CROFS_MAX_BLOCK_LOG)
+		err("block size must be 2^%d to 2^%d", CROFS_MIN_BLOCK_LOG,
+		    CROFS_MAX_BLOCK_LOG);
+	block_size = 1 << block_log;
+
+	memset(&root, 0, sizeof(root));
+	root.name = "";
+	root.path = argv[optind];
+	if (stat(root.path, &root.st))
+		err("%s: %s", root.path, strerror(errno));
+	if (!S_ISDIR(root.st.st_mode))
+		err("%s: not a directory", root.path);
+	root.parent = &root;
+	add_inode(&root);
+	scan_dir(&root);
+
+	out_fd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0)
+		err("%s: %s", argv[optind + 1], strerror(errno));
+
+	block_buf = xmalloc(block_size);
+	frag_buf = xmalloc(block_size);
+	compr_size = compressBound(block_size);
+	compr_buf = xmalloc(compr_size);
+
+	/* the super block is written last */
+	pos = sizeof(sb);
+	for (i = 0; i < nr_inodes; i++)
+		if (S_ISREG(inodes[i]->st.st_mode))
+			write_file(inodes[i]);
+	flush_fragment();
+
+	inode_table = pos;
+	dir_base = inode_table + (uint64_t)nr_inodes *
+		   sizeof(struct crofs_inode);
+	build_dir_table(dir_base);
+	write_inode_table();
+	append(dir_table, dir_size);
+	frag_table = pos;
+	append(frags, nr_frags * sizeof(*frags));
+
+	memset(&sb, 0, sizeof(sb));
+	sb.s_magic = htole32(CROFS_MAGIC);
+	sb.s_major = htole16(CROFS_MAJOR);
+	sb.s_minor = htole16(CROFS_MINOR);
+	sb.s_block_log = htole32(block_log);
+	sb.s_inodes = htole32(nr_inodes);
+	sb.s_fragments = htole32(nr_frags);
+	sb.s_mkfs_time = htole32(time(NULL));
+	sb.s_bytes_used = htole64(pos);
+	sb.s_inode_table = htole64(inode_table);
+	sb.s_dir_table = htole64(dir_base);
+	sb.s_frag_table = htole64(frag_table);
+	strncpy((char *)sb.s_name, name, sizeof(sb.s_name));
+	write_at(&sb, sizeof(sb), 0);
+
+	if (ftruncate(out_fd, (pos + 4095) & ~4095ULL))
+		err("%s: %s", argv[optind + 1], strerror(errno));
+	if (close(out_fd))
+		err("%s: %s", argv[optind + 1], strerror(errno));
+
+	if (verbose)
+		printf("%u inodes, %u fragments, %llu bytes of files in "
+		       "%llu bytes, %llu holes, %llu stored blocks\n",
+		       nr_inodes, nr_frags, (unsigned long long)bytes_in,
+		       (unsigned long long)pos, (unsigned long long)nr_holes,
+		       (unsigned long long)nr_stored);
+	return 0;
+}
@@ -387,6 +387,20 @@
 #define __NR_dup3			(__NR_SYSCALL_BASE+358)
 #define __NR_pipe2			(__NR_SYSCALL_BASE+359)
 #define __NR_inotify_init1		(__NR_SYSCALL_BASE+360)
+					/* 361 for preadv */
+					/* 362 for pwritev */
+					/* 363 for rt_tgsigqueueinfo */
+					/* 364 for perf_event_open */
+#define __NR_recvmmsg			(__NR_SYSCALL_BASE+365)
+					/* 366 for accept4 */
+					/* 367 for fanotify_init */
+					/* 368 for fanotify_mark */
+					/* 369 for prlimit64 */
+					/* 370 for name_to_handle_at */
+					/* 371 for open_by_handle_at */
+					/* 372 for clock_adjtime */
+					/* 373 for syncfs */
+#define __NR_sendmmsg			(__NR_SYSCALL_BASE+374)
 
 /*
  * The following SWIs are ARM private.
@@ -63,4 +63,6 @@
 
 #define SO_MARK			36
 
+#define SO_BUSY_POLL		46
+
 #endif /* _ASM_IA64_SOCKET_H */
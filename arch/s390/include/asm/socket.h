@@ -62,4 +62,6 @@
 
 #define SO_MARK			36
 
+#define SO_BUSY_POLL		46
+
 #endif /* _ASM_SOCKET_H */
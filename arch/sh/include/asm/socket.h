@@ -54,4 +54,6 @@
 
 #define SO_MARK			36
 
+#define SO_BUSY_POLL		46
+
 #endif /* __ASM_SH_SOCKET_H */
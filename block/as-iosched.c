@@ -751,6 +751,12 @@ static int as_can_anticipate(struct as_data *ad, struct request *rq)
 		 */
 		return 0;
 
+	if (blk_queue_nonrot(ad->q))
+		/*
+		 * No seeks to avoid, waiting only adds latency
+		 */
+		return 0;
+
 	if (ad->antic_status == ANTIC_FINISHED)
 		/*
 		 * Don't restart if we have just finished. Run the next request
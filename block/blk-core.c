@@ -1028,6 +1028,45 @@ void part_round_stats(struct hd_struct *part)
 	part->stamp = now;
 }
 
+#ifdef CONFIG_BLK_DEV_IO_LATENCY
+static void disk_latency_add(struct gendisk *disk, int rw, int type,
+			     ktime_t start, ktime_t end)
+{
+	s64 us = ktime_us_delta(end, start);
+	int bucket = 0;
+
+	if (us >= 1LL << (DISK_LAT_BUCKETS - 1))
+		bucket = DISK_LAT_BUCKETS - 1;
+	else if (us > 0)
+		bucket = fls(us) - 1;
+
+	disk->latency.hist[rw][type][bucket]++;
+}
+
+/*
+ * Account the latencies of a completed request, queue lock must be held.
+ * Requests that never went through elv_next_request() only count in the
+ * total.
+ */
+void blk_account_latency(struct gendisk *disk, struct request *rq)
+{
+	const int rw = rq_data_dir(rq);
+	ktime_t now;
+
+	if (!ktime_to_ns(rq->start_ktime))
+		return;
+
+	now = ktime_get();
+	if (ktime_to_ns(rq->issue_ktime)) {
+		disk_latency_add(disk, rw, DISK_LAT_QUEUE, rq->start_ktime,
+				 rq->issue_ktime);
+		disk_latency_add(disk, rw, DISK_LAT_SERVICE, rq->issue_ktime,
+				 now);
+	}
+	disk_latency_add(disk, rw, DISK_LAT_TOTAL, rq->start_ktime, now);
+}
+#endif
+
 /*
  * queue lock must be held
  */
@@ -1093,19 +1132,113 @@ void init_request_from_bio(struct request *req, struct bio *bio)
 	req->hard_sector = req->sector = bio->bi_sector;
 	req->ioprio = bio_prio(bio);
 	req->start_time = jiffies;
+	blk_latency_queued(req);
 	blk_rq_bio_prep(req->q, req, bio);
 }
 
+static int bio_attempt_back_merge(struct request_queue *q, struct request *req,
+				  struct bio *bio)
+{
+	const int nr_sectors = bio_sectors(bio);
+
+	if (!ll_back_merge_fn(q, req, bio))
+		return 0;
+
+	blk_add_trace_bio(q, bio, BLK_TA_BACKMERGE);
+
+	req->biotail->bi_next = bio;
+	req->biotail = bio;
+	req->nr_sectors = req->hard_nr_sectors += nr_sectors;
+	req->ioprio = ioprio_best(req->ioprio, bio_prio(bio));
+	drive_stat_acct(req, 0);
+	return 1;
+}
+
+static int bio_attempt_front_merge(struct request_queue *q,
+				   struct request *req, struct bio *bio)
+{
+	const int nr_sectors = bio_sectors(bio);
+
+	if (!ll_front_merge_fn(q, req, bio))
+		return 0;
+
+	blk_add_trace_bio(q, bio, BLK_TA_FRONTMERGE);
+
+	bio->bi_next = req->bio;
+	req->bio = bio;
+
+	/*
+	 * may not be valid. if the low level driver said
+	 * it didn't need a bounce buffer then it better
+	 * not touch req->buffer either...
+	 */
+	req->buffer = bio_data(bio);
+	req->current_nr_sectors = bio_cur_sectors(bio);
+	req->hard_cur_sectors = req->current_nr_sectors;
+	req->sector = req->hard_sector = bio->bi_sector;
+	req->nr_sectors = req->hard_nr_sectors += nr_sectors;
+	req->ioprio = ioprio_best(req->ioprio, bio_prio(bio));
+	drive_stat_acct(req, 0);
+	return 1;
+}
+
+/*
+ * Try to merge @bio into a request on the task plug list. The requests there
+ * are private to the task, so no queue lock is needed.
+ */
+static int attempt_plug_merge(struct blk_plug *plug, struct request_queue *q,
+			      struct bio *bio)
+{
+	struct request *rq;
+	int ret = 0;
+
+	/* The disk stats are per-cpu and otherwise updated under the lock */
+	preempt_disable();
+	list_for_each_entry_reverse(rq, &plug->list, queuelist) {
+		if (rq->q != q || !elv_rq_merge_ok(rq, bio))
+			continue;
+
+		if (rq->sector + rq->nr_sectors == bio->bi_sector)
+			ret = bio_attempt_back_merge(q, rq, bio);
+		else if (bio->bi_sector + bio_sectors(bio) == rq->sector)
+			ret = bio_attempt_front_merge(q, rq, bio);
+		if (ret)
+			break;
+	}
+	preempt_enable();
+	return ret;
+}
+
+/*
+ * Add a request to the task plug list, which is kept sorted by queue and by
+ * sector. I/O is mostly submitted in ascending order, so search from the end.
+ */
+static void plug_add_request(struct blk_plug *plug, struct request *rq)
+{
+	struct list_head *pos;
+
+	list_for_each_prev(pos, &plug->list) {
+		struct request *prev = list_entry_rq(pos);
+
+		if ((unsigned long)prev->q < (unsigned long)rq->q)
+			break;
+		if (prev->q == rq->q && prev->sector <= rq->sector)
+			break;
+	}
+	list_add(&rq->queuelist, pos);
+
+	if (++plug->count >= BLK_MAX_REQUEST_COUNT)
+		blk_flush_plug_list(plug, 0);
+}
+
 static int __make_request(struct request_queue *q, struct bio *bio)
 {
 	struct request *req;
-	int el_ret, nr_sectors, barrier, err;
-	const unsigned short prio = bio_prio(bio);
+	int el_ret, barrier, err;
 	const int sync = bio_sync(bio);
+	struct blk_plug *plug;
 	int rw_flags;
 
-	nr_sectors = bio_sectors(bio);
-
 	/*
 	 * low level driver can indicate that it wants pages above a
 	 * certain limit bounced to low memory (ie for highmem, or even
@@ -1119,6 +1252,18 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 		goto end_io;
 	}
 
+	/*
+	 * Try the task plug list first, that needs no locking. A barrier
+	 * must not pass the requests plugged before it.
+	 */
+	plug = current->plug;
+	if (plug) {
+		if (unlikely(barrier))
+			blk_flush_plug_list(plug, 0);
+		else if (attempt_plug_merge(plug, q, bio))
+			return 0;
+	}
+
 	spin_lock_irq(q->queue_lock);
 
 	if (unlikely(barrier) || elv_queue_empty(q))
@@ -1129,16 +1274,9 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 	case ELEVATOR_BACK_MERGE:
 		BUG_ON(!rq_mergeable(req));
 
-		if (!ll_back_merge_fn(q, req, bio))
+		if (!bio_attempt_back_merge(q, req, bio))
 			break;
 
-		blk_add_trace_bio(q, bio, BLK_TA_BACKMERGE);
-
-		req->biotail->bi_next = bio;
-		req->biotail = bio;
-		req->nr_sectors = req->hard_nr_sectors += nr_sectors;
-		req->ioprio = ioprio_best(req->ioprio, prio);
-		drive_stat_acct(req, 0);
 		if (!attempt_back_merge(q, req))
 			elv_merged_request(q, req, el_ret);
 		goto out;
@@ -1146,26 +1284,9 @@ static int __make_request(struct request_queue *q, struct bio *bio)
 	case ELEVATOR_FRONT_MERGE:
 		BUG_ON(!rq_mergeable(req));
 
-		if (!ll_front_merge_fn(q, req, bio))
+		if (!bio_attempt_front_merge(q, req, bio))
 			break;
 
-		blk_add_trace_bio(q, bio, BLK_TA_FRONTMERGE);
-
-		bio->bi_next = req->bio;
-		req->bio = bio;
-
-		/*
-		 * may not be valid. if the low level driver said
-		 * it didn't need a bounce buffer then it better
-		 * not touch req->buffer either...
-		 */
-		req->buffer = bio_data(bio);
-		req->current_nr_sectors = bio_cur_sectors(bio);
-		req->hard_cur_sectors = req->current_nr_sectors;
-		req->sector = req->hard_sector = bio->bi_sector;
-		req->nr_sectors = req->hard_nr_sectors += nr_sectors;
-		req->ioprio = ioprio_best(req->ioprio, prio);
-		drive_stat_acct(req, 0);
 		if (!attempt_front_merge(q, req))
 			elv_merged_request(q, req, el_ret);
 		goto out;
@@ -1199,6 +1320,16 @@ get_rq:
 	 */
 	init_request_from_bio(req, bio);
 
+	/*
+	 * Hold the request on the task plug list. If we slept above the
+	 * list has been flushed already, but the plug is still ours. Sync
+	 * requests get the queue unplugged when the plug is flushed.
+	 */
+	if (plug && !barrier) {
+		plug_add_request(plug, req);
+		return 0;
+	}
+
 	spin_lock_irq(q->queue_lock);
 	if (elv_queue_empty(q))
 		blk_plug_device(q);
@@ -1744,6 +1875,7 @@ static void end_that_request_last(struct request *req, int error)
 
 		__all_stat_inc(disk, part, ios[rw], req->sector);
 		__all_stat_add(disk, part, ticks[rw], duration, req->sector);
+		blk_account_latency(disk, req);
 		disk_round_stats(disk);
 		disk->in_flight--;
 		if (part) {
@@ -2033,6 +2165,114 @@ void blk_rq_bio_prep(struct request_queue *q, struct request *rq,
 		rq->rq_disk = bio->bi_bdev->bd_disk;
 }
 
+/**
+ * blk_start_plug - start holding back I/O submitted by this task
+ * @plug:	the &struct blk_plug to use, usually on the caller's stack
+ *
+ * Description:
+ *     Requests submitted by the task are collected on @plug instead of
+ *     being added to their queue one by one. This allows merging them
+ *     without taking the queue lock, and they are later inserted in one
+ *     batch per queue. The plug is flushed by blk_finish_plug(), when too
+ *     many requests have been collected, and when the task goes to sleep.
+ *
+ *     Plugs may nest, only the outermost one is used.
+ **/
+void blk_start_plug(struct blk_plug *plug)
+{
+	struct task_struct *tsk = current;
+
+	INIT_LIST_HEAD(&plug->list);
+	plug->count = 0;
+
+	if (!tsk->plug)
+		tsk->plug = plug;
+}
+EXPORT_SYMBOL(blk_start_plug);
+
+static void plug_flush_queue(struct request_queue *q, unsigned int depth,
+			     int unplug, int from_schedule)
+{
+	blk_add_trace_plug_flush(q, depth, from_schedule);
+
+	/*
+	 * A task going to sleep can't run the queue itself, let kblockd
+	 * do it. Otherwise only kick the queue for sync I/O, async I/O is
+	 * left to the unplug timer as before.
+	 */
+	if (from_schedule)
+		kblockd_schedule_work(&q->unplug_work);
+	else if (unplug)
+		__generic_unplug_device(q);
+
+	spin_unlock(q->queue_lock);
+}
+
+/**
+ * blk_flush_plug_list - insert the requests held on a plug
+ * @plug:		the plug to flush
+ * @from_schedule:	called from schedule(), the task is about to sleep
+ *
+ * Description:
+ *     Moves all requests on @plug to their queues, taking each queue lock
+ *     once per batch.
+ **/
+void blk_flush_plug_list(struct blk_plug *plug, int from_schedule)
+{
+	struct request_queue *q = NULL;
+	unsigned int depth = 0;
+	unsigned long flags;
+	struct request *rq;
+	int unplug = 0;
+	LIST_HEAD(list);
+
+	if (list_empty(&plug->list))
+		return;
+
+	list_splice_init(&plug->list, &list);
+	plug->count = 0;
+
+	local_irq_save(flags);
+	while (!list_empty(&list)) {
+		rq = list_entry_rq(list.next);
+		list_del_init(&rq->queuelist);
+
+		if (rq->q != q) {
+			if (q)
+				plug_flush_queue(q, depth, unplug,
+						 from_schedule);
+			q = rq->q;
+			depth = 0;
+			unplug = 0;
+			spin_lock(q->queue_lock);
+		}
+
+		if (elv_queue_empty(q))
+			blk_plug_device(q);
+		add_request(q, rq);
+
+		if (rq->cmd_flags & REQ_RW_SYNC)
+			unplug = 1;
+		depth++;
+	}
+	plug_flush_queue(q, depth, unplug, from_schedule);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(blk_flush_plug_list);
+
+/**
+ * blk_finish_plug - submit the I/O held back since blk_start_plug()
+ * @plug:	the plug passed to blk_start_plug()
+ **/
+void blk_finish_plug(struct blk_plug *plug)
+{
+	blk_flush_plug_list(plug, 0);
+
+	if (plug == current->plug)
+		current->plug = NULL;
+}
+EXPORT_SYMBOL(blk_finish_plug);
+
 int kblockd_schedule_work(struct work_struct *work)
 {
 	return queue_work(kblockd_workqueue, work);
@@ -461,6 +461,7 @@ static int attempt_merge(struct request_queue *q, struct request *req,
 	 */
 	if (time_after(req->start_time, next->start_time))
 		req->start_time = next->start_time;
+	blk_latency_merge(req, next);
 
 	req->biotail->bi_next = next->bio;
 	req->biotail = next->biotail;
@@ -33,6 +33,44 @@ void blk_queue_congestion_threshold(struct request_queue *q);
 
 int blk_dev_init(void);
 
+#ifdef CONFIG_BLK_DEV_IO_LATENCY
+void blk_account_latency(struct gendisk *disk, struct request *rq);
+
+static inline void blk_latency_queued(struct request *rq)
+{
+	rq->start_ktime = ktime_get();
+}
+
+static inline void blk_latency_issued(struct request *rq)
+{
+	if (blk_fs_request(rq))
+		rq->issue_ktime = ktime_get();
+}
+
+/*
+ * @rq absorbs @next, keep the earlier queueing time
+ */
+static inline void blk_latency_merge(struct request *rq, struct request *next)
+{
+	if (ktime_to_ns(next->start_ktime) < ktime_to_ns(rq->start_ktime))
+		rq->start_ktime = next->start_ktime;
+}
+#else
+static inline void blk_account_latency(struct gendisk *disk,
+				       struct request *rq)
+{
+}
+static inline void blk_latency_queued(struct request *rq)
+{
+}
+static inline void blk_latency_issued(struct request *rq)
+{
+}
+static inline void blk_latency_merge(struct request *rq, struct request *next)
+{
+}
+#endif
+
 /*
  * Return the threshold (number of used requests) at which the queue is
  * considered to be congested.  It include a little hysteresis to keep the
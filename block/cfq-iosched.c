@@ -887,6 +887,12 @@ static void cfq_arm_slice_timer(struct cfq_data *cfqd)
 	if (!cfqd->cfq_slice_idle || !cfq_cfqq_idle_window(cfqq))
 		return;
 
+	/*
+	 * idling is there to save seeks, a non-rotational device has none
+	 */
+	if (blk_queue_nonrot(cfqd->queue))
+		return;
+
 	/*
 	 * still requests with the driver, don't idle
 	 */
@@ -1734,7 +1740,7 @@ cfq_update_idle_window(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 	enable_idle = old_idle = cfq_cfqq_idle_window(cfqq);
 
 	if (!atomic_read(&cic->ioc->nr_tasks) || !cfqd->cfq_slice_idle ||
-	    (cfqd->hw_tag && CIC_SEEKY(cic)))
+	    blk_queue_nonrot(cfqd->queue) || (cfqd->hw_tag && CIC_SEEKY(cic)))
 		enable_idle = 0;
 	else if (sample_valid(cic->ttime_samples)) {
 		if (cic->ttime_mean > cfqd->cfq_slice_idle)
@@ -37,6 +37,8 @@
 
 #include <asm/uaccess.h>
 
+#include "blk.h"
+
 static DEFINE_SPINLOCK(elv_list_lock);
 static LIST_HEAD(elv_list);
 
@@ -763,6 +765,7 @@ struct request *elv_next_request(struct request_queue *q)
 			 * not be passed by new incoming requests
 			 */
 			rq->cmd_flags |= REQ_STARTED;
+			blk_latency_issued(rq);
 			blk_add_trace_rq(q, rq, BLK_TA_ISSUE);
 		}
 
@@ -0,0 +1,556 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  A deadline style scheduler for devices without seek cost, such as SD
+ *  cards and eMMC. Reads are served in arrival order and always before
+ *  writes, writes are issued in sector order in batches that fill whole
+ *  erase blocks. Requests are served by ioprio class.
+ *
+ *  Based on the deadline i/o scheduler,
+ *  Copyright (C) 2002 Jens Axboe <axboe@kernel.dk>
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int read_expire = HZ / 8;	/* max time before a read is served */
+static const int write_expire = HZ;	/* ditto for writes, limits are SOFT! */
+static const int writes_starved = 8;	/* max reads served while writes wait */
+static const int write_batch_kb = 1024;	/* max size of a write batch */
+static const int erase_block_kb = 128;	/* batches are aligned to this */
+
+/*
+ * the ioprio classes, in the order they are served
+ */
+enum {
+	FLASH_CLASS_RT,
+	FLASH_CLASS_BE,
+	FLASH_CLASS_IDLE,
+	FLASH_NR_CLASSES,
+};
+
+struct flash_data {
+	/*
+	 * run time data
+	 */
+
+	/*
+	 * requests are present on both sort_list and fifo_list of their class
+	 */
+	struct rb_root sort_list[FLASH_NR_CLASSES][2];
+	struct list_head fifo_list[FLASH_NR_CLASSES][2];
+
+	/*
+	 * the running write batch
+	 */
+	struct request *next_write;	/* next write in sort order */
+	sector_t batch_end;		/* end of the current erase block */
+	unsigned int batch_sectors;	/* sectors written in this batch */
+	unsigned int starved;		/* reads served while writes wait */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[2];
+	int writes_starved;
+	int write_batch_kb;
+	int erase_block_kb;
+};
+
+#define RQ_CLASS(rq)		((unsigned long)(rq)->elevator_private)
+#define RQ_RB_ROOT(fd, rq)	\
+	(&(fd)->sort_list[RQ_CLASS(rq)][rq_data_dir(rq)])
+
+/*
+ * map the ioprio class of the submitting task to a flash class
+ */
+static unsigned long flash_rq_class(struct request *rq)
+{
+	struct io_context *ioc = current->io_context;
+	int class = IOPRIO_PRIO_CLASS(rq->ioprio);
+
+	if (class == IOPRIO_CLASS_NONE) {
+		if (ioc && ioprio_valid(ioc->ioprio))
+			class = task_ioprio_class(ioc);
+		else
+			class = task_nice_ioclass(current);
+	}
+
+	switch (class) {
+	case IOPRIO_CLASS_RT:
+		return FLASH_CLASS_RT;
+	case IOPRIO_CLASS_IDLE:
+		return FLASH_CLASS_IDLE;
+	default:
+		return FLASH_CLASS_BE;
+	}
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *flash_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+/*
+ * get the request before `rq' in sector-sorted order
+ */
+static inline struct request *flash_former_request(struct request *rq)
+{
+	struct rb_node *node = rb_prev(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static void flash_move_to_dispatch(struct flash_data *fd, struct request *rq);
+
+static void flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct rb_root *root = RQ_RB_ROOT(fd, rq);
+	struct request *__alias;
+
+retry:
+	__alias = elv_rb_add(root, rq);
+	if (unlikely(__alias)) {
+		flash_move_to_dispatch(fd, __alias);
+		goto retry;
+	}
+}
+
+static inline void flash_del_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	if (fd->next_write == rq)
+		fd->next_write = flash_latter_request(rq);
+
+	elv_rb_del(RQ_RB_ROOT(fd, rq), rq);
+}
+
+/*
+ * add rq to rbtree and fifo of its class
+ */
+static void flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int data_dir = rq_data_dir(rq);
+
+	rq->elevator_private = (void *)flash_rq_class(rq);
+	flash_add_rq_rb(fd, rq);
+
+	rq_set_fifo_time(rq, jiffies + fd->fifo_expire[data_dir]);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[RQ_CLASS(rq)][data_dir]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	flash_del_rq_rb(fd, rq);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	sector_t sector = bio->bi_sector + bio_sectors(bio);
+	struct request *__rq;
+	int class;
+
+	/*
+	 * check for front merge, back merges are found by the elevator core
+	 */
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		__rq = elv_rb_find(&fd->sort_list[class][bio_data_dir(bio)],
+				   sector);
+		if (__rq) {
+			BUG_ON(sector != __rq->sector);
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(RQ_RB_ROOT(fd, req), req);
+		flash_add_rq_rb(fd, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo.
+	 * The fifo lists are per class, so only within the same class.
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist) &&
+	    RQ_CLASS(req) == RQ_CLASS(next)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+/*
+ * move request from sort list to dispatch queue.
+ */
+static void flash_move_to_dispatch(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	flash_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+/*
+ * move an entry to dispatch queue, a write continues the batch
+ */
+static void flash_move_request(struct flash_data *fd, struct request *rq)
+{
+	if (rq_data_dir(rq) == WRITE) {
+		fd->next_write = flash_latter_request(rq);
+		fd->batch_sectors += rq->nr_sectors;
+	}
+
+	flash_move_to_dispatch(fd, rq);
+}
+
+/*
+ * flash_check_fifo returns 0 if there are no expired requests on the fifo,
+ * 1 otherwise. Requires !list_empty(&fd->fifo_list[class][data_dir])
+ */
+static inline int flash_check_fifo(struct flash_data *fd, int class, int ddir)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[class][ddir].next);
+
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * are reads waiting in @class or a class served before it
+ */
+static int flash_reads_pending(struct flash_data *fd, int class)
+{
+	int i;
+
+	for (i = 0; i <= class; i++)
+		if (!list_empty(&fd->fifo_list[i][READ]))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * has a read of any class waited for longer than read_expire
+ */
+static int flash_reads_expired(struct flash_data *fd)
+{
+	int i;
+
+	for (i = 0; i < FLASH_NR_CLASSES; i++)
+		if (!list_empty(&fd->fifo_list[i][READ]) &&
+		    flash_check_fifo(fd, i, READ))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Start a write batch in @class. The batch begins with the oldest write,
+ * or rather with the lowest queued write in the erase block it falls in,
+ * so that the erase block is written from its start.
+ */
+static struct request *flash_start_batch(struct flash_data *fd, int class)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[class][WRITE].next);
+	const unsigned int eb_sectors = fd->erase_block_kb << 1;
+	struct request *prev;
+	sector_t start = rq->sector;
+	unsigned int offset = sector_div(start, eb_sectors);
+
+	start = rq->sector - offset;
+
+	while ((prev = flash_former_request(rq)) && prev->sector >= start)
+		rq = prev;
+
+	fd->batch_end = start + eb_sectors;
+	fd->batch_sectors = 0;
+	return rq;
+}
+
+/*
+ * Should the write batch go on with @rq? The erase block the batch is in
+ * is always finished. The batch only carries on into the following erase
+ * block while it is below write_batch_kb, no reads of the same or a higher
+ * class are waiting and no read has expired.
+ */
+static int flash_continue_batch(struct flash_data *fd, struct request *rq)
+{
+	const unsigned int eb_sectors = fd->erase_block_kb << 1;
+
+	if (rq->sector < fd->batch_end)
+		return 1;
+
+	if (fd->batch_sectors >= fd->write_batch_kb << 1 ||
+	    rq->sector >= fd->batch_end + eb_sectors ||
+	    flash_reads_pending(fd, RQ_CLASS(rq)) ||
+	    flash_reads_expired(fd))
+		return 0;
+
+	fd->batch_end += eb_sectors;
+	return 1;
+}
+
+/*
+ * flash_dispatch_requests selects the best request according to ioprio
+ * class, read/write expire, writes_starved and the running write batch
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *rq;
+	int class;
+
+	rq = fd->next_write;
+	if (rq) {
+		if (flash_continue_batch(fd, rq)) {
+			flash_move_request(fd, rq);
+			return 1;
+		}
+		fd->next_write = NULL;
+	}
+
+	/*
+	 * not running a batch. Take the first class with requests, and in it
+	 * prefer reads unless writes have been starved for writes_starved
+	 * reads, or have expired while the oldest read has not.
+	 */
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		const int reads = !list_empty(&fd->fifo_list[class][READ]);
+		const int writes = !list_empty(&fd->fifo_list[class][WRITE]);
+
+		if (!reads && !writes)
+			continue;
+
+		if (writes && (!reads || fd->starved >= fd->writes_starved ||
+			       (flash_check_fifo(fd, class, WRITE) &&
+				!flash_check_fifo(fd, class, READ)))) {
+			fd->starved = 0;
+			rq = flash_start_batch(fd, class);
+		} else {
+			if (writes)
+				fd->starved++;
+			rq = rq_entry_fifo(fd->fifo_list[class][READ].next);
+		}
+
+		flash_move_request(fd, rq);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int flash_queue_empty(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	int class;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++)
+		if (!list_empty(&fd->fifo_list[class][READ]) ||
+		    !list_empty(&fd->fifo_list[class][WRITE]))
+			return 0;
+
+	return 1;
+}
+
+static void flash_exit_queue(elevator_t *e)
+{
+	struct flash_data *fd = e->elevator_data;
+	int class;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		BUG_ON(!list_empty(&fd->fifo_list[class][READ]));
+		BUG_ON(!list_empty(&fd->fifo_list[class][WRITE]));
+	}
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int class;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		INIT_LIST_HEAD(&fd->fifo_list[class][READ]);
+		INIT_LIST_HEAD(&fd->fifo_list[class][WRITE]);
+		fd->sort_list[class][READ] = RB_ROOT;
+		fd->sort_list[class][WRITE] = RB_ROOT;
+	}
+	fd->fifo_expire[READ] = read_expire;
+	fd->fifo_expire[WRITE] = write_expire;
+	fd->writes_starved = writes_starved;
+	fd->write_batch_kb = write_batch_kb;
+	fd->erase_block_kb = erase_block_kb;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(elevator_t *e, char *page)			\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_read_expire_show, fd->fifo_expire[READ], 1);
+SHOW_FUNCTION(flash_write_expire_show, fd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_write_batch_kb_show, fd->write_batch_kb, 0);
+SHOW_FUNCTION(flash_erase_block_kb_show, fd->erase_block_kb, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(elevator_t *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_read_expire_store, &fd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_write_expire_store, &fd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_write_batch_kb_store, &fd->write_batch_kb, 0, INT_MAX / 2, 0);
+STORE_FUNCTION(flash_erase_block_kb_store, &fd->erase_block_kb, 1, INT_MAX / 2, 0);
+#undef STORE_FUNCTION
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(read_expire),
+	FD_ATTR(write_expire),
+	FD_ATTR(writes_starved),
+	FD_ATTR(write_batch_kb),
+	FD_ATTR(erase_block_kb),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_queue_empty_fn =	flash_queue_empty,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
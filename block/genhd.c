@@ -490,6 +490,46 @@ static ssize_t disk_stat_show(struct device *dev,
 		jiffies_to_msecs(disk_stat_read(disk, time_in_queue)));
 }
 
+#ifdef CONFIG_BLK_DEV_IO_LATENCY
+static ssize_t disk_latency_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct gendisk *disk = dev_to_disk(dev);
+	struct disk_latency *lat = &disk->latency;
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < DISK_LAT_BUCKETS; i++)
+		len += sprintf(buf + len,
+			"%8lu %8lu %8lu %8lu %8lu %8lu %8lu\n",
+			i ? 1UL << i : 0,
+			lat->hist[READ][DISK_LAT_QUEUE][i],
+			lat->hist[READ][DISK_LAT_SERVICE][i],
+			lat->hist[READ][DISK_LAT_TOTAL][i],
+			lat->hist[WRITE][DISK_LAT_QUEUE][i],
+			lat->hist[WRITE][DISK_LAT_SERVICE][i],
+			lat->hist[WRITE][DISK_LAT_TOTAL][i]);
+	return len;
+}
+
+static ssize_t disk_latency_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct gendisk *disk = dev_to_disk(dev);
+	struct request_queue *q = disk->queue;
+
+	/* any write clears the histograms */
+	if (q) {
+		spin_lock_irq(q->queue_lock);
+		memset(&disk->latency, 0, sizeof(disk->latency));
+		spin_unlock_irq(q->queue_lock);
+	}
+
+	return count;
+}
+#endif
+
 #ifdef CONFIG_FAIL_MAKE_REQUEST
 static ssize_t disk_fail_show(struct device *dev,
 			      struct device_attribute *attr, char *buf)
@@ -524,6 +564,10 @@ static DEVICE_ATTR(ro, S_IRUGO, disk_ro_show, NULL);
 static DEVICE_ATTR(size, S_IRUGO, disk_size_show, NULL);
 static DEVICE_ATTR(capability, S_IRUGO, disk_capability_show, NULL);
 static DEVICE_ATTR(stat, S_IRUGO, disk_stat_show, NULL);
+#ifdef CONFIG_BLK_DEV_IO_LATENCY
+static DEVICE_ATTR(latency_hist, S_IRUGO|S_IWUSR, disk_latency_show,
+		   disk_latency_store);
+#endif
 #ifdef CONFIG_FAIL_MAKE_REQUEST
 static struct device_attribute dev_attr_fail =
 	__ATTR(make-it-fail, S_IRUGO|S_IWUSR, disk_fail_show, disk_fail_store);
@@ -536,6 +580,9 @@ static struct attribute *disk_attrs[] = {
 	&dev_attr_size.attr,
 	&dev_attr_capability.attr,
 	&dev_attr_stat.attr,
+#ifdef CONFIG_BLK_DEV_IO_LATENCY
+	&dev_attr_latency_hist.attr,
+#endif
 #ifdef CONFIG_FAIL_MAKE_REQUEST
 	&dev_attr_fail.attr,
 #endif
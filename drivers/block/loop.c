@@ -44,6 +44,9 @@
  * backing filesystem.
  * Anton Altaparmakov, 16 Feb 2005
  *
+ * Direct I/O mode, remapping bios to the blocks backing the file and
+ * submitting them to the underlying device without the loop thread.
+ *
  * Still To Fix:
  * - Advisory locking is ignored here.
  * - Should use an own CAP_* category instead of CAP_SYS_ADMIN
@@ -76,6 +79,7 @@
 #include <linux/gfp.h>
 #include <linux/kthread.h>
 #include <linux/splice.h>
+#include <linux/vmalloc.h>
 
 #include <asm/uaccess.h>
 
@@ -513,6 +517,343 @@ static struct bio *loop_get_bio(struct loop_device *lo)
 	return bio;
 }
 
+/*
+ * In direct I/O mode (LO_FLAGS_DIRECT_IO) the blocks backing the file are
+ * looked up once with bmap(), and bios are remapped to them and submitted
+ * to the underlying device. This keeps the data out of the page cache of
+ * the backing file and lets any number of requests be in flight. A bio
+ * that maps to one extent and fits the limits of the underlying queue is
+ * passed on whole, straight from loop_make_request(). Anything else is
+ * split by the loop thread, which may wait for the pools because its
+ * clones are issued at once. Like a swap file, the backing file is marked
+ * S_SWAPFILE so it cannot be truncated, and must be fully allocated and
+ * not otherwise written to while direct I/O is on.
+ *
+ * bmap() does not tell blocks holding data from preallocated (unwritten)
+ * ones, which read back as zeroes through the file system. Files that
+ * can have those, on file systems with ->fallocate(), are refused.
+ */
+#define LOOP_DIO_POOL_SIZE	16
+
+struct loop_extent {
+	sector_t	start;		/* in the file, in sectors */
+	sector_t	len;
+	sector_t	phys;		/* on lo_dio_bdev */
+};
+
+/*
+ * a bio submitted in direct I/O mode, it may be split over extents
+ */
+struct loop_dio {
+	struct loop_device	*lo;
+	struct bio		*bio;
+	atomic_t		remaining;
+	int			error;
+};
+
+static struct loop_extent *loop_find_extent(struct loop_device *lo,
+					    sector_t sector)
+{
+	unsigned int lo_idx = 0, hi_idx = lo->lo_nr_extents;
+
+	while (lo_idx < hi_idx) {
+		unsigned int mid = (lo_idx + hi_idx) / 2;
+		struct loop_extent *ext = &lo->lo_extents[mid];
+
+		if (sector < ext->start)
+			hi_idx = mid;
+		else if (sector >= ext->start + ext->len)
+			lo_idx = mid + 1;
+		else
+			return ext;
+	}
+
+	return NULL;
+}
+
+static void loop_dio_put(struct loop_dio *dio)
+{
+	struct loop_device *lo = dio->lo;
+
+	if (!atomic_dec_and_test(&dio->remaining))
+		return;
+
+	bio_endio(dio->bio, dio->error);
+	mempool_free(dio, lo->lo_dio_pool);
+
+	if (atomic_dec_and_test(&lo->lo_pending))
+		wake_up(&lo->lo_event);
+}
+
+static void loop_dio_destructor(struct bio *clone)
+{
+	struct loop_dio *dio = clone->bi_private;
+
+	bio_free(clone, dio->lo->lo_bio_set);
+}
+
+static void loop_dio_end_io(struct bio *clone, int error)
+{
+	struct loop_dio *dio = clone->bi_private;
+
+	if (error)
+		dio->error = error;
+
+	bio_put(clone);
+	loop_dio_put(dio);
+}
+
+static void loop_dio_init(struct loop_dio *dio, struct loop_device *lo,
+			  struct bio *bio)
+{
+	dio->lo = lo;
+	dio->bio = bio;
+	atomic_set(&dio->remaining, 1);
+	dio->error = 0;
+}
+
+static void loop_dio_issue(struct loop_dio *dio, struct bio *clone,
+			   sector_t phys)
+{
+	/* loop has never ordered writes, don't pretend otherwise below */
+	clone->bi_rw = dio->bio->bi_rw & ~(1 << BIO_RW_BARRIER);
+	clone->bi_sector = phys;
+	clone->bi_bdev = dio->lo->lo_dio_bdev;
+	clone->bi_end_io = loop_dio_end_io;
+	clone->bi_private = dio;
+	clone->bi_destructor = loop_dio_destructor;
+
+	atomic_inc(&dio->remaining);
+	generic_make_request(clone);
+}
+
+/*
+ * Can @clone be passed to the underlying queue @q as it is?
+ */
+static int loop_dio_fits(struct request_queue *q, struct bio *clone)
+{
+	return !q->merge_bvec_fn &&
+	       bio_sectors(clone) <= q->max_hw_sectors &&
+	       bio_phys_segments(q, clone) <= q->max_phys_segments &&
+	       bio_hw_segments(q, clone) <= q->max_hw_segments;
+}
+
+/*
+ * Submit @bio with a single clone, if it maps to one extent and fits the
+ * underlying queue. The caller has accounted it in lo_pending. Returns 1
+ * if the bio was submitted, 0 if it has to be split or memory was short.
+ */
+static int loop_dio_submit_whole(struct loop_device *lo, struct bio *bio,
+				 gfp_t gfp)
+{
+	sector_t sector = bio->bi_sector + (lo->lo_offset >> 9);
+	struct loop_extent *ext = loop_find_extent(lo, sector);
+	struct loop_dio *dio;
+	struct bio *clone;
+
+	if (!bio->bi_size || !ext ||
+	    sector + bio_sectors(bio) > ext->start + ext->len)
+		return 0;
+
+	dio = mempool_alloc(lo->lo_dio_pool, gfp);
+	if (!dio)
+		return 0;
+	loop_dio_init(dio, lo, bio);
+	clone = bio_alloc_bioset(gfp, bio->bi_max_vecs, lo->lo_bio_set);
+	if (!clone) {
+		mempool_free(dio, lo->lo_dio_pool);
+		return 0;
+	}
+	clone->bi_private = dio;
+	clone->bi_destructor = loop_dio_destructor;
+	__bio_clone(clone, bio);
+	if (!loop_dio_fits(bdev_get_queue(lo->lo_dio_bdev), clone)) {
+		bio_put(clone);
+		mempool_free(dio, lo->lo_dio_pool);
+		return 0;
+	}
+
+	loop_dio_issue(dio, clone, ext->phys + sector - ext->start);
+	loop_dio_put(dio);
+	return 1;
+}
+
+/*
+ * Submit @bio to the blocks backing it, from the loop thread. The caller
+ * has accounted it in lo_pending. If it cannot be passed on whole, it is
+ * cut into a clone per extent and page, which always fits the queue.
+ */
+static void loop_dio_submit(struct loop_device *lo, struct bio *bio)
+{
+	sector_t sector = bio->bi_sector + (lo->lo_offset >> 9);
+	struct loop_extent *ext;
+	struct loop_dio *dio;
+	struct bio_vec *bvec;
+	struct bio *clone;
+	int i;
+
+	if (loop_dio_submit_whole(lo, bio, GFP_NOIO))
+		return;
+
+	dio = mempool_alloc(lo->lo_dio_pool, GFP_NOIO);
+	loop_dio_init(dio, lo, bio);
+
+	if (!bio->bi_size)
+		goto out;
+
+	bio_for_each_segment(bvec, bio, i) {
+		unsigned int off = 0;
+
+		while (off < bvec->bv_len) {
+			unsigned int len = bvec->bv_len - off;
+			sector_t left;
+
+			ext = loop_find_extent(lo, sector);
+			if (!ext) {
+				dio->error = -EIO;
+				goto out;
+			}
+			left = ext->start + ext->len - sector;
+			if (left < len >> 9)
+				len = left << 9;
+
+			clone = bio_alloc_bioset(GFP_NOIO, 1, lo->lo_bio_set);
+			clone->bi_io_vec[0].bv_page = bvec->bv_page;
+			clone->bi_io_vec[0].bv_len = len;
+			clone->bi_io_vec[0].bv_offset = bvec->bv_offset + off;
+			clone->bi_vcnt = 1;
+			clone->bi_size = len;
+			loop_dio_issue(dio, clone,
+				       ext->phys + sector - ext->start);
+
+			off += len;
+			sector += len >> 9;
+		}
+	}
+out:
+	loop_dio_put(dio);
+}
+
+/*
+ * Look up the blocks backing the file. A block device maps to itself.
+ */
+static int loop_map_backing(struct loop_device *lo)
+{
+	struct inode *inode = lo->lo_backing_file->f_mapping->host;
+	struct loop_extent *ext = NULL;
+	unsigned int nr = 0, i;
+	sector_t block, blocks, phys, prev = 0;
+	unsigned int shift;
+	int pass;
+
+	if (S_ISBLK(inode->i_mode)) {
+		ext = vmalloc(sizeof(*ext));
+		if (!ext)
+			return -ENOMEM;
+		ext->start = 0;
+		ext->len = i_size_read(inode) >> 9;
+		ext->phys = 0;
+		lo->lo_dio_bdev = inode->i_bdev;
+		lo->lo_extents = ext;
+		lo->lo_nr_extents = 1;
+		return 0;
+	}
+
+	if (!inode->i_sb->s_bdev || !inode->i_mapping->a_ops->bmap)
+		return -EINVAL;
+
+	shift = inode->i_blkbits - 9;
+	blocks = (i_size_read(inode) + (1 << inode->i_blkbits) - 1) >>
+		 inode->i_blkbits;
+	if (!blocks)
+		return -EINVAL;
+
+	/* count the extents first, then fill them in */
+	for (pass = 0; pass < 2; pass++) {
+		i = 0;
+		for (block = 0; block < blocks; block++) {
+			phys = bmap(inode, block);
+			if (!phys)
+				goto out_hole;
+
+			if (!block || phys != prev + 1) {
+				if (ext) {
+					if (i == nr)
+						goto out_hole;
+					ext[i].start = block << shift;
+					ext[i].len = 0;
+					ext[i].phys = phys << shift;
+				}
+				i++;
+			}
+			if (ext)
+				ext[i - 1].len += 1 << shift;
+			prev = phys;
+			cond_resched();
+		}
+
+		if (!ext) {
+			nr = i;
+			ext = vmalloc(nr * sizeof(*ext));
+			if (!ext)
+				return -ENOMEM;
+		}
+	}
+
+	lo->lo_dio_bdev = inode->i_sb->s_bdev;
+	lo->lo_extents = ext;
+	lo->lo_nr_extents = i;
+	return 0;
+
+out_hole:
+	/* a hole, or the file changed while we were looking */
+	vfree(ext);
+	return -EINVAL;
+}
+
+/*
+ * Whole bios are passed on to the underlying device, so they must fit its
+ * limits. Like blk_queue_stack_limits(), which needs a queue lock.
+ */
+static void loop_stack_limits(struct loop_device *lo)
+{
+	struct request_queue *q = lo->lo_queue;
+	struct request_queue *b = bdev_get_queue(lo->lo_dio_bdev);
+
+	q->max_sectors = min(q->max_sectors, b->max_sectors);
+	q->max_hw_sectors = min(q->max_hw_sectors, b->max_hw_sectors);
+	q->max_phys_segments = min(q->max_phys_segments, b->max_phys_segments);
+	q->max_hw_segments = min(q->max_hw_segments, b->max_hw_segments);
+	q->max_segment_size = min(q->max_segment_size, b->max_segment_size);
+	q->seg_boundary_mask = min(q->seg_boundary_mask, b->seg_boundary_mask);
+	if (!test_bit(QUEUE_FLAG_CLUSTER, &b->queue_flags))
+		queue_flag_clear_unlocked(QUEUE_FLAG_CLUSTER, q);
+}
+
+/*
+ * Called when direct I/O is off again, or failed to be turned on
+ */
+static void loop_free_direct_io(struct loop_device *lo)
+{
+	struct inode *inode = lo->lo_backing_file->f_mapping->host;
+
+	if (S_ISREG(inode->i_mode)) {
+		mutex_lock(&inode->i_mutex);
+		inode->i_flags &= ~S_SWAPFILE;
+		mutex_unlock(&inode->i_mutex);
+	}
+	if (lo->lo_bio_set)
+		bioset_free(lo->lo_bio_set);
+	if (lo->lo_dio_pool)
+		mempool_destroy(lo->lo_dio_pool);
+	vfree(lo->lo_extents);
+	lo->lo_bio_set = NULL;
+	lo->lo_dio_pool = NULL;
+	lo->lo_extents = NULL;
+	lo->lo_nr_extents = 0;
+	lo->lo_dio_bdev = NULL;
+}
+
 static int loop_make_request(struct request_queue *q, struct bio *old_bio)
 {
 	struct loop_device *lo = q->queuedata;
@@ -528,6 +869,23 @@ static int loop_make_request(struct request_queue *q, struct bio *old_bio)
 		goto out;
 	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
+	/*
+	 * Switch requests always go through the thread, and so does
+	 * everything that cannot be passed on whole: clones submitted from
+	 * here are only issued once we return, so we must not wait for the
+	 * pools they come from.
+	 */
+	if ((lo->lo_flags & LO_FLAGS_DIRECT_IO) && old_bio->bi_bdev) {
+		atomic_inc(&lo->lo_pending);
+		spin_unlock_irq(&lo->lo_lock);
+		if (loop_dio_submit_whole(lo, old_bio, GFP_NOWAIT))
+			return 0;
+		if (atomic_dec_and_test(&lo->lo_pending))
+			wake_up(&lo->lo_event);
+		spin_lock_irq(&lo->lo_lock);
+		if (lo->lo_state != Lo_bound)
+			goto out;
+	}
 	loop_add_bio(lo, old_bio);
 	wake_up(&lo->lo_event);
 	spin_unlock_irq(&lo->lo_lock);
@@ -551,17 +909,30 @@ static void loop_unplug(struct request_queue *q)
 }
 
 struct switch_request {
-	struct file *file;
+	struct file *file;	/* new backing file, or NULL */
+	int direct;		/* if !file, turn direct I/O on or off */
+	int error;		/* if !file, result of the switch */
 	struct completion wait;
 };
 
 static void do_loop_switch(struct loop_device *, struct switch_request *);
+static void do_loop_set_direct_io(struct loop_device *,
+				  struct switch_request *);
 
 static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 {
 	if (unlikely(!bio->bi_bdev)) {
-		do_loop_switch(lo, bio->bi_private);
+		struct switch_request *p = bio->bi_private;
+
+		if (p->file)
+			do_loop_switch(lo, p);
+		else
+			do_loop_set_direct_io(lo, p);
 		bio_put(bio);
+	} else if (lo->lo_flags & LO_FLAGS_DIRECT_IO) {
+		/* queued before the switch to direct I/O was done */
+		atomic_inc(&lo->lo_pending);
+		loop_dio_submit(lo, bio);
 	} else {
 		int ret = do_bio_filebacked(lo, bio);
 		bio_endio(bio, ret);
@@ -610,21 +981,98 @@ static int loop_thread(void *data)
  * First it needs to flush existing IO, it does this by sending a magic
  * BIO down the pipe. The completion of this BIO does the actual switch.
  */
-static int loop_switch(struct loop_device *lo, struct file *file)
+static int __loop_switch(struct loop_device *lo, struct switch_request *w)
 {
-	struct switch_request w;
 	struct bio *bio = bio_alloc(GFP_KERNEL, 0);
 	if (!bio)
 		return -ENOMEM;
-	init_completion(&w.wait);
-	w.file = file;
-	bio->bi_private = &w;
+	init_completion(&w->wait);
+	bio->bi_private = w;
 	bio->bi_bdev = NULL;
 	loop_make_request(lo->lo_queue, bio);
-	wait_for_completion(&w.wait);
+	wait_for_completion(&w->wait);
 	return 0;
 }
 
+static int loop_switch(struct loop_device *lo, struct file *file)
+{
+	struct switch_request w;
+
+	w.file = file;
+	return __loop_switch(lo, &w);
+}
+
+/*
+ * Turn direct I/O on or off. The mode is switched from the loop thread, in
+ * order with the bios it still has queued.
+ */
+static int loop_set_direct_io(struct loop_device *lo, int direct)
+{
+	struct inode *inode = lo->lo_backing_file->f_mapping->host;
+	struct switch_request w;
+	int err;
+
+	if (direct) {
+		if (lo->lo_encryption || (lo->lo_offset & 511))
+			return -EINVAL;
+
+		/* keep the blocks we map from being freed, as swapon does */
+		if (S_ISREG(inode->i_mode)) {
+			if (!inode->i_sb->s_bdev ||
+			    !inode->i_mapping->a_ops->bmap ||
+			    inode->i_op->fallocate)
+				return -EINVAL;
+			mutex_lock(&inode->i_mutex);
+			if (IS_SWAPFILE(inode)) {
+				mutex_unlock(&inode->i_mutex);
+				return -EBUSY;
+			}
+			inode->i_flags |= S_SWAPFILE;
+			mutex_unlock(&inode->i_mutex);
+		}
+
+		/* bmap() must see the blocks of any dirty pages */
+		err = filemap_write_and_wait(lo->lo_backing_file->f_mapping);
+		if (err)
+			goto out_free;
+
+		err = loop_map_backing(lo);
+		if (err)
+			goto out_free;
+
+		/* bios are only guaranteed to be aligned to 512 bytes */
+		err = -EINVAL;
+		if (bdev_hardsect_size(lo->lo_dio_bdev) > 512)
+			goto out_free;
+		loop_stack_limits(lo);
+
+		err = -ENOMEM;
+		lo->lo_dio_pool = mempool_create_kmalloc_pool(
+				LOOP_DIO_POOL_SIZE, sizeof(struct loop_dio));
+		if (!lo->lo_dio_pool)
+			goto out_free;
+		lo->lo_bio_set = bioset_create(LOOP_DIO_POOL_SIZE, 2);
+		if (!lo->lo_bio_set)
+			goto out_free;
+	}
+
+	w.file = NULL;
+	w.direct = direct;
+	w.error = 0;
+	err = __loop_switch(lo, &w);
+	if (!err)
+		err = w.error;
+	if (err && direct)
+		goto out_free;
+	if (!err && !direct)
+		loop_free_direct_io(lo);
+	return err;
+
+out_free:
+	loop_free_direct_io(lo);
+	return err;
+}
+
 /*
  * Do the actual switch; called from the BIO completion routine
  */
@@ -643,6 +1091,40 @@ static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 	complete(&p->wait);
 }
 
+/*
+ * Do the actual direct I/O switch, called from the loop thread
+ */
+static void do_loop_set_direct_io(struct loop_device *lo,
+				  struct switch_request *p)
+{
+	struct address_space *mapping = lo->lo_backing_file->f_mapping;
+
+	if (p->direct) {
+		/*
+		 * Reads bypass the page cache from now on, so it must be
+		 * clean and empty, or they would see stale data.
+		 */
+		p->error = filemap_write_and_wait(mapping);
+		if (!p->error)
+			p->error = invalidate_inode_pages2(mapping);
+		if (p->error)
+			goto out;
+
+		spin_lock_irq(&lo->lo_lock);
+		lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+		spin_unlock_irq(&lo->lo_lock);
+	} else {
+		spin_lock_irq(&lo->lo_lock);
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+		spin_unlock_irq(&lo->lo_lock);
+
+		/* the page cache must not be used before they are done */
+		wait_event(lo->lo_event, !atomic_read(&lo->lo_pending));
+	}
+out:
+	complete(&p->wait);
+}
+
 
 /*
  * loop_change_fd switched the backing store of a loopback device to
@@ -663,9 +1145,10 @@ static int loop_change_fd(struct loop_device *lo, struct file *lo_file,
 	if (lo->lo_state != Lo_bound)
 		goto out;
 
-	/* the loop device has to be read-only */
+	/* the loop device has to be read-only, and not map the old file */
 	error = -EINVAL;
-	if (!(lo->lo_flags & LO_FLAGS_READ_ONLY))
+	if (!(lo->lo_flags & LO_FLAGS_READ_ONLY) ||
+	    (lo->lo_flags & LO_FLAGS_DIRECT_IO))
 		goto out;
 
 	error = -EBADF;
@@ -903,6 +1386,11 @@ static int loop_clr_fd(struct loop_device *lo, struct block_device *bdev)
 
 	kthread_stop(lo->lo_thread);
 
+	if (lo->lo_flags & LO_FLAGS_DIRECT_IO) {
+		wait_event(lo->lo_event, !atomic_read(&lo->lo_pending));
+		loop_free_direct_io(lo);
+	}
+
 	lo->lo_backing_file = NULL;
 
 	loop_release_xfer(lo);
@@ -944,10 +1432,17 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		return -ENXIO;
 	if ((unsigned int) info->lo_encrypt_key_size > LO_KEY_SIZE)
 		return -EINVAL;
-
-	err = loop_release_xfer(lo);
-	if (err)
-		return err;
+	/*
+	 * Direct I/O writes to the blocks of the backing file behind the
+	 * back of its file system.
+	 */
+	if ((info->lo_flags & ~lo->lo_flags & LO_FLAGS_DIRECT_IO) &&
+	    !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	/* direct I/O passes the data through untouched */
+	if (((lo->lo_flags | info->lo_flags) & LO_FLAGS_DIRECT_IO) &&
+	    (info->lo_encrypt_type || (info->lo_offset & 511)))
+		return -EINVAL;
 
 	if (info->lo_encrypt_type) {
 		unsigned int type = info->lo_encrypt_type;
@@ -960,6 +1455,23 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	} else
 		xfer = NULL;
 
+	/*
+	 * Switch direct I/O before anything else is changed, so a failure
+	 * leaves the device as it was. Direct I/O is only on with no
+	 * transfer, so releasing and setting up the transfer below can then
+	 * only fail when it has just been turned off.
+	 */
+	if ((lo->lo_flags ^ info->lo_flags) & LO_FLAGS_DIRECT_IO) {
+		err = loop_set_direct_io(lo,
+				info->lo_flags & LO_FLAGS_DIRECT_IO);
+		if (err)
+			return err;
+	}
+
+	err = loop_release_xfer(lo);
+	if (err)
+		return err;
+
 	err = loop_init_xfer(lo, xfer, info);
 	if (err)
 		return err;
@@ -453,6 +453,66 @@ static int mmc_test_transfer(struct mmc_test_card *test,
 	return 0;
 }
 
+struct mmc_test_async_req {
+	struct mmc_async_req	areq;
+	struct mmc_test_card	*test;
+
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+	struct scatterlist	sg;
+};
+
+static int mmc_test_check_result_async(struct mmc_card *card,
+	struct mmc_async_req *areq)
+{
+	struct mmc_test_async_req *rq =
+		container_of(areq, struct mmc_test_async_req, areq);
+
+	mmc_test_wait_busy(rq->test);
+
+	return mmc_test_check_result(rq->test, areq->mrq);
+}
+
+/*
+ * Transfers the first sectors of the card one at a time with
+ * mmc_start_req(), so the host prepares each request while the one
+ * before it is still running.
+ */
+static int mmc_test_nonblock_transfer(struct mmc_test_card *test,
+	unsigned count, int write)
+{
+	struct mmc_test_async_req rq[2];
+	int ret, i;
+
+	for (i = 0;i < count;i++) {
+		struct mmc_test_async_req *cur = &rq[i & 1];
+
+		memset(cur, 0, sizeof(struct mmc_test_async_req));
+		cur->mrq.cmd = &cur->cmd;
+		cur->mrq.data = &cur->data;
+		cur->mrq.stop = &cur->stop;
+		cur->areq.mrq = &cur->mrq;
+		cur->areq.err_check = mmc_test_check_result_async;
+		cur->test = test;
+
+		sg_init_one(&cur->sg, test->buffer + i * 512, 512);
+
+		mmc_test_prepare_mrq(test, &cur->mrq, &cur->sg, 1, i * 512,
+			1, 512, write);
+
+		mmc_start_req(test->card->host, &cur->areq, &ret);
+		if (ret)
+			return ret;
+	}
+
+	/* Wait for the last one */
+	mmc_start_req(test->card->host, NULL, &ret);
+
+	return ret;
+}
+
 /*******************************************************************/
 /*  Tests                                                          */
 /*******************************************************************/
@@ -803,6 +863,60 @@ static int mmc_test_multi_xfersize_read(struct mmc_test_card *test)
 	return 0;
 }
 
+static int mmc_test_nonblock_write(struct mmc_test_card *test)
+{
+	int ret, i;
+
+	ret = mmc_test_set_blksize(test, 512);
+	if (ret)
+		return ret;
+
+	for (i = 0;i < BUFFER_SIZE;i++)
+		test->buffer[i] = i / 512;
+
+	ret = mmc_test_nonblock_transfer(test, BUFFER_SIZE / 512, 1);
+	if (ret)
+		return ret;
+
+	memset(test->buffer, 0, BUFFER_SIZE);
+
+	for (i = 0;i < BUFFER_SIZE / 512;i++) {
+		ret = mmc_test_buffer_transfer(test, test->buffer + i * 512,
+			i * 512, 512, 0);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0;i < BUFFER_SIZE;i++) {
+		if (test->buffer[i] != (u8)(i / 512))
+			return RESULT_FAIL;
+	}
+
+	return 0;
+}
+
+static int mmc_test_nonblock_read(struct mmc_test_card *test)
+{
+	int ret, i;
+
+	ret = mmc_test_set_blksize(test, 512);
+	if (ret)
+		return ret;
+
+	memset(test->buffer, 0, BUFFER_SIZE);
+
+	ret = mmc_test_nonblock_transfer(test, BUFFER_SIZE / 512, 0);
+	if (ret)
+		return ret;
+
+	for (i = 0;i < BUFFER_SIZE;i++) {
+		if (test->buffer[i] != (u8)(i % 512))
+			return RESULT_FAIL;
+	}
+
+	return 0;
+}
+
 #ifdef CONFIG_HIGHMEM
 
 static int mmc_test_write_high(struct mmc_test_card *test)
@@ -1006,6 +1120,20 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.run = mmc_test_multi_xfersize_read,
 	},
 
+	{
+		.name = "Consecutive non-blocking writes",
+		.prepare = mmc_test_prepare_write,
+		.run = mmc_test_nonblock_write,
+		.cleanup = mmc_test_cleanup,
+	},
+
+	{
+		.name = "Consecutive non-blocking reads",
+		.prepare = mmc_test_prepare_read,
+		.run = mmc_test_nonblock_read,
+		.cleanup = mmc_test_cleanup,
+	},
+
 #ifdef CONFIG_HIGHMEM
 
 	{
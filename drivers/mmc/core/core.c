@@ -179,6 +179,88 @@ static void mmc_wait_done(struct mmc_request *mrq)
 	complete(mrq->done_data);
 }
 
+/*
+ * Let the host driver prepare @mrq (map its buffers for DMA and the
+ * like) while the request before it may still be on the bus.
+ */
+static inline void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq,
+			       bool is_first_req)
+{
+	if (host->ops->pre_req)
+		host->ops->pre_req(host, mrq, is_first_req);
+}
+
+/*
+ * Undo mmc_pre_req(), once @mrq has completed or when it is dropped
+ * without having been started (@err non zero).
+ */
+static inline void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq,
+				int err)
+{
+	if (host->ops->post_req)
+		host->ops->post_req(host, mrq, err);
+}
+
+/**
+ *	mmc_start_req - start a non-blocking request
+ *	@host: MMC host to start command
+ *	@areq: async request to start
+ *	@error: out parameter returns 0 for success, otherwise non zero
+ *
+ *	Start a new MMC custom command request for a host.  If there is
+ *	an ongoing async request, wait for it to complete and check its
+ *	status before starting the new one; the new request is prepared
+ *	by the host driver before that wait, so its preparation overlaps
+ *	with the transfer of the previous one.
+ *
+ *	Returns the completed async request, or NULL if there was none.
+ *	If the completed request failed, @error is set, the new request
+ *	is not started and the caller keeps ownership of it.  @areq may
+ *	be NULL to just wait for the ongoing request.
+ */
+struct mmc_async_req *mmc_start_req(struct mmc_host *host,
+				    struct mmc_async_req *areq, int *error)
+{
+	int err = 0;
+	struct mmc_async_req *data = host->areq;
+
+	/* Prepare a new request */
+	if (areq)
+		mmc_pre_req(host, areq->mrq, !host->areq);
+
+	if (host->areq) {
+		wait_for_completion(&host->areq->mrq->completion);
+		err = host->areq->err_check(host->card, host->areq);
+		if (err) {
+			mmc_post_req(host, host->areq->mrq, 0);
+			if (areq)
+				mmc_post_req(host, areq->mrq, -EINVAL);
+
+			host->areq = NULL;
+			goto out;
+		}
+	}
+
+	if (areq) {
+		init_completion(&areq->mrq->completion);
+		areq->mrq->done_data = &areq->mrq->completion;
+		areq->mrq->done = mmc_wait_done;
+		mmc_start_request(host, areq->mrq);
+	}
+
+	/* Clean up the previous request now that the next one is running */
+	if (host->areq)
+		mmc_post_req(host, host->areq->mrq, 0);
+
+	host->areq = areq;
+ out:
+	if (error)
+		*error = err;
+	return data;
+}
+
+EXPORT_SYMBOL(mmc_start_req);
+
 /**
  *	mmc_wait_for_req - start a request and wait for completion
  *	@host: MMC host to start command
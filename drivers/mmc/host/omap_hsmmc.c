@@ -333,7 +333,8 @@ mmc_omap_xfer_done(struct mmc_omap_host *host, struct mmc_data *data)
 {
 	host->data = NULL;
 
-	if (host->use_dma && host->dma_ch != -1)
+	/* Buffers mapped in omap_mmc_pre_req() are unmapped in post_req */
+	if (host->use_dma && host->dma_ch != -1 && !data->host_cookie)
 		dma_unmap_sg(mmc_dev(host->mmc), data->sg, host->dma_len,
 			host->dma_dir);
 
@@ -386,8 +387,9 @@ static void mmc_dma_cleanup(struct mmc_omap_host *host)
 	host->data->error = -ETIMEDOUT;
 
 	if (host->use_dma && host->dma_ch != -1) {
-		dma_unmap_sg(mmc_dev(host->mmc), host->data->sg, host->dma_len,
-			host->dma_dir);
+		if (!host->data->host_cookie)
+			dma_unmap_sg(mmc_dev(host->mmc), host->data->sg,
+				host->dma_len, host->dma_dir);
 		omap_free_dma(host->dma_ch);
 		host->dma_ch = -1;
 		up(&host->sem);
@@ -708,8 +710,11 @@ mmc_omap_start_dma_transfer(struct mmc_omap_host *host, struct mmc_request *req)
 		return ret;
 	}
 
-	host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
-			data->sg_len, host->dma_dir);
+	if (data->host_cookie)
+		host->dma_len = data->host_cookie;
+	else
+		host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
+				data->sg_len, host->dma_dir);
 	host->dma_ch = dma_ch;
 
 	if (!(data->flags & MMC_DATA_WRITE))
@@ -812,6 +817,39 @@ static void omap_mmc_request(struct mmc_host *mmc, struct mmc_request *req)
 	mmc_omap_start_command(host, req->cmd, req->data);
 }
 
+/*
+ * Map the buffers of a request while the previous one is still being
+ * transferred, so the cache maintenance of dma_map_sg() is off the
+ * critical path.  The number of mapped entries is kept in host_cookie.
+ */
+static void omap_mmc_pre_req(struct mmc_host *mmc, struct mmc_request *req,
+			     bool is_first_req)
+{
+	struct mmc_omap_host *host = mmc_priv(mmc);
+	struct mmc_data *data = req->data;
+
+	if (!host->use_dma || !data || data->host_cookie)
+		return;
+
+	data->host_cookie = dma_map_sg(mmc_dev(host->mmc), data->sg,
+			data->sg_len, (data->flags & MMC_DATA_WRITE) ?
+			DMA_TO_DEVICE : DMA_FROM_DEVICE);
+}
+
+static void omap_mmc_post_req(struct mmc_host *mmc, struct mmc_request *req,
+			      int err)
+{
+	struct mmc_omap_host *host = mmc_priv(mmc);
+	struct mmc_data *data = req->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
+		(data->flags & MMC_DATA_WRITE) ?
+		DMA_TO_DEVICE : DMA_FROM_DEVICE);
+	data->host_cookie = 0;
+}
 
 /* Routine to configure clock values. Exposed API to core */
 static void omap_mmc_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
@@ -900,6 +938,8 @@ static void omap_mmc_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
 }
 /* NOTE: Read only switch not supported yet */
 static struct mmc_host_ops mmc_omap_ops = {
+	.pre_req = omap_mmc_pre_req,
+	.post_req = omap_mmc_post_req,
 	.request = omap_mmc_request,
 	.set_ios = omap_mmc_set_ios,
 };
@@ -42,6 +42,7 @@
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/nand.h>
 #include <linux/mtd/nand_ecc.h>
+#include <linux/mtd/nand_bch.h>
 #include <linux/mtd/compatmac.h>
 #include <linux/interrupt.h>
 #include <linux/bitops.h>
@@ -1041,6 +1042,7 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 	struct mtd_ecc_stats stats;
 	int blkcheck = (1 << (chip->phys_erase_shift - chip->page_shift)) - 1;
 	int sndcmd = 1;
+	int cacheseq = 0;
 	int ret = 0;
 	uint32_t readlen = ops->len;
 	uint32_t oobreadlen = ops->ooblen;
@@ -1065,6 +1067,19 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 
 		/* Is the current page in the buffer ? */
 		if (realpage != chip->pagebuf || oob) {
+			/*
+			 * With cache reads the chip loads the next page of
+			 * the block into its data register while we fetch
+			 * this one from the cache register.  Only used for
+			 * whole pages, and only when the next one is read
+			 * whole too.
+			 */
+			int readnext = NAND_HAS_CACHEREAD(chip) && aligned &&
+				!oob && ops->mode != MTD_OOB_RAW &&
+				readlen - bytes >= mtd->writesize &&
+				((page + 1) & blkcheck) &&
+				realpage + 1 != chip->pagebuf;
+
 			bufpoi = aligned ? buf : chip->buffers->databuf;
 
 			if (likely(sndcmd)) {
@@ -1072,6 +1087,13 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 				sndcmd = 0;
 			}
 
+			if (readnext)
+				chip->cmdfunc(mtd, NAND_CMD_READCACHE, -1, -1);
+			else if (cacheseq)
+				chip->cmdfunc(mtd, NAND_CMD_READCACHEEND,
+					      -1, -1);
+			cacheseq = readnext;
+
 			/* Now read the page into the buffer */
 			if (unlikely(ops->mode == MTD_OOB_RAW))
 				ret = chip->ecc.read_page_raw(mtd, chip, bufpoi);
@@ -1079,8 +1101,14 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 				ret = chip->ecc.read_subpage(mtd, chip, col, bytes, bufpoi);
 			else
 				ret = chip->ecc.read_page(mtd, chip, bufpoi);
-			if (ret < 0)
+			if (ret < 0) {
+				/* Don't leave the chip loading the next page */
+				if (cacheseq)
+					chip->cmdfunc(mtd,
+						      NAND_CMD_READCACHEEND,
+						      -1, -1);
 				break;
+			}
 
 			/* Transfer not aligned data */
 			if (!aligned) {
@@ -1143,9 +1171,11 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		}
 
 		/* Check, if the chip supports auto page increment
-		 * or if we have hit a block boundary.
+		 * or if we have hit a block boundary.  A cache read
+		 * in progress already has the page coming.
 		 */
-		if (!NAND_CANAUTOINCR(chip) || !(page & blkcheck))
+		if (!cacheseq &&
+		    (!NAND_CANAUTOINCR(chip) || !(page & blkcheck)))
 			sndcmd = 1;
 	}
 
@@ -1588,6 +1618,37 @@ static void nand_write_page_syndrome(struct mtd_info *mtd,
 		chip->write_buf(mtd, oob, i);
 }
 
+/**
+ * nand_wait_true_ready - [Internal] wait for the end of a cache program
+ * @mtd:	MTD device structure
+ * @chip:	NAND chip descriptor
+ *
+ * After a cache program the chip reports ready (I/O6) as soon as its cache
+ * register is free, while the array may still be programming. The pass/fail
+ * bit of the last page (I/O0) is only valid once the array is ready (I/O5).
+ * Returns the status, with NAND_STATUS_FAIL set if the array does not get
+ * ready in time.
+ */
+static int nand_wait_true_ready(struct mtd_info *mtd, struct nand_chip *chip)
+{
+	unsigned long timeo = jiffies + (HZ * 20) / 1000;
+	int status;
+
+	chip->cmdfunc(mtd, NAND_CMD_STATUS, -1, -1);
+	while (time_before(jiffies, timeo)) {
+		status = chip->read_byte(mtd);
+		if (status & NAND_STATUS_TRUE_READY)
+			return status;
+		udelay(chip->chip_delay);
+		cond_resched();
+	}
+
+	status = chip->read_byte(mtd);
+	if (!(status & NAND_STATUS_TRUE_READY))
+		status |= NAND_STATUS_FAIL | NAND_STATUS_FAIL_N1;
+	return status;
+}
+
 /**
  * nand_write_page - [REPLACEABLE] write one page
  * @mtd:	MTD device structure
@@ -1609,31 +1670,61 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 	else
 		chip->ecc.write_page(mtd, chip, buf);
 
-	/*
-	 * Cached progamming disabled for now, Not sure if its worth the
-	 * trouble. The speed gain is not very impressive. (2.3->2.6Mib/s)
-	 */
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
+	/* The read back can't overlap with programming the next page */
 	cached = 0;
+#endif
+
+	chip->cacheprg_fail = 0;
 
-	if (!cached || !(chip->options & NAND_CACHEPRG)) {
+	if (!cached || !NAND_HAS_CACHEPROG(chip) ||
+	    !(chip->options & NAND_USE_CACHEPRG)) {
 
 		chip->cmdfunc(mtd, NAND_CMD_PAGEPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
+
 		/*
-		 * See if operation failed and additional status checks are
-		 * available
+		 * This ends a cache program sequence. The status of this
+		 * page (I/O0) and of the one before it (I/O1) are valid once
+		 * the array is ready.
 		 */
-		if ((status & NAND_STATUS_FAIL) && (chip->errstat))
-			status = chip->errstat(mtd, chip, FL_WRITING, status,
-					       page);
-
-		if (status & NAND_STATUS_FAIL)
-			return -EIO;
+		if (chip->cacheprg) {
+			chip->cacheprg = 0;
+			if (!(status & NAND_STATUS_TRUE_READY))
+				status = nand_wait_true_ready(mtd, chip);
+			if (status & NAND_STATUS_FAIL_N1)
+				goto prev_failed;
+		}
 	} else {
+		/*
+		 * The chip returns as soon as the page is in its cache
+		 * register and programs it while we transfer the next one.
+		 * Only I/O1 is valid then, and it reports the page before
+		 * this one.
+		 */
 		chip->cmdfunc(mtd, NAND_CMD_CACHEDPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
+
+		if (chip->cacheprg && (status & NAND_STATUS_FAIL_N1)) {
+			/* Let the array finish before we report the error */
+			chip->cacheprg = 0;
+			nand_wait_true_ready(mtd, chip);
+			goto prev_failed;
+		}
+		chip->cacheprg = 1;
+		status &= ~NAND_STATUS_FAIL;
 	}
 
+	/*
+	 * See if operation failed and additional status checks are
+	 * available
+	 */
+	if ((status & NAND_STATUS_FAIL) && (chip->errstat))
+		status = chip->errstat(mtd, chip, FL_WRITING, status, page);
+
+	if (status & NAND_STATUS_FAIL)
+		return -EIO;
+
 #ifdef CONFIG_MTD_NAND_VERIFY_WRITE
 	/* Send command to read back the data */
 	chip->cmdfunc(mtd, NAND_CMD_READ0, 0, page);
@@ -1642,6 +1733,11 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 		return -EIO;
 #endif
 	return 0;
+
+prev_failed:
+	/* Cached pages never cross a block, so page - 1 is in this one */
+	chip->cacheprg_fail = 1;
+	return -EIO;
 }
 
 /**
@@ -1752,7 +1848,7 @@ static int nand_do_write_ops(struct mtd_info *mtd, loff_t to,
 
 	while(1) {
 		int bytes = mtd->writesize;
-		int cached = writelen > bytes && page != blockmask;
+		int cached = writelen > bytes && (page & blockmask) != blockmask;
 		uint8_t *wbuf = buf;
 
 		/* Partial page write ? */
@@ -1770,8 +1866,12 @@ static int nand_do_write_ops(struct mtd_info *mtd, loff_t to,
 
 		ret = chip->write_page(mtd, chip, wbuf, page, cached,
 				       (ops->mode == MTD_OOB_RAW));
-		if (ret)
+		if (ret) {
+			/* The page before this one was the one that failed */
+			if (chip->cacheprg_fail)
+				writelen += mtd->writesize;
 			break;
+		}
 
 		writelen -= bytes;
 		if (!writelen)
@@ -2529,9 +2629,11 @@ int nand_scan_tail(struct mtd_info *mtd)
 	chip->oob_poi = chip->buffers->databuf + mtd->writesize;
 
 	/*
-	 * If no default placement scheme is given, select an appropriate one
+	 * If no default placement scheme is given, select an appropriate one.
+	 * The BCH layout depends on the ecc strength, nand_bch_init() builds
+	 * it below.
 	 */
-	if (!chip->ecc.layout) {
+	if (!chip->ecc.layout && chip->ecc.mode != NAND_ECC_SOFT_BCH) {
 		switch (mtd->oobsize) {
 		case 8:
 			chip->ecc.layout = &nand_oob_8;
@@ -2613,6 +2715,36 @@ int nand_scan_tail(struct mtd_info *mtd)
 		chip->ecc.bytes = 3;
 		break;
 
+	case NAND_ECC_SOFT_BCH:
+		if (!mtd_nand_has_bch()) {
+			printk(KERN_WARNING "CONFIG_MTD_NAND_ECC_BCH not "
+			       "enabled\n");
+			BUG();
+		}
+		chip->ecc.calculate = nand_bch_calculate_ecc;
+		chip->ecc.correct = nand_bch_correct_data;
+		chip->ecc.read_page = nand_read_page_swecc;
+		chip->ecc.write_page = nand_write_page_swecc;
+		chip->ecc.read_oob = nand_read_oob_std;
+		chip->ecc.write_oob = nand_write_oob_std;
+		/*
+		 * The board driver selects the strength with ecc.size and
+		 * ecc.bytes, see nand_bch_init().  Large page devices
+		 * default to 4 bit correction per 512 bytes.
+		 */
+		if (!chip->ecc.size && mtd->oobsize >= 64) {
+			chip->ecc.size = 512;
+			chip->ecc.bytes = 7;
+		}
+		chip->ecc.priv = nand_bch_init(mtd, chip->ecc.size,
+					       chip->ecc.bytes,
+					       &chip->ecc.layout);
+		if (!chip->ecc.priv) {
+			printk(KERN_WARNING "BCH ECC initialization failed\n");
+			BUG();
+		}
+		break;
+
 	case NAND_ECC_NONE:
 		printk(KERN_WARNING "NAND_ECC_NONE selected by board driver. "
 		       "This is not recommended !!\n");
@@ -2760,6 +2892,9 @@ void nand_release(struct mtd_info *mtd)
 	/* Deregister the device */
 	del_mtd_device(mtd);
 
+	if (chip->ecc.mode == NAND_ECC_SOFT_BCH)
+		nand_bch_free(chip->ecc.priv);
+
 	/* Free bad block table memory */
 	kfree(chip->bbt);
 	if (!(chip->options & NAND_OWN_BUFFERS))
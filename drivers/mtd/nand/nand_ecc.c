@@ -38,10 +38,13 @@
 #include <linux/types.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/string.h>
 #include <linux/mtd/nand_ecc.h>
+#include <asm/byteorder.h>
 
 /*
- * Pre-calculated 256-way 1 byte column parity
+ * Pre-calculated 256-way 1 byte column parity, bit 6 is the parity of
+ * the whole byte
  */
 static const u_char nand_ecc_precalc_table[] = {
 	0x00, 0x55, 0x56, 0x03, 0x59, 0x0c, 0x0f, 0x5a, 0x5a, 0x0f, 0x0c, 0x59, 0x03, 0x56, 0x55, 0x00,
@@ -62,6 +65,14 @@ static const u_char nand_ecc_precalc_table[] = {
 	0x00, 0x55, 0x56, 0x03, 0x59, 0x0c, 0x0f, 0x5a, 0x5a, 0x0f, 0x0c, 0x59, 0x03, 0x56, 0x55, 0x00
 };
 
+/* Parity of all 32 bits of a word */
+static inline uint8_t nand_ecc_parity32(uint32_t w)
+{
+	w ^= w >> 16;
+	w ^= w >> 8;
+	return (nand_ecc_precalc_table[w & 0xff] & 0x40) >> 6;
+}
+
 /**
  * nand_calculate_ecc - [NAND Interface] Calculate 3-byte ECC for 256-byte block
  * @mtd:	MTD block structure
@@ -71,25 +82,70 @@ static const u_char nand_ecc_precalc_table[] = {
 int nand_calculate_ecc(struct mtd_info *mtd, const u_char *dat,
 		       u_char *ecc_code)
 {
-	uint8_t idx, reg1, reg2, reg3, tmp1, tmp2;
+	uint32_t aligned[256 / sizeof(uint32_t)];
+	const uint32_t *bp = (const uint32_t *)dat;
+	uint32_t w0, w1, w2, w3, w4, w5, w6, w7, grp;
+	uint32_t par, rp0, rp1, rp2, rp3, rp4, rp5;
+	uint8_t col, reg1, reg2, reg3, tmp1, tmp2;
 	int i;
 
-	/* Initialize variables */
-	reg1 = reg2 = reg3 = 0;
-
-	/* Build up column parity */
-	for(i = 0; i < 256; i++) {
-		/* Get CP0 - CP5 from table */
-		idx = nand_ecc_precalc_table[*dat++];
-		reg1 ^= (idx & 0x3f);
+	if ((unsigned long)dat & (sizeof(uint32_t) - 1)) {
+		memcpy(aligned, dat, sizeof(aligned));
+		bp = aligned;
+	}
 
-		/* All bit XOR = 1 ? */
-		if (idx & 0x40) {
-			reg3 ^= (uint8_t) i;
-			reg2 ^= ~((uint8_t) i);
-		}
+	/*
+	 * The line parity bit k is the parity of all bytes whose offset
+	 * has bit k set.  XOR is linear, so instead of looking up every
+	 * byte, XOR together whole words: rpN collects the words whose
+	 * word index has bit N set, par all of them.  Bits 0-2 of the
+	 * word index are fixed by the position within the group of 8,
+	 * bits 3-5 by the group number.
+	 */
+	par = rp0 = rp1 = rp2 = rp3 = rp4 = rp5 = 0;
+	for (i = 0; i < 8; i++, bp += 8) {
+		w0 = bp[0]; w1 = bp[1]; w2 = bp[2]; w3 = bp[3];
+		w4 = bp[4]; w5 = bp[5]; w6 = bp[6]; w7 = bp[7];
+
+		rp0 ^= w1 ^ w3 ^ w5 ^ w7;
+		rp1 ^= w2 ^ w3 ^ w6 ^ w7;
+		rp2 ^= w4 ^ w5 ^ w6 ^ w7;
+
+		grp = w0 ^ w1 ^ w2 ^ w3 ^ w4 ^ w5 ^ w6 ^ w7;
+		par ^= grp;
+		if (i & 1)
+			rp3 ^= grp;
+		if (i & 2)
+			rp4 ^= grp;
+		if (i & 4)
+			rp5 ^= grp;
 	}
 
+	/* Put the byte at offset k of the data into bits 8k..8k+7 of par */
+	par = le32_to_cpu((__force __le32)par);
+
+	/* XOR of all data bytes gives the column parity CP0 - CP5 */
+	col = par ^ (par >> 8) ^ (par >> 16) ^ (par >> 24);
+	reg1 = nand_ecc_precalc_table[col] & 0x3f;
+
+	/*
+	 * Line parity for odd offsets: bits 0 and 1 of the offset select
+	 * the byte within a word, bits 2-7 the word.
+	 */
+	reg3  = (nand_ecc_precalc_table[(uint8_t)((par >> 8) ^ (par >> 24))]
+		 & 0x40) >> 6;
+	reg3 |= (nand_ecc_precalc_table[(uint8_t)((par >> 16) ^ (par >> 24))]
+		 & 0x40) >> 5;
+	reg3 |= nand_ecc_parity32(rp0) << 2;
+	reg3 |= nand_ecc_parity32(rp1) << 3;
+	reg3 |= nand_ecc_parity32(rp2) << 4;
+	reg3 |= nand_ecc_parity32(rp3) << 5;
+	reg3 |= nand_ecc_parity32(rp4) << 6;
+	reg3 |= nand_ecc_parity32(rp5) << 7;
+
+	/* Even offsets: the rest of the bytes, i.e. the total parity XOR odd */
+	reg2 = (nand_ecc_precalc_table[col] & 0x40) ? ~reg3 : reg3;
+
 	/* Create non-inverted ECC code from line parity */
 	tmp1  = (reg3 & 0x80) >> 0; /* B7 -> B7 */
 	tmp1 |= (reg2 & 0x80) >> 1; /* B7 -> B6 */
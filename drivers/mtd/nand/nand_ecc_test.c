@@ -0,0 +1,225 @@
+/*
+ * drivers/mtd/nand/nand_ecc_test.c
+ *
+ * Self test and benchmark for the software Hamming ECC in nand_ecc.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * nand_calculate_ecc() is compared with a plain byte at a time reference
+ * on random blocks at every alignment.  Then every single bit error in
+ * the data and in the ECC of a block is fed to nand_correct_data(), which
+ * must repair it.  Finally the throughput of both implementations is
+ * measured.  Results go to the kernel log; loading the module fails if a
+ * test does.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/string.h>
+#include <linux/random.h>
+#include <linux/bitops.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/mtd/nand_ecc.h>
+
+static int iterations = 10000;
+module_param(iterations, int, S_IRUGO);
+MODULE_PARM_DESC(iterations, "random blocks per alignment");
+
+static int bench_ms = 200;
+module_param(bench_ms, int, S_IRUGO);
+MODULE_PARM_DESC(bench_ms, "duration of each benchmark in milliseconds");
+
+static u_char buf[256 + 4];
+static u_char block[256];
+
+static inline int parity8(u_char b)
+{
+	return hweight8(b) & 1;
+}
+
+/*
+ * The original algorithm: the column parities of each byte, CP0 - CP5 in
+ * bits 0 - 5 and the parity of the whole byte in bit 6, and the line
+ * parities from the offsets of the bytes with odd parity.
+ */
+static void ref_calculate_ecc(const u_char *dat, u_char *ecc_code)
+{
+	uint8_t idx, reg1, reg2, reg3, tmp1, tmp2;
+	int i, j;
+
+	reg1 = reg2 = reg3 = 0;
+	for (i = 0; i < 256; i++) {
+		idx = parity8(dat[i] & 0x55) << 0 |
+		      parity8(dat[i] & 0xaa) << 1 |
+		      parity8(dat[i] & 0x33) << 2 |
+		      parity8(dat[i] & 0xcc) << 3 |
+		      parity8(dat[i] & 0x0f) << 4 |
+		      parity8(dat[i] & 0xf0) << 5 |
+		      parity8(dat[i]) << 6;
+		reg1 ^= idx & 0x3f;
+		if (idx & 0x40) {
+			reg3 ^= (uint8_t) i;
+			reg2 ^= ~((uint8_t) i);
+		}
+	}
+
+	/* interleave the line parities, odd ones first */
+	tmp1 = tmp2 = 0;
+	for (j = 0; j < 4; j++) {
+		tmp1 |= ((reg3 >> (7 - j)) & 1) << (7 - 2 * j);
+		tmp1 |= ((reg2 >> (7 - j)) & 1) << (6 - 2 * j);
+		tmp2 |= ((reg3 >> (3 - j)) & 1) << (7 - 2 * j);
+		tmp2 |= ((reg2 >> (3 - j)) & 1) << (6 - 2 * j);
+	}
+
+#ifdef CONFIG_MTD_NAND_ECC_SMC
+	ecc_code[0] = ~tmp2;
+	ecc_code[1] = ~tmp1;
+#else
+	ecc_code[0] = ~tmp1;
+	ecc_code[1] = ~tmp2;
+#endif
+	ecc_code[2] = ((~reg1) << 2) | 0x03;
+}
+
+static void random_block(u_char *dat, int i)
+{
+	int j;
+
+	get_random_bytes(dat, 256);
+	/* sparse blocks, down to a single set bit, every fourth time */
+	if (i & 3)
+		return;
+	for (j = 0; j < 256; j++)
+		if (random32() & 15)
+			dat[j] &= random32();
+}
+
+static int test_calculate(void)
+{
+	u_char ecc[3], ref[3];
+	int align, i;
+
+	for (align = 0; align < 4; align++) {
+		for (i = 0; i < iterations; i++) {
+			random_block(buf + align, i);
+			nand_calculate_ecc(NULL, buf + align, ecc);
+			ref_calculate_ecc(buf + align, ref);
+			if (memcmp(ecc, ref, 3)) {
+				printk(KERN_ERR "nand_ecc_test: ECC "
+				       "%02x%02x%02x, expected %02x%02x%02x "
+				       "at alignment %d\n", ecc[0], ecc[1],
+				       ecc[2], ref[0], ref[1], ref[2], align);
+				return -EINVAL;
+			}
+			cond_resched();
+		}
+	}
+	printk(KERN_INFO "nand_ecc_test: %d blocks at 4 alignments match "
+	       "the reference\n", iterations);
+	return 0;
+}
+
+static int test_correct(void)
+{
+	u_char good[3], read_ecc[3], calc_ecc[3];
+	int bit, ret;
+
+	random_block(block, 1);
+	nand_calculate_ecc(NULL, block, good);
+	memcpy(buf, block, 256);
+
+	memcpy(read_ecc, good, 3);
+	ret = nand_correct_data(NULL, buf, read_ecc, good);
+	if (ret != 0) {
+		printk(KERN_ERR "nand_ecc_test: clean block, "
+		       "nand_correct_data() returned %d\n", ret);
+		return -EINVAL;
+	}
+
+	/* every bit of the data */
+	for (bit = 0; bit < 256 * 8; bit++) {
+		buf[bit >> 3] ^= 1 << (bit & 7);
+		nand_calculate_ecc(NULL, buf, calc_ecc);
+		ret = nand_correct_data(NULL, buf, read_ecc, calc_ecc);
+		if (ret != 1 || memcmp(buf, block, 256)) {
+			printk(KERN_ERR "nand_ecc_test: data bit %d not "
+			       "corrected, returned %d\n", bit, ret);
+			return -EINVAL;
+		}
+	}
+
+	/* every bit of the ECC, but the two constant ones */
+	for (bit = 2; bit < 3 * 8; bit++) {
+		memcpy(read_ecc, good, 3);
+		read_ecc[2 - bit / 8] ^= 1 << (bit & 7);
+		ret = nand_correct_data(NULL, buf, read_ecc, good);
+		if (ret != 1 || memcmp(buf, block, 256)) {
+			printk(KERN_ERR "nand_ecc_test: ECC bit %d not "
+			       "handled, returned %d\n", bit, ret);
+			return -EINVAL;
+		}
+	}
+
+	printk(KERN_INFO "nand_ecc_test: all 2048 data and 22 ECC single bit "
+	       "errors corrected\n");
+	return 0;
+}
+
+/* Returns the throughput in MB/s */
+static u64 bench(void (*calc)(const u_char *, u_char *), const u_char *dat)
+{
+	s64 limit = (s64)bench_ms * NSEC_PER_MSEC;
+	u_char ecc[3];
+	u64 n = 0, ns;
+	ktime_t start;
+
+	start = ktime_get();
+	do {
+		calc(dat, ecc);
+		n++;
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	} while (ns < limit);
+
+	return div64_u64(n * 256 * 1000, ns);
+}
+
+static void calculate_ecc(const u_char *dat, u_char *ecc_code)
+{
+	nand_calculate_ecc(NULL, dat, ecc_code);
+}
+
+static int __init nand_ecc_test_init(void)
+{
+	int err;
+
+	err = test_calculate();
+	if (err)
+		return err;
+	err = test_correct();
+	if (err)
+		return err;
+
+	random_block(block, 1);
+	printk(KERN_INFO "nand_ecc_test: nand_calculate_ecc() %llu MB/s, "
+	       "reference %llu MB/s\n",
+	       (unsigned long long)bench(calculate_ecc, block),
+	       (unsigned long long)bench(ref_calculate_ecc, block));
+	return 0;
+}
+
+static void __exit nand_ecc_test_exit(void)
+{
+}
+
+module_init(nand_ecc_test_init);
+module_exit(nand_ecc_test_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("NAND Hamming ECC self test and benchmark");
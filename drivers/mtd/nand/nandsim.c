@@ -34,10 +34,12 @@
 #include <linux/string.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/nand.h>
+#include <linux/mtd/nand_bch.h>
 #include <linux/mtd/partitions.h>
 #include <linux/delay.h>
 #include <linux/list.h>
 #include <linux/random.h>
+#include <linux/hrtimer.h>
 #include <asm/div64.h>
 
 /* Default simulator parameters values */
@@ -101,6 +103,8 @@ static unsigned int bitflips = 0;
 static char *gravepages = NULL;
 static unsigned int rptwear = 0;
 static unsigned int overridesize = 0;
+static unsigned int cache_ops = 1;
+static unsigned int bch;
 
 module_param(first_id_byte,  uint, 0400);
 module_param(second_id_byte, uint, 0400);
@@ -123,6 +127,8 @@ module_param(bitflips,       uint, 0400);
 module_param(gravepages,     charp, 0400);
 module_param(rptwear,        uint, 0400);
 module_param(overridesize,   uint, 0400);
+module_param(cache_ops,      uint, 0400);
+module_param(bch,            uint, 0400);
 
 MODULE_PARM_DESC(first_id_byte,  "The first byte returned by NAND Flash 'read ID' command (manufacturer ID)");
 MODULE_PARM_DESC(second_id_byte, "The second byte returned by NAND Flash 'read ID' command (chip ID)");
@@ -154,6 +160,10 @@ MODULE_PARM_DESC(rptwear,        "Number of erases inbetween reporting wear, if
 MODULE_PARM_DESC(overridesize,   "Specifies the NAND Flash size overriding the ID bytes. "
 				 "The size is specified in erase blocks and as the exponent of a power of two"
 				 " e.g. 5 means a size of 32 erase blocks");
+MODULE_PARM_DESC(cache_ops,      "Support cache read and cache program operations on large page chips"
+				 " if not zero (default)");
+MODULE_PARM_DESC(bch,            "Enable BCH ecc and set how many bits should "
+				 "be correctable in 512-byte blocks");
 
 /* The largest possible page size */
 #define NS_LARGEST_PAGE_SIZE	2048
@@ -182,8 +192,13 @@ MODULE_PARM_DESC(overridesize,   "Specifies the NAND Flash size overriding the I
 /* Is the nandsim structure initialized ? */
 #define NS_IS_INITIALIZED(ns) ((ns)->geom.totsz != 0)
 
+/* Bus transfer time of 'len' bytes, 'cycle' nanoseconds per word */
+#define NS_XFER_UDELAY(ns, cycle, len) \
+	NS_UDELAY((cycle) * (len) / 1000 / ((ns)->busw == 8 ? 1 : 2))
+
 /* Good operation completion status */
-#define NS_STATUS_OK(ns) (NAND_STATUS_READY | (NAND_STATUS_WP * ((ns)->lines.wp == 0)))
+#define NS_STATUS_OK(ns) (NAND_STATUS_READY | NAND_STATUS_TRUE_READY | \
+			  (NAND_STATUS_WP * ((ns)->lines.wp == 0)))
 
 /* Operation failed completion status */
 #define NS_STATUS_FAILED(ns) (NAND_STATUS_FAIL | NS_STATUS_OK(ns))
@@ -210,6 +225,7 @@ MODULE_PARM_DESC(overridesize,   "Specifies the NAND Flash size overriding the I
 #define STATE_CMD_RESET        0x0000000C /* reset */
 #define STATE_CMD_RNDOUT       0x0000000D /* random output command */
 #define STATE_CMD_RNDOUTSTART  0x0000000E /* random output start command */
+#define STATE_CMD_READCACHE    0x0000000F /* read page from cache (both cache read commands) */
 #define STATE_CMD_MASK         0x0000000F /* command states mask */
 
 /* After an address is input, the simulator goes to one of these states */
@@ -242,9 +258,10 @@ MODULE_PARM_DESC(overridesize,   "Specifies the NAND Flash size overriding the I
 #define ACTION_ZEROOFF   0x00400000 /* don't add any offset to address */
 #define ACTION_HALFOFF   0x00500000 /* add to address half of page */
 #define ACTION_OOBOFF    0x00600000 /* add to address OOB offset */
-#define ACTION_MASK      0x00700000 /* action mask */
+#define ACTION_CPYCACHE  0x00700000 /* copy the cached page to the internal buffer */
+#define ACTION_MASK      0x00F00000 /* action mask */
 
-#define NS_OPER_NUM      13 /* Number of operations supported by the simulator */
+#define NS_OPER_NUM      14 /* Number of operations supported by the simulator */
 #define NS_OPER_STATES   6  /* Maximum number of states in operation */
 
 #define OPT_ANY          0xFFFFFFFF /* any chip supports this operation */
@@ -329,6 +346,27 @@ struct nandsim {
 		uint     off;     /* fixed page offset */
 	} regs;
 
+	/*
+	 * Cache operations state.  A cache read or cache program leaves
+	 * the array busy in the background while data is transferred,
+	 * 'busy' is the time it becomes ready again.  Without delays the
+	 * array is busy until its status has been read once.
+	 *
+	 * After a program the status reports the page programmed last in
+	 * I/O0, valid once the array is ready (I/O5), and the page before
+	 * it in I/O1 if both were part of one cache program sequence.
+	 */
+	struct ns_cache_status {
+		int valid;       /* 'row' may be read with a cache read */
+		uint row;        /* the page in the data register */
+		int working;     /* the array may still be busy */
+		ktime_t busy;    /* time the array finishes its operation */
+		int progstat;    /* the status has the result of a program */
+		int progseq;     /* the last program was a cache program */
+		int fail;        /* the last page programmed failed */
+		int fail_n1;     /* the page before it failed */
+	} cache;
+
 	/* NAND flash lines state */
         struct ns_lines_status {
                 int ce;  /* chip Enable */
@@ -381,6 +419,8 @@ static struct nandsim_operations {
 	/* Large page devices random page read */
 	{OPT_LARGEPAGE, {STATE_CMD_RNDOUT, STATE_ADDR_COLUMN, STATE_CMD_RNDOUTSTART | ACTION_CPY,
 			       STATE_DATAOUT, STATE_READY}},
+	/* Large page devices sequential cache read */
+	{OPT_LARGEPAGE, {STATE_CMD_READCACHE | ACTION_CPYCACHE, STATE_DATAOUT, STATE_READY}},
 };
 
 struct weak_block {
@@ -950,6 +990,8 @@ static char *get_state_name(uint32_t state)
 			return "STATE_CMD_RNDOUT";
 		case STATE_CMD_RNDOUTSTART:
 			return "STATE_CMD_RNDOUTSTART";
+		case STATE_CMD_READCACHE:
+			return "STATE_CMD_READCACHE";
 		case STATE_ADDR_PAGE:
 			return "STATE_ADDR_PAGE";
 		case STATE_ADDR_SEC:
@@ -1002,6 +1044,11 @@ static int check_command(int cmd)
 	case NAND_CMD_RNDOUTSTART:
 		return 0;
 
+	case NAND_CMD_CACHEDPROG:
+	case NAND_CMD_READCACHE:
+	case NAND_CMD_READCACHEEND:
+		return !cache_ops;
+
 	case NAND_CMD_STATUS_MULTI:
 	default:
 		return 1;
@@ -1019,6 +1066,7 @@ static uint32_t get_state_by_command(unsigned command)
 		case NAND_CMD_READ1:
 			return STATE_CMD_READ1;
 		case NAND_CMD_PAGEPROG:
+		case NAND_CMD_CACHEDPROG:
 			return STATE_CMD_PAGEPROG;
 		case NAND_CMD_READSTART:
 			return STATE_CMD_READSTART;
@@ -1042,6 +1090,9 @@ static uint32_t get_state_by_command(unsigned command)
 			return STATE_CMD_RNDOUT;
 		case NAND_CMD_RNDOUTSTART:
 			return STATE_CMD_RNDOUTSTART;
+		case NAND_CMD_READCACHE:
+		case NAND_CMD_READCACHEEND:
+			return STATE_CMD_READCACHE;
 	}
 
 	NS_ERR("get_state_by_command: unknown command, BUG\n");
@@ -1320,6 +1371,62 @@ static int prog_page(struct nandsim *ns, int num)
 	return 0;
 }
 
+/*
+ * Wait for the array to finish an operation started by a cache read or
+ * cache program command.
+ */
+static void ns_wait_array(struct nandsim *ns)
+{
+	s64 left;
+
+	ns->cache.working = 0;
+	if (!do_delays)
+		return;
+
+	left = ktime_us_delta(ns->cache.busy, ktime_get());
+	if (left > 0)
+		udelay(left);
+}
+
+/*
+ * Let the array work on its own for 'us' microseconds, while the
+ * simulator goes on with data transfers.
+ */
+static void ns_array_busy(struct nandsim *ns, uint us)
+{
+	ns->cache.working = 1;
+	ns->cache.busy = ktime_add_us(ktime_get(), us);
+}
+
+/*
+ * The status register as the chip reports it right now.  While the array
+ * is busy I/O5 is low and I/O0 is not driven, so it reads as garbage.
+ */
+static u_char ns_status(struct nandsim *ns)
+{
+	u_char status = ns->regs.status;
+
+	if (ns->cache.progstat) {
+		if (ns->cache.fail)
+			status |= NAND_STATUS_FAIL;
+		if (ns->cache.fail_n1)
+			status |= NAND_STATUS_FAIL_N1;
+	}
+
+	if (ns->cache.working) {
+		if (!do_delays)
+			ns->cache.working = 0;
+		else if (ktime_us_delta(ns->cache.busy, ktime_get()) <= 0) {
+			ns->cache.working = 0;
+			return status;
+		}
+		status &= ~(NAND_STATUS_TRUE_READY | NAND_STATUS_FAIL);
+		status |= random32() & NAND_STATUS_FAIL;
+	}
+
+	return status;
+}
+
 /*
  * If state has any action bit, perform this action.
  *
@@ -1328,7 +1435,6 @@ static int prog_page(struct nandsim *ns, int num)
 static int do_state_action(struct nandsim *ns, uint32_t action)
 {
 	int num;
-	int busdiv = ns->busw == 8 ? 1 : 2;
 	unsigned int erase_block_no, page_no;
 
 	action &= ACTION_MASK;
@@ -1351,9 +1457,15 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 			NS_ERR("do_state_action: column number is too large\n");
 			break;
 		}
+		ns_wait_array(ns);
+		ns->cache.progstat = 0;
 		num = ns->geom.pgszoob - ns->regs.off - ns->regs.column;
 		read_page(ns, num);
 
+		/* The page stays in the data register for a cache read */
+		ns->cache.row = ns->regs.row;
+		ns->cache.valid = 1;
+
 		NS_DBG("do_state_action: (ACTION_CPY:) copy %d bytes to int buf, raw offset %d\n",
 			num, NS_RAW_OFFSET(ns) + ns->regs.off);
 
@@ -1365,7 +1477,35 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 			NS_LOG("read OOB of page %d\n", ns->regs.row);
 
 		NS_UDELAY(access_delay);
-		NS_UDELAY(input_cycle * ns->geom.pgsz / 1000 / busdiv);
+
+		break;
+
+	case ACTION_CPYCACHE:
+		/*
+		 * Cache read - output the page the array has loaded and,
+		 * unless this is the last one, start loading the next.
+		 */
+
+		if (!ns->cache.valid) {
+			NS_ERR("do_state_action: cache read without a page read\n");
+			return -1;
+		}
+
+		ns_wait_array(ns);
+		ns->cache.progstat = 0;
+		ns->regs.row = ns->cache.row;
+		ns->regs.column = 0;
+		ns->regs.off = 0;
+		read_page(ns, ns->geom.pgszoob);
+
+		NS_LOG("read page %d from cache\n", ns->regs.row);
+
+		if (ns->regs.command == NAND_CMD_READCACHE &&
+		    ns->cache.row + 1 < ns->geom.pgnum) {
+			ns->cache.row += 1;
+			ns_array_busy(ns, access_delay);
+		} else
+			ns->cache.valid = 0;
 
 		break;
 
@@ -1391,6 +1531,10 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 
 		erase_block_no = ns->regs.row >> (ns->geom.secshift - ns->geom.pgshift);
 
+		ns_wait_array(ns);
+		ns->cache.valid = 0;
+		ns->cache.progstat = 0;
+
 		NS_DBG("do_state_action: erase sector at address %#x, off = %d\n",
 				ns->regs.row, NS_RAW_OFFSET(ns));
 		NS_LOG("erase sector %u\n", erase_block_no);
@@ -1435,13 +1579,25 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 			num, ns->regs.row, ns->regs.column, NS_RAW_OFFSET(ns) + ns->regs.off);
 		NS_LOG("programm page %d\n", ns->regs.row);
 
-		NS_UDELAY(programm_delay);
-		NS_UDELAY(output_cycle * ns->geom.pgsz / 1000 / busdiv);
-
-		if (write_error(page_no)) {
+		/*
+		 * A cache program returns as soon as the previous page is
+		 * done, the array programs this one in the background.  Its
+		 * result only shows once the array is ready, and the result
+		 * of the previous page moves to I/O1.
+		 */
+		ns_wait_array(ns);
+		ns->cache.valid = 0;
+		ns->cache.fail_n1 = ns->cache.progstat && ns->cache.progseq &&
+				    ns->cache.fail;
+		ns->cache.fail = write_error(page_no);
+		if (ns->cache.fail)
 			NS_WARN("simulating write failure in page %u\n", page_no);
-			return -1;
-		}
+		ns->cache.progstat = 1;
+		ns->cache.progseq = ns->regs.command == NAND_CMD_CACHEDPROG;
+		if (ns->cache.progseq)
+			ns_array_busy(ns, programm_delay);
+		else
+			NS_UDELAY(programm_delay);
 
 		break;
 
@@ -1643,8 +1799,9 @@ static u_char ns_nand_read_byte(struct mtd_info *mtd)
 
 	/* Status register may be read as many times as it is wanted */
 	if (NS_STATE(ns->state) == STATE_DATAOUT_STATUS) {
-		NS_DBG("read_byte: return %#x status\n", ns->regs.status);
-		return ns->regs.status;
+		outb = ns_status(ns);
+		NS_DBG("read_byte: return %#x status\n", (uint)outb);
+		return outb;
 	}
 
 	/* Check if there is any data in the internal buffer which may be read */
@@ -1715,6 +1872,9 @@ static void ns_nand_write_byte(struct mtd_info *mtd, u_char byte)
 
 		if (byte == NAND_CMD_RESET) {
 			NS_LOG("reset chip\n");
+			ns->cache.valid = 0;
+			ns->cache.working = 0;
+			ns->cache.progstat = 0;
 			switch_to_ready_state(ns, NS_STATUS_OK(ns));
 			return;
 		}
@@ -1893,6 +2053,7 @@ static void ns_nand_write_buf(struct mtd_info *mtd, const u_char *buf, int len)
 
 	memcpy(ns->buf.byte + ns->regs.count, buf, len);
 	ns->regs.count += len;
+	NS_XFER_UDELAY(ns, input_cycle, len);
 
 	if (ns->regs.count == ns->regs.num) {
 		NS_DBG("write_buf: %d bytes were written\n", ns->regs.count);
@@ -1936,6 +2097,7 @@ static void ns_nand_read_buf(struct mtd_info *mtd, u_char *buf, int len)
 
 	memcpy(buf, ns->buf.byte + ns->regs.count, len);
 	ns->regs.count += len;
+	NS_XFER_UDELAY(ns, output_cycle, len);
 
 	if (ns->regs.count == ns->regs.num) {
 		if ((ns->options & OPT_AUTOINCR) && NS_STATE(ns->state) == STATE_DATAOUT) {
@@ -2037,13 +2199,54 @@ static int __init ns_init_module(void)
 	if ((retval = parse_gravepages()) != 0)
 		goto error;
 
-	if ((retval = nand_scan(nsmtd, 1)) != 0) {
+	if ((retval = nand_scan_ident(nsmtd, 1)) != 0) {
+		NS_ERR("cannot scan NAND Simulator device\n");
+		if (retval > 0)
+			retval = -ENXIO;
+		goto error;
+	}
+
+	if (bch) {
+		unsigned int eccsteps, eccbytes;
+
+		if (!mtd_nand_has_bch()) {
+			NS_ERR("BCH ECC support is disabled\n");
+			retval = -EINVAL;
+			goto error;
+		}
+		/* use 512-byte ecc blocks, GF(2^13) */
+		eccsteps = nsmtd->writesize / 512;
+		eccbytes = (bch * 13 + 7) / 8;
+		/* do not bother supporting small page devices */
+		if (nsmtd->oobsize < 64 || !eccsteps) {
+			NS_ERR("bch not available on small page devices\n");
+			retval = -EINVAL;
+			goto error;
+		}
+		if (eccbytes * eccsteps + 2 > nsmtd->oobsize) {
+			NS_ERR("invalid bch value %u\n", bch);
+			retval = -EINVAL;
+			goto error;
+		}
+		chip->ecc.mode = NAND_ECC_SOFT_BCH;
+		chip->ecc.size = 512;
+		chip->ecc.bytes = eccbytes;
+		NS_INFO("using %u-bit/%u bytes BCH ECC\n", bch, chip->ecc.size);
+	}
+
+	if ((retval = nand_scan_tail(nsmtd)) != 0) {
 		NS_ERR("can't register NAND Simulator\n");
 		if (retval > 0)
 			retval = -ENXIO;
 		goto error;
 	}
 
+	/* Only the large page command set has the cache operations */
+	if (cache_ops && nsmtd->writesize > 512)
+		chip->options |= NAND_CACHERD | NAND_USE_CACHEPRG;
+	else
+		chip->options &= ~NAND_CACHEPRG;
+
 	if (overridesize) {
 		u_int64_t new_size = (u_int64_t)nsmtd->erasesize << overridesize;
 		if (new_size >> overridesize != nsmtd->erasesize) {
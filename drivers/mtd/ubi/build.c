@@ -808,6 +808,7 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 	mutex_init(&ubi->mult_mutex);
 	mutex_init(&ubi->volumes_mutex);
 	spin_lock_init(&ubi->volumes_lock);
+	init_waitqueue_head(&ubi->fg_wait);
 
 	ubi_msg("attaching mtd%d to ubi%d", mtd->index, ubi_num);
 
@@ -854,6 +855,8 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 		goto out_uif;
 	}
 
+	ubi_debugfs_init_dev(ubi);
+
 	ubi_msg("attached mtd%d to ubi%d", mtd->index, ubi_num);
 	ubi_msg("MTD device name:            \"%s\"", mtd->name);
 	ubi_msg("MTD device size:            %llu MiB", ubi->flash_size >> 20);
@@ -945,6 +948,21 @@ int ubi_detach_mtd_dev(int ubi_num, int anyway)
 	 */
 	if (ubi->bgt_thread)
 		kthread_stop(ubi->bgt_thread);
+	spin_lock(&ubi->wl_lock);
+	ubi->thread_enabled = 0;
+	ubi->bgt_thread = NULL;
+	spin_unlock(&ubi->wl_lock);
+	ubi_debugfs_exit_dev(ubi);
+
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/*
+	 * Let the next attach avoid scanning the device. Writing the fastmap
+	 * schedules the erasure of the old one and releases the deferred
+	 * erasures, and there is no thread to run them any more.
+	 */
+	ubi_update_fastmap(ubi);
+	ubi_wl_flush(ubi);
+#endif
 
 	uif_close(ubi);
 	ubi_wl_close(ubi);
@@ -1028,6 +1046,8 @@ static int __init ubi_init(void)
 	if (!ubi_wl_entry_slab)
 		goto out_dev_unreg;
 
+	ubi_debugfs_init();
+
 	/* Attach MTD devices */
 	for (i = 0; i < mtd_devs; i++) {
 		struct mtd_dev_param *p = &mtd_dev_param[i];
@@ -1061,6 +1081,7 @@ out_detach:
 			ubi_detach_mtd_dev(ubi_devices[k]->ubi_num, 1);
 			mutex_unlock(&ubi_devices_mutex);
 		}
+	ubi_debugfs_exit();
 	kmem_cache_destroy(ubi_wl_entry_slab);
 out_dev_unreg:
 	misc_deregister(&ubi_ctrl_cdev);
@@ -1084,6 +1105,7 @@ static void __exit ubi_exit(void)
 			ubi_detach_mtd_dev(ubi_devices[i]->ubi_num, 1);
 			mutex_unlock(&ubi_devices_mutex);
 		}
+	ubi_debugfs_exit();
 	kmem_cache_destroy(ubi_wl_entry_slab);
 	misc_deregister(&ubi_ctrl_cdev);
 	class_remove_file(ubi_class, &ubi_version);
@@ -26,8 +26,13 @@
 
 #ifdef CONFIG_MTD_UBI_DEBUG
 
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
 #include "ubi.h"
 
+/* The "ubi" directory in debugfs */
+static struct dentry *dfs_rootdir;
+
 /**
  * ubi_dbg_dump_ec_hdr - dump an erase counter header.
  * @ec_hdr: the erase counter header to dump
@@ -194,4 +199,106 @@ void ubi_dbg_dump_mkvol_req(const struct ubi_mkvol_req *req)
 	printk(KERN_DEBUG "\t1st 16 characters of name: %s\n", nm);
 }
 
+static int dfs_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static ssize_t dfs_wl_stats_read(struct file *file, char __user *u,
+				 size_t count, loff_t *ppos)
+{
+	struct ubi_device *ubi = file->private_data;
+	struct ubi_wl_stats *st = &ubi->wl_stats;
+	int works_count, len;
+	char buf[320];
+
+	spin_lock(&ubi->wl_lock);
+	works_count = ubi->works_count;
+	spin_unlock(&ubi->wl_lock);
+
+	len = snprintf(buf, sizeof(buf),
+		       "pending works:       %d\n"
+		       "max. pending works:  %d\n"
+		       "erased PEBs:         %lu\n"
+		       "moved LEBs:          %lu\n"
+		       "foreground I/O:      %d\n"
+		       "deferrals:           %lu\n"
+		       "deferred time (ms):  %u\n"
+		       "move yields:         %lu\n"
+		       "move yield timeouts: %lu\n",
+		       works_count, st->max_works, st->erases, st->moves,
+		       atomic_read(&ubi->fg_ops), st->defers,
+		       jiffies_to_msecs(st->defer_time), st->yields,
+		       st->yield_timeouts);
+	return simple_read_from_buffer(u, count, ppos, buf, len);
+}
+
+static const struct file_operations dfs_wl_stats_fops = {
+	.open  = dfs_open,
+	.read  = dfs_wl_stats_read,
+	.owner = THIS_MODULE,
+};
+
+/**
+ * ubi_debugfs_init - create the UBI debugfs directory.
+ *
+ * Debugfs is only an aid, so failures are reported but ignored.
+ */
+void ubi_debugfs_init(void)
+{
+	dfs_rootdir = debugfs_create_dir(UBI_NAME_STR, NULL);
+	if (IS_ERR(dfs_rootdir) || !dfs_rootdir) {
+		if (!IS_ERR(dfs_rootdir))
+			ubi_warn("cannot create \"%s\" debugfs directory",
+				 UBI_NAME_STR);
+		dfs_rootdir = NULL;
+	}
+}
+
+/**
+ * ubi_debugfs_exit - remove the UBI debugfs directory.
+ */
+void ubi_debugfs_exit(void)
+{
+	debugfs_remove(dfs_rootdir);
+}
+
+/**
+ * ubi_debugfs_init_dev - create the debugfs files of an UBI device.
+ * @ubi: UBI device description object
+ */
+void ubi_debugfs_init_dev(struct ubi_device *ubi)
+{
+	if (!dfs_rootdir)
+		return;
+
+	ubi->dfs_dir = debugfs_create_dir(ubi->ubi_name, dfs_rootdir);
+	if (!ubi->dfs_dir)
+		goto out;
+
+	ubi->dfs_wl_stats = debugfs_create_file("wl_stats", S_IRUSR,
+						ubi->dfs_dir, ubi,
+						&dfs_wl_stats_fops);
+	if (!ubi->dfs_wl_stats) {
+		debugfs_remove(ubi->dfs_dir);
+		ubi->dfs_dir = NULL;
+		goto out;
+	}
+	return;
+
+out:
+	ubi_warn("cannot create debugfs files of %s", ubi->ubi_name);
+}
+
+/**
+ * ubi_debugfs_exit_dev - remove the debugfs files of an UBI device.
+ * @ubi: UBI device description object
+ */
+void ubi_debugfs_exit_dev(struct ubi_device *ubi)
+{
+	debugfs_remove(ubi->dfs_wl_stats);
+	debugfs_remove(ubi->dfs_dir);
+}
+
 #endif /* CONFIG_MTD_UBI_DEBUG */
@@ -56,6 +56,13 @@ void ubi_dbg_dump_sv(const struct ubi_scan_volume *sv);
 void ubi_dbg_dump_seb(const struct ubi_scan_leb *seb, int type);
 void ubi_dbg_dump_mkvol_req(const struct ubi_mkvol_req *req);
 
+struct ubi_device;
+
+void ubi_debugfs_init(void);
+void ubi_debugfs_exit(void);
+void ubi_debugfs_init_dev(struct ubi_device *ubi);
+void ubi_debugfs_exit_dev(struct ubi_device *ubi);
+
 #ifdef CONFIG_MTD_UBI_DEBUG_MSG
 /* General debugging messages */
 #define dbg_gen(fmt, ...) dbg_msg(fmt, ##__VA_ARGS__)
@@ -161,6 +168,10 @@ static inline int ubi_dbg_is_erase_failure(void)
 #define ubi_dbg_dump_sv(sv)              ({})
 #define ubi_dbg_dump_seb(seb, type)      ({})
 #define ubi_dbg_dump_mkvol_req(req)      ({})
+#define ubi_debugfs_init()               ({})
+#define ubi_debugfs_exit()               ({})
+#define ubi_debugfs_init_dev(ubi)        ({})
+#define ubi_debugfs_exit_dev(ubi)        ({})
 
 #define UBI_IO_DEBUG               0
 #define DBG_DISABLE_BGT            0
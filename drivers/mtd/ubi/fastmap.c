@@ -0,0 +1,719 @@
+/*
+ * Copyright (c) International Business Machines Corp., 2006
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * UBI fastmap.
+ *
+ * Normally UBI reads the EC and VID headers of every physical eraseblock when
+ * a device is attached, so attaching takes time proportional to the size of
+ * the flash. The fastmap is a checkpoint of the state of all physical
+ * eraseblocks - which ones are free, which logical eraseblock each used one
+ * holds, which ones have to be erased - stored in a single physical
+ * eraseblock, the anchor, which belongs to the %UBI_FM_VOLUME_ID internal
+ * volume. The anchor is always one of the first %UBI_FM_MAX_START physical
+ * eraseblocks, so finding it costs only a few VID header reads.
+ *
+ * The fastmap stays valid while UBI keeps working, because the WL sub-system
+ * maintains the following rules while it is in use:
+ *
+ * o new physical eraseblocks are only taken from the pool, which is a set of
+ *   free physical eraseblocks the fastmap marks as %UBI_FM_PEB_SCAN, so their
+ *   headers are read when the device is attached; when the pool is used up,
+ *   a new fastmap with a new pool is written;
+ * o physical eraseblocks the fastmap marks as used are not erased before a
+ *   newer fastmap is written, the erasure works are kept aside in
+ *   @ubi->fm_works instead;
+ * o the anchor is only erased after the next fastmap is written.
+ *
+ * So when attaching, UBI reads the fastmap and the headers of the pool
+ * eraseblocks, and a newer copy of a logical eraseblock found in the pool
+ * wins over the copy recorded in the fastmap, exactly like when two copies
+ * are found by scanning. Eraseblocks taken from the fastmap have no sequence
+ * number, which is fine as any copy written after the fastmap is newer.
+ *
+ * One consequence is that if a logical eraseblock is un-mapped and the
+ * device is not detached cleanly, it may come back after the next attach
+ * with any of its contents written since the last fastmap. This is similar
+ * to what happens without fastmap when an erasure is interrupted.
+ *
+ * If no valid fastmap is found, UBI erases all the fastmap eraseblocks it
+ * found and falls back to full scanning. UBI implementations without fastmap
+ * support see the fastmap as a "delete"-compatible internal volume and
+ * remove it, but only after attaching, in background. So such an attach may
+ * leave a stale fastmap on the flash if it is not followed by a clean detach.
+ *
+ * At the moment the fastmap has to fit into one logical eraseblock, which
+ * limits the amount of physical eraseblocks it can describe. If it does not
+ * fit, it is not used.
+ */
+
+#include <linux/crc32.h>
+#include <linux/bitops.h>
+#include "ubi.h"
+
+/**
+ * ubi_fm_size - get size of the fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function returns the maximum size of the fastmap of UBI device @ubi,
+ * aligned to the minimal I/O unit size.
+ */
+int ubi_fm_size(const struct ubi_device *ubi)
+{
+	int size;
+
+	size = sizeof(struct ubi_fm_hdr);
+	size += (UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT) *
+		sizeof(struct ubi_fm_volume);
+	size += ubi->peb_count * sizeof(struct ubi_fm_peb);
+	return ALIGN(size, ubi->min_io_size);
+}
+
+/**
+ * fm_vol_idx - get fastmap volume record table index by volume ID.
+ * @vol_id: volume ID
+ *
+ * The volume table is not read yet when the fastmap is, so 'vol_id2idx()'
+ * cannot be used.
+ */
+static int fm_vol_idx(int vol_id)
+{
+	if (vol_id == UBI_LAYOUT_VOLUME_ID)
+		return UBI_MAX_VOLUMES;
+	if (vol_id < 0 || vol_id >= UBI_MAX_VOLUMES)
+		return -1;
+	return vol_id;
+}
+
+/**
+ * snapshot_volumes - fill in the volume records and the EBA information.
+ * @ubi: UBI device description object
+ * @fmvol: where to put the volume records
+ * @fmpeb: the eraseblock table
+ *
+ * This function returns the number of volume records.
+ */
+static int snapshot_volumes(struct ubi_device *ubi,
+			    struct ubi_fm_volume *fmvol,
+			    struct ubi_fm_peb *fmpeb)
+{
+	int i, lnum, pnum, vol_count = 0;
+	int used_ebs, last_eb_bytes;
+	struct ubi_volume *vol;
+	struct ubi_fm_volume *fv;
+
+	bitmap_zero(ubi->fm_mapped, ubi->peb_count);
+
+	spin_lock(&ubi->volumes_lock);
+	for (i = 0; i < ubi->vtbl_slots + UBI_INT_VOL_COUNT; i++) {
+		vol = ubi->volumes[i];
+		if (!vol)
+			continue;
+
+		used_ebs = vol->used_ebs;
+		last_eb_bytes = vol->last_eb_bytes;
+		if (vol->vol_type == UBI_STATIC_VOLUME && vol->updating) {
+			/* The LEBs written so far carry the new values */
+			used_ebs = vol->upd_ebs;
+			last_eb_bytes = 0;
+			if (used_ebs)
+				last_eb_bytes = vol->upd_bytes -
+					(long long)(used_ebs - 1) *
+					vol->usable_leb_size;
+		}
+
+		fv = &fmvol[vol_count++];
+		fv->vol_id = cpu_to_be32(vol->vol_id);
+		fv->data_pad = cpu_to_be32(vol->data_pad);
+		if (vol->vol_type == UBI_DYNAMIC_VOLUME) {
+			fv->vol_type = UBI_VID_DYNAMIC;
+			fv->used_ebs = cpu_to_be32(0);
+			fv->last_eb_bytes = cpu_to_be32(0);
+		} else {
+			fv->vol_type = UBI_VID_STATIC;
+			fv->used_ebs = cpu_to_be32(used_ebs);
+			fv->last_eb_bytes = cpu_to_be32(last_eb_bytes);
+		}
+		if (vol->vol_id == UBI_LAYOUT_VOLUME_ID)
+			fv->compat = UBI_LAYOUT_VOLUME_COMPAT;
+
+		for (lnum = 0; lnum < vol->reserved_pebs; lnum++) {
+			pnum = vol->eba_tbl[lnum];
+			if (pnum < 0)
+				continue;
+
+			__set_bit(pnum, ubi->fm_mapped);
+			fmpeb[pnum].vol_id = cpu_to_be32(vol->vol_id);
+			fmpeb[pnum].lnum = cpu_to_be32(lnum);
+		}
+	}
+	spin_unlock(&ubi->volumes_lock);
+
+	return vol_count;
+}
+
+/**
+ * update_fastmap - write a new fastmap.
+ * @ubi: UBI device description object
+ *
+ * @ubi->fm_mutex has to be locked. Returns zero in case of success, including
+ * the case when the fastmap could not be written and has been disabled, and a
+ * negative error code in case of failure.
+ */
+static int update_fastmap(struct ubi_device *ubi)
+{
+	int err, pnum, vol_count, data_size, len;
+	struct ubi_fm_hdr *hdr = ubi->fm_buf;
+	struct ubi_fm_volume *fmvol = ubi->fm_buf + sizeof(*hdr);
+	struct ubi_fm_peb *fmpeb;
+	struct ubi_vid_hdr *vid_hdr;
+	unsigned long long sqnum;
+
+	if (ubi->fm_disabled)
+		return 0;
+	if (ubi->ro_mode)
+		return -EROFS;
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_NOFS);
+	if (!vid_hdr)
+		return -ENOMEM;
+
+	/*
+	 * Hold off wear-leveling so that no LEB moves while its old and new
+	 * PEBs are being described.
+	 */
+	mutex_lock(&ubi->move_mutex);
+
+	fmpeb = (void *)(fmvol + UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT);
+	memset(ubi->fm_buf, 0, ubi->fm_size);
+	vol_count = snapshot_volumes(ubi, fmvol, fmpeb);
+
+	pnum = ubi_wl_fm_prepare(ubi, fmpeb);
+	if (pnum < 0) {
+		ubi_wl_fm_disable(ubi);
+		goto out_unlock;
+	}
+
+	/* Close the gap between the volume records and the eraseblock table */
+	if (vol_count < UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT) {
+		memmove(fmvol + vol_count, fmpeb,
+			ubi->peb_count * sizeof(struct ubi_fm_peb));
+		fmpeb = (void *)(fmvol + vol_count);
+	}
+	data_size = vol_count * sizeof(struct ubi_fm_volume) +
+		    ubi->peb_count * sizeof(struct ubi_fm_peb);
+	len = ALIGN(sizeof(*hdr) + data_size, ubi->min_io_size);
+	memset((void *)hdr + sizeof(*hdr) + data_size, 0,
+	       len - sizeof(*hdr) - data_size);
+
+	sqnum = ubi_next_sqnum(ubi);
+	hdr->magic = cpu_to_be32(UBI_FM_HDR_MAGIC);
+	hdr->version = UBI_FM_VERSION;
+	hdr->peb_count = cpu_to_be32(ubi->peb_count);
+	hdr->leb_size = cpu_to_be32(ubi->leb_size);
+	hdr->vol_count = cpu_to_be32(vol_count);
+	hdr->data_size = cpu_to_be32(data_size);
+	hdr->data_crc = cpu_to_be32(crc32(UBI_CRC32_INIT, fmvol, data_size));
+	hdr->sqnum = cpu_to_be64(sqnum);
+	hdr->hdr_crc = cpu_to_be32(crc32(UBI_CRC32_INIT, hdr,
+					 UBI_FM_HDR_SIZE_CRC));
+
+	vid_hdr->vol_type = UBI_VID_DYNAMIC;
+	vid_hdr->vol_id = cpu_to_be32(UBI_FM_VOLUME_ID);
+	vid_hdr->compat = UBI_FM_VOLUME_COMPAT;
+	vid_hdr->sqnum = cpu_to_be64(sqnum);
+
+	dbg_gen("write fastmap to PEB %d, %d volumes, %d bytes",
+		pnum, vol_count, len);
+	err = ubi_io_write_vid_hdr(ubi, pnum, vid_hdr);
+	if (!err)
+		err = ubi_io_write_data(ubi, hdr, pnum, 0, len);
+	ubi_wl_fm_finish(ubi, fmpeb, err);
+
+out_unlock:
+	mutex_unlock(&ubi->move_mutex);
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return ubi->ro_mode ? -EROFS : 0;
+}
+
+/**
+ * ubi_update_fastmap - write a new fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function writes a new fastmap describing the current state of the
+ * device and gives the WL sub-system a new pool of free eraseblocks. If the
+ * fastmap cannot be written, it is disabled. Returns zero in case of success
+ * and a negative error code in case of failure.
+ */
+int ubi_update_fastmap(struct ubi_device *ubi)
+{
+	int err;
+
+	mutex_lock(&ubi->fm_mutex);
+	err = update_fastmap(ubi);
+	mutex_unlock(&ubi->fm_mutex);
+	return err;
+}
+
+/**
+ * ubi_refill_pool - write a new fastmap if the pool is empty.
+ * @ubi: UBI device description object
+ *
+ * This function is called when the WL sub-system ran out of pool eraseblocks.
+ * Concurrent callers have to wait for a single fastmap to be written. Returns
+ * zero in case of success and a negative error code in case of failure.
+ */
+int ubi_refill_pool(struct ubi_device *ubi)
+{
+	int err = 0, empty;
+
+	mutex_lock(&ubi->fm_mutex);
+	spin_lock(&ubi->wl_lock);
+	empty = !ubi->fm_pool.rb_node;
+	spin_unlock(&ubi->wl_lock);
+	if (empty)
+		err = update_fastmap(ubi);
+	mutex_unlock(&ubi->fm_mutex);
+	return err;
+}
+
+/**
+ * struct fm_scan - fastmap eraseblocks found when attaching.
+ * @fm: PEBs belonging to the fastmap volume
+ * @empty: PEBs without VID header
+ * @sqnum: sequence numbers of the VID headers of @fm PEBs
+ *
+ * Only the first %UBI_FM_MAX_START physical eraseblocks are described.
+ */
+struct fm_scan {
+	DECLARE_BITMAP(fm, UBI_FM_MAX_START);
+	DECLARE_BITMAP(empty, UBI_FM_MAX_START);
+	unsigned long long sqnum[UBI_FM_MAX_START];
+};
+
+/**
+ * read_fastmap - read and check the fastmap stored in a PEB.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock to read from
+ * @buf: buffer of @ubi_fm_size() bytes to read the fastmap to
+ * @ech: EC header buffer
+ * @ec: the erase counter of @pnum is returned here
+ *
+ * This function returns zero if @pnum contains a valid fastmap, %1 if it
+ * does not, and a negative error code in case of failure.
+ */
+static int read_fastmap(struct ubi_device *ubi, int pnum, void *buf,
+			struct ubi_ec_hdr *ech, int *ec)
+{
+	int err, vol_count, data_size;
+	long long ec64;
+	struct ubi_fm_hdr *hdr = buf;
+	uint32_t crc;
+
+	err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+	if (err < 0)
+		return err;
+	if (err && err != UBI_IO_BITFLIPS)
+		return 1;
+	ec64 = be64_to_cpu(ech->ec);
+	if (ec64 > UBI_MAX_ERASECOUNTER)
+		return 1;
+	*ec = ec64;
+
+	err = ubi_io_read_data(ubi, hdr, pnum, 0, sizeof(*hdr));
+	if (err && err != UBI_IO_BITFLIPS)
+		return 1;
+
+	crc = crc32(UBI_CRC32_INIT, hdr, UBI_FM_HDR_SIZE_CRC);
+	if (be32_to_cpu(hdr->magic) != UBI_FM_HDR_MAGIC ||
+	    be32_to_cpu(hdr->hdr_crc) != crc) {
+		dbg_bld("bad fastmap header in PEB %d", pnum);
+		return 1;
+	}
+
+	vol_count = be32_to_cpu(hdr->vol_count);
+	data_size = be32_to_cpu(hdr->data_size);
+	if (hdr->version != UBI_FM_VERSION ||
+	    be32_to_cpu(hdr->peb_count) != ubi->peb_count ||
+	    be32_to_cpu(hdr->leb_size) != ubi->leb_size ||
+	    vol_count < 0 || vol_count > UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT ||
+	    data_size != vol_count * sizeof(struct ubi_fm_volume) +
+			 ubi->peb_count * sizeof(struct ubi_fm_peb)) {
+		ubi_warn("unsupported fastmap in PEB %d", pnum);
+		return 1;
+	}
+
+	err = ubi_io_read_data(ubi, buf + sizeof(*hdr), pnum, sizeof(*hdr),
+			       data_size);
+	if (err && err != UBI_IO_BITFLIPS)
+		return 1;
+
+	crc = crc32(UBI_CRC32_INIT, buf + sizeof(*hdr), data_size);
+	if (be32_to_cpu(hdr->data_crc) != crc) {
+		dbg_bld("bad fastmap data CRC in PEB %d", pnum);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * add_fm_used - add a used PEB described by the fastmap to scanning info.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @pnum: the physical eraseblock
+ * @ec: its erase counter
+ * @fv: record of the volume the PEB belongs to
+ * @lnum: the logical eraseblock the PEB holds
+ * @scrub: if the PEB needs scrubbing
+ * @vh: VID header buffer
+ *
+ * The VID header the scanning code needs is built from the volume record.
+ * Returns zero in case of success, %1 if the fastmap is inconsistent and a
+ * negative error code in case of failure.
+ */
+static int add_fm_used(struct ubi_device *ubi, struct ubi_scan_info *si,
+		       int pnum, int ec, const struct ubi_fm_volume *fv,
+		       int lnum, int scrub, struct ubi_vid_hdr *vh)
+{
+	int used_ebs = be32_to_cpu(fv->used_ebs);
+	int data_pad = be32_to_cpu(fv->data_pad);
+	int data_size = 0;
+
+	if (lnum < 0)
+		return 1;
+	if (fv->vol_type == UBI_VID_STATIC) {
+		if (lnum >= used_ebs)
+			return 1;
+		if (lnum == used_ebs - 1)
+			data_size = be32_to_cpu(fv->last_eb_bytes);
+		else
+			data_size = ubi->leb_size - data_pad;
+	}
+
+	memset(vh, 0, sizeof(struct ubi_vid_hdr));
+	vh->vol_type = fv->vol_type;
+	vh->compat = fv->compat;
+	vh->vol_id = fv->vol_id;
+	vh->lnum = cpu_to_be32(lnum);
+	vh->data_size = cpu_to_be32(data_size);
+	vh->used_ebs = fv->used_ebs;
+	vh->data_pad = fv->data_pad;
+
+	__set_bit(pnum, si->fm_used);
+	return ubi_scan_add_used(ubi, si, pnum, ec, vh, scrub);
+}
+
+/**
+ * fm_to_si - build scanning information from a fastmap.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @fs: fastmap eraseblocks found on the flash
+ * @anchor: the physical eraseblock the fastmap was read from
+ * @anchor_ec: its erase counter
+ * @buf: the fastmap
+ *
+ * This function returns zero in case of success, %1 if the fastmap turned
+ * out to be inconsistent, and a negative error code in case of failure.
+ */
+static int fm_to_si(struct ubi_device *ubi, struct ubi_scan_info *si,
+		    const struct fm_scan *fs, int anchor, int anchor_ec,
+		    void *buf)
+{
+	int i, err, pnum, ec, idx, vol_count, anchor_found = 0;
+	struct ubi_fm_hdr *hdr = buf;
+	struct ubi_fm_volume *fmvol = buf + sizeof(*hdr);
+	struct ubi_fm_volume **vols;
+	struct ubi_fm_peb *fmpeb;
+	struct ubi_vid_hdr *vh;
+	unsigned long long sqnum;
+
+	vol_count = be32_to_cpu(hdr->vol_count);
+	fmpeb = (void *)(fmvol + vol_count);
+
+	si->fm_used = kzalloc(BITS_TO_LONGS(ubi->peb_count) *
+			      sizeof(unsigned long), GFP_KERNEL);
+	vols = kcalloc(UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT, sizeof(void *),
+		       GFP_KERNEL);
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	err = -ENOMEM;
+	if (!si->fm_used || !vols || !vh)
+		goto out_free;
+
+	err = 1;
+	for (i = 0; i < vol_count; i++) {
+		idx = fm_vol_idx(be32_to_cpu(fmvol[i].vol_id));
+		if (idx < 0 || vols[idx])
+			goto out_free;
+		if (fmvol[i].vol_type != UBI_VID_DYNAMIC &&
+		    fmvol[i].vol_type != UBI_VID_STATIC)
+			goto out_free;
+		vols[idx] = &fmvol[i];
+	}
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		struct ubi_fm_peb *p = &fmpeb[pnum];
+
+		cond_resched();
+
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			goto out_free;
+		if (err) {
+			si->bad_peb_count += 1;
+			continue;
+		}
+
+		ec = be32_to_cpu(p->ec);
+		if (ec < 0 || ec > UBI_MAX_ERASECOUNTER) {
+			err = 1;
+			goto out_free;
+		}
+
+		switch (p->state) {
+		case UBI_FM_PEB_ANCHOR:
+			err = 1;
+			if (pnum != anchor)
+				goto out_free;
+			anchor_found = 1;
+			ec = anchor_ec;
+			si->fm_pnum = pnum;
+			si->fm_ec = ec;
+			break;
+
+		case UBI_FM_PEB_FREE:
+			/*
+			 * A newer fastmap may have been partially written to
+			 * a PEB this fastmap considers free.
+			 */
+			if (pnum < UBI_FM_MAX_START &&
+			    !test_bit(pnum, fs->empty))
+				err = ubi_scan_add_to_list(si, pnum, ec,
+							   &si->erase);
+			else
+				err = ubi_scan_add_to_list(si, pnum, ec,
+							   &si->free);
+			if (err)
+				goto out_free;
+			break;
+
+		case UBI_FM_PEB_ERASE:
+			err = ubi_scan_add_to_list(si, pnum, ec, &si->erase);
+			if (err)
+				goto out_free;
+			break;
+
+		case UBI_FM_PEB_USED:
+		case UBI_FM_PEB_SCRUB:
+			err = 1;
+			if (pnum < UBI_FM_MAX_START && test_bit(pnum, fs->fm))
+				goto out_free;
+			idx = fm_vol_idx(be32_to_cpu(p->vol_id));
+			if (idx < 0 || !vols[idx])
+				goto out_free;
+			err = add_fm_used(ubi, si, pnum, ec, vols[idx],
+					  be32_to_cpu(p->lnum),
+					  p->state == UBI_FM_PEB_SCRUB, vh);
+			if (err)
+				goto out_free;
+			break;
+
+		case UBI_FM_PEB_SCAN:
+		case UBI_FM_PEB_BAD:
+			/* A PEB which is not bad any more is just scanned */
+			err = ubi_scan_process_eb(ubi, si, pnum);
+			if (err)
+				goto out_free;
+			continue;
+
+		default:
+			err = 1;
+			goto out_free;
+		}
+
+		si->ec_sum += ec;
+		si->ec_count += 1;
+		if (ec > si->max_ec)
+			si->max_ec = ec;
+		if (ec < si->min_ec)
+			si->min_ec = ec;
+	}
+
+	err = 1;
+	if (!anchor_found)
+		goto out_free;
+
+	sqnum = be64_to_cpu(hdr->sqnum);
+	if (sqnum < fs->sqnum[anchor])
+		sqnum = fs->sqnum[anchor];
+	if (si->max_sqnum < sqnum)
+		si->max_sqnum = sqnum;
+	si->is_empty = 0;
+	err = 0;
+
+out_free:
+	ubi_free_vid_hdr(ubi, vh);
+	kfree(vols);
+	return err;
+}
+
+/**
+ * ubi_scan_fastmap - attach an MTD device using the fastmap.
+ * @ubi: UBI device description object
+ * @si: empty scanning information to fill in
+ *
+ * This function looks for the newest valid fastmap and builds the scanning
+ * information from it, reading only the physical eraseblocks the fastmap
+ * does not describe. If there is no usable fastmap, all the fastmap
+ * eraseblocks are erased, so that a stale fastmap is never found later.
+ *
+ * This function returns zero in case of success, %1 if the device has to be
+ * fully scanned, in which case @si has to be thrown away, and a negative
+ * error code in case of failure.
+ */
+int ubi_scan_fastmap(struct ubi_device *ubi, struct ubi_scan_info *si)
+{
+	int err, pnum, max_pnum, ec, fm_size = ubi_fm_size(ubi);
+	DECLARE_BITMAP(tried, UBI_FM_MAX_START);
+	struct ubi_vid_hdr *vh;
+	struct ubi_ec_hdr *ech;
+	struct fm_scan *fs;
+	void *buf = NULL;
+
+	fs = kzalloc(sizeof(struct fm_scan), GFP_KERNEL);
+	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	err = -ENOMEM;
+	if (!fs || !ech || !vh)
+		goto out_free;
+
+	/* Find the fastmap eraseblocks */
+	max_pnum = min(ubi->peb_count, UBI_FM_MAX_START);
+	for (pnum = 0; pnum < max_pnum; pnum++) {
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			goto out_free;
+		if (err)
+			continue;
+
+		err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+		if (err < 0)
+			goto out_free;
+		if (err == UBI_IO_PEB_FREE)
+			__set_bit(pnum, fs->empty);
+		if (err && err != UBI_IO_BITFLIPS)
+			continue;
+
+		if (be32_to_cpu(vh->vol_id) == UBI_FM_VOLUME_ID) {
+			__set_bit(pnum, fs->fm);
+			fs->sqnum[pnum] = be64_to_cpu(vh->sqnum);
+		}
+	}
+
+	err = 1;
+	if (bitmap_empty(fs->fm, UBI_FM_MAX_START))
+		goto out_free;
+
+	buf = vmalloc(fm_size);
+	if (!buf) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	/* Try the fastmaps starting from the newest one */
+	bitmap_copy(tried, fs->fm, UBI_FM_MAX_START);
+	while (!bitmap_empty(tried, UBI_FM_MAX_START)) {
+		int i, best = -1;
+
+		for (i = 0; i < max_pnum; i++)
+			if (test_bit(i, tried) &&
+			    (best < 0 || fs->sqnum[i] > fs->sqnum[best]))
+				best = i;
+		__clear_bit(best, tried);
+
+		err = read_fastmap(ubi, best, buf, ech, &ec);
+		if (err < 0)
+			goto out_free;
+		if (err)
+			continue;
+
+		err = fm_to_si(ubi, si, fs, best, ec, buf);
+		if (err <= 0) {
+			if (!err)
+				ubi_msg("attached using fastmap in PEB %d",
+					best);
+			goto out_free;
+		}
+		ubi_warn("fastmap in PEB %d is inconsistent", best);
+		break;
+	}
+
+	/*
+	 * No usable fastmap - get rid of all of them before the device is
+	 * scanned and changed, they would be wrong from now on.
+	 */
+	ubi_msg("no usable fastmap found, scanning the device");
+	for (pnum = 0; pnum < max_pnum; pnum++) {
+		if (!test_bit(pnum, fs->fm))
+			continue;
+
+		err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+		if (err < 0)
+			goto out_free;
+		ec = 0;
+		if (!err || err == UBI_IO_BITFLIPS)
+			ec = be64_to_cpu(ech->ec);
+
+		err = ubi_scan_erase_peb(ubi, si, pnum, ec + 1);
+		if (err)
+			goto out_free;
+	}
+	err = 1;
+
+out_free:
+	vfree(buf);
+	ubi_free_vid_hdr(ubi, vh);
+	kfree(ech);
+	kfree(fs);
+	return err;
+}
+
+/**
+ * ubi_scan_drop_fastmap - stop relying on the fastmap when attaching.
+ * @ubi: UBI device description object
+ * @si: scanning information built from the fastmap
+ *
+ * This function has to be called before anything is written to the flash
+ * while the device is being attached using the fastmap, because the fastmap
+ * would not describe the change. The fastmap is erased, so the device is
+ * fully scanned next time if it is not cleanly detached. Returns zero in case
+ * of success and a negative error code in case of failure.
+ */
+int ubi_scan_drop_fastmap(struct ubi_device *ubi, struct ubi_scan_info *si)
+{
+	int err, pnum = si->fm_pnum, ec = si->fm_ec + 1;
+
+	dbg_bld("drop fastmap in PEB %d", pnum);
+	err = ubi_scan_erase_peb(ubi, si, pnum, ec);
+	if (err)
+		return err;
+
+	si->fm_pnum = -1;
+	bitmap_zero(si->fm_used, ubi->peb_count);
+	return ubi_scan_add_to_list(si, pnum, ec, &si->free);
+}
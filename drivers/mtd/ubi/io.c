@@ -92,10 +92,10 @@
 
 #ifdef CONFIG_MTD_UBI_DEBUG_PARANOID
 static int paranoid_check_not_bad(const struct ubi_device *ubi, int pnum);
-static int paranoid_check_peb_ec_hdr(const struct ubi_device *ubi, int pnum);
+static int paranoid_check_peb_ec_hdr(struct ubi_device *ubi, int pnum);
 static int paranoid_check_ec_hdr(const struct ubi_device *ubi, int pnum,
 				 const struct ubi_ec_hdr *ec_hdr);
-static int paranoid_check_peb_vid_hdr(const struct ubi_device *ubi, int pnum);
+static int paranoid_check_peb_vid_hdr(struct ubi_device *ubi, int pnum);
 static int paranoid_check_vid_hdr(const struct ubi_device *ubi, int pnum,
 				  const struct ubi_vid_hdr *vid_hdr);
 static int paranoid_check_all_ff(struct ubi_device *ubi, int pnum, int offset,
@@ -109,6 +109,39 @@ static int paranoid_check_all_ff(struct ubi_device *ubi, int pnum, int offset,
 #define paranoid_check_all_ff(ubi, pnum, offset, len) 0
 #endif
 
+/* Maximum time 'ubi_io_yield()' waits for foreground I/O */
+#define IO_YIELD_TIME msecs_to_jiffies(10)
+
+/**
+ * fg_io_begin - account an I/O operation.
+ * @ubi: UBI device description object
+ *
+ * I/O done by anybody but the background thread is foreground I/O, which
+ * background work should not get in the way of. Returns non-zero if the
+ * operation was accounted as foreground I/O.
+ */
+static int fg_io_begin(struct ubi_device *ubi)
+{
+	if (current == ubi->bgt_thread)
+		return 0;
+	atomic_inc(&ubi->fg_ops);
+	return 1;
+}
+
+/**
+ * fg_io_end - finish accounting an I/O operation.
+ * @ubi: UBI device description object
+ * @fg: what 'fg_io_begin()' returned
+ */
+static void fg_io_end(struct ubi_device *ubi, int fg)
+{
+	if (!fg)
+		return;
+	ubi->fg_last = jiffies;
+	if (atomic_dec_and_test(&ubi->fg_ops))
+		wake_up(&ubi->fg_wait);
+}
+
 /**
  * ubi_io_read - read data from a physical eraseblock.
  * @ubi: UBI device description object
@@ -131,10 +164,10 @@ static int paranoid_check_all_ff(struct ubi_device *ubi, int pnum, int offset,
  * o %-EIO if some I/O error occurred;
  * o other negative error codes in case of other errors.
  */
-int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
+int ubi_io_read(struct ubi_device *ubi, void *buf, int pnum, int offset,
 		int len)
 {
-	int err, retries = 0;
+	int err, fg, retries = 0;
 	size_t read;
 	loff_t addr;
 
@@ -150,7 +183,9 @@ int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
 
 	addr = (loff_t)pnum * ubi->peb_size + offset;
 retry:
+	fg = fg_io_begin(ubi);
 	err = ubi->mtd->read(ubi->mtd, addr, len, &read, buf);
+	fg_io_end(ubi, fg);
 	if (err) {
 		if (err == -EUCLEAN) {
 			/*
@@ -219,7 +254,7 @@ retry:
 int ubi_io_write(struct ubi_device *ubi, const void *buf, int pnum, int offset,
 		 int len)
 {
-	int err;
+	int err, fg;
 	size_t written;
 	loff_t addr;
 
@@ -267,7 +302,9 @@ int ubi_io_write(struct ubi_device *ubi, const void *buf, int pnum, int offset,
 	}
 
 	addr = (loff_t)pnum * ubi->peb_size + offset;
+	fg = fg_io_begin(ubi);
 	err = ubi->mtd->write(ubi->mtd, addr, len, &written, buf);
+	fg_io_end(ubi, fg);
 	if (err) {
 		ubi_err("error %d while writing %d bytes to PEB %d:%d, written"
 			" %zd bytes", err, len, pnum, offset, written);
@@ -301,7 +338,7 @@ static void erase_callback(struct erase_info *ei)
  */
 static int do_sync_erase(struct ubi_device *ubi, int pnum)
 {
-	int err, retries = 0;
+	int err, fg, retries = 0;
 	struct erase_info ei;
 	wait_queue_head_t wq;
 
@@ -317,7 +354,9 @@ retry:
 	ei.callback = erase_callback;
 	ei.priv     = (unsigned long)&wq;
 
+	fg = fg_io_begin(ubi);
 	err = ubi->mtd->erase(ubi->mtd, &ei);
+	fg_io_end(ubi, fg);
 	if (err) {
 		if (retries++ < UBI_IO_RETRIES) {
 			dbg_io("error %d while erasing PEB %d, retry",
@@ -558,6 +597,30 @@ int ubi_io_mark_bad(const struct ubi_device *ubi, int pnum)
 	return err;
 }
 
+/**
+ * ubi_io_yield - let foreground I/O go first.
+ * @ubi: UBI device description object
+ *
+ * Long background operations, like moving a logical eraseblock, call this
+ * function between I/O units, so that foreground I/O waiting for the flash
+ * does not have to wait until the whole operation is finished. Foreground I/O
+ * may keep coming, so the wait is limited. Returns %0 if the wait timed out,
+ * in which case the caller should stop yielding, and %1 otherwise.
+ */
+int ubi_io_yield(struct ubi_device *ubi)
+{
+	if (!atomic_read(&ubi->fg_ops))
+		return 1;
+
+	ubi->wl_stats.yields += 1;
+	if (!wait_event_timeout(ubi->fg_wait, !atomic_read(&ubi->fg_ops),
+				IO_YIELD_TIME)) {
+		ubi->wl_stats.yield_timeouts += 1;
+		return 0;
+	}
+	return 1;
+}
+
 /**
  * validate_ec_hdr - validate an erase counter header.
  * @ubi: UBI device description object
@@ -1108,7 +1171,7 @@ fail:
  * This function returns zero if the erase counter header is all right, %1 if
  * not, and a negative error code if an error occurred.
  */
-static int paranoid_check_peb_ec_hdr(const struct ubi_device *ubi, int pnum)
+static int paranoid_check_peb_ec_hdr(struct ubi_device *ubi, int pnum)
 {
 	int err;
 	uint32_t crc, hdr_crc;
@@ -1186,7 +1249,7 @@ fail:
  * This function returns zero if the volume identifier header is all right,
  * %1 if not, and a negative error code if an error occurred.
  */
-static int paranoid_check_peb_vid_hdr(const struct ubi_device *ubi, int pnum)
+static int paranoid_check_peb_vid_hdr(struct ubi_device *ubi, int pnum)
 {
 	int err;
 	uint32_t crc, hdr_crc;
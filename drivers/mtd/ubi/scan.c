@@ -56,7 +56,7 @@ static struct ubi_ec_hdr *ech;
 static struct ubi_vid_hdr *vidh;
 
 /**
- * add_to_list - add physical eraseblock to a list.
+ * ubi_scan_add_to_list - add physical eraseblock to a list.
  * @si: scanning information
  * @pnum: physical eraseblock number to add
  * @ec: erase counter of the physical eraseblock
@@ -66,8 +66,8 @@ static struct ubi_vid_hdr *vidh;
  * alien lists. Returns zero in case of success and a negative error code in
  * case of failure.
  */
-static int add_to_list(struct ubi_scan_info *si, int pnum, int ec,
-		       struct list_head *list)
+int ubi_scan_add_to_list(struct ubi_scan_info *si, int pnum, int ec,
+			 struct list_head *list)
 {
 	struct ubi_scan_leb *seb;
 
@@ -458,11 +458,11 @@ int ubi_scan_add_used(struct ubi_device *ubi, struct ubi_scan_info *si,
 				return err;
 
 			if (cmp_res & 4)
-				err = add_to_list(si, seb->pnum, seb->ec,
-						  &si->corr);
+				err = ubi_scan_add_to_list(si, seb->pnum,
+							   seb->ec, &si->corr);
 			else
-				err = add_to_list(si, seb->pnum, seb->ec,
-						  &si->erase);
+				err = ubi_scan_add_to_list(si, seb->pnum,
+							   seb->ec, &si->erase);
 			if (err)
 				return err;
 
@@ -482,9 +482,11 @@ int ubi_scan_add_used(struct ubi_device *ubi, struct ubi_scan_info *si,
 			 * previously.
 			 */
 			if (cmp_res & 4)
-				return add_to_list(si, pnum, ec, &si->corr);
+				return ubi_scan_add_to_list(si, pnum, ec,
+							    &si->corr);
 			else
-				return add_to_list(si, pnum, ec, &si->erase);
+				return ubi_scan_add_to_list(si, pnum, ec,
+							    &si->erase);
 		}
 	}
 
@@ -664,6 +666,18 @@ struct ubi_scan_leb *ubi_scan_get_free_peb(struct ubi_device *ubi,
 	int err = 0, i;
 	struct ubi_scan_leb *seb;
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/*
+	 * The eraseblock we return is about to be written, which makes the
+	 * fastmap we attached from lie about it.
+	 */
+	if (si->fm_pnum >= 0) {
+		err = ubi_scan_drop_fastmap(ubi, si);
+		if (err)
+			return ERR_PTR(err);
+	}
+#endif
+
 	if (!list_empty(&si->free)) {
 		seb = list_entry(si->free.next, struct ubi_scan_leb, u.list);
 		list_del(&seb->u.list);
@@ -706,16 +720,19 @@ struct ubi_scan_leb *ubi_scan_get_free_peb(struct ubi_device *ubi,
 }
 
 /**
- * process_eb - read, check UBI headers, and add them to scanning information.
+ * ubi_scan_process_eb - read and check UBI headers of an eraseblock.
  * @ubi: UBI device description object
  * @si: scanning information
  * @pnum: the physical eraseblock number
  *
- * This function returns a zero if the physical eraseblock was successfully
- * handled and a negative error code in case of failure.
+ * This function reads the UBI headers of physical eraseblock @pnum and adds
+ * it to the scanning information. It uses the header buffers of 'ubi_scan()'
+ * and may only be called while it runs. This function returns a zero if the
+ * physical eraseblock was successfully handled and a negative error code in
+ * case of failure.
  */
-static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
-		      int pnum)
+int ubi_scan_process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
+			int pnum)
 {
 	long long uninitialized_var(ec);
 	int err, bitflips = 0, vol_id, ec_corr = 0;
@@ -742,7 +759,8 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 	else if (err == UBI_IO_BITFLIPS)
 		bitflips = 1;
 	else if (err == UBI_IO_PEB_EMPTY)
-		return add_to_list(si, pnum, UBI_SCAN_UNKNOWN_EC, &si->erase);
+		return ubi_scan_add_to_list(si, pnum, UBI_SCAN_UNKNOWN_EC,
+					    &si->erase);
 	else if (err == UBI_IO_BAD_EC_HDR) {
 		/*
 		 * We have to also look at the VID header, possibly it is not
@@ -790,13 +808,13 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 	else if (err == UBI_IO_BAD_VID_HDR ||
 		 (err == UBI_IO_PEB_FREE && ec_corr)) {
 		/* VID header is corrupted */
-		err = add_to_list(si, pnum, ec, &si->corr);
+		err = ubi_scan_add_to_list(si, pnum, ec, &si->corr);
 		if (err)
 			return err;
 		goto adjust_mean_ec;
 	} else if (err == UBI_IO_PEB_FREE) {
 		/* No VID header - the physical eraseblock is free */
-		err = add_to_list(si, pnum, ec, &si->free);
+		err = ubi_scan_add_to_list(si, pnum, ec, &si->free);
 		if (err)
 			return err;
 		goto adjust_mean_ec;
@@ -811,7 +829,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		case UBI_COMPAT_DELETE:
 			ubi_msg("\"delete\" compatible internal volume %d:%d"
 				" found, remove it", vol_id, lnum);
-			err = add_to_list(si, pnum, ec, &si->corr);
+			err = ubi_scan_add_to_list(si, pnum, ec, &si->corr);
 			if (err)
 				return err;
 			break;
@@ -826,7 +844,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		case UBI_COMPAT_PRESERVE:
 			ubi_msg("\"preserve\" compatible internal volume %d:%d"
 				" found", vol_id, lnum);
-			err = add_to_list(si, pnum, ec, &si->alien);
+			err = ubi_scan_add_to_list(si, pnum, ec, &si->alien);
 			if (err)
 				return err;
 			si->alien_peb_count += 1;
@@ -857,12 +875,39 @@ adjust_mean_ec:
 	return 0;
 }
 
+/**
+ * alloc_si - allocate and initialize an empty scanning information object.
+ *
+ * Returns %NULL if there is not enough memory.
+ */
+static struct ubi_scan_info *alloc_si(void)
+{
+	struct ubi_scan_info *si;
+
+	si = kzalloc(sizeof(struct ubi_scan_info), GFP_KERNEL);
+	if (!si)
+		return NULL;
+
+	INIT_LIST_HEAD(&si->corr);
+	INIT_LIST_HEAD(&si->free);
+	INIT_LIST_HEAD(&si->erase);
+	INIT_LIST_HEAD(&si->alien);
+	si->volumes = RB_ROOT;
+	si->is_empty = 1;
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	si->fm_pnum = -1;
+#endif
+	return si;
+}
+
 /**
  * ubi_scan - scan an MTD device.
  * @ubi: UBI device description object
  *
  * This function does full scanning of an MTD device and returns complete
- * information about it. In case of failure, an error code is returned.
+ * information about it. If the device contains a usable fastmap, only the
+ * eraseblocks which may have changed since the fastmap was written are
+ * scanned. In case of failure, an error code is returned.
  */
 struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 {
@@ -872,17 +917,10 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 	struct ubi_scan_leb *seb;
 	struct ubi_scan_info *si;
 
-	si = kzalloc(sizeof(struct ubi_scan_info), GFP_KERNEL);
+	si = alloc_si();
 	if (!si)
 		return ERR_PTR(-ENOMEM);
 
-	INIT_LIST_HEAD(&si->corr);
-	INIT_LIST_HEAD(&si->free);
-	INIT_LIST_HEAD(&si->erase);
-	INIT_LIST_HEAD(&si->alien);
-	si->volumes = RB_ROOT;
-	si->is_empty = 1;
-
 	err = -ENOMEM;
 	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
 	if (!ech)
@@ -892,15 +930,34 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 	if (!vidh)
 		goto out_ech;
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	err = ubi_scan_fastmap(ubi, si);
+	if (err < 0)
+		goto out_vidh;
+	if (err == 0)
+		goto scanned;
+
+	/* No usable fastmap, start from scratch */
+	ubi_scan_destroy_si(si);
+	si = alloc_si();
+	if (!si) {
+		err = -ENOMEM;
+		goto out_vidh_nosi;
+	}
+#endif
+
 	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
 		cond_resched();
 
 		dbg_gen("process PEB %d", pnum);
-		err = process_eb(ubi, si, pnum);
+		err = ubi_scan_process_eb(ubi, si, pnum);
 		if (err < 0)
 			goto out_vidh;
 	}
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+scanned:
+#endif
 	dbg_msg("scanning is finished");
 
 	/* Calculate mean erase counter */
@@ -948,7 +1005,14 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 	return si;
 
 out_vidh:
+	ubi_scan_destroy_si(si);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+out_vidh_nosi:
+#endif
 	ubi_free_vid_hdr(ubi, vidh);
+	kfree(ech);
+	return ERR_PTR(err);
+
 out_ech:
 	kfree(ech);
 out_si:
@@ -1038,6 +1102,9 @@ void ubi_scan_destroy_si(struct ubi_scan_info *si)
 		}
 	}
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	kfree(si->fm_used);
+#endif
 	kfree(si);
 }
 
@@ -1200,7 +1267,12 @@ static int paranoid_check_si(struct ubi_device *ubi, struct ubi_scan_info *si)
 				goto bad_vid_hdr;
 			}
 
-			if (seb->sqnum != be64_to_cpu(vidh->sqnum)) {
+			/*
+			 * Eraseblocks taken from the fastmap carry no sequence
+			 * number, see 'ubi_scan_fastmap()'.
+			 */
+			if (seb->sqnum &&
+			    seb->sqnum != be64_to_cpu(vidh->sqnum)) {
 				ubi_err("bad sqnum %llu", seb->sqnum);
 				goto bad_vid_hdr;
 			}
@@ -1239,7 +1311,8 @@ static int paranoid_check_si(struct ubi_device *ubi, struct ubi_scan_info *si)
 			goto bad_vid_hdr;
 		}
 
-		if (sv->last_data_size != be32_to_cpu(vidh->data_size)) {
+		if (last_seb->sqnum &&
+		    sv->last_data_size != be32_to_cpu(vidh->data_size)) {
 			ubi_err("bad last_data_size %d", sv->last_data_size);
 			goto bad_vid_hdr;
 		}
@@ -1278,6 +1351,11 @@ static int paranoid_check_si(struct ubi_device *ubi, struct ubi_scan_info *si)
 	list_for_each_entry(seb, &si->alien, u.list)
 		buf[seb->pnum] = 1;
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	if (si->fm_pnum >= 0)
+		buf[si->fm_pnum] = 1;
+#endif
+
 	err = 0;
 	for (pnum = 0; pnum < ubi->peb_count; pnum++)
 		if (!buf[pnum]) {
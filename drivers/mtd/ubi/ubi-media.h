@@ -302,6 +302,17 @@ struct ubi_vid_hdr {
 #define UBI_LAYOUT_VOLUME_NAME   "layout volume"
 #define UBI_LAYOUT_VOLUME_COMPAT UBI_COMPAT_REJECT
 
+/*
+ * The fastmap internal volume. Its only eraseblock (the "anchor") contains a
+ * checkpoint of the state of all physical eraseblocks, which allows attaching
+ * the device without scanning all of it. The anchor is always one of the first
+ * %UBI_FM_MAX_START physical eraseblocks. UBI implementations without fastmap
+ * support just delete it. See fastmap.c for more details.
+ */
+#define UBI_FM_VOLUME_ID     (UBI_INTERNAL_VOL_START + 1)
+#define UBI_FM_VOLUME_COMPAT UBI_COMPAT_DELETE
+#define UBI_FM_MAX_START     64
+
 /* The maximum number of volumes per one UBI device */
 #define UBI_MAX_VOLUMES 128
 
@@ -365,4 +376,108 @@ struct ubi_vtbl_record {
 	__be32  crc;
 } __attribute__ ((packed));
 
+/* Fastmap header magic number (ASCII "UBIF") */
+#define UBI_FM_HDR_MAGIC 0x55424946
+
+/* The version of the fastmap format */
+#define UBI_FM_VERSION 1
+
+/* Size of the fastmap header without the ending CRC */
+#define UBI_FM_HDR_SIZE_CRC (sizeof(struct ubi_fm_hdr) - sizeof(__be32))
+
+/*
+ * Physical eraseblock states used in the fastmap.
+ *
+ * @UBI_FM_PEB_FREE: the physical eraseblock is erased and has a valid erase
+ *                   counter header
+ * @UBI_FM_PEB_USED: the physical eraseblock contains a logical eraseblock
+ * @UBI_FM_PEB_SCRUB: like %UBI_FM_PEB_USED, but bit-flips were seen in it
+ * @UBI_FM_PEB_ERASE: the physical eraseblock has to be erased
+ * @UBI_FM_PEB_SCAN: the contents is unknown, the headers have to be read when
+ *                   the device is attached
+ * @UBI_FM_PEB_BAD: the physical eraseblock is bad
+ * @UBI_FM_PEB_ANCHOR: the physical eraseblock holds this fastmap
+ */
+enum {
+	UBI_FM_PEB_FREE   = 1,
+	UBI_FM_PEB_USED   = 2,
+	UBI_FM_PEB_SCRUB  = 3,
+	UBI_FM_PEB_ERASE  = 4,
+	UBI_FM_PEB_SCAN   = 5,
+	UBI_FM_PEB_BAD    = 6,
+	UBI_FM_PEB_ANCHOR = 7
+};
+
+/**
+ * struct ubi_fm_hdr - fastmap header.
+ * @magic: fastmap header magic number (%UBI_FM_HDR_MAGIC)
+ * @version: version of the fastmap format (%UBI_FM_VERSION)
+ * @padding1: reserved for future, zeroes
+ * @peb_count: count of physical eraseblocks described by this fastmap
+ * @leb_size: logical eraseblock size of the device
+ * @vol_count: count of &struct ubi_fm_volume records
+ * @data_size: size of the volume records and the eraseblock table
+ * @data_crc: CRC32 checksum of the volume records and the eraseblock table
+ * @sqnum: value of the global sequence counter when this fastmap was written
+ * @padding2: reserved for future, zeroes
+ * @hdr_crc: fastmap header CRC checksum
+ *
+ * The fastmap is stored in the data area of the anchor physical eraseblock.
+ * The header is followed by @vol_count volume records and then by @peb_count
+ * &struct ubi_fm_peb objects, one for each physical eraseblock of the device.
+ */
+struct ubi_fm_hdr {
+	__be32  magic;
+	__u8    version;
+	__u8    padding1[3];
+	__be32  peb_count;
+	__be32  leb_size;
+	__be32  vol_count;
+	__be32  data_size;
+	__be32  data_crc;
+	__be64  sqnum;
+	__u8    padding2[24];
+	__be32  hdr_crc;
+} __attribute__ ((packed));
+
+/**
+ * struct ubi_fm_volume - fastmap volume record.
+ * @vol_id: volume ID
+ * @used_ebs: total number of used logical eraseblocks in this volume
+ * @last_eb_bytes: how many bytes are stored in the last logical eraseblock
+ * @data_pad: how many bytes at the end of physical eraseblocks are not used
+ * @vol_type: volume type (%UBI_VID_DYNAMIC or %UBI_VID_STATIC)
+ * @compat: compatibility of this volume (the @compat field of its VID headers)
+ * @padding: reserved for future, zeroes
+ *
+ * These records provide the information which is otherwise taken from the VID
+ * headers of the logical eraseblocks of the volume.
+ */
+struct ubi_fm_volume {
+	__be32  vol_id;
+	__be32  used_ebs;
+	__be32  last_eb_bytes;
+	__be32  data_pad;
+	__u8    vol_type;
+	__u8    compat;
+	__u8    padding[6];
+} __attribute__ ((packed));
+
+/**
+ * struct ubi_fm_peb - fastmap physical eraseblock record.
+ * @ec: the erase counter
+ * @vol_id: volume ID (only for %UBI_FM_PEB_USED and %UBI_FM_PEB_SCRUB)
+ * @lnum: logical eraseblock number (only for %UBI_FM_PEB_USED and
+ *        %UBI_FM_PEB_SCRUB)
+ * @state: state of the physical eraseblock (%UBI_FM_PEB_FREE, etc)
+ * @padding: reserved for future, zeroes
+ */
+struct ubi_fm_peb {
+	__be32  ec;
+	__be32  vol_id;
+	__be32  lnum;
+	__u8    state;
+	__u8    padding[3];
+} __attribute__ ((packed));
+
 #endif /* !__UBI_MEDIA_H__ */
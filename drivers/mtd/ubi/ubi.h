@@ -109,6 +109,30 @@ struct ubi_wl_entry {
 	int pnum;
 };
 
+/**
+ * struct ubi_wl_stats - wear-leveling sub-system statistics.
+ * @max_works: maximum count of pending works seen
+ * @erases: count of physical eraseblocks erased by the erase worker
+ * @moves: count of logical eraseblocks moved by the wear-leveling worker
+ * @defers: how many times the background thread postponed pending works
+ *          because of foreground I/O
+ * @defer_time: total time pending works were postponed, in jiffies
+ * @yields: how many times a move waited for foreground I/O
+ * @yield_timeouts: how many of these waits timed out
+ *
+ * The counters are not serialized, they are only meant for debugging and
+ * tuning.
+ */
+struct ubi_wl_stats {
+	int max_works;
+	unsigned long erases;
+	unsigned long moves;
+	unsigned long defers;
+	unsigned long defer_time;
+	unsigned long yields;
+	unsigned long yield_timeouts;
+};
+
 /**
  * struct ubi_ltree_entry - an entry in the lock tree.
  * @rb: links RB-tree nodes
@@ -326,6 +350,27 @@ struct ubi_wl_entry;
  * @bgt_thread: background thread description object
  * @thread_enabled: if the background thread is enabled
  * @bgt_name: background thread name
+ * @fg_ops: count of foreground I/O operations in progress
+ * @fg_last: time the last foreground I/O operation finished, in jiffies
+ * @fg_wait: wait queue to wait for foreground I/O to finish
+ * @wl_stats: wear-leveling statistics
+ *
+ * @fm_pool: RB-tree of free physical eraseblocks new eraseblocks are taken
+ *           from while the fastmap is used
+ * @fm_staged: physical eraseblocks which become @fm_pool once the fastmap
+ *             which is being written is on the flash
+ * @fm_staged_count: count of physical eraseblocks in @fm_staged
+ * @fm_pool_max: maximum size of the pool
+ * @fm_anchor: physical eraseblock holding the current fastmap
+ * @fm_new: physical eraseblock the new fastmap is being written to
+ * @fm_next: free physical eraseblock reserved for the next fastmap
+ * @fm_used: physical eraseblocks the current fastmap reports as used
+ * @fm_mapped: temporary bitmap used when writing the fastmap
+ * @fm_works: erasure works deferred until the next fastmap is written
+ * @fm_mutex: serializes fastmap writing
+ * @fm_disabled: non-zero if the fastmap is not used
+ * @fm_buf: buffer the fastmap is built in
+ * @fm_size: size of the fastmap in bytes
  *
  * @flash_size: underlying MTD device size (in bytes)
  * @peb_count: count of physical eraseblocks on the MTD device
@@ -356,6 +401,8 @@ struct ubi_wl_entry;
  * @mult_mutex: serializes operations on multiple volumes, like re-nameing
  * @dbg_peb_buf: buffer of PEB size used for debugging
  * @dbg_buf_mutex: proptects @dbg_peb_buf
+ * @dfs_dir: debugfs directory of this UBI device
+ * @dfs_wl_stats: debugfs file with the wear-leveling statistics
  */
 struct ubi_device {
 	struct cdev cdev;
@@ -410,6 +457,28 @@ struct ubi_device {
 	struct task_struct *bgt_thread;
 	int thread_enabled;
 	char bgt_name[sizeof(UBI_BGT_NAME_PATTERN)+2];
+	atomic_t fg_ops;
+	unsigned long fg_last;
+	wait_queue_head_t fg_wait;
+	struct ubi_wl_stats wl_stats;
+
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/* Fastmap stuff */
+	struct rb_root fm_pool;
+	struct ubi_wl_entry **fm_staged;
+	int fm_staged_count;
+	int fm_pool_max;
+	struct ubi_wl_entry *fm_anchor;
+	struct ubi_wl_entry *fm_new;
+	struct ubi_wl_entry *fm_next;
+	unsigned long *fm_used;
+	unsigned long *fm_mapped;
+	struct list_head fm_works;
+	struct mutex fm_mutex;
+	int fm_disabled;
+	void *fm_buf;
+	int fm_size;
+#endif
 
 	/* I/O sub-system's stuff */
 	long long flash_size;
@@ -438,6 +507,8 @@ struct ubi_device {
 #ifdef CONFIG_MTD_UBI_DEBUG
 	void *dbg_peb_buf;
 	struct mutex dbg_buf_mutex;
+	struct dentry *dfs_dir;
+	struct dentry *dfs_wl_stats;
 #endif
 };
 
@@ -491,6 +562,7 @@ void ubi_gluebi_updated(struct ubi_volume *vol);
 #endif
 
 /* eba.c */
+unsigned long long ubi_next_sqnum(struct ubi_device *ubi);
 int ubi_eba_unmap_leb(struct ubi_device *ubi, struct ubi_volume *vol,
 		      int lnum);
 int ubi_eba_read_leb(struct ubi_device *ubi, struct ubi_volume *vol, int lnum,
@@ -514,9 +586,27 @@ int ubi_wl_scrub_peb(struct ubi_device *ubi, int pnum);
 int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
 void ubi_wl_close(struct ubi_device *ubi);
 int ubi_thread(void *u);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+int ubi_wl_fm_prepare(struct ubi_device *ubi, struct ubi_fm_peb *fmpeb);
+void ubi_wl_fm_finish(struct ubi_device *ubi, const struct ubi_fm_peb *fmpeb,
+		      int err);
+void ubi_wl_fm_disable(struct ubi_device *ubi);
+#endif
+
+/* fastmap.c */
+#ifdef CONFIG_MTD_UBI_FASTMAP
+int ubi_fm_size(const struct ubi_device *ubi);
+int ubi_update_fastmap(struct ubi_device *ubi);
+int ubi_refill_pool(struct ubi_device *ubi);
+int ubi_scan_fastmap(struct ubi_device *ubi, struct ubi_scan_info *si);
+int ubi_scan_drop_fastmap(struct ubi_device *ubi, struct ubi_scan_info *si);
+#else
+static inline int ubi_update_fastmap(struct ubi_device *ubi) { return 0; }
+static inline int ubi_refill_pool(struct ubi_device *ubi) { return 0; }
+#endif
 
 /* io.c */
-int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
+int ubi_io_read(struct ubi_device *ubi, void *buf, int pnum, int offset,
 		int len);
 int ubi_io_write(struct ubi_device *ubi, const void *buf, int pnum, int offset,
 		 int len);
@@ -531,6 +621,7 @@ int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 			struct ubi_vid_hdr *vid_hdr, int verbose);
 int ubi_io_write_vid_hdr(struct ubi_device *ubi, int pnum,
 			 struct ubi_vid_hdr *vid_hdr);
+int ubi_io_yield(struct ubi_device *ubi);
 
 /* build.c */
 int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset);
@@ -599,7 +690,7 @@ static inline void ubi_free_vid_hdr(const struct ubi_device *ubi,
  * the beginning of the logical eraseblock, not to the beginning of the
  * physical eraseblock.
  */
-static inline int ubi_io_read_data(const struct ubi_device *ubi, void *buf,
+static inline int ubi_io_read_data(struct ubi_device *ubi, void *buf,
 				   int pnum, int offset, int len)
 {
 	ubi_assert(offset >= 0);
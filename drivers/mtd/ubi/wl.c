@@ -71,6 +71,13 @@
  * pick target PEB with an average EC if our PEB is not very "old". This is a
  * room for future re-works of the WL sub-system.
  *
+ * Erasures and moves are done by the background thread, which gets out of the
+ * way of foreground I/O: it starts pending works only once the flash has been
+ * idle for a while, so that they are done in batches during idle periods, and
+ * moves let foreground I/O go first between minimal I/O units. Nothing
+ * depends on the background thread making progress, because 'ubi_wl_get_peb()'
+ * does pending works itself if it runs out of free physical eraseblocks.
+ *
  * Note: the stuff with protection trees looks too complex and is difficult to
  * understand. Should be fixed.
  */
@@ -119,6 +126,24 @@
  */
 #define WL_MAX_FAILURES 32
 
+/*
+ * The background thread starts pending works only after there has been no
+ * foreground I/O for %BGT_IDLE_TIME. It does not postpone works for longer
+ * than %BGT_MAX_DEFER, nor when %BGT_MAX_WORKS or more works are pending.
+ */
+#define BGT_IDLE_TIME (HZ/20)
+#define BGT_MAX_DEFER (HZ/2)
+#define BGT_MAX_WORKS 32
+
+/*
+ * How many free physical eraseblocks are handed over to the pool at a time
+ * when the fastmap is used, and how many physical eraseblocks are reserved
+ * for the fastmap itself (the anchor and the next anchor).
+ */
+#define FM_MIN_POOL 8
+#define FM_MAX_POOL 256
+#define FM_RESERVED_PEBS 2
+
 /**
  * struct ubi_wl_prot_entry - PEB protection entry.
  * @rb_pnum: link in the @wl->prot.pnum RB-tree
@@ -203,6 +228,39 @@ static int paranoid_check_in_wl_tree(struct ubi_wl_entry *e,
 #define paranoid_check_in_wl_tree(e, root)
 #endif
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+/**
+ * alloc_root - get the RB-tree new physical eraseblocks are taken from.
+ * @ubi: UBI device description object
+ *
+ * While the fastmap is in use, only the physical eraseblocks of the pool may
+ * be handed out, because only those are scanned when the device is attached.
+ * @ubi->wl_lock has to be locked.
+ */
+static struct rb_root *alloc_root(struct ubi_device *ubi)
+{
+	if (ubi->fm_disabled)
+		return &ubi->free;
+	return &ubi->fm_pool;
+}
+
+/**
+ * pool_refillable - check if a new fastmap would provide a non-empty pool.
+ * @ubi: UBI device description object
+ *
+ * @ubi->wl_lock has to be locked.
+ */
+static int pool_refillable(struct ubi_device *ubi)
+{
+	if (ubi->fm_disabled)
+		return 0;
+	return ubi->free.rb_node || !list_empty(&ubi->fm_works);
+}
+#else
+#define alloc_root(ubi) (&(ubi)->free)
+#define pool_refillable(ubi) 0
+#endif
+
 /**
  * wl_tree_add - add a wear-leveling entry to a WL RB-tree.
  * @e: the wear-leveling entry to add
@@ -446,6 +504,7 @@ int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
 	int err, protect, medium_ec;
 	struct ubi_wl_entry *e, *first, *last;
 	struct ubi_wl_prot_entry *pe;
+	struct rb_root *root;
 
 	ubi_assert(dtype == UBI_LONGTERM || dtype == UBI_SHORTTERM ||
 		   dtype == UBI_UNKNOWN);
@@ -456,7 +515,19 @@ int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
 
 retry:
 	spin_lock(&ubi->wl_lock);
-	if (!ubi->free.rb_node) {
+	root = alloc_root(ubi);
+	if (!root->rb_node) {
+		if (pool_refillable(ubi)) {
+			/* The pool is used up, write a new fastmap */
+			spin_unlock(&ubi->wl_lock);
+			err = ubi_refill_pool(ubi);
+			if (err) {
+				kfree(pe);
+				return err;
+			}
+			goto retry;
+		}
+
 		if (ubi->works_count == 0) {
 			ubi_assert(list_empty(&ubi->works));
 			ubi_err("no free eraseblocks");
@@ -482,7 +553,7 @@ retry:
 		 * bounded by the the lowest erase counter plus
 		 * %WL_FREE_MAX_DIFF.
 		 */
-		e = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		e = find_wl_entry(root, WL_FREE_MAX_DIFF);
 		protect = LT_PROTECTION;
 		break;
 	case UBI_UNKNOWN:
@@ -492,15 +563,14 @@ retry:
 		 * eraseblock with erase counter greater or equivalent than the
 		 * lowest erase counter plus %WL_FREE_MAX_DIFF.
 		 */
-		first = rb_entry(rb_first(&ubi->free), struct ubi_wl_entry, rb);
-		last = rb_entry(rb_last(&ubi->free), struct ubi_wl_entry, rb);
+		first = rb_entry(rb_first(root), struct ubi_wl_entry, rb);
+		last = rb_entry(rb_last(root), struct ubi_wl_entry, rb);
 
 		if (last->ec - first->ec < WL_FREE_MAX_DIFF)
-			e = rb_entry(ubi->free.rb_node,
-					struct ubi_wl_entry, rb);
+			e = rb_entry(root->rb_node, struct ubi_wl_entry, rb);
 		else {
 			medium_ec = (first->ec + WL_FREE_MAX_DIFF)/2;
-			e = find_wl_entry(&ubi->free, medium_ec);
+			e = find_wl_entry(root, medium_ec);
 		}
 		protect = U_PROTECTION;
 		break;
@@ -509,7 +579,7 @@ retry:
 		 * For short term data we pick a physical eraseblock with the
 		 * lowest erase counter as we expect it will be erased soon.
 		 */
-		e = rb_entry(rb_first(&ubi->free), struct ubi_wl_entry, rb);
+		e = rb_entry(rb_first(root), struct ubi_wl_entry, rb);
 		protect = ST_PROTECTION;
 		break;
 	default:
@@ -522,8 +592,8 @@ retry:
 	 * Move the physical eraseblock to the protection trees where it will
 	 * be protected from being moved for some time.
 	 */
-	paranoid_check_in_wl_tree(e, &ubi->free);
-	rb_erase(&e->rb, &ubi->free);
+	paranoid_check_in_wl_tree(e, root);
+	rb_erase(&e->rb, root);
 	prot_tree_add(ubi, e, pe, protect);
 
 	dbg_wl("PEB %d EC %d, protection %d", e->pnum, e->ec, protect);
@@ -689,6 +759,8 @@ static void schedule_ubi_work(struct ubi_device *ubi, struct ubi_work *wrk)
 	list_add_tail(&wrk->list, &ubi->works);
 	ubi_assert(ubi->works_count >= 0);
 	ubi->works_count += 1;
+	if (ubi->works_count > ubi->wl_stats.max_works)
+		ubi->wl_stats.max_works = ubi->works_count;
 	if (ubi->thread_enabled)
 		wake_up_process(ubi->bgt_thread);
 	spin_unlock(&ubi->wl_lock);
@@ -722,6 +794,21 @@ static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
 	wl_wrk->e = e;
 	wl_wrk->torture = torture;
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	spin_lock(&ubi->wl_lock);
+	if (!ubi->fm_disabled && test_bit(e->pnum, ubi->fm_used)) {
+		/*
+		 * The fastmap on the flash still says this PEB contains data,
+		 * so it must not be erased before a new fastmap is written.
+		 */
+		dbg_wl("defer erasure of PEB %d", e->pnum);
+		list_add_tail(&wl_wrk->list, &ubi->fm_works);
+		spin_unlock(&ubi->wl_lock);
+		return 0;
+	}
+	spin_unlock(&ubi->wl_lock);
+#endif
+
 	schedule_ubi_work(ubi, wl_wrk);
 	return 0;
 }
@@ -743,6 +830,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	struct ubi_wl_prot_entry *uninitialized_var(pe);
 	struct ubi_wl_entry *e1, *e2;
 	struct ubi_vid_hdr *vid_hdr;
+	struct rb_root *root;
 
 	kfree(wrk);
 
@@ -758,12 +846,14 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	ubi_assert(!ubi->move_from && !ubi->move_to);
 	ubi_assert(!ubi->move_to_put);
 
-	if (!ubi->free.rb_node ||
+	root = alloc_root(ubi);
+	if (!root->rb_node ||
 	    (!ubi->used.rb_node && !ubi->scrub.rb_node)) {
 		/*
 		 * No free physical eraseblocks? Well, they must be waiting in
-		 * the queue to be erased. Cancel movement - it will be
-		 * triggered again when a free physical eraseblock appears.
+		 * the queue to be erased, or the fastmap pool is used up.
+		 * Cancel movement - it will be triggered again when a free
+		 * physical eraseblock appears.
 		 *
 		 * No used physical eraseblocks? They must be temporarily
 		 * protected from being moved. They will be moved to the
@@ -771,7 +861,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * triggered again.
 		 */
 		dbg_wl("cancel WL, a list is empty: free %d, used %d",
-		       !ubi->free.rb_node, !ubi->used.rb_node);
+		       !root->rb_node, !ubi->used.rb_node);
 		goto out_cancel;
 	}
 
@@ -782,7 +872,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * counters differ much enough, start wear-leveling.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		e2 = find_wl_entry(root, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD)) {
 			dbg_wl("no WL needed: min used EC %d, max free EC %d",
@@ -797,14 +887,14 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		/* Perform scrubbing */
 		scrubbing = 1;
 		e1 = rb_entry(rb_first(&ubi->scrub), struct ubi_wl_entry, rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		e2 = find_wl_entry(root, WL_FREE_MAX_DIFF);
 		paranoid_check_in_wl_tree(e1, &ubi->scrub);
 		rb_erase(&e1->rb, &ubi->scrub);
 		dbg_wl("scrub PEB %d to PEB %d", e1->pnum, e2->pnum);
 	}
 
-	paranoid_check_in_wl_tree(e2, &ubi->free);
-	rb_erase(&e2->rb, &ubi->free);
+	paranoid_check_in_wl_tree(e2, root);
+	rb_erase(&e2->rb, root);
 	ubi->move_from = e1;
 	ubi->move_to = e2;
 	spin_unlock(&ubi->wl_lock);
@@ -875,6 +965,8 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	spin_lock(&ubi->wl_lock);
 	if (protect)
 		prot_tree_add(ubi, e1, pe, protect);
+	else
+		ubi->wl_stats.moves += 1;
 	if (!ubi->move_to_put)
 		wl_tree_add(e2, &ubi->used);
 	else
@@ -967,6 +1059,7 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 	struct ubi_wl_entry *e1;
 	struct ubi_wl_entry *e2;
 	struct ubi_work *wrk;
+	struct rb_root *root;
 
 	spin_lock(&ubi->wl_lock);
 	if (ubi->wl_scheduled)
@@ -977,8 +1070,9 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 	 * If the ubi->scrub tree is not empty, scrubbing is needed, and the
 	 * the WL worker has to be scheduled anyway.
 	 */
+	root = alloc_root(ubi);
 	if (!ubi->scrub.rb_node) {
-		if (!ubi->used.rb_node || !ubi->free.rb_node)
+		if (!ubi->used.rb_node || !root->rb_node)
 			/* No physical eraseblocks - no deal */
 			goto out_unlock;
 
@@ -989,7 +1083,7 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 		 * %UBI_WL_THRESHOLD.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		e2 = find_wl_entry(root, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD))
 			goto out_unlock;
@@ -1051,6 +1145,7 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 
 		spin_lock(&ubi->wl_lock);
 		ubi->abs_ec += 1;
+		ubi->wl_stats.erases += 1;
 		wl_tree_add(e, &ubi->free);
 		spin_unlock(&ubi->wl_lock);
 
@@ -1067,7 +1162,6 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 
 	ubi_err("failed to erase PEB %d, error %d", pnum, err);
 	kfree(wl_wrk);
-	kmem_cache_free(ubi_wl_entry_slab, e);
 
 	if (err == -EINTR || err == -ENOMEM || err == -EAGAIN ||
 	    err == -EBUSY) {
@@ -1080,7 +1174,14 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 			goto out_ro;
 		}
 		return err;
-	} else if (err != -EIO) {
+	}
+
+	spin_lock(&ubi->wl_lock);
+	ubi->lookuptbl[pnum] = NULL;
+	spin_unlock(&ubi->wl_lock);
+	kmem_cache_free(ubi_wl_entry_slab, e);
+
+	if (err != -EIO) {
 		/*
 		 * If this is not %-EIO, we have no idea what to do. Scheduling
 		 * this physical eraseblock for erasure again would cause
@@ -1289,6 +1390,18 @@ int ubi_wl_flush(struct ubi_device *ubi)
 {
 	int err;
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/*
+	 * Erasures deferred because of the fastmap are only started when a new
+	 * fastmap is written.
+	 */
+	if (!list_empty(&ubi->fm_works)) {
+		err = ubi_update_fastmap(ubi);
+		if (err)
+			return err;
+	}
+#endif
+
 	/*
 	 * Erase while the pending works queue is not empty, but not more then
 	 * the number of currently pending works.
@@ -1352,13 +1465,24 @@ static void tree_destroy(struct rb_root *root)
 	}
 }
 
+/**
+ * fg_busy - check if there is foreground I/O going on.
+ * @ubi: UBI device description object
+ */
+static int fg_busy(struct ubi_device *ubi)
+{
+	return atomic_read(&ubi->fg_ops) ||
+	       time_before(jiffies, ubi->fg_last + BGT_IDLE_TIME);
+}
+
 /**
  * ubi_thread - UBI background thread.
  * @u: the UBI device description object pointer
  */
 int ubi_thread(void *u)
 {
-	int failures = 0;
+	int failures = 0, deferring = 0, works_count;
+	unsigned long defer_start = 0;
 	struct ubi_device *ubi = u;
 
 	ubi_msg("background thread \"%s\" started, PID %d",
@@ -1382,8 +1506,25 @@ int ubi_thread(void *u)
 			schedule();
 			continue;
 		}
+		works_count = ubi->works_count;
 		spin_unlock(&ubi->wl_lock);
 
+		if (works_count < BGT_MAX_WORKS && fg_busy(ubi)) {
+			if (!deferring) {
+				deferring = 1;
+				defer_start = jiffies;
+				ubi->wl_stats.defers += 1;
+			}
+			if (time_before(jiffies, defer_start + BGT_MAX_DEFER)) {
+				schedule_timeout_interruptible(BGT_IDLE_TIME);
+				continue;
+			}
+		}
+		if (deferring) {
+			ubi->wl_stats.defer_time += jiffies - defer_start;
+			deferring = 0;
+		}
+
 		err = do_work(ubi);
 		if (err) {
 			ubi_err("%s: work failed with error code %d",
@@ -1425,6 +1566,352 @@ static void cancel_pending(struct ubi_device *ubi)
 	}
 }
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+
+/**
+ * take_anchor - take a free PEB which may hold a fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function removes the least worn out free physical eraseblock among the
+ * first %UBI_FM_MAX_START ones from the free tree and returns it, or returns
+ * %NULL if there is none. @ubi->wl_lock has to be locked.
+ */
+static struct ubi_wl_entry *take_anchor(struct ubi_device *ubi)
+{
+	struct rb_node *rb;
+	struct ubi_wl_entry *e;
+
+	ubi_rb_for_each_entry(rb, e, &ubi->free, rb)
+		if (e->pnum < UBI_FM_MAX_START) {
+			rb_erase(&e->rb, &ubi->free);
+			return e;
+		}
+
+	return NULL;
+}
+
+/**
+ * fm_set_used - set the fastmap state of a used physical eraseblock.
+ * @ubi: UBI device description object
+ * @fmpeb: the fastmap eraseblock table
+ * @e: the physical eraseblock
+ * @state: %UBI_FM_PEB_USED or %UBI_FM_PEB_SCRUB
+ *
+ * A used physical eraseblock which is not referred to by the EBA table
+ * snapshot is being written to right now, so its headers have to be read when
+ * the device is attached.
+ */
+static void fm_set_used(struct ubi_device *ubi, struct ubi_fm_peb *fmpeb,
+			struct ubi_wl_entry *e, int state)
+{
+	if (test_bit(e->pnum, ubi->fm_mapped)) {
+		fmpeb[e->pnum].state = state;
+		/* Keep it from being erased until the fastmap is written */
+		__set_bit(e->pnum, ubi->fm_used);
+	} else
+		fmpeb[e->pnum].state = UBI_FM_PEB_SCAN;
+}
+
+/**
+ * ubi_wl_fm_prepare - prepare the WL sub-system for writing a fastmap.
+ * @ubi: UBI device description object
+ * @fmpeb: the fastmap eraseblock table
+ *
+ * This function picks the anchor for the new fastmap and the pool of free
+ * physical eraseblocks it publishes, and fills in the state and erase counter
+ * of every physical eraseblock in @fmpeb. The PEBs referred to by the EBA
+ * table have to be marked in @ubi->fm_mapped, and their volume ID and LEB
+ * number have to be set in @fmpeb by the caller.
+ *
+ * The caller has to hold @ubi->fm_mutex and @ubi->move_mutex, and has to call
+ * 'ubi_wl_fm_finish()' once the fastmap is written. This function returns the
+ * anchor physical eraseblock number in case of success and a negative error
+ * code in case of failure, in which case the fastmap has to be disabled.
+ */
+int ubi_wl_fm_prepare(struct ubi_device *ubi, struct ubi_fm_peb *fmpeb)
+{
+	int pnum, i, err;
+	struct rb_node *rb;
+	struct ubi_wl_entry *e;
+	struct ubi_wl_prot_entry *pe;
+
+	spin_lock(&ubi->wl_lock);
+	/* The pool of the current fastmap goes back to the free tree */
+	while (ubi->fm_pool.rb_node) {
+		e = rb_entry(rb_first(&ubi->fm_pool), struct ubi_wl_entry, rb);
+		rb_erase(&e->rb, &ubi->fm_pool);
+		wl_tree_add(e, &ubi->free);
+	}
+
+	e = ubi->fm_next;
+	ubi->fm_next = NULL;
+	if (!e)
+		e = take_anchor(ubi);
+	spin_unlock(&ubi->wl_lock);
+
+	if (!e) {
+		/*
+		 * No suitable free PEB, re-use the current anchor. There is no
+		 * valid fastmap on the flash until the new one is written, so
+		 * the device is fully scanned if we are interrupted.
+		 */
+		e = ubi->fm_anchor;
+		if (!e) {
+			ubi_err("no PEB for the fastmap");
+			return -ENOSPC;
+		}
+
+		err = sync_erase(ubi, e, 0);
+		if (err)
+			return err;
+		ubi->fm_anchor = NULL;
+	}
+	ubi->fm_new = e;
+
+	spin_lock(&ubi->wl_lock);
+	ubi->fm_next = take_anchor(ubi);
+
+	/*
+	 * Stage the new pool, mixing PEBs with low and with high erase counters
+	 * so that 'ubi_wl_get_peb()' has something to pick from.
+	 */
+	for (i = 0; i < ubi->fm_pool_max && ubi->free.rb_node; i++) {
+		if (i & 1)
+			e = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		else
+			e = rb_entry(rb_first(&ubi->free), struct ubi_wl_entry,
+				     rb);
+		rb_erase(&e->rb, &ubi->free);
+		ubi->fm_staged[i] = e;
+	}
+	ubi->fm_staged_count = i;
+
+	/*
+	 * Now describe all PEBs. Those which are not in any tree are either
+	 * waiting for erasure or are the old anchor.
+	 */
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		e = ubi->lookuptbl[pnum];
+		if (!e) {
+			fmpeb[pnum].state = UBI_FM_PEB_BAD;
+			continue;
+		}
+		fmpeb[pnum].ec = cpu_to_be32(e->ec);
+		fmpeb[pnum].state = UBI_FM_PEB_ERASE;
+	}
+
+	ubi_rb_for_each_entry(rb, e, &ubi->used, rb)
+		fm_set_used(ubi, fmpeb, e, UBI_FM_PEB_USED);
+	ubi_rb_for_each_entry(rb, e, &ubi->scrub, rb)
+		fm_set_used(ubi, fmpeb, e, UBI_FM_PEB_SCRUB);
+	ubi_rb_for_each_entry(rb, pe, &ubi->prot.pnum, rb_pnum)
+		fm_set_used(ubi, fmpeb, pe->e, UBI_FM_PEB_USED);
+	ubi_rb_for_each_entry(rb, e, &ubi->free, rb)
+		fmpeb[e->pnum].state = UBI_FM_PEB_FREE;
+	for (i = 0; i < ubi->fm_staged_count; i++)
+		fmpeb[ubi->fm_staged[i]->pnum].state = UBI_FM_PEB_SCAN;
+	if (ubi->fm_next)
+		fmpeb[ubi->fm_next->pnum].state = UBI_FM_PEB_FREE;
+	fmpeb[ubi->fm_new->pnum].state = UBI_FM_PEB_ANCHOR;
+	spin_unlock(&ubi->wl_lock);
+
+	return ubi->fm_new->pnum;
+}
+
+/**
+ * ubi_wl_fm_finish - finish writing a fastmap.
+ * @ubi: UBI device description object
+ * @fmpeb: the fastmap eraseblock table
+ * @err: zero if the fastmap was written, a negative error code if not
+ *
+ * If the new fastmap is on the flash, this function publishes its pool,
+ * erases the old anchor and starts the erasures the new fastmap does not
+ * forbid. Otherwise the fastmap is disabled.
+ */
+void ubi_wl_fm_finish(struct ubi_device *ubi, const struct ubi_fm_peb *fmpeb,
+		      int err)
+{
+	int i, pnum, state;
+	struct ubi_wl_entry *old = ubi->fm_anchor, *e = ubi->fm_new;
+	struct ubi_work *wrk, *tmp;
+
+	ubi->fm_new = NULL;
+	if (err) {
+		ubi_err("cannot write fastmap to PEB %d, error %d",
+			e->pnum, err);
+		if (schedule_erase(ubi, e, 1))
+			ubi_ro_mode(ubi);
+		ubi_wl_fm_disable(ubi);
+		return;
+	}
+
+	spin_lock(&ubi->wl_lock);
+	for (i = 0; i < ubi->fm_staged_count; i++)
+		wl_tree_add(ubi->fm_staged[i], &ubi->fm_pool);
+	ubi->fm_staged_count = 0;
+	ubi->fm_anchor = e;
+
+	bitmap_zero(ubi->fm_used, ubi->peb_count);
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		state = fmpeb[pnum].state;
+		if (state == UBI_FM_PEB_USED || state == UBI_FM_PEB_SCRUB)
+			__set_bit(pnum, ubi->fm_used);
+	}
+
+	list_for_each_entry_safe(wrk, tmp, &ubi->fm_works, list) {
+		/* PEBs put while the fastmap was written stay deferred */
+		if (test_bit(wrk->e->pnum, ubi->fm_used))
+			continue;
+		list_move_tail(&wrk->list, &ubi->works);
+		ubi->works_count += 1;
+	}
+	if (ubi->thread_enabled)
+		wake_up_process(ubi->bgt_thread);
+	spin_unlock(&ubi->wl_lock);
+
+	dbg_wl("fastmap written to PEB %d", e->pnum);
+	if (old && schedule_erase(ubi, old, 0))
+		ubi_ro_mode(ubi);
+
+	/* The pool may have been empty, so the WL may have been cancelled */
+	ensure_wear_leveling(ubi);
+}
+
+/**
+ * ubi_wl_fm_disable - stop using the fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function invalidates the fastmap on the flash and returns all the
+ * fastmap physical eraseblocks and the pool to the free tree. Called with
+ * @ubi->fm_mutex held, or when the WL sub-system is initialized.
+ */
+void ubi_wl_fm_disable(struct ubi_device *ubi)
+{
+	int i, err;
+	struct ubi_wl_entry *e = ubi->fm_anchor;
+	struct ubi_work *wrk, *tmp;
+
+	if (ubi->fm_disabled)
+		return;
+
+	/* The old fastmap must never be used again */
+	if (e) {
+		err = sync_erase(ubi, e, 0);
+		if (err) {
+			ubi_err("cannot erase fastmap PEB %d, error %d",
+				e->pnum, err);
+			ubi_ro_mode(ubi);
+			return;
+		}
+		ubi->fm_anchor = NULL;
+	}
+
+	spin_lock(&ubi->wl_lock);
+	if (e)
+		wl_tree_add(e, &ubi->free);
+	if (ubi->fm_next)
+		wl_tree_add(ubi->fm_next, &ubi->free);
+	ubi->fm_next = NULL;
+	while (ubi->fm_pool.rb_node) {
+		e = rb_entry(rb_first(&ubi->fm_pool), struct ubi_wl_entry, rb);
+		rb_erase(&e->rb, &ubi->fm_pool);
+		wl_tree_add(e, &ubi->free);
+	}
+	for (i = 0; i < ubi->fm_staged_count; i++)
+		wl_tree_add(ubi->fm_staged[i], &ubi->free);
+	ubi->fm_staged_count = 0;
+
+	bitmap_zero(ubi->fm_used, ubi->peb_count);
+	list_for_each_entry_safe(wrk, tmp, &ubi->fm_works, list) {
+		list_move_tail(&wrk->list, &ubi->works);
+		ubi->works_count += 1;
+	}
+	ubi->fm_disabled = 1;
+	if (ubi->thread_enabled)
+		wake_up_process(ubi->bgt_thread);
+	spin_unlock(&ubi->wl_lock);
+
+	ubi_msg("fastmap disabled");
+}
+
+/**
+ * fm_init - initialize the fastmap part of the WL sub-system.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ *
+ * This function has to be called before any erasure is scheduled, because
+ * the PEBs the fastmap we attached from reports as used must not be erased
+ * before the next fastmap is written. Returns zero in case of success and
+ * %-ENOMEM in case of failure.
+ */
+static int fm_init(struct ubi_device *ubi, struct ubi_scan_info *si)
+{
+	int size = BITS_TO_LONGS(ubi->peb_count) * sizeof(unsigned long);
+	struct ubi_wl_entry *e;
+
+	ubi->fm_pool_max = clamp(ubi->peb_count / 20, FM_MIN_POOL, FM_MAX_POOL);
+	ubi->fm_size = ubi_fm_size(ubi);
+	ubi->fm_used = kzalloc(size, GFP_KERNEL);
+	ubi->fm_mapped = kzalloc(size, GFP_KERNEL);
+	ubi->fm_staged = kmalloc(ubi->fm_pool_max * sizeof(void *), GFP_KERNEL);
+	ubi->fm_buf = vmalloc(ubi->fm_size);
+	if (!ubi->fm_used || !ubi->fm_mapped || !ubi->fm_staged ||
+	    !ubi->fm_buf)
+		return -ENOMEM;
+
+	if (si->fm_pnum < 0)
+		return 0;
+
+	/*
+	 * The anchor is not in any tree, it is only erased when the next
+	 * fastmap is on the flash.
+	 */
+	e = kmem_cache_alloc(ubi_wl_entry_slab, GFP_KERNEL);
+	if (!e)
+		return -ENOMEM;
+
+	e->pnum = si->fm_pnum;
+	e->ec = si->fm_ec;
+	ubi->lookuptbl[e->pnum] = e;
+	ubi->fm_anchor = e;
+	memcpy(ubi->fm_used, si->fm_used, size);
+	return 0;
+}
+
+/**
+ * fm_close - free the fastmap resources of the WL sub-system.
+ * @ubi: UBI device description object
+ */
+static void fm_close(struct ubi_device *ubi)
+{
+	int i;
+
+	while (!list_empty(&ubi->fm_works)) {
+		struct ubi_work *wrk;
+
+		wrk = list_entry(ubi->fm_works.next, struct ubi_work, list);
+		list_del(&wrk->list);
+		wrk->func(ubi, wrk, 1);
+	}
+
+	tree_destroy(&ubi->fm_pool);
+	for (i = 0; i < ubi->fm_staged_count; i++)
+		kmem_cache_free(ubi_wl_entry_slab, ubi->fm_staged[i]);
+	if (ubi->fm_anchor)
+		kmem_cache_free(ubi_wl_entry_slab, ubi->fm_anchor);
+	if (ubi->fm_next)
+		kmem_cache_free(ubi_wl_entry_slab, ubi->fm_next);
+	kfree(ubi->fm_used);
+	kfree(ubi->fm_mapped);
+	kfree(ubi->fm_staged);
+	vfree(ubi->fm_buf);
+}
+
+#else
+#define fm_init(ubi, si) 0
+#define fm_close(ubi)
+#endif /* CONFIG_MTD_UBI_FASTMAP */
+
 /**
  * ubi_wl_init_scan - initialize the WL sub-system using scanning information.
  * @ubi: UBI device description object
@@ -1446,9 +1933,15 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	ubi->prot.pnum = ubi->prot.aec = RB_ROOT;
 	spin_lock_init(&ubi->wl_lock);
 	mutex_init(&ubi->move_mutex);
+	ubi->fg_last = jiffies;
 	init_rwsem(&ubi->work_sem);
 	ubi->max_ec = si->max_ec;
 	INIT_LIST_HEAD(&ubi->works);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	ubi->fm_pool = RB_ROOT;
+	INIT_LIST_HEAD(&ubi->fm_works);
+	mutex_init(&ubi->fm_mutex);
+#endif
 
 	sprintf(ubi->bgt_name, UBI_BGT_NAME_PATTERN, ubi->ubi_num);
 
@@ -1457,6 +1950,11 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	if (!ubi->lookuptbl)
 		return err;
 
+	err = fm_init(ubi, si);
+	if (err)
+		goto out_free;
+	err = -ENOMEM;
+
 	list_for_each_entry_safe(seb, tmp, &si->erase, u.list) {
 		cond_resched();
 
@@ -1534,6 +2032,22 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	ubi->avail_pebs -= WL_RESERVED_PEBS;
 	ubi->rsvd_pebs += WL_RESERVED_PEBS;
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	if (ubi->fm_size > ubi->leb_size) {
+		ubi_msg("the fastmap does not fit into a LEB, not using it");
+		ubi_wl_fm_disable(ubi);
+	} else if (si->alien_peb_count) {
+		ubi_msg("alien PEBs found, not using the fastmap");
+		ubi_wl_fm_disable(ubi);
+	} else if (ubi->avail_pebs < FM_RESERVED_PEBS) {
+		ubi_msg("no PEBs for the fastmap, not using it");
+		ubi_wl_fm_disable(ubi);
+	} else {
+		ubi->avail_pebs -= FM_RESERVED_PEBS;
+		ubi->rsvd_pebs += FM_RESERVED_PEBS;
+	}
+#endif
+
 	/* Schedule wear-leveling if needed */
 	err = ensure_wear_leveling(ubi);
 	if (err)
@@ -1543,6 +2057,7 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 
 out_free:
 	cancel_pending(ubi);
+	fm_close(ubi);
 	tree_destroy(&ubi->used);
 	tree_destroy(&ubi->free);
 	tree_destroy(&ubi->scrub);
@@ -1590,6 +2105,7 @@ void ubi_wl_close(struct ubi_device *ubi)
 {
 	dbg_wl("close the WL sub-system");
 	cancel_pending(ubi);
+	fm_close(ubi);
 	protection_trees_destroy(ubi);
 	tree_destroy(&ubi->used);
 	tree_destroy(&ubi->free);
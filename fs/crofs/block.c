@@ -0,0 +1,230 @@
+/*
+ * crofs - compressed read-only file system
+ *
+ * Reading of raw data from the device and decompression of blocks.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/buffer_head.h>
+#include <linux/cpumask.h>
+#include <linux/lzo.h>
+#include "crofs.h"
+
+/* Number of buffer heads submitted for reading in one go */
+#define CROFS_BH_BATCH	32
+
+/*
+ * Copy @len bytes at byte offset @offset of the device into @buf.
+ * Buffers are read in batches, so that a large data block is a few big
+ * requests rather than one synchronous read per buffer.
+ */
+int crofs_read_bytes(struct super_block *sb, u64 offset, void *buf,
+		     size_t len)
+{
+	struct buffer_head *bh[CROFS_BH_BATCH];
+	sector_t block = offset >> sb->s_blocksize_bits;
+	unsigned int pos = offset & (sb->s_blocksize - 1);
+	int i, n, err = 0;
+
+	if (offset + len > CROFS_SB(sb)->bytes_used)
+		return -EIO;
+
+	while (len) {
+		for (n = 0; n < CROFS_BH_BATCH; n++) {
+			if (n * sb->s_blocksize >= pos + len)
+				break;
+			bh[n] = sb_getblk(sb, block + n);
+			if (!bh[n]) {
+				err = -ENOMEM;
+				break;
+			}
+		}
+		ll_rw_block(READ, n, bh);
+
+		for (i = 0; i < n; i++) {
+			size_t chunk = min_t(size_t, sb->s_blocksize - pos, len);
+
+			wait_on_buffer(bh[i]);
+			if (!err && !buffer_uptodate(bh[i]))
+				err = -EIO;
+			if (!err) {
+				memcpy(buf, bh[i]->b_data + pos, chunk);
+				buf += chunk;
+				len -= chunk;
+				pos = 0;
+			}
+			brelse(bh[i]);
+		}
+		if (err)
+			return err;
+		block += n;
+	}
+
+	return 0;
+}
+
+static struct crofs_stream *stream_get(struct crofs_sb_info *sbi)
+{
+	struct crofs_stream *stream;
+
+	spin_lock(&sbi->stream_lock);
+	while (list_empty(&sbi->stream_free)) {
+		spin_unlock(&sbi->stream_lock);
+		wait_event(sbi->stream_wait, !list_empty(&sbi->stream_free));
+		spin_lock(&sbi->stream_lock);
+	}
+	stream = list_entry(sbi->stream_free.next, struct crofs_stream, list);
+	list_del(&stream->list);
+	spin_unlock(&sbi->stream_lock);
+
+	return stream;
+}
+
+static void stream_put(struct crofs_sb_info *sbi, struct crofs_stream *stream)
+{
+	spin_lock(&sbi->stream_lock);
+	list_add(&stream->list, &sbi->stream_free);
+	spin_unlock(&sbi->stream_lock);
+	wake_up(&sbi->stream_wait);
+}
+
+static int zlib_decompress(struct crofs_sb_info *sbi,
+			   struct crofs_stream *stream, int len, void *out)
+{
+	z_stream *zstr = &stream->zstr;
+	int err;
+
+	zstr->next_in = stream->input;
+	zstr->avail_in = len;
+	zstr->next_out = out;
+	zstr->avail_out = sbi->block_size;
+
+	err = zlib_inflateReset(zstr);
+	if (err != Z_OK)
+		return -EIO;
+
+	err = zlib_inflate(zstr, Z_FINISH);
+	if (err != Z_STREAM_END)
+		return -EIO;
+
+	return zstr->total_out;
+}
+
+static int lzo_decompress(struct crofs_sb_info *sbi,
+			  struct crofs_stream *stream, int len, void *out)
+{
+#ifdef CONFIG_CROFS_LZO
+	size_t out_len = sbi->block_size;
+	int err;
+
+	err = lzo1x_decompress_safe(stream->input, len, out, &out_len);
+	if (err != LZO_E_OK)
+		return -EIO;
+
+	return out_len;
+#else
+	printk(KERN_ERR "crofs: LZO compressed block, but LZO support "
+	       "is not compiled in\n");
+	return -EIO;
+#endif
+}
+
+/*
+ * Read the block described by @start and @word and decompress it into
+ * @out, which has room for one data block.  Returns the decompressed
+ * length or a negative error code.
+ */
+int crofs_read_block(struct super_block *sb, u64 start, u32 word, void *out)
+{
+	struct crofs_sb_info *sbi = CROFS_SB(sb);
+	struct crofs_stream *stream;
+	int len = CROFS_BLOCK_LEN(word);
+	int compr = CROFS_BLOCK_COMPR(word);
+	int err;
+
+	if (len > sbi->block_size)
+		goto bad;
+
+	if (compr == CROFS_COMPR_NONE) {
+		err = crofs_read_bytes(sb, start, out, len);
+		return err ? err : len;
+	}
+
+	stream = stream_get(sbi);
+	err = crofs_read_bytes(sb, start, stream->input, len);
+	if (!err) {
+		if (compr == CROFS_COMPR_ZLIB)
+			err = zlib_decompress(sbi, stream, len, out);
+		else if (compr == CROFS_COMPR_LZO)
+			err = lzo_decompress(sbi, stream, len, out);
+		else
+			err = -EIO;
+	}
+	stream_put(sbi, stream);
+
+	if (err != -EIO)
+		return err;
+bad:
+	printk(KERN_ERR "crofs: bad block at 0x%llx, word 0x%08x\n",
+	       (unsigned long long)start, word);
+	return -EIO;
+}
+
+static void stream_free(struct crofs_stream *stream)
+{
+	if (stream->zstr.workspace) {
+		zlib_inflateEnd(&stream->zstr);
+		vfree(stream->zstr.workspace);
+	}
+	vfree(stream->input);
+	kfree(stream);
+}
+
+int crofs_streams_init(struct super_block *sb)
+{
+	struct crofs_sb_info *sbi = CROFS_SB(sb);
+	struct crofs_stream *stream;
+	int i;
+
+	INIT_LIST_HEAD(&sbi->stream_free);
+	spin_lock_init(&sbi->stream_lock);
+	init_waitqueue_head(&sbi->stream_wait);
+
+	for (i = 0; i < num_online_cpus(); i++) {
+		stream = kzalloc(sizeof(struct crofs_stream), GFP_KERNEL);
+		if (!stream)
+			goto out_nomem;
+		list_add(&stream->list, &sbi->stream_free);
+
+		stream->input = vmalloc(sbi->block_size);
+		stream->zstr.workspace = vmalloc(zlib_inflate_workspacesize());
+		if (!stream->input || !stream->zstr.workspace)
+			goto out_nomem;
+		if (zlib_inflateInit(&stream->zstr) != Z_OK) {
+			vfree(stream->zstr.workspace);
+			stream->zstr.workspace = NULL;
+			goto out_nomem;
+		}
+	}
+
+	return 0;
+
+out_nomem:
+	crofs_streams_free(sb);
+	return -ENOMEM;
+}
+
+void crofs_streams_free(struct super_block *sb)
+{
+	struct crofs_sb_info *sbi = CROFS_SB(sb);
+	struct crofs_stream *stream, *next;
+
+	list_for_each_entry_safe(stream, next, &sbi->stream_free, list) {
+		list_del(&stream->list);
+		stream_free(stream);
+	}
+}
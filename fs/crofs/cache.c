@@ -0,0 +1,144 @@
+/*
+ * crofs - compressed read-only file system
+ *
+ * Cache of decompressed data and fragment blocks.
+ *
+ * A data block is usually much bigger than a page, and fragment blocks
+ * hold the tails of many files, so the same block is wanted by many
+ * readpage calls in a row, possibly from different tasks.  Keeping a
+ * few decompressed blocks around means each of them is decompressed
+ * once instead of once per page.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include "crofs.h"
+
+/*
+ * Look up the block at @block in the cache, reading and decompressing
+ * it if it is not there.  Sleeps if every entry is in use.  The caller
+ * must check entry->error and release the entry with crofs_cache_put().
+ */
+struct crofs_cache_entry *crofs_cache_get(struct super_block *sb, u64 block,
+					  u32 word)
+{
+	struct crofs_cache *cache = &CROFS_SB(sb)->cache;
+	struct crofs_cache_entry *entry;
+	int i, n, ret;
+
+	spin_lock(&cache->lock);
+	for (;;) {
+		for (i = 0; i < cache->entries; i++)
+			if (cache->entry[i].block == block)
+				break;
+
+		if (i < cache->entries) {
+			entry = &cache->entry[i];
+			if (entry->refcount++ == 0)
+				cache->unused--;
+			spin_unlock(&cache->lock);
+			/* Somebody else is reading it, wait for them */
+			wait_event(entry->wait, !entry->pending);
+			return entry;
+		}
+
+		if (cache->unused)
+			break;
+
+		spin_unlock(&cache->lock);
+		wait_event(cache->wait, cache->unused);
+		spin_lock(&cache->lock);
+	}
+
+	/* Not cached, recycle the next unused entry */
+	i = cache->next;
+	for (n = 0; n < cache->entries; n++) {
+		if (cache->entry[i].refcount == 0)
+			break;
+		i = (i + 1) % cache->entries;
+	}
+	cache->next = (i + 1) % cache->entries;
+	cache->unused--;
+
+	entry = &cache->entry[i];
+	entry->block = block;
+	entry->refcount = 1;
+	entry->pending = 1;
+	entry->error = 0;
+	spin_unlock(&cache->lock);
+
+	ret = crofs_read_block(sb, block, word, entry->data);
+
+	spin_lock(&cache->lock);
+	if (ret < 0)
+		entry->error = ret;
+	else
+		entry->length = ret;
+	entry->pending = 0;
+	spin_unlock(&cache->lock);
+
+	wake_up_all(&entry->wait);
+	return entry;
+}
+
+void crofs_cache_put(struct crofs_cache *cache, struct crofs_cache_entry *entry)
+{
+	spin_lock(&cache->lock);
+	if (--entry->refcount == 0) {
+		/* Don't let a failed read be found by the next lookup */
+		if (entry->error)
+			entry->block = CROFS_INVALID_BLK;
+		cache->unused++;
+		spin_unlock(&cache->lock);
+		wake_up(&cache->wait);
+		return;
+	}
+	spin_unlock(&cache->lock);
+}
+
+int crofs_cache_init(struct crofs_cache *cache, int entries, int block_size)
+{
+	int i;
+
+	spin_lock_init(&cache->lock);
+	init_waitqueue_head(&cache->wait);
+	cache->next = 0;
+	cache->entries = entries;
+	cache->unused = entries;
+
+	cache->entry = kcalloc(entries, sizeof(struct crofs_cache_entry),
+			       GFP_KERNEL);
+	if (!cache->entry)
+		return -ENOMEM;
+
+	for (i = 0; i < entries; i++) {
+		struct crofs_cache_entry *entry = &cache->entry[i];
+
+		entry->block = CROFS_INVALID_BLK;
+		init_waitqueue_head(&entry->wait);
+		entry->data = vmalloc(block_size);
+		if (!entry->data) {
+			crofs_cache_free(cache);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+void crofs_cache_free(struct crofs_cache *cache)
+{
+	int i;
+
+	if (!cache->entry)
+		return;
+
+	for (i = 0; i < cache->entries; i++)
+		vfree(cache->entry[i].data);
+	kfree(cache->entry);
+	cache->entry = NULL;
+}
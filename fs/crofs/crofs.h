@@ -0,0 +1,125 @@
+/*
+ * crofs - compressed read-only file system
+ *
+ * This file is released under the GPL.
+ */
+
+#ifndef __CROFS_H__
+#define __CROFS_H__
+
+#include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/zlib.h>
+#include <linux/crofs_fs.h>
+
+#define CROFS_INVALID_BLK	((u64)-1)
+
+/* Location of one data block of a regular file */
+struct crofs_block {
+	u64 start;			/* offset of the block on disk */
+	u32 word;			/* block word, see crofs_fs.h */
+};
+
+struct crofs_inode_info {
+	u64 start;			/* i_start of the on-disk inode */
+	u32 fragment;
+	u32 frag_offset;
+	unsigned int nr_blocks;		/* data blocks not in a fragment */
+	struct crofs_block *blocks;	/* block index, read on first use */
+	struct mutex index_mutex;	/* serializes reading of @blocks */
+	struct inode vfs_inode;
+};
+
+/*
+ * Cache of decompressed blocks, shared by all readers of a file system.
+ * Entries are looked up by the on-disk offset of the block.  An entry
+ * being filled is marked pending, and other readers of the same block
+ * sleep on its wait queue instead of decompressing it a second time.
+ */
+struct crofs_cache_entry {
+	u64 block;
+	int length;			/* decompressed length */
+	int refcount;
+	int pending;
+	int error;
+	wait_queue_head_t wait;
+	void *data;
+};
+
+struct crofs_cache {
+	spinlock_t lock;
+	int entries;
+	int next;			/* where to start looking for a victim */
+	int unused;			/* entries with zero refcount */
+	wait_queue_head_t wait;		/* for an entry to become unused */
+	struct crofs_cache_entry *entry;
+};
+
+/*
+ * Decompressor state.  Each file system has a pool of one stream per
+ * online CPU, so that readers of different blocks decompress in
+ * parallel rather than queueing up behind a single zlib stream.
+ */
+struct crofs_stream {
+	struct list_head list;
+	z_stream zstr;
+	void *input;			/* raw block as read from disk */
+};
+
+struct crofs_sb_info {
+	unsigned int block_log;
+	unsigned int block_size;
+	unsigned int inodes;
+	unsigned int fragments;
+	u64 bytes_used;
+	u64 inode_table;
+	u64 dir_table;
+	u64 frag_table;
+
+	struct crofs_cache cache;
+
+	struct list_head stream_free;
+	spinlock_t stream_lock;
+	wait_queue_head_t stream_wait;
+};
+
+static inline struct crofs_sb_info *CROFS_SB(struct super_block *sb)
+{
+	return sb->s_fs_info;
+}
+
+static inline struct crofs_inode_info *CROFS_I(struct inode *inode)
+{
+	return container_of(inode, struct crofs_inode_info, vfs_inode);
+}
+
+/* block.c */
+int crofs_read_bytes(struct super_block *sb, u64 offset, void *buf,
+		     size_t len);
+int crofs_read_block(struct super_block *sb, u64 start, u32 word, void *out);
+int crofs_streams_init(struct super_block *sb);
+void crofs_streams_free(struct super_block *sb);
+
+/* cache.c */
+int crofs_cache_init(struct crofs_cache *cache, int entries, int block_size);
+void crofs_cache_free(struct crofs_cache *cache);
+struct crofs_cache_entry *crofs_cache_get(struct super_block *sb, u64 block,
+					  u32 word);
+void crofs_cache_put(struct crofs_cache *cache,
+		     struct crofs_cache_entry *entry);
+
+/* inode.c */
+struct inode *crofs_iget(struct super_block *sb, unsigned long ino);
+
+/* dir.c */
+extern const struct file_operations crofs_dir_operations;
+extern const struct inode_operations crofs_dir_inode_operations;
+
+/* file.c */
+extern const struct address_space_operations crofs_aops;
+extern const struct address_space_operations crofs_symlink_aops;
+
+#endif /* __CROFS_H__ */
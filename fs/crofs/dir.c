@@ -0,0 +1,145 @@
+/*
+ * crofs - compressed read-only file system
+ *
+ * Directory reading and lookup.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include "crofs.h"
+
+/*
+ * Read the entry at byte @offset of directory @dir into @de and its
+ * name into @name.  Returns the size of the entry on disk, or a
+ * negative error code.
+ */
+static int read_dirent(struct inode *dir, unsigned int offset,
+		       struct crofs_dirent *de, char *name)
+{
+	u64 pos = CROFS_I(dir)->start + offset;
+	int err, len;
+
+	if (offset & 3 || offset + sizeof(*de) > dir->i_size)
+		return -EIO;
+
+	err = crofs_read_bytes(dir->i_sb, pos, de, sizeof(*de));
+	if (err)
+		return err;
+
+	len = le16_to_cpu(de->d_name_len);
+	if (!len || len > CROFS_MAX_NAMELEN ||
+	    offset + sizeof(*de) + len > dir->i_size)
+		return -EIO;
+
+	err = crofs_read_bytes(dir->i_sb, pos + sizeof(*de), name, len);
+	if (err)
+		return err;
+
+	return sizeof(*de) + ALIGN(len, 4);
+}
+
+/*
+ * f_pos 0 and 1 are "." and "..", after that f_pos - 2 is the byte
+ * offset of the next entry.
+ */
+static int crofs_readdir(struct file *filp, void *dirent, filldir_t filldir)
+{
+	struct inode *inode = filp->f_path.dentry->d_inode;
+	struct crofs_dirent de;
+	char *name;
+	int len;
+
+	if (filp->f_pos == 0) {
+		if (filldir(dirent, ".", 1, 0, inode->i_ino, DT_DIR) < 0)
+			return 0;
+		filp->f_pos = 1;
+	}
+	if (filp->f_pos == 1) {
+		if (filldir(dirent, "..", 2, 1, parent_ino(filp->f_path.dentry),
+			    DT_DIR) < 0)
+			return 0;
+		filp->f_pos = 2;
+	}
+
+	name = kmalloc(CROFS_MAX_NAMELEN, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	while (filp->f_pos - 2 < inode->i_size) {
+		len = read_dirent(inode, filp->f_pos - 2, &de, name);
+		if (len < 0) {
+			kfree(name);
+			return len;
+		}
+		if (filldir(dirent, name, le16_to_cpu(de.d_name_len),
+			    filp->f_pos, le32_to_cpu(de.d_ino), de.d_type) < 0)
+			break;
+		filp->f_pos += len;
+	}
+
+	kfree(name);
+	return 0;
+}
+
+static struct dentry *crofs_lookup(struct inode *dir, struct dentry *dentry,
+				   struct nameidata *nd)
+{
+	struct crofs_dirent de;
+	struct inode *inode = NULL;
+	unsigned int offset = 0;
+	char *name;
+	int len;
+
+	if (dentry->d_name.len > CROFS_MAX_NAMELEN)
+		return ERR_PTR(-ENAMETOOLONG);
+
+	name = kmalloc(CROFS_MAX_NAMELEN, GFP_KERNEL);
+	if (!name)
+		return ERR_PTR(-ENOMEM);
+
+	while (offset < dir->i_size) {
+		int namelen, cmp;
+
+		len = read_dirent(dir, offset, &de, name);
+		if (len < 0) {
+			kfree(name);
+			return ERR_PTR(len);
+		}
+		offset += len;
+
+		namelen = le16_to_cpu(de.d_name_len);
+		cmp = memcmp(dentry->d_name.name, name,
+			     min_t(int, namelen, dentry->d_name.len));
+		if (!cmp)
+			cmp = dentry->d_name.len - namelen;
+
+		/* Entries are sorted, so we can stop at the first bigger one */
+		if (cmp < 0)
+			break;
+		if (!cmp) {
+			inode = crofs_iget(dir->i_sb, le32_to_cpu(de.d_ino));
+			if (IS_ERR(inode)) {
+				kfree(name);
+				return ERR_CAST(inode);
+			}
+			break;
+		}
+	}
+
+	kfree(name);
+	d_add(dentry, inode);
+	return NULL;
+}
+
+const struct file_operations crofs_dir_operations = {
+	.llseek		= generic_file_llseek,
+	.read		= generic_read_dir,
+	.readdir	= crofs_readdir,
+};
+
+const struct inode_operations crofs_dir_inode_operations = {
+	.lookup		= crofs_lookup,
+};
@@ -0,0 +1,246 @@
+/*
+ * crofs - compressed read-only file system
+ *
+ * Regular file and symlink reading.
+ *
+ * A regular file is a list of block words followed by its data blocks,
+ * with the tail optionally packed into a fragment block shared with the
+ * tails of other files.  The block words are read into an index the
+ * first time the file is read, so finding the block for any page is a
+ * table lookup no matter how big the file is.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include "crofs.h"
+
+static struct crofs_block *read_block_index(struct inode *inode)
+{
+	struct crofs_sb_info *sbi = CROFS_SB(inode->i_sb);
+	struct crofs_inode_info *ci = CROFS_I(inode);
+	unsigned int i, j, n, nr = ci->nr_blocks;
+	struct crofs_block *blocks = NULL;
+	__le32 *words = NULL;
+	u64 pos;
+	int err;
+
+	mutex_lock(&ci->index_mutex);
+	if (ci->blocks)
+		goto out;
+
+	if (nr > ULONG_MAX / sizeof(*blocks)) {
+		err = -EFBIG;
+		goto out_free;
+	}
+	if (nr * sizeof(*blocks) > PAGE_SIZE)
+		blocks = vmalloc(nr * sizeof(*blocks));
+	else
+		blocks = kmalloc(nr * sizeof(*blocks), GFP_KERNEL);
+	words = (__le32 *)__get_free_page(GFP_KERNEL);
+	if (!blocks || !words) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	pos = ci->start + (u64)nr * sizeof(__le32);
+	for (i = 0; i < nr; i += n) {
+		n = min_t(unsigned int, nr - i, PAGE_SIZE / sizeof(__le32));
+		err = crofs_read_bytes(inode->i_sb,
+				       ci->start + (u64)i * sizeof(__le32),
+				       words, n * sizeof(__le32));
+		if (err)
+			goto out_free;
+
+		for (j = 0; j < n; j++) {
+			blocks[i + j].start = pos;
+			blocks[i + j].word = le32_to_cpu(words[j]);
+			pos += CROFS_BLOCK_LEN(blocks[i + j].word);
+		}
+	}
+
+	if (pos > sbi->bytes_used) {
+		err = -EIO;
+		goto out_free;
+	}
+
+	free_page((unsigned long)words);
+	smp_wmb();
+	ci->blocks = blocks;
+out:
+	mutex_unlock(&ci->index_mutex);
+	return ci->blocks;
+
+out_free:
+	mutex_unlock(&ci->index_mutex);
+	free_page((unsigned long)words);
+	if (is_vmalloc_addr(blocks))
+		vfree(blocks);
+	else
+		kfree(blocks);
+	return ERR_PTR(err);
+}
+
+static int read_fragment(struct super_block *sb, u32 fragment,
+			 struct crofs_block *block)
+{
+	struct crofs_sb_info *sbi = CROFS_SB(sb);
+	struct crofs_fragment frag;
+	int err;
+
+	err = crofs_read_bytes(sb, sbi->frag_table +
+			       (u64)fragment * sizeof(frag), &frag, sizeof(frag));
+	if (err)
+		return err;
+
+	block->start = le64_to_cpu(frag.f_start);
+	block->word = le32_to_cpu(frag.f_size);
+	return 0;
+}
+
+/*
+ * Fill in @page, and any other page of the same block that is not in
+ * the page cache yet, from the decompressed block.  Pushing the
+ * neighbouring pages means sequential reads decompress every block
+ * once, even when readahead is smaller than the block size.
+ */
+static int crofs_readpage(struct file *file, struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	struct crofs_sb_info *sbi = CROFS_SB(inode->i_sb);
+	struct crofs_inode_info *ci = CROFS_I(inode);
+	int shift = sbi->block_log - PAGE_CACHE_SHIFT;
+	unsigned int index = page->index >> shift;
+	pgoff_t first = index << shift;
+	pgoff_t last = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	struct crofs_cache_entry *entry = NULL;
+	struct crofs_block *blocks, block;
+	void *data = NULL;
+	int length, err;
+	pgoff_t i;
+
+	if (page->index > last || !i_size_read(inode))
+		goto zero_fill;
+
+	if (index < ci->nr_blocks) {
+		blocks = ci->blocks;
+		smp_rmb();
+		if (!blocks) {
+			blocks = read_block_index(inode);
+			if (IS_ERR(blocks)) {
+				err = PTR_ERR(blocks);
+				goto error;
+			}
+		}
+		block = blocks[index];
+		length = min_t(loff_t, sbi->block_size, i_size_read(inode) -
+			       ((loff_t)index << sbi->block_log));
+	} else {
+		err = read_fragment(inode->i_sb, ci->fragment, &block);
+		if (err)
+			goto error;
+		length = i_size_read(inode) & (sbi->block_size - 1);
+	}
+
+	/* Holes take no space on disk and are not cached */
+	if (!CROFS_BLOCK_LEN(block.word))
+		goto zero_fill;
+
+	entry = crofs_cache_get(inode->i_sb, block.start, block.word);
+	err = entry->error;
+	if (err)
+		goto error;
+
+	data = entry->data;
+	if (index >= ci->nr_blocks) {
+		data += ci->frag_offset;
+		if (ci->frag_offset + length > entry->length)
+			err = -EIO;
+	} else if (length > entry->length)
+		err = -EIO;
+	if (err)
+		goto error;
+
+	last = min(last, first + (1 << shift) - 1);
+	for (i = first; i <= last; i++, data += PAGE_CACHE_SIZE,
+					length -= PAGE_CACHE_SIZE) {
+		int avail = clamp_t(int, length, 0, PAGE_CACHE_SIZE);
+		struct page *push;
+		void *addr;
+
+		if (i == page->index)
+			push = page;
+		else
+			push = grab_cache_page_nowait(page->mapping, i);
+		if (!push)
+			continue;
+		if (PageUptodate(push))
+			goto skip;
+
+		addr = kmap_atomic(push, KM_USER0);
+		memcpy(addr, data, avail);
+		memset(addr + avail, 0, PAGE_CACHE_SIZE - avail);
+		kunmap_atomic(addr, KM_USER0);
+		flush_dcache_page(push);
+		SetPageUptodate(push);
+skip:
+		unlock_page(push);
+		if (push != page)
+			page_cache_release(push);
+	}
+
+	crofs_cache_put(&sbi->cache, entry);
+	return 0;
+
+zero_fill:
+	zero_user(page, 0, PAGE_CACHE_SIZE);
+	SetPageUptodate(page);
+	unlock_page(page);
+	return 0;
+
+error:
+	if (entry)
+		crofs_cache_put(&sbi->cache, entry);
+	printk(KERN_ERR "crofs: error %d reading inode %lu, page %lu\n",
+	       err, inode->i_ino, page->index);
+	SetPageError(page);
+	unlock_page(page);
+	return err;
+}
+
+/* Symlink targets are stored uncompressed */
+static int crofs_symlink_readpage(struct file *file, struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+	void *addr = kmap(page);
+	int err;
+
+	err = crofs_read_bytes(inode->i_sb, CROFS_I(inode)->start, addr,
+			       inode->i_size);
+	if (err) {
+		kunmap(page);
+		SetPageError(page);
+		unlock_page(page);
+		return err;
+	}
+
+	memset(addr + inode->i_size, 0, PAGE_CACHE_SIZE - inode->i_size);
+	kunmap(page);
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+	unlock_page(page);
+	return 0;
+}
+
+const struct address_space_operations crofs_aops = {
+	.readpage	= crofs_readpage,
+};
+
+const struct address_space_operations crofs_symlink_aops = {
+	.readpage	= crofs_symlink_readpage,
+};
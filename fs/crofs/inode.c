@@ -0,0 +1,110 @@
+/*
+ * crofs - compressed read-only file system
+ *
+ * Reading of inodes from the inode table.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/kdev_t.h>
+#include "crofs.h"
+
+static int crofs_fill_inode(struct inode *inode, struct crofs_inode *raw)
+{
+	struct crofs_sb_info *sbi = CROFS_SB(inode->i_sb);
+	struct crofs_inode_info *ci = CROFS_I(inode);
+	u64 nr;
+
+	inode->i_mode = le16_to_cpu(raw->i_mode);
+	inode->i_nlink = le16_to_cpu(raw->i_nlink);
+	inode->i_uid = le32_to_cpu(raw->i_uid);
+	inode->i_gid = le32_to_cpu(raw->i_gid);
+	inode->i_mtime.tv_sec = le32_to_cpu(raw->i_mtime);
+	inode->i_mtime.tv_nsec = 0;
+	inode->i_atime = inode->i_ctime = inode->i_mtime;
+	inode->i_size = le64_to_cpu(raw->i_size);
+	inode->i_blocks = (inode->i_size + 511) >> 9;
+
+	ci->start = le64_to_cpu(raw->i_start);
+	ci->fragment = le32_to_cpu(raw->i_fragment);
+	ci->frag_offset = le32_to_cpu(raw->i_frag_offset);
+	ci->nr_blocks = 0;
+
+	switch (inode->i_mode & S_IFMT) {
+	case S_IFREG:
+		if (inode->i_size < 0)
+			return -EIO;
+		if (ci->fragment == CROFS_NO_FRAGMENT)
+			nr = ((u64)inode->i_size + sbi->block_size - 1) >>
+			     sbi->block_log;
+		else if (ci->fragment < sbi->fragments)
+			nr = (u64)inode->i_size >> sbi->block_log;
+		else
+			return -EIO;
+		/* The block words have to be inside the image */
+		if (nr > UINT_MAX || ci->start > sbi->bytes_used ||
+		    nr * sizeof(__le32) > sbi->bytes_used - ci->start)
+			return -EIO;
+		ci->nr_blocks = nr;
+		inode->i_fop = &generic_ro_fops;
+		inode->i_data.a_ops = &crofs_aops;
+		break;
+	case S_IFDIR:
+		inode->i_op = &crofs_dir_inode_operations;
+		inode->i_fop = &crofs_dir_operations;
+		break;
+	case S_IFLNK:
+		if (inode->i_size >= PAGE_CACHE_SIZE)
+			return -EIO;
+		inode->i_op = &page_symlink_inode_operations;
+		inode->i_data.a_ops = &crofs_symlink_aops;
+		break;
+	case S_IFCHR:
+	case S_IFBLK:
+	case S_IFIFO:
+	case S_IFSOCK:
+		inode->i_size = 0;
+		inode->i_blocks = 0;
+		init_special_inode(inode, inode->i_mode,
+				   new_decode_dev(le32_to_cpu(raw->i_rdev)));
+		break;
+	default:
+		return -EIO;
+	}
+
+	return 0;
+}
+
+struct inode *crofs_iget(struct super_block *sb, unsigned long ino)
+{
+	struct crofs_sb_info *sbi = CROFS_SB(sb);
+	struct crofs_inode raw;
+	struct inode *inode;
+	int err;
+
+	if (ino < CROFS_ROOT_INO || ino > sbi->inodes)
+		return ERR_PTR(-EIO);
+
+	inode = iget_locked(sb, ino);
+	if (!inode)
+		return ERR_PTR(-ENOMEM);
+	if (!(inode->i_state & I_NEW))
+		return inode;
+
+	err = crofs_read_bytes(sb, sbi->inode_table +
+			       (u64)(ino - 1) * sizeof(raw), &raw, sizeof(raw));
+	if (!err)
+		err = crofs_fill_inode(inode, &raw);
+	if (err) {
+		printk(KERN_ERR "crofs: cannot read inode %lu, error %d\n",
+		       ino, err);
+		iget_failed(inode);
+		return ERR_PTR(err);
+	}
+
+	unlock_new_inode(inode);
+	return inode;
+}
@@ -0,0 +1,261 @@
+/*
+ * crofs - compressed read-only file system
+ *
+ * Super block handling and module glue.
+ *
+ * This file is released under the GPL.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/buffer_head.h>
+#include <linux/blkdev.h>
+#include <linux/pagemap.h>
+#include <linux/cpumask.h>
+#include <linux/vfs.h>
+#include "crofs.h"
+
+static struct kmem_cache *crofs_inode_cachep;
+
+static struct inode *crofs_alloc_inode(struct super_block *sb)
+{
+	struct crofs_inode_info *ci;
+
+	ci = kmem_cache_alloc(crofs_inode_cachep, GFP_KERNEL);
+	if (!ci)
+		return NULL;
+	ci->blocks = NULL;
+	return &ci->vfs_inode;
+}
+
+static void crofs_destroy_inode(struct inode *inode)
+{
+	struct crofs_inode_info *ci = CROFS_I(inode);
+
+	if (is_vmalloc_addr(ci->blocks))
+		vfree(ci->blocks);
+	else
+		kfree(ci->blocks);
+	kmem_cache_free(crofs_inode_cachep, ci);
+}
+
+static void crofs_init_once(void *foo)
+{
+	struct crofs_inode_info *ci = foo;
+
+	mutex_init(&ci->index_mutex);
+	inode_init_once(&ci->vfs_inode);
+}
+
+static void crofs_put_super(struct super_block *sb)
+{
+	struct crofs_sb_info *sbi = CROFS_SB(sb);
+
+	crofs_cache_free(&sbi->cache);
+	crofs_streams_free(sb);
+	kfree(sbi);
+	sb->s_fs_info = NULL;
+}
+
+static int crofs_remount(struct super_block *sb, int *flags, char *data)
+{
+	*flags |= MS_RDONLY;
+	return 0;
+}
+
+static int crofs_statfs(struct dentry *dentry, struct kstatfs *buf)
+{
+	struct crofs_sb_info *sbi = CROFS_SB(dentry->d_sb);
+
+	buf->f_type = CROFS_MAGIC;
+	buf->f_bsize = sbi->block_size;
+	buf->f_blocks = (sbi->bytes_used + sbi->block_size - 1) >>
+			sbi->block_log;
+	buf->f_bfree = 0;
+	buf->f_bavail = 0;
+	buf->f_files = sbi->inodes;
+	buf->f_ffree = 0;
+	buf->f_namelen = CROFS_MAX_NAMELEN;
+	return 0;
+}
+
+static const struct super_operations crofs_super_ops = {
+	.alloc_inode	= crofs_alloc_inode,
+	.destroy_inode	= crofs_destroy_inode,
+	.put_super	= crofs_put_super,
+	.remount_fs	= crofs_remount,
+	.statfs		= crofs_statfs,
+};
+
+static int crofs_fill_super(struct super_block *sb, void *data, int silent)
+{
+	struct crofs_super_block *csb;
+	struct crofs_sb_info *sbi;
+	struct buffer_head *bh;
+	struct inode *root;
+	u64 dev_size;
+	int err = -EINVAL;
+
+	sb->s_flags |= MS_RDONLY;
+
+	sbi = kzalloc(sizeof(struct crofs_sb_info), GFP_KERNEL);
+	if (!sbi)
+		return -ENOMEM;
+	sb->s_fs_info = sbi;
+	INIT_LIST_HEAD(&sbi->stream_free);
+
+	if (!sb_min_blocksize(sb, BLOCK_SIZE)) {
+		if (!silent)
+			printk(KERN_ERR "crofs: unable to set blocksize\n");
+		goto out;
+	}
+
+	bh = sb_bread(sb, 0);
+	if (!bh) {
+		printk(KERN_ERR "crofs: unable to read superblock\n");
+		err = -EIO;
+		goto out;
+	}
+	csb = (struct crofs_super_block *)bh->b_data;
+
+	if (le32_to_cpu(csb->s_magic) != CROFS_MAGIC) {
+		if (!silent)
+			printk(KERN_ERR "crofs: wrong magic\n");
+		goto out_brelse;
+	}
+	if (le16_to_cpu(csb->s_major) != CROFS_MAJOR) {
+		printk(KERN_ERR "crofs: unsupported format version %u.%u\n",
+		       le16_to_cpu(csb->s_major), le16_to_cpu(csb->s_minor));
+		goto out_brelse;
+	}
+	if (le32_to_cpu(csb->s_flags) & ~CROFS_SUPPORTED_FLAGS) {
+		printk(KERN_ERR "crofs: unsupported filesystem features\n");
+		goto out_brelse;
+	}
+
+	sbi->block_log = le32_to_cpu(csb->s_block_log);
+	sbi->inodes = le32_to_cpu(csb->s_inodes);
+	sbi->fragments = le32_to_cpu(csb->s_fragments);
+	sbi->bytes_used = le64_to_cpu(csb->s_bytes_used);
+	sbi->inode_table = le64_to_cpu(csb->s_inode_table);
+	sbi->dir_table = le64_to_cpu(csb->s_dir_table);
+	sbi->frag_table = le64_to_cpu(csb->s_frag_table);
+	brelse(bh);
+
+	/* A page never spans two blocks, see crofs_readpage() */
+	if (sbi->block_log < max(CROFS_MIN_BLOCK_LOG, PAGE_CACHE_SHIFT) ||
+	    sbi->block_log > CROFS_MAX_BLOCK_LOG) {
+		printk(KERN_ERR "crofs: unsupported block size %u\n",
+		       1 << sbi->block_log);
+		goto out;
+	}
+	sbi->block_size = 1 << sbi->block_log;
+
+	dev_size = i_size_read(sb->s_bdev->bd_inode);
+	if (sbi->bytes_used > dev_size) {
+		printk(KERN_ERR "crofs: image is %llu bytes, device only "
+		       "%llu\n", (unsigned long long)sbi->bytes_used,
+		       (unsigned long long)dev_size);
+		goto out;
+	}
+	if (sbi->inodes < CROFS_ROOT_INO) {
+		printk(KERN_ERR "crofs: no root inode\n");
+		goto out;
+	}
+
+	err = crofs_streams_init(sb);
+	if (err)
+		goto out;
+	err = crofs_cache_init(&sbi->cache, max(4, 2 * num_online_cpus()),
+			       sbi->block_size);
+	if (err)
+		goto out_streams;
+
+	sb->s_op = &crofs_super_ops;
+	sb->s_maxbytes = MAX_LFS_FILESIZE;
+
+	root = crofs_iget(sb, CROFS_ROOT_INO);
+	if (IS_ERR(root)) {
+		err = PTR_ERR(root);
+		goto out_cache;
+	}
+	if (!S_ISDIR(root->i_mode)) {
+		printk(KERN_ERR "crofs: root is not a directory\n");
+		iput(root);
+		err = -EINVAL;
+		goto out_cache;
+	}
+
+	sb->s_root = d_alloc_root(root);
+	if (!sb->s_root) {
+		iput(root);
+		err = -ENOMEM;
+		goto out_cache;
+	}
+	return 0;
+
+out_brelse:
+	brelse(bh);
+	goto out;
+out_cache:
+	crofs_cache_free(&sbi->cache);
+out_streams:
+	crofs_streams_free(sb);
+out:
+	kfree(sbi);
+	sb->s_fs_info = NULL;
+	return err;
+}
+
+static int crofs_get_sb(struct file_system_type *fs_type, int flags,
+			const char *dev_name, void *data, struct vfsmount *mnt)
+{
+	return get_sb_bdev(fs_type, flags, dev_name, data, crofs_fill_super,
+			   mnt);
+}
+
+static struct file_system_type crofs_fs_type = {
+	.owner		= THIS_MODULE,
+	.name		= "crofs",
+	.get_sb		= crofs_get_sb,
+	.kill_sb	= kill_block_super,
+	.fs_flags	= FS_REQUIRES_DEV,
+};
+
+static int __init init_crofs_fs(void)
+{
+	int err;
+
+	BUILD_BUG_ON(sizeof(struct crofs_super_block) != 128);
+	BUILD_BUG_ON(sizeof(struct crofs_inode) != 64);
+	BUILD_BUG_ON(sizeof(struct crofs_dirent) != 8);
+	BUILD_BUG_ON(sizeof(struct crofs_fragment) != 16);
+
+	crofs_inode_cachep = kmem_cache_create("crofs_inode_cache",
+					       sizeof(struct crofs_inode_info),
+					       0, SLAB_RECLAIM_ACCOUNT |
+					       SLAB_MEM_SPREAD,
+					       crofs_init_once);
+	if (!crofs_inode_cachep)
+		return -ENOMEM;
+
+	err = register_filesystem(&crofs_fs_type);
+	if (err)
+		kmem_cache_destroy(crofs_inode_cachep);
+	return err;
+}
+
+static void __exit exit_crofs_fs(void)
+{
+	unregister_filesystem(&crofs_fs_type);
+	kmem_cache_destroy(crofs_inode_cachep);
+}
+
+module_init(init_crofs_fs)
+module_exit(exit_crofs_fs)
+MODULE_DESCRIPTION("Compressed read-only file system");
+MODULE_LICENSE("GPL");
@@ -55,6 +55,8 @@ static void ext3_mark_recovery_complete(struct super_block * sb,
 					struct ext3_super_block * es);
 static void ext3_clear_journal_err(struct super_block * sb,
 				   struct ext3_super_block * es);
+static void ext3_set_journal_features(struct super_block *sb,
+				      journal_t *journal);
 static int ext3_sync_fs(struct super_block *sb, int wait);
 static const char *ext3_decode_error(struct super_block * sb, int errno,
 				     char nbuf[16]);
@@ -615,6 +617,10 @@ static int ext3_show_options(struct seq_file *seq, struct vfsmount *vfs)
 	}
 	if (test_opt(sb, BARRIER))
 		seq_puts(seq, ",barrier=1");
+	if (test_opt(sb, JOURNAL_ASYNC_COMMIT))
+		seq_puts(seq, ",journal_async_commit");
+	else if (test_opt(sb, JOURNAL_CHECKSUM))
+		seq_puts(seq, ",journal_checksum");
 	if (test_opt(sb, NOBH))
 		seq_puts(seq, ",nobh");
 
@@ -757,7 +763,7 @@ enum {
 	Opt_usrjquota, Opt_grpjquota, Opt_offusrjquota, Opt_offgrpjquota,
 	Opt_jqfmt_vfsold, Opt_jqfmt_vfsv0, Opt_quota, Opt_noquota,
 	Opt_ignore, Opt_barrier, Opt_err, Opt_resize, Opt_usrquota,
-	Opt_grpquota
+	Opt_grpquota, Opt_journal_checksum, Opt_journal_async_commit
 };
 
 static match_table_t tokens = {
@@ -792,6 +798,8 @@ static match_table_t tokens = {
 	{Opt_journal_update, "journal=update"},
 	{Opt_journal_inum, "journal=%u"},
 	{Opt_journal_dev, "journal_dev=%u"},
+	{Opt_journal_checksum, "journal_checksum"},
+	{Opt_journal_async_commit, "journal_async_commit"},
 	{Opt_abort, "abort"},
 	{Opt_data_journal, "data=journal"},
 	{Opt_data_ordered, "data=ordered"},
@@ -977,6 +985,13 @@ static int parse_options (char *options, struct super_block *sb,
 				return 0;
 			*journal_devnum = option;
 			break;
+		case Opt_journal_checksum:
+			set_opt(sbi->s_mount_opt, JOURNAL_CHECKSUM);
+			break;
+		case Opt_journal_async_commit:
+			set_opt(sbi->s_mount_opt, JOURNAL_ASYNC_COMMIT);
+			set_opt(sbi->s_mount_opt, JOURNAL_CHECKSUM);
+			break;
 		case Opt_noload:
 			set_opt (sbi->s_mount_opt, NOLOAD);
 			break;
@@ -1856,6 +1871,9 @@ static int ext3_fill_super (struct super_block *sb, void *data, int silent)
 		goto failed_mount3;
 	}
 
+	if (!(sb->s_flags & MS_RDONLY))
+		ext3_set_journal_features(sb, sbi->s_journal);
+
 	/* We have now updated the journal if required, so we can
 	 * validate the data journaling mode. */
 	switch (test_opt(sb, DATA_FLAGS)) {
@@ -1989,6 +2007,37 @@ static void ext3_init_journal_params(struct super_block *sb, journal_t *journal)
 	spin_unlock(&journal->j_state_lock);
 }
 
+/*
+ * Turn transaction checksums and async commit on or off as asked for by
+ * the mount options.  This must only happen after recovery: the log we
+ * replayed was written with the old features.  The journal superblock is
+ * written out right away so that a crash before the next checkpoint is
+ * recovered with the features the log was written with.
+ */
+static void ext3_set_journal_features(struct super_block *sb,
+				      journal_t *journal)
+{
+	journal_superblock_t *jsb = journal->j_superblock;
+	__be32 compat = jsb->s_feature_compat;
+	__be32 incompat = jsb->s_feature_incompat;
+
+	if (test_opt(sb, JOURNAL_ASYNC_COMMIT)) {
+		journal_set_features(journal, JFS_FEATURE_COMPAT_CHECKSUM, 0,
+				     JFS_FEATURE_INCOMPAT_ASYNC_COMMIT);
+	} else if (test_opt(sb, JOURNAL_CHECKSUM)) {
+		journal_set_features(journal, JFS_FEATURE_COMPAT_CHECKSUM, 0, 0);
+		journal_clear_features(journal, 0, 0,
+				       JFS_FEATURE_INCOMPAT_ASYNC_COMMIT);
+	} else {
+		journal_clear_features(journal, JFS_FEATURE_COMPAT_CHECKSUM, 0,
+				       JFS_FEATURE_INCOMPAT_ASYNC_COMMIT);
+	}
+
+	if (compat != jsb->s_feature_compat ||
+	    incompat != jsb->s_feature_incompat)
+		journal_update_superblock(journal, 1);
+}
+
 static journal_t *ext3_get_journal(struct super_block *sb,
 				   unsigned int journal_inum)
 {
@@ -2444,6 +2493,19 @@ static int ext3_remount (struct super_block * sb, int * flags, char * data)
 		goto restore_opts;
 	}
 
+	/*
+	 * Transactions may be committing right now, the journal features
+	 * cannot be switched under them.
+	 */
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) &
+	    (EXT3_MOUNT_JOURNAL_CHECKSUM | EXT3_MOUNT_JOURNAL_ASYNC_COMMIT)) {
+		printk(KERN_ERR "EXT3-fs: %s: journal_checksum and "
+		       "journal_async_commit cannot be changed on remount\n",
+		       sb->s_id);
+		err = -EINVAL;
+		goto restore_opts;
+	}
+
 	if (sbi->s_mount_opt & EXT3_MOUNT_ABORT)
 		ext3_abort(sb, __func__, "Abort forced by user");
 
@@ -2521,6 +2583,8 @@ static int ext3_remount (struct super_block * sb, int * flags, char * data)
 			sbi->s_mount_state = le16_to_cpu(es->s_state);
 			if ((err = ext3_group_extend(sb, es, n_blocks_count)))
 				goto restore_opts;
+			/* Nothing has been journalled while read-only */
+			ext3_set_journal_features(sb, sbi->s_journal);
 			if (!ext3_setup_super (sb, es, 0))
 				sb->s_flags &= ~MS_RDONLY;
 		}
@@ -116,6 +116,8 @@ struct ext4_allocation_request {
  * Maximal count of links to a file
  */
 #define EXT4_LINK_MAX		65000
+/* the ext3 limit, kept on filesystems with the ext3 layout */
+#define EXT4_EXT3_LINK_MAX	32000
 
 /*
  * Macro-instructions used to manage several block sizes
@@ -783,6 +785,22 @@ static inline int ext4_valid_inum(struct super_block *sb, unsigned long ino)
 					 EXT4_FEATURE_RO_COMPAT_BTREE_DIR |\
 					 EXT4_FEATURE_RO_COMPAT_HUGE_FILE)
 
+/*
+ * The features an ext3 filesystem may have.  Such a filesystem can be
+ * mounted with mballoc and delayed allocation as long as nothing turns
+ * on a feature outside these sets, so it stays mountable as ext3.
+ */
+#define EXT4_FEATURE_INCOMPAT_EXT3	(EXT4_FEATURE_INCOMPAT_FILETYPE| \
+					 EXT4_FEATURE_INCOMPAT_RECOVER| \
+					 EXT4_FEATURE_INCOMPAT_JOURNAL_DEV| \
+					 EXT4_FEATURE_INCOMPAT_META_BG)
+#define EXT4_FEATURE_RO_COMPAT_EXT3	(EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER| \
+					 EXT4_FEATURE_RO_COMPAT_LARGE_FILE| \
+					 EXT4_FEATURE_RO_COMPAT_BTREE_DIR)
+#define EXT4_HAS_EXT3_LAYOUT(sb)					\
+	(!EXT4_HAS_INCOMPAT_FEATURE(sb, ~EXT4_FEATURE_INCOMPAT_EXT3) &&	\
+	 !EXT4_HAS_RO_COMPAT_FEATURE(sb, ~EXT4_FEATURE_RO_COMPAT_EXT3))
+
 /*
  * Default values for user and/or group using reserved blocks
  */
@@ -880,7 +898,11 @@ static inline __le16 ext4_rec_len_to_disk(unsigned len)
 #define is_dx(dir) (EXT4_HAS_COMPAT_FEATURE(dir->i_sb, \
 				      EXT4_FEATURE_COMPAT_DIR_INDEX) && \
 		      (EXT4_I(dir)->i_flags & EXT4_INDEX_FL))
-#define EXT4_DIR_LINK_MAX(dir) (!is_dx(dir) && (dir)->i_nlink >= EXT4_LINK_MAX)
+/* ext3 has no dir_nlink feature, so indexed directories keep the limit */
+#define EXT4_DIR_LINK_MAX(dir) \
+	(EXT4_HAS_EXT3_LAYOUT((dir)->i_sb) ? \
+	 (dir)->i_nlink >= EXT4_EXT3_LINK_MAX : \
+	 (!is_dx(dir) && (dir)->i_nlink >= EXT4_LINK_MAX))
 #define EXT4_DIR_LINK_EMPTY(dir) ((dir)->i_nlink == 2 || (dir)->i_nlink == 1)
 
 /* Legal values for the dx_root hash_version field: */
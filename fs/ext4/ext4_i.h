@@ -170,6 +170,9 @@ struct ext4_inode_info {
 	unsigned long i_allocated_meta_blocks;
 	unsigned short i_delalloc_reserved_flag;
 	spinlock_t i_block_reservation_lock;
+	/* where the next delalloc block lands if the file stays contiguous */
+	ext4_lblk_t i_da_next_lblk;
+	ext4_fsblk_t i_da_next_pblk;
 };
 
 #endif	/* _EXT4_I */
@@ -138,6 +138,11 @@ struct ext4_sb_info {
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
 	atomic_t s_mb_lost_chunks;
+
+	/* stats for delayed allocation writeback */
+	atomic_t s_da_allocs;	/* allocation requests */
+	atomic_t s_da_blocks;	/* blocks allocated */
+	atomic_t s_da_frags;	/* runs not following the previous block */
 	atomic_t s_mb_preallocated;
 	atomic_t s_mb_discarded;
 
@@ -1836,6 +1836,20 @@ static void mpage_da_map_blocks(struct mpage_da_data *mpd)
 #define BH_FLAGS ((1 << BH_Uptodate) | (1 << BH_Mapped) | \
 		(1 << BH_Delay) | (1 << BH_Unwritten))
 
+/*
+ * Largest chunk of an indirect-mapped file handed to the allocator in
+ * one transaction.  A single get_blocks call never maps across an
+ * indirect block boundary and mballoc returns each request as one
+ * contiguous run, so the credits for a full indirect block are small
+ * (see ext4_indirect_trans_blocks()); there is no need to stop at
+ * EXT4_MAX_TRANS_DATA and split writeback into tiny allocations.
+ */
+static unsigned int ext4_da_indirect_max_blocks(struct inode *inode)
+{
+	return max_t(unsigned int, EXT4_ADDR_PER_BLOCK(inode->i_sb),
+		     EXT4_MAX_TRANS_DATA);
+}
+
 /*
  * mpage_add_bh_to_extent - try to add one more block to extent of blocks
  *
@@ -1855,7 +1869,9 @@ static void mpage_add_bh_to_extent(struct mpage_da_data *mpd,
 
 	/* check if thereserved journal credits might overflow */
 	if (!(EXT4_I(mpd->inode)->i_flags & EXT4_EXTENTS_FL)) {
-		if (nrblocks >= EXT4_MAX_TRANS_DATA) {
+		unsigned int max_blocks = ext4_da_indirect_max_blocks(mpd->inode);
+
+		if (nrblocks >= max_blocks) {
 			/*
 			 * With non-extent format we are limited by the journal
 			 * credit available.  Total credit needed to insert
@@ -1864,13 +1880,13 @@ static void mpage_add_bh_to_extent(struct mpage_da_data *mpd,
 			 */
 			goto flush_it;
 		} else if ((nrblocks + (b_size >> mpd->inode->i_blkbits)) >
-				EXT4_MAX_TRANS_DATA) {
+				max_blocks) {
 			/*
 			 * Adding the new buffer_head would make it cross the
 			 * allowed limit for which we have journal credit
 			 * reserved. So limit the new bh->b_size
 			 */
-			b_size = (EXT4_MAX_TRANS_DATA - nrblocks) <<
+			b_size = (max_blocks - nrblocks) <<
 						mpd->inode->i_blkbits;
 			/* we will do mpage_da_submit_io in the next loop */
 		}
@@ -2093,6 +2109,28 @@ static int ext4_da_get_block_prep(struct inode *inode, sector_t iblock,
 
 	return ret;
 }
+/*
+ * Account a writeback allocation in the per-filesystem statistics.  A
+ * run that does not start right after the previous block of the file
+ * on disk counts as a new fragment.  The per-inode hint is updated
+ * without locking, so the numbers are approximate with concurrent
+ * writeback of one file.
+ */
+static void ext4_da_account_alloc(struct inode *inode, sector_t iblock,
+				  ext4_fsblk_t pblk, int count)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	atomic_inc(&sbi->s_da_allocs);
+	atomic_add(count, &sbi->s_da_blocks);
+	if (!ei->i_da_next_pblk || iblock != ei->i_da_next_lblk ||
+	    pblk != ei->i_da_next_pblk)
+		atomic_inc(&sbi->s_da_frags);
+	ei->i_da_next_lblk = iblock + count;
+	ei->i_da_next_pblk = pblk + count;
+}
+
 #define		EXT4_DELALLOC_RSVED	1
 static int ext4_da_get_block_write(struct inode *inode, sector_t iblock,
 				   struct buffer_head *bh_result, int create)
@@ -2110,6 +2148,9 @@ static int ext4_da_get_block_write(struct inode *inode, sector_t iblock,
 	} else {
 		ret = ext4_get_blocks_wrap(handle, inode, iblock, max_blocks,
 				   bh_result, create, 0, EXT4_DELALLOC_RSVED);
+		if (ret > 0 && buffer_new(bh_result))
+			ext4_da_account_alloc(inode, iblock, bh_result->b_blocknr,
+					      ret);
 	}
 
 	if (ret > 0) {
@@ -2272,9 +2313,9 @@ static int ext4_da_writepages_trans_blocks(struct inode *inode)
 	 * number of contiguous block. So we will limit
 	 * number of contiguous block to a sane value
 	 */
-	if (!(inode->i_flags & EXT4_EXTENTS_FL) &&
-	    (max_blocks > EXT4_MAX_TRANS_DATA))
-		max_blocks = EXT4_MAX_TRANS_DATA;
+	if (!(EXT4_I(inode)->i_flags & EXT4_EXTENTS_FL) &&
+	    (max_blocks > ext4_da_indirect_max_blocks(inode)))
+		max_blocks = ext4_da_indirect_max_blocks(inode);
 
 	return ext4_chunk_trans_blocks(inode, max_blocks);
 }
@@ -2400,7 +2441,7 @@ static int ext4_da_write_begin(struct file *file, struct address_space *mapping,
 	pgoff_t index;
 	unsigned from, to;
 	struct inode *inode = mapping->host;
-	handle_t *handle;
+	handle_t *handle = NULL;
 
 	index = pos >> PAGE_CACHE_SHIFT;
 	from = pos & (PAGE_CACHE_SIZE - 1);
@@ -2411,17 +2452,22 @@ retry:
 	 * With delayed allocation, we don't log the i_disksize update
 	 * if there is delayed block allocation. But we still need
 	 * to journalling the i_disksize update if writes to the end
-	 * of file which has an already mapped buffer.
+	 * of file which has an already mapped buffer.  Writes inside
+	 * i_disksize never touch the journal here: the blocks are only
+	 * reserved, and i_mutex keeps i_disksize from shrinking under us.
 	 */
-	handle = ext4_journal_start(inode, 1);
-	if (IS_ERR(handle)) {
-		ret = PTR_ERR(handle);
-		goto out;
+	if (pos + len > EXT4_I(inode)->i_disksize) {
+		handle = ext4_journal_start(inode, 1);
+		if (IS_ERR(handle)) {
+			ret = PTR_ERR(handle);
+			goto out;
+		}
 	}
 
 	page = __grab_cache_page(mapping, index);
 	if (!page) {
-		ext4_journal_stop(handle);
+		if (handle)
+			ext4_journal_stop(handle);
 		ret = -ENOMEM;
 		goto out;
 	}
@@ -2431,7 +2477,8 @@ retry:
 							ext4_da_get_block_prep);
 	if (ret < 0) {
 		unlock_page(page);
-		ext4_journal_stop(handle);
+		if (handle)
+			ext4_journal_stop(handle);
 		page_cache_release(page);
 	}
 
@@ -2485,7 +2532,7 @@ static int ext4_da_write_end(struct file *file,
 	 */
 
 	new_i_size = pos + copied;
-	if (new_i_size > EXT4_I(inode)->i_disksize) {
+	if (handle && new_i_size > EXT4_I(inode)->i_disksize) {
 		if (ext4_da_should_update_i_disksize(page, end)) {
 			down_write(&EXT4_I(inode)->i_data_sem);
 			if (new_i_size > EXT4_I(inode)->i_disksize) {
@@ -2507,9 +2554,11 @@ static int ext4_da_write_end(struct file *file,
 	copied = ret2;
 	if (ret2 < 0)
 		ret = ret2;
-	ret2 = ext4_journal_stop(handle);
-	if (!ret)
-		ret = ret2;
+	if (handle) {
+		ret2 = ext4_journal_stop(handle);
+		if (!ret)
+			ret = ret2;
+	}
 
 	return ret ? ret : copied;
 }
@@ -4444,7 +4493,7 @@ static int ext4_indirect_trans_blocks(struct inode *inode, int nrblocks,
 static int ext4_index_trans_blocks(struct inode *inode, int nrblocks, int chunk)
 {
 	if (!(EXT4_I(inode)->i_flags & EXT4_EXTENTS_FL))
-		return ext4_indirect_trans_blocks(inode, nrblocks, 0);
+		return ext4_indirect_trans_blocks(inode, nrblocks, chunk);
 	return ext4_ext_index_trans_blocks(inode, nrblocks, 0);
 }
 /*
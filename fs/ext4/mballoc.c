@@ -2720,6 +2720,7 @@ ext4_mb_free_committed_blocks(struct super_block *sb)
 #define EXT4_MB_ORDER2_REQ		"order2_req"
 #define EXT4_MB_STREAM_REQ		"stream_req"
 #define EXT4_MB_GROUP_PREALLOC		"group_prealloc"
+#define EXT4_DA_STATS_NAME		"delalloc_stats"
 
 
 
@@ -2770,6 +2771,32 @@ MB_PROC_FOPS(order2_reqs);
 MB_PROC_FOPS(stream_request);
 MB_PROC_FOPS(group_prealloc);
 
+static int ext4_da_stats_proc_show(struct seq_file *m, void *v)
+{
+	struct ext4_sb_info *sbi = m->private;
+	unsigned int frags = atomic_read(&sbi->s_da_frags);
+	unsigned int blocks = atomic_read(&sbi->s_da_blocks);
+
+	seq_printf(m, "allocations: %u\n", atomic_read(&sbi->s_da_allocs));
+	seq_printf(m, "blocks: %u\n", blocks);
+	seq_printf(m, "fragments: %u\n", frags);
+	seq_printf(m, "blocks per fragment: %u\n", frags ? blocks / frags : 0);
+	return 0;
+}
+
+static int ext4_da_stats_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_da_stats_proc_show, PDE(inode)->data);
+}
+
+static const struct file_operations ext4_da_stats_proc_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_da_stats_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 #define	MB_PROC_HANDLER(name, var)					\
 do {									\
 	proc = proc_create_data(name, mode, sbi->s_mb_proc,		\
@@ -2801,10 +2828,19 @@ static int ext4_mb_init_per_dev_proc(struct super_block *sb)
 	MB_PROC_HANDLER(EXT4_MB_STREAM_REQ, stream_request);
 	MB_PROC_HANDLER(EXT4_MB_GROUP_PREALLOC, group_prealloc);
 
+	proc = proc_create_data(EXT4_DA_STATS_NAME, S_IRUGO, sbi->s_mb_proc,
+				&ext4_da_stats_proc_fops, sbi);
+	if (proc == NULL) {
+		printk(KERN_ERR "EXT4-fs: can't to create %s\n",
+		       EXT4_DA_STATS_NAME);
+		goto err_out;
+	}
+
 	return 0;
 
 err_out:
 	printk(KERN_ERR "EXT4-fs: Unable to create %s\n", devname);
+	remove_proc_entry(EXT4_DA_STATS_NAME, sbi->s_mb_proc);
 	remove_proc_entry(EXT4_MB_GROUP_PREALLOC, sbi->s_mb_proc);
 	remove_proc_entry(EXT4_MB_STREAM_REQ, sbi->s_mb_proc);
 	remove_proc_entry(EXT4_MB_ORDER2_REQ, sbi->s_mb_proc);
@@ -2826,6 +2862,7 @@ static int ext4_mb_destroy_per_dev_proc(struct super_block *sb)
 		return -EINVAL;
 
 	bdevname(sb->s_bdev, devname);
+	remove_proc_entry(EXT4_DA_STATS_NAME, sbi->s_mb_proc);
 	remove_proc_entry(EXT4_MB_GROUP_PREALLOC, sbi->s_mb_proc);
 	remove_proc_entry(EXT4_MB_STREAM_REQ, sbi->s_mb_proc);
 	remove_proc_entry(EXT4_MB_ORDER2_REQ, sbi->s_mb_proc);
@@ -578,6 +578,8 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	ei->i_allocated_meta_blocks = 0;
 	ei->i_delalloc_reserved_flag = 0;
 	spin_lock_init(&(ei->i_block_reservation_lock));
+	ei->i_da_next_lblk = 0;
+	ei->i_da_next_pblk = 0;
 	return &ei->vfs_inode;
 }
 
@@ -2008,7 +2010,7 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	 */
 	if (EXT4_HAS_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_EXTENTS))
 		set_opt(sbi->s_mount_opt, EXTENTS);
-	else
+	else if (!EXT4_HAS_EXT3_LAYOUT(sb))
 		ext4_warning(sb, __func__,
 			"extents feature not enabled on this filesystem, "
 			"use tune2fs.\n");
@@ -2042,9 +2044,14 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 
 	/*
 	 * Since ext4 is still considered development code, we require
-	 * that the TEST_FILESYS flag in s->flags be set.
+	 * that the TEST_FILESYS flag in s->flags be set.  Plain ext3
+	 * filesystems are let through: we never add ext4 features to
+	 * them, so they can always go back to the ext3 driver.
 	 */
-	if (!(le32_to_cpu(es->s_flags) & EXT2_FLAGS_TEST_FILESYS)) {
+	if (EXT4_HAS_EXT3_LAYOUT(sb)) {
+		printk(KERN_INFO "EXT4-fs: %s: ext3 layout, ext4 features "
+		       "will not be enabled\n", sb->s_id);
+	} else if (!(le32_to_cpu(es->s_flags) & EXT2_FLAGS_TEST_FILESYS)) {
 		printk(KERN_WARNING "EXT4-fs: %s: not marked "
 		       "OK to use with test code.\n", sb->s_id);
 		goto failed_mount;
@@ -2985,6 +2992,19 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		goto restore_opts;
 	}
 
+	/*
+	 * Transactions may be committing right now, the journal features
+	 * cannot be switched under them.
+	 */
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) &
+	    (EXT4_MOUNT_JOURNAL_CHECKSUM | EXT4_MOUNT_JOURNAL_ASYNC_COMMIT)) {
+		printk(KERN_ERR "EXT4-fs: %s: journal_checksum and "
+		       "journal_async_commit cannot be changed on remount\n",
+		       sb->s_id);
+		err = -EINVAL;
+		goto restore_opts;
+	}
+
 	if (sbi->s_mount_opt & EXT4_MOUNT_ABORT)
 		ext4_abort(sb, __func__, "Abort forced by user");
 
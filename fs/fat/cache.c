@@ -11,12 +11,24 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/buffer_head.h>
+#include <linux/rbtree.h>
+#include <linux/swap.h>
 
-/* this must be > 0. */
-#define FAT_MAX_CACHE	8
+/*
+ * Every inode can cache at least this many runs of contiguous clusters,
+ * and at most one per cluster of the file or fat_cache_limit, which is
+ * scaled by the memory size.  Runs are found through an rbtree, so a
+ * big cache does not slow down lookups; the LRU list picks the run to
+ * drop once an inode has as many as it may have.
+ */
+#define FAT_MAX_CACHE	8	/* this must be > 0. */
+#define FAT_CACHE_LIMIT	65536
+
+static int fat_cache_limit __read_mostly = FAT_MAX_CACHE;
 
 struct fat_cache {
 	struct list_head cache_list;
+	struct rb_node rb_node;
 	int nr_contig;	/* number of contiguous clusters */
 	int fcluster;	/* cluster number in the file. */
 	int dcluster;	/* cluster number on disk. */
@@ -31,7 +43,10 @@ struct fat_cache_id {
 
 static inline int fat_max_cache(struct inode *inode)
 {
-	return FAT_MAX_CACHE;
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
+	loff_t clusters = i_size_read(inode) >> sbi->cluster_bits;
+
+	return clamp_t(loff_t, clusters + 1, FAT_MAX_CACHE, fat_cache_limit);
 }
 
 static struct kmem_cache *fat_cache_cachep;
@@ -51,6 +66,8 @@ int __init fat_cache_init(void)
 				init_once);
 	if (fat_cache_cachep == NULL)
 		return -ENOMEM;
+	fat_cache_limit = clamp_t(unsigned long, totalram_pages >> 6,
+				  FAT_MAX_CACHE, FAT_CACHE_LIMIT);
 	return 0;
 }
 
@@ -81,25 +98,24 @@ static int fat_cache_lookup(struct inode *inode, int fclus,
 			    struct fat_cache_id *cid,
 			    int *cached_fclus, int *cached_dclus)
 {
-	static struct fat_cache nohit = { .fcluster = 0, };
-
-	struct fat_cache *hit = &nohit, *p;
+	struct rb_node *n;
+	struct fat_cache *hit = NULL, *p;
 	int offset = -1;
 
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the cache of "fclus" or nearest cache. */
-		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
+	/* Find the cache of "fclus" or nearest cache. */
+	n = MSDOS_I(inode)->cache_tree.rb_node;
+	while (n) {
+		p = rb_entry(n, struct fat_cache, rb_node);
+		if (p->fcluster > fclus)
+			n = n->rb_left;
+		else {
 			hit = p;
-			if ((hit->fcluster + hit->nr_contig) < fclus) {
-				offset = hit->nr_contig;
-			} else {
-				offset = fclus - hit->fcluster;
-				break;
-			}
+			n = n->rb_right;
 		}
 	}
-	if (hit != &nohit) {
+	if (hit) {
+		offset = min(fclus - hit->fcluster, hit->nr_contig);
 		fat_cache_update_lru(inode, hit);
 
 		cid->id = MSDOS_I(inode)->cache_valid_id;
@@ -114,21 +130,38 @@ static int fat_cache_lookup(struct inode *inode, int fclus,
 	return offset;
 }
 
+/* Find the run starting at "new", or link "cache" in its place. */
 static struct fat_cache *fat_cache_merge(struct inode *inode,
-					 struct fat_cache_id *new)
+					 struct fat_cache_id *new,
+					 struct fat_cache *cache)
 {
+	struct rb_node **link = &MSDOS_I(inode)->cache_tree.rb_node;
+	struct rb_node *parent = NULL;
 	struct fat_cache *p;
 
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the same part as "new" in cluster-chain. */
-		if (p->fcluster == new->fcluster) {
+	while (*link) {
+		parent = *link;
+		p = rb_entry(parent, struct fat_cache, rb_node);
+		if (new->fcluster < p->fcluster)
+			link = &parent->rb_left;
+		else if (new->fcluster > p->fcluster)
+			link = &parent->rb_right;
+		else {
+			/* Found the same part as "new" in cluster-chain. */
 			BUG_ON(p->dcluster != new->dcluster);
 			if (new->nr_contig > p->nr_contig)
 				p->nr_contig = new->nr_contig;
 			return p;
 		}
 	}
-	return NULL;
+	if (cache) {
+		cache->fcluster = new->fcluster;
+		cache->dcluster = new->dcluster;
+		cache->nr_contig = new->nr_contig;
+		rb_link_node(&cache->rb_node, parent, link);
+		rb_insert_color(&cache->rb_node, &MSDOS_I(inode)->cache_tree);
+	}
+	return cache;
 }
 
 static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
@@ -143,7 +176,7 @@ static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 	    new->id != MSDOS_I(inode)->cache_valid_id)
 		goto out;	/* this cache was invalidated */
 
-	cache = fat_cache_merge(inode, new);
+	cache = fat_cache_merge(inode, new, NULL);
 	if (cache == NULL) {
 		if (MSDOS_I(inode)->nr_caches < fat_max_cache(inode)) {
 			MSDOS_I(inode)->nr_caches++;
@@ -151,22 +184,22 @@ static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 
 			tmp = fat_cache_alloc(inode);
 			spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-			cache = fat_cache_merge(inode, new);
-			if (cache != NULL) {
+			if (tmp == NULL) {
+				MSDOS_I(inode)->nr_caches--;
+				goto out;
+			}
+			cache = fat_cache_merge(inode, new, tmp);
+			if (cache != tmp) {
 				MSDOS_I(inode)->nr_caches--;
 				fat_cache_free(tmp);
-				goto out_update_lru;
 			}
-			cache = tmp;
 		} else {
 			struct list_head *p = MSDOS_I(inode)->cache_lru.prev;
-			cache = list_entry(p, struct fat_cache, cache_list);
+			tmp = list_entry(p, struct fat_cache, cache_list);
+			rb_erase(&tmp->rb_node, &MSDOS_I(inode)->cache_tree);
+			cache = fat_cache_merge(inode, new, tmp);
 		}
-		cache->fcluster = new->fcluster;
-		cache->dcluster = new->dcluster;
-		cache->nr_contig = new->nr_contig;
 	}
-out_update_lru:
 	fat_cache_update_lru(inode, cache);
 out:
 	spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
@@ -187,6 +220,7 @@ static void __fat_cache_inval_inode(struct inode *inode)
 		i->nr_caches--;
 		fat_cache_free(cache);
 	}
+	i->cache_tree = RB_ROOT;
 	/* Update. The copy of caches before this id is discarded. */
 	i->cache_valid_id++;
 	if (i->cache_valid_id == FAT_CACHE_VALID)
@@ -202,8 +236,10 @@ void fat_cache_inval_inode(struct inode *inode)
 
 static inline int cache_contiguous(struct fat_cache_id *cid, int dclus)
 {
+	if ((cid->dcluster + cid->nr_contig + 1) != dclus)
+		return 0;
 	cid->nr_contig++;
-	return ((cid->dcluster + cid->nr_contig) == dclus);
+	return 1;
 }
 
 static inline void cache_init(struct fat_cache_id *cid, int fclus, int dclus)
@@ -218,8 +254,10 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 {
 	struct super_block *sb = inode->i_sb;
 	const int limit = sb->s_maxbytes >> MSDOS_SB(sb)->cluster_bits;
+	const int reada_min = (sb->s_blocksize << 3) / MSDOS_SB(sb)->fat_bits;
 	struct fat_entry fatent;
 	struct fat_cache_id cid;
+	sector_t reada_end = 0;
 	int nr;
 
 	BUG_ON(MSDOS_I(inode)->i_start == 0);
@@ -248,6 +286,10 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 			goto out;
 		}
 
+		/* Long walks read the FAT ahead rather than block by block */
+		if (cluster - *fclus > reada_min)
+			fat_ent_reada_chain(sb, *dclus, &reada_end);
+
 		nr = fat_ent_read(inode, &fatent, *dclus);
 		if (nr < 0)
 			goto out;
@@ -263,8 +305,14 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 		}
 		(*fclus)++;
 		*dclus = nr;
-		if (!cache_contiguous(&cid, *dclus))
+		if (!cache_contiguous(&cid, *dclus)) {
+			/*
+			 * Keep every run on the way, so the whole chain up to
+			 * "cluster" ends up in the cache, not only its tail.
+			 */
+			fat_cache_add(inode, &cid);
 			cache_init(&cid, *fclus, *dclus);
+		}
 	}
 	nr = 0;
 	fat_cache_add(inode, &cid);
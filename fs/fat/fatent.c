@@ -606,6 +606,32 @@ static void fat_ent_reada(struct super_block *sb, struct fat_entry *fatent,
 		sb_breadahead(sb, blocknr + i);
 }
 
+/*
+ * Readahead for cluster chain walks.  The chain of a file written in one
+ * go mostly moves forward through the FAT, so when the walk leaves the
+ * window read ahead last time (ending before *@reada_end), read ahead a
+ * new one from the FAT block holding @entry.
+ */
+void fat_ent_reada_chain(struct super_block *sb, int entry,
+			 sector_t *reada_end)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	unsigned long reada_blocks, rest, i;
+	sector_t blocknr;
+	int offset;
+
+	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
+	sbi->fatent_ops->ent_blocknr(sb, entry, &offset, &blocknr);
+	if (blocknr < *reada_end && blocknr + reada_blocks >= *reada_end)
+		return;
+
+	rest = sbi->fat_start + sbi->fat_length - blocknr;
+	reada_blocks = min(reada_blocks, rest);
+	for (i = 0; i < reada_blocks; i++)
+		sb_breadahead(sb, blocknr + i);
+	*reada_end = blocknr + reada_blocks;
+}
+
 int fat_count_free_clusters(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
@@ -20,6 +20,8 @@
 #include <linux/slab.h>
 #include <linux/mm.h>
 #include <linux/pagemap.h>
+#include <linux/blkdev.h>
+#include <linux/crc32.h>
 
 /*
  * Default IO end handler for temporary BJ_IO buffer_heads.
@@ -105,21 +107,24 @@ static int inverted_lock(journal_t *journal, struct buffer_head *bh)
 	return 1;
 }
 
-/* Done it all: now write the commit record.  We should have
+/*
+ * Done it all: now submit the commit record.  We should have
  * cleaned up our previous buffers by now, so if we are in abort
  * mode we can now just skip the rest of the journal write
  * entirely.
  *
  * Returns 1 if the journal needs to be aborted or 0 on success
  */
-static int journal_write_commit_record(journal_t *journal,
-					transaction_t *commit_transaction)
+static int journal_submit_commit_record(journal_t *journal,
+					transaction_t *commit_transaction,
+					struct buffer_head **cbh,
+					__u32 crc32_sum)
 {
 	struct journal_head *descriptor;
+	struct commit_header *tmp;
 	struct buffer_head *bh;
-	journal_header_t *header;
 	int ret;
-	int barrier_done = 0;
+	struct timespec now = current_kernel_time();
 
 	if (is_journal_aborted(journal))
 		return 0;
@@ -130,26 +135,62 @@ static int journal_write_commit_record(journal_t *journal,
 
 	bh = jh2bh(descriptor);
 
-	header = (journal_header_t *)(bh->b_data);
-	header->h_magic = cpu_to_be32(JFS_MAGIC_NUMBER);
-	header->h_blocktype = cpu_to_be32(JFS_COMMIT_BLOCK);
-	header->h_sequence = cpu_to_be32(commit_transaction->t_tid);
+	tmp = (struct commit_header *)bh->b_data;
+	tmp->h_magic = cpu_to_be32(JFS_MAGIC_NUMBER);
+	tmp->h_blocktype = cpu_to_be32(JFS_COMMIT_BLOCK);
+	tmp->h_sequence = cpu_to_be32(commit_transaction->t_tid);
+	tmp->h_commit_sec = cpu_to_be64(now.tv_sec);
+	tmp->h_commit_nsec = cpu_to_be32(now.tv_nsec);
+
+	if (JFS_HAS_COMPAT_FEATURE(journal, JFS_FEATURE_COMPAT_CHECKSUM)) {
+		tmp->h_chksum_type = JFS_CRC32_CHKSUM;
+		tmp->h_chksum_size = JFS_CRC32_CHKSUM_SIZE;
+		tmp->h_chksum[0] = cpu_to_be32(crc32_sum);
+	}
 
-	JBUFFER_TRACE(descriptor, "write commit block");
+	JBUFFER_TRACE(descriptor, "submit commit block");
+	lock_buffer(bh);
+	get_bh(bh);
 	set_buffer_dirty(bh);
-	if (journal->j_flags & JFS_BARRIER) {
+	set_buffer_uptodate(bh);
+	bh->b_end_io = journal_end_buffer_io_sync;
+
+	/*
+	 * An async commit block is written together with the rest of the
+	 * transaction and recovery relies on the checksum to tell whether
+	 * all of it made it to disk, so it must not be a barrier.
+	 */
+	if (journal->j_flags & JFS_BARRIER &&
+	    !JFS_HAS_INCOMPAT_FEATURE(journal,
+				      JFS_FEATURE_INCOMPAT_ASYNC_COMMIT))
 		set_buffer_ordered(bh);
-		barrier_done = 1;
-	}
-	ret = sync_dirty_buffer(bh);
-	if (barrier_done)
-		clear_buffer_ordered(bh);
+	ret = submit_bh(WRITE, bh);
+	clear_buffer_ordered(bh);
+
+	*cbh = bh;
+	return ret == -EIO;
+}
+
+/*
+ * Wait for the commit record submitted by journal_submit_commit_record().
+ * An async commit block went out without a barrier, so flush the disk
+ * cache here: once the commit returns the transaction must be on stable
+ * storage.
+ */
+static int journal_wait_on_commit_record(journal_t *journal,
+					 struct buffer_head *bh)
+{
+	int ret = 0;
+
+	clear_buffer_dirty(bh);
+	wait_on_buffer(bh);
+
 	/* is it possible for another commit to fail at roughly
 	 * the same time as this one?  If so, we don't want to
 	 * trust the barrier flag in the super, but instead want
 	 * to remember if we sent a barrier request
 	 */
-	if (ret == -EOPNOTSUPP && barrier_done) {
+	if (buffer_eopnotsupp(bh) && journal->j_flags & JFS_BARRIER) {
 		char b[BDEVNAME_SIZE];
 
 		printk(KERN_WARNING
@@ -161,14 +202,46 @@ static int journal_write_commit_record(journal_t *journal,
 		spin_unlock(&journal->j_state_lock);
 
 		/* And try again, without the barrier */
+		clear_buffer_eopnotsupp(bh);
 		set_buffer_uptodate(bh);
 		set_buffer_dirty(bh);
-		ret = sync_dirty_buffer(bh);
+		sync_dirty_buffer(bh);
 	}
+
+	if (unlikely(!buffer_uptodate(bh)))
+		ret = -EIO;
 	put_bh(bh);		/* One for getblk() */
-	journal_put_journal_head(descriptor);
+	journal_put_journal_head(bh2jh(bh));
+
+	if (!ret && journal->j_flags & JFS_BARRIER &&
+	    JFS_HAS_INCOMPAT_FEATURE(journal,
+				     JFS_FEATURE_INCOMPAT_ASYNC_COMMIT) &&
+	    blkdev_issue_flush(journal->j_dev, NULL) == -EOPNOTSUPP) {
+		char b[BDEVNAME_SIZE];
 
-	return (ret == -EIO);
+		printk(KERN_WARNING
+			"JBD: cache flush failed on %s - disabling barriers\n",
+			bdevname(journal->j_dev, b));
+		spin_lock(&journal->j_state_lock);
+		journal->j_flags &= ~JFS_BARRIER;
+		spin_unlock(&journal->j_state_lock);
+	}
+
+	return ret;
+}
+
+static __u32 journal_checksum_data(__u32 crc32_sum, struct buffer_head *bh)
+{
+	struct page *page = bh->b_page;
+	char *addr;
+	__u32 checksum;
+
+	addr = kmap_atomic(page, KM_USER0);
+	checksum = crc32_be(crc32_sum,
+		(void *)(addr + offset_in_page(bh->b_data)), bh->b_size);
+	kunmap_atomic(addr, KM_USER0);
+
+	return checksum;
 }
 
 static void journal_do_submit_data(struct buffer_head **wbuf, int bufs)
@@ -313,6 +386,10 @@ void journal_commit_transaction(journal_t *journal)
 	int first_tag = 0;
 	int tag_flag;
 	int i;
+	struct buffer_head *cbh = NULL; /* For transactional checksums */
+	__u32 crc32_sum = ~0;
+	int async_commit = JFS_HAS_INCOMPAT_FEATURE(journal,
+					JFS_FEATURE_INCOMPAT_ASYNC_COMMIT);
 
 	/*
 	 * First job: lock down the current transaction and wait for
@@ -650,6 +727,15 @@ void journal_commit_transaction(journal_t *journal)
 start_journal_io:
 			for (i = 0; i < bufs; i++) {
 				struct buffer_head *bh = wbuf[i];
+				/*
+				 * Compute checksum.
+				 */
+				if (JFS_HAS_COMPAT_FEATURE(journal,
+					JFS_FEATURE_COMPAT_CHECKSUM)) {
+					crc32_sum =
+					    journal_checksum_data(crc32_sum, bh);
+				}
+
 				lock_buffer(bh);
 				clear_buffer_dirty(bh);
 				set_buffer_uptodate(bh);
@@ -665,6 +751,15 @@ start_journal_io:
 		}
 	}
 
+	/* Done it all: with async commit the commit record goes out right
+	   behind the rest of the transaction instead of after it. */
+
+	if (async_commit) {
+		if (journal_submit_commit_record(journal, commit_transaction,
+						 &cbh, crc32_sum))
+			err = -EIO;
+	}
+
 	/* Lo and behold: we have just managed to send a transaction to
            the log.  Before we can commit it, wait for the IO so far to
            complete.  Control buffers being written are on the
@@ -764,8 +859,17 @@ wait_for_iobuf:
 
 	jbd_debug(3, "JBD: commit phase 6\n");
 
-	if (journal_write_commit_record(journal, commit_transaction))
-		err = -EIO;
+	if (!async_commit) {
+		if (journal_submit_commit_record(journal, commit_transaction,
+						 &cbh, crc32_sum))
+			err = -EIO;
+	}
+	if (cbh) {
+		int ret = journal_wait_on_commit_record(journal, cbh);
+
+		if (!err)
+			err = ret;
+	}
 
 	if (err)
 		journal_abort(journal, err);
@@ -21,6 +21,7 @@
 #include <linux/jbd.h>
 #include <linux/errno.h>
 #include <linux/slab.h>
+#include <linux/crc32.h>
 #endif
 
 /*
@@ -307,6 +308,55 @@ int journal_skip_recovery(journal_t *journal)
 	return err;
 }
 
+/*
+ * calc_chksums calculates the checksums for the blocks described in the
+ * descriptor block.
+ */
+static int calc_chksums(journal_t *journal, struct buffer_head *bh,
+			unsigned long *next_log_block, __u32 *crc32_sum)
+{
+	int i, num_blks, err;
+	unsigned long io_block;
+	struct buffer_head *obh;
+
+	num_blks = count_tags(bh, journal->j_blocksize);
+	/* Calculate checksum of the descriptor block. */
+	*crc32_sum = crc32_be(*crc32_sum, (void *)bh->b_data, bh->b_size);
+
+	for (i = 0; i < num_blks; i++) {
+		io_block = (*next_log_block)++;
+		wrap(journal, *next_log_block);
+		err = jread(&obh, journal, io_block);
+		if (err) {
+			printk(KERN_ERR "JBD: IO error %d recovering block "
+				"%lu in log\n", err, io_block);
+			return err;
+		}
+		*crc32_sum = crc32_be(*crc32_sum, (void *)obh->b_data,
+				      obh->b_size);
+		brelse(obh);
+	}
+	return 0;
+}
+
+/*
+ * Check the checksum in a commit block against the one computed over the
+ * transaction.  Commit blocks written before the journal had checksums
+ * enabled carry no checksum at all and are accepted.
+ */
+static int commit_chksum_ok(struct buffer_head *bh, __u32 crc32_sum)
+{
+	struct commit_header *cbh = (struct commit_header *)bh->b_data;
+	__u32 found_chksum = be32_to_cpu(cbh->h_chksum[0]);
+
+	if (cbh->h_chksum_type == 0 && cbh->h_chksum_size == 0 &&
+	    found_chksum == 0)
+		return 1;
+	return cbh->h_chksum_type == JFS_CRC32_CHKSUM &&
+	       cbh->h_chksum_size == JFS_CRC32_CHKSUM_SIZE &&
+	       found_chksum == crc32_sum;
+}
+
 static int do_one_pass(journal_t *journal,
 			struct recovery_info *info, enum passtype pass)
 {
@@ -318,6 +368,7 @@ static int do_one_pass(journal_t *journal,
 	struct buffer_head *	bh;
 	unsigned int		sequence;
 	int			blocktype;
+	__u32			crc32_sum = ~0; /* Transactional Checksums */
 
 	/* Precompute the maximum metadata descriptors in a descriptor block */
 	int			MAX_BLOCKS_PER_DESC;
@@ -409,8 +460,19 @@ static int do_one_pass(journal_t *journal,
 		switch(blocktype) {
 		case JFS_DESCRIPTOR_BLOCK:
 			/* If it is a valid descriptor block, replay it
-			 * in pass REPLAY; otherwise, just skip over the
-			 * blocks it describes. */
+			 * in pass REPLAY; if journal checksums are enabled,
+			 * calculate them in PASS_SCAN, otherwise just skip
+			 * over the blocks it describes. */
+			if (pass == PASS_SCAN &&
+			    JFS_HAS_COMPAT_FEATURE(journal,
+					JFS_FEATURE_COMPAT_CHECKSUM)) {
+				err = calc_chksums(journal, bh,
+						   &next_log_block, &crc32_sum);
+				brelse(bh);
+				if (err)
+					goto failed;
+				continue;
+			}
 			if (pass != PASS_REPLAY) {
 				next_log_block +=
 					count_tags(bh, journal->j_blocksize);
@@ -506,9 +568,35 @@ static int do_one_pass(journal_t *journal,
 			continue;
 
 		case JFS_COMMIT_BLOCK:
-			/* Found an expected commit block: not much to
-			 * do other than move on to the next sequence
-			 * number. */
+			/* Found an expected commit block: if checksums
+			 * are present verify them in PASS_SCAN, else not
+			 * much to do other than move on to the next
+			 * sequence number.
+			 *
+			 * With async commit the commit block may reach
+			 * the disk before the rest of the transaction, so
+			 * a bad checksum just means the commit was
+			 * interrupted.  Without it the commit block is
+			 * written last and a bad checksum is corruption.
+			 * Either way the transaction is not replayed and
+			 * the log ends here. */
+			if (pass == PASS_SCAN &&
+			    JFS_HAS_COMPAT_FEATURE(journal,
+					JFS_FEATURE_COMPAT_CHECKSUM)) {
+				int ok = commit_chksum_ok(bh, crc32_sum);
+
+				crc32_sum = ~0;
+				if (!ok) {
+					if (!JFS_HAS_INCOMPAT_FEATURE(journal,
+					    JFS_FEATURE_INCOMPAT_ASYNC_COMMIT))
+						printk(KERN_ERR "JBD: checksum "
+						       "error in transaction "
+						       "%u, log truncated\n",
+						       next_commit_ID);
+					brelse(bh);
+					goto done;
+				}
+			}
 			brelse(bh);
 			next_commit_ID++;
 			continue;
@@ -19,6 +19,7 @@
 
 
 static int jffs2_garbage_collect_thread(void *);
+static int jffs2_build_thread(void *);
 
 void jffs2_garbage_collect_trigger(struct jffs2_sb_info *c)
 {
@@ -147,3 +148,42 @@ static int jffs2_garbage_collect_thread(void *_c)
 	spin_unlock(&c->erase_completion_lock);
 	complete_and_exit(&c->gc_thread_exit, 0);
 }
+
+/* Called from jffs2_build_filesystem() with JFFS2_SB_FLAG_BUILDING set.
+   On failure the caller has to do the build itself. */
+int jffs2_start_build_thread(struct jffs2_sb_info *c)
+{
+	pid_t pid;
+
+	c->build_pending = 1;
+
+	pid = kernel_thread(jffs2_build_thread, c, CLONE_FS|CLONE_FILES);
+	if (pid < 0) {
+		printk(KERN_WARNING "fork failed for JFFS2 build thread: %d\n", -pid);
+		c->build_pending = 0;
+		complete(&c->build_thread_exit);
+		return pid;
+	}
+
+	D1(printk(KERN_DEBUG "JFFS2: Build thread is pid %d\n", pid));
+	return 0;
+}
+
+static int jffs2_build_thread(void *_c)
+{
+	struct jffs2_sb_info *c = _c;
+
+	daemonize("jffs2_build_mtd%d", c->mtd->index);
+
+	jffs2_build_inocaches(c);
+	D1(printk(KERN_DEBUG "jffs2_build_thread(): build complete\n"));
+
+	c->build_pending = 0;
+	wake_up_all(&c->build_wait);
+
+	/* Erases and GC were held off while the build ran */
+	jffs2_erase_pending_trigger(c);
+	jffs2_garbage_collect_trigger(c);
+
+	complete_and_exit(&c->build_thread_exit, 0);
+}
@@ -84,38 +84,23 @@ static void jffs2_build_inode_pass1(struct jffs2_sb_info *c,
 	}
 }
 
-/* Scan plan:
- - Scan physical nodes. Build map of inodes/dirents. Allocate inocaches as we go
- - Scan directory tree from top down, setting nlink in inocaches
- - Scan inocaches for inodes with nlink==0
-*/
-static int jffs2_build_filesystem(struct jffs2_sb_info *c)
+/*
+ * Directory tree passes of the build: work out nlink for every inode from
+ * the dirents collected by the scan, remove the unlinked inodes and build
+ * the xattr subsystem. Called with JFFS2_SB_FLAG_BUILDING set, clears it.
+ * Pass 1 of the root directory has already been done by the caller.
+ */
+void jffs2_build_inocaches(struct jffs2_sb_info *c)
 {
-	int ret;
 	int i;
 	struct jffs2_inode_cache *ic;
 	struct jffs2_full_dirent *fd;
 	struct jffs2_full_dirent *dead_fds = NULL;
 
-	dbg_fsbuild("build FS data structures\n");
-
-	/* First, scan the medium and build all the inode caches with
-	   lists of physical nodes */
-
-	c->flags |= JFFS2_SB_FLAG_SCANNING;
-	ret = jffs2_scan_medium(c);
-	c->flags &= ~JFFS2_SB_FLAG_SCANNING;
-	if (ret)
-		goto exit;
-
-	dbg_fsbuild("scanned flash completely\n");
-	jffs2_dbg_dump_block_lists_nolock(c);
-
 	dbg_fsbuild("pass 1 starting\n");
-	c->flags |= JFFS2_SB_FLAG_BUILDING;
 	/* Now scan the directory tree, increasing nlink according to every dirent found. */
 	for_each_inode(i, c, ic) {
-		if (ic->scan_dents) {
+		if (ic->scan_dents && ic->ino != 1) {
 			jffs2_build_inode_pass1(c, ic);
 			cond_resched();
 		}
@@ -168,10 +153,55 @@ static int jffs2_build_filesystem(struct jffs2_sb_info *c)
 	c->flags &= ~JFFS2_SB_FLAG_BUILDING;
 
 	dbg_fsbuild("FS build complete\n");
+}
+
+/* Scan plan:
+ - Scan physical nodes. Build map of inodes/dirents. Allocate inocaches as we go
+ - Scan directory tree from top down, setting nlink in inocaches
+ - Scan inocaches for inodes with nlink==0
+*/
+static int jffs2_build_filesystem(struct jffs2_sb_info *c)
+{
+	int ret;
+	int i;
+	struct jffs2_inode_cache *ic;
+	struct jffs2_full_dirent *fd;
+
+	dbg_fsbuild("build FS data structures\n");
+
+	/* First, scan the medium and build all the inode caches with
+	   lists of physical nodes */
+
+	c->flags |= JFFS2_SB_FLAG_SCANNING;
+	ret = jffs2_scan_medium(c);
+	c->flags &= ~JFFS2_SB_FLAG_SCANNING;
+	if (ret)
+		goto exit;
+
+	dbg_fsbuild("scanned flash completely\n");
+	jffs2_dbg_dump_block_lists_nolock(c);
 
 	/* Rotate the lists by some number to ensure wear levelling */
 	jffs2_rotate_lists(c);
 
+	c->flags |= JFFS2_SB_FLAG_BUILDING;
+
+	/* The root inode is read as soon as we return, possibly while a
+	   lazy build is still running. Do pass 1 for the root directory
+	   here, so that its dirents pointing to missing inodes are gone
+	   and the build thread never touches the root's nodes. */
+	ic = jffs2_get_ino_cache(c, 1);
+	if (ic && ic->scan_dents)
+		jffs2_build_inode_pass1(c, ic);
+
+	/* With the "lazy_build" mount option the directory tree passes run
+	   in a kernel thread and the mount completes straight after the
+	   scan. Everybody who needs nlink counts or the xattr subsystem
+	   waits in jffs2_wait_for_build() until they are done. */
+	if (c->mount_opts.lazy_build && !jffs2_start_build_thread(c))
+		return 0;
+
+	jffs2_build_inocaches(c);
 	ret = 0;
 
 exit:
@@ -107,6 +107,10 @@ void jffs2_erase_pending_blocks(struct jffs2_sb_info *c, int count)
 {
 	struct jffs2_eraseblock *jeb;
 
+	/* Erase completion walks the inode caches the build is changing */
+	if (c->build_pending)
+		return;
+
 	mutex_lock(&c->erase_free_sem);
 
 	spin_lock(&c->erase_completion_lock);
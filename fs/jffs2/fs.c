@@ -245,6 +245,12 @@ struct inode *jffs2_iget(struct super_block *sb, unsigned long ino)
 	int ret;
 
 	D1(printk(KERN_DEBUG "jffs2_iget(): ino == %lu\n", ino));
+	c = JFFS2_SB_INFO(sb);
+
+	/* The root inode is read at mount time, everything else needs
+	   the nlink counts from the build */
+	if (ino != 1)
+		jffs2_wait_for_build(c);
 
 	inode = iget_locked(sb, ino);
 	if (!inode)
@@ -253,7 +259,6 @@ struct inode *jffs2_iget(struct super_block *sb, unsigned long ino)
 		return inode;
 
 	f = JFFS2_INODE_INFO(inode);
-	c = JFFS2_SB_INFO(inode->i_sb);
 
 	jffs2_init_inode_info(f);
 	mutex_lock(&f->sem);
@@ -405,7 +410,7 @@ void jffs2_write_super (struct super_block *sb)
 	struct jffs2_sb_info *c = JFFS2_SB_INFO(sb);
 	sb->s_dirt = 0;
 
-	if (sb->s_flags & MS_RDONLY)
+	if (sb->s_flags & MS_RDONLY || c->build_pending)
 		return;
 
 	D1(printk(KERN_DEBUG "jffs2_write_super()\n"));
@@ -563,6 +568,8 @@ int jffs2_do_fill_super(struct super_block *sb, void *data, int silent)
  out_root_i:
 	iput(root_i);
 out_root:
+	if (c->mount_opts.lazy_build)
+		wait_for_completion(&c->build_thread_exit);
 	jffs2_free_ino_caches(c);
 	jffs2_free_raw_node_refs(c);
 	if (jffs2_blocks_use_vmalloc(c))
@@ -126,6 +126,8 @@ int jffs2_garbage_collect_pass(struct jffs2_sb_info *c)
 	int ret = 0, inum, nlink;
 	int xattr = 0;
 
+	jffs2_wait_for_build(c);
+
 	if (mutex_lock_interruptible(&c->alloc_sem))
 		return -EINTR;
 
@@ -28,6 +28,10 @@
 
 struct jffs2_inodirty;
 
+struct jffs2_mount_opts {
+	unsigned int lazy_build:1;	/* Build inode caches in background */
+};
+
 /* A struct for the overall file system control.  Pointers to
    jffs2_sb_info structs are named `c' in the source code.
    Nee jffs_control
@@ -44,6 +48,11 @@ struct jffs2_sb_info {
 	struct completion gc_thread_start; /* GC thread start completion */
 	struct completion gc_thread_exit; /* GC thread exit completion port */
 
+	struct jffs2_mount_opts mount_opts;
+	unsigned int build_pending;	/* Background build still running */
+	wait_queue_head_t build_wait;	/* For waiting for the build to finish */
+	struct completion build_thread_exit; /* Build thread exit completion */
+
 	struct mutex alloc_sem;		/* Used to protect all the following
 					   fields, and also to protect against
 					   out-of-order writing of nodes. And GC. */
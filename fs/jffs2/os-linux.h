@@ -154,6 +154,10 @@ static inline void jffs2_erase_pending_trigger(struct jffs2_sb_info *c)
 int jffs2_start_garbage_collect_thread(struct jffs2_sb_info *c);
 void jffs2_stop_garbage_collect_thread(struct jffs2_sb_info *c);
 void jffs2_garbage_collect_trigger(struct jffs2_sb_info *c);
+int jffs2_start_build_thread(struct jffs2_sb_info *c);
+
+/* Block until the directory tree passes of a lazy mount have finished */
+#define jffs2_wait_for_build(c) wait_event((c)->build_wait, !(c)->build_pending)
 
 /* dir.c */
 extern const struct file_operations jffs2_dir_operations;
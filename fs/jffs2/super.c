@@ -22,6 +22,8 @@
 #include <linux/mtd/super.h>
 #include <linux/ctype.h>
 #include <linux/namei.h>
+#include <linux/seq_file.h>
+#include <linux/parser.h>
 #include "compr.h"
 #include "nodelist.h"
 
@@ -62,6 +64,16 @@ static int jffs2_sync_fs(struct super_block *sb, int wait)
 	return 0;
 }
 
+static int jffs2_show_options(struct seq_file *s, struct vfsmount *mnt)
+{
+	struct jffs2_sb_info *c = JFFS2_SB_INFO(mnt->mnt_sb);
+
+	if (c->mount_opts.lazy_build)
+		seq_printf(s, ",lazy_build");
+
+	return 0;
+}
+
 static const struct super_operations jffs2_super_operations =
 {
 	.alloc_inode =	jffs2_alloc_inode,
@@ -73,8 +85,45 @@ static const struct super_operations jffs2_super_operations =
 	.clear_inode =	jffs2_clear_inode,
 	.dirty_inode =	jffs2_dirty_inode,
 	.sync_fs =	jffs2_sync_fs,
+	.show_options =	jffs2_show_options,
+};
+
+enum {
+	Opt_lazy_build,
+	Opt_err,
 };
 
+static match_table_t tokens = {
+	{Opt_lazy_build, "lazy_build"},
+	{Opt_err, NULL},
+};
+
+static void jffs2_parse_options(struct jffs2_sb_info *c, char *data)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+
+	if (!data)
+		return;
+
+	while ((p = strsep(&data, ","))) {
+		int token;
+
+		if (!*p)
+			continue;
+
+		token = match_token(p, tokens, args);
+		switch (token) {
+		case Opt_lazy_build:
+			c->mount_opts.lazy_build = 1;
+			break;
+		default:
+			/* JFFS2 has always ignored options it does not know */
+			break;
+		}
+	}
+}
+
 /*
  * fill in the superblock
  */
@@ -102,6 +151,10 @@ static int jffs2_fill_super(struct super_block *sb, void *data, int silent)
 	init_waitqueue_head(&c->inocache_wq);
 	spin_lock_init(&c->erase_completion_lock);
 	spin_lock_init(&c->inocache_lock);
+	init_waitqueue_head(&c->build_wait);
+	init_completion(&c->build_thread_exit);
+
+	jffs2_parse_options(c, data);
 
 	sb->s_op = &jffs2_super_operations;
 	sb->s_flags = sb->s_flags | MS_NOATIME;
@@ -126,6 +179,9 @@ static void jffs2_put_super (struct super_block *sb)
 
 	D2(printk(KERN_DEBUG "jffs2: jffs2_put_super()\n"));
 
+	if (c->mount_opts.lazy_build)
+		wait_for_completion(&c->build_thread_exit);
+
 	mutex_lock(&c->alloc_sem);
 	jffs2_flush_wbuf_pad(c);
 	mutex_unlock(&c->alloc_sem);
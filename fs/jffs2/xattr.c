@@ -633,6 +633,9 @@ static int check_xattr_ref_inode(struct jffs2_sb_info *c, struct jffs2_inode_cac
 	struct jffs2_xattr_ref *ref, *cmp, **pref, **pcmp;
 	int rc = 0;
 
+	/* xrefs are attached to their inodes by the build */
+	jffs2_wait_for_build(c);
+
 	if (likely(ic->flags & INO_FLAGS_XATTR_CHECKED))
 		return 0;
 	down_write(&c->xattr_sem);
@@ -839,6 +839,175 @@ fail:
 	return PTR_ERR(dentry);
 }
 
+/*
+ * Lockless path walk.
+ *
+ * The ref-walk below takes d_lock and a reference for every component,
+ * which makes the dentries of busy directories like /usr bounce between
+ * CPUs.  Before falling back to it, __link_path_walk() walks as many of
+ * the leading components as it can under rcu_read_lock() alone, checking
+ * what it saw against the d_seq counts of the dentries it went through.
+ * Only the dentry it ends up on gets a reference.
+ *
+ * The lockless walk stops in front of the last component and of anything
+ * it cannot handle: "..", mount points, symlinks, ->d_hash(),
+ * ->d_compare(), ->d_revalidate(), ->permission() and inodes with LSM
+ * state.  The ref-walk continues from there, so flags, intents and
+ * error reporting are all the ref-walk's.  If the lockless walk loses a
+ * race, it leaves nd alone and the ref-walk starts from the beginning.
+ *
+ * Dentries are always RCU freed, but inodes are not: an inode is only
+ * trusted after the d_seq of a dentry still pointing to it was checked
+ * again, so the loads from a racing freed inode are discarded.  With
+ * CONFIG_DEBUG_PAGEALLOC such a load could fault, so it is disabled there.
+ */
+
+#ifdef CONFIG_DEBUG_PAGEALLOC
+#define rcu_walk_enabled(nd)	0
+#else
+#define rcu_walk_enabled(nd)	(!((nd)->flags & LOOKUP_REVAL))
+#endif
+
+/* May we search @dentry?  0 if so, -EAGAIN to leave it to the ref-walk. */
+static int rcu_walk_may_exec(struct dentry *dentry, unsigned seq)
+{
+	struct inode *inode = dentry->d_inode;
+	const struct inode_operations *iop;
+	void *security = NULL;
+	umode_t mode;
+	uid_t uid;
+	gid_t gid;
+
+	if (!inode)
+		return -EAGAIN;
+	iop = inode->i_op;
+	mode = inode->i_mode;
+	uid = inode->i_uid;
+	gid = inode->i_gid;
+#ifdef CONFIG_SECURITY
+	security = inode->i_security;
+#endif
+	if (read_seqcount_retry(&dentry->d_seq, seq))
+		return -EAGAIN;
+	if ((iop && iop->permission) || security)
+		return -EAGAIN;
+
+	if (current->fsuid == uid)
+		mode >>= 6;
+	else if (in_group_p(gid))
+		mode >>= 3;
+	return (mode & MAY_EXEC) ? 0 : -EAGAIN;
+}
+
+/* Can the lockless walk step onto @dentry and carry on from it? */
+static int rcu_walk_can_enter(struct dentry *dentry, unsigned seq)
+{
+	const struct inode_operations *iop;
+	struct inode *inode;
+
+	if (d_mountpoint(dentry))
+		return 0;
+	if (dentry->d_op && dentry->d_op->d_revalidate)
+		return 0;
+	inode = dentry->d_inode;
+	if (!inode)
+		return 0;
+	iop = inode->i_op;
+	if (read_seqcount_retry(&dentry->d_seq, seq))
+		return 0;
+	return iop && iop->lookup && !iop->follow_link;
+}
+
+/*
+ * Walk the leading components of @name locklessly, see above.  Returns
+ * the part of @name left for the ref-walk, with nd->path moved to the
+ * dentry the lockless walk got to.
+ */
+static const char *rcu_walk_prefix(const char *name, struct nameidata *nd)
+{
+	struct dentry *start = nd->path.dentry;
+	struct dentry *dentry = start;
+	const char *done = name;
+	const char *orig = name;
+	unsigned seq;
+
+	if (!rcu_walk_enabled(nd))
+		return name;
+
+	rcu_read_lock();
+	seq = read_seqcount_begin(&dentry->d_seq);
+	for (;;) {
+		struct dentry *child;
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+		unsigned cseq;
+
+		if (rcu_walk_may_exec(dentry, seq))
+			break;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		/* The last component is always the ref-walk's */
+		if (!c)
+			break;
+		while (*++name == '/');
+		if (!*name)
+			break;
+
+		if (this.name[0] == '.') {
+			if (this.len == 1) {
+				done = name;
+				continue;
+			}
+			if (this.len == 2 && this.name[1] == '.')
+				break;
+		}
+
+		if (dentry->d_op &&
+		    (dentry->d_op->d_hash || dentry->d_op->d_compare))
+			break;
+		child = __d_lookup_rcu(dentry, &this, &cseq);
+		if (!child || read_seqcount_retry(&dentry->d_seq, seq))
+			break;
+		if (!rcu_walk_can_enter(child, cseq))
+			break;
+
+		dentry = child;
+		seq = cseq;
+		done = name;
+	}
+
+	if (dentry != start) {
+		spin_lock(&dentry->d_lock);
+		if (read_seqcount_retry(&dentry->d_seq, seq) ||
+		    d_unhashed(dentry)) {
+			spin_unlock(&dentry->d_lock);
+			rcu_read_unlock();
+			return orig;
+		}
+		atomic_inc(&dentry->d_count);
+		spin_unlock(&dentry->d_lock);
+	}
+	rcu_read_unlock();
+
+	if (dentry != start) {
+		dput(start);
+		nd->path.dentry = dentry;
+	}
+	return done;
+}
+
 /*
  * Name resolution.
  * This is the basic name resolution function, turning a pathname into
@@ -859,6 +1028,7 @@ static int __link_path_walk(const char *name, struct nameidata *nd)
 	if (!*name)
 		goto return_reval;
 
+	name = rcu_walk_prefix(name, nd);
 	inode = nd->path.dentry->d_inode;
 	if (nd->depth)
 		lookup_flags = LOOKUP_FOLLOW | (nd->flags & LOOKUP_CONTINUE);
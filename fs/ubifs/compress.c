@@ -38,11 +38,8 @@ static struct ubifs_compressor none_compr = {
 };
 
 #ifdef CONFIG_UBIFS_FS_LZO
-static DEFINE_MUTEX(lzo_mutex);
-
 static struct ubifs_compressor lzo_compr = {
 	.compr_type = UBIFS_COMPR_LZO,
-	.comp_mutex = &lzo_mutex,
 	.name = "LZO",
 	.capi_name = "lzo",
 };
@@ -54,13 +51,9 @@ static struct ubifs_compressor lzo_compr = {
 #endif
 
 #ifdef CONFIG_UBIFS_FS_ZLIB
-static DEFINE_MUTEX(deflate_mutex);
-static DEFINE_MUTEX(inflate_mutex);
-
 static struct ubifs_compressor zlib_compr = {
 	.compr_type = UBIFS_COMPR_ZLIB,
-	.comp_mutex = &deflate_mutex,
-	.decomp_mutex = &inflate_mutex,
+	.decomp_pool = 1,
 	.name = "zlib",
 	.capi_name = "deflate",
 };
@@ -74,6 +67,43 @@ static struct ubifs_compressor zlib_compr = {
 /* All UBIFS compressors */
 struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
 
+/**
+ * compr_get - get an unused cryptoapi handle from a pool.
+ * @pool: the pool
+ *
+ * This function takes an unused handle out of @pool, waiting for one to be
+ * returned if all of them are busy. The handle has to be given back with
+ * 'compr_put()'.
+ */
+static struct crypto_comp *compr_get(struct ubifs_compr_pool *pool)
+{
+	struct crypto_comp *cc;
+
+	spin_lock(&pool->lock);
+	while (pool->free == 0) {
+		spin_unlock(&pool->lock);
+		wait_event(pool->wait, pool->free != 0);
+		spin_lock(&pool->lock);
+	}
+	cc = pool->cc[--pool->free];
+	spin_unlock(&pool->lock);
+
+	return cc;
+}
+
+/**
+ * compr_put - return a cryptoapi handle to its pool.
+ * @pool: the pool
+ * @cc: the handle obtained with 'compr_get()'
+ */
+static void compr_put(struct ubifs_compr_pool *pool, struct crypto_comp *cc)
+{
+	spin_lock(&pool->lock);
+	pool->cc[pool->free++] = cc;
+	spin_unlock(&pool->lock);
+	wake_up(&pool->wait);
+}
+
 /**
  * ubifs_compress - compress data.
  * @in_buf: data to compress
@@ -99,6 +129,7 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 {
 	int err;
 	struct ubifs_compressor *compr = ubifs_compressors[*compr_type];
+	struct crypto_comp *cc;
 
 	if (*compr_type == UBIFS_COMPR_NONE)
 		goto no_compr;
@@ -107,12 +138,9 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 	if (in_len < UBIFS_MIN_COMPR_LEN)
 		goto no_compr;
 
-	if (compr->comp_mutex)
-		mutex_lock(compr->comp_mutex);
-	err = crypto_comp_compress(compr->cc, in_buf, in_len, out_buf,
-				   out_len);
-	if (compr->comp_mutex)
-		mutex_unlock(compr->comp_mutex);
+	cc = compr_get(&compr->comp);
+	err = crypto_comp_compress(cc, in_buf, in_len, out_buf, out_len);
+	compr_put(&compr->comp, cc);
 	if (unlikely(err)) {
 		ubifs_warn("cannot compress %d bytes, compressor %s, "
 			   "error %d, leave data uncompressed",
@@ -152,6 +180,7 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 {
 	int err;
 	struct ubifs_compressor *compr;
+	struct crypto_comp *cc;
 
 	if (unlikely(compr_type < 0 || compr_type >= UBIFS_COMPR_TYPES_CNT)) {
 		ubifs_err("invalid compression type %d", compr_type);
@@ -171,12 +200,14 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 		return 0;
 	}
 
-	if (compr->decomp_mutex)
-		mutex_lock(compr->decomp_mutex);
-	err = crypto_comp_decompress(compr->cc, in_buf, in_len, out_buf,
-				     out_len);
-	if (compr->decomp_mutex)
-		mutex_unlock(compr->decomp_mutex);
+	if (compr->decomp_pool) {
+		cc = compr_get(&compr->decomp);
+		err = crypto_comp_decompress(cc, in_buf, in_len, out_buf,
+					     out_len);
+		compr_put(&compr->decomp, cc);
+	} else
+		err = crypto_comp_decompress(compr->comp.cc[0], in_buf, in_len,
+					     out_buf, out_len);
 	if (err)
 		ubifs_err("cannot decompress %d bytes, compressor %s, "
 			  "error %d", in_len, compr->name, err);
@@ -184,21 +215,79 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 	return err;
 }
 
+/**
+ * free_pool - free the cryptoapi handles of a pool.
+ * @pool: the pool
+ */
+static void free_pool(struct ubifs_compr_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < pool->size; i++)
+		crypto_free_comp(pool->cc[i]);
+	kfree(pool->cc);
+	pool->cc = NULL;
+	pool->size = pool->free = 0;
+}
+
+/**
+ * init_pool - allocate the cryptoapi handles of a pool.
+ * @compr: compressor description object
+ * @pool: the pool of @compr to fill
+ *
+ * This function allocates one cryptoapi handle for each online CPU. Returns
+ * zero in case of success or a negative error code in case of failure.
+ */
+static int __init init_pool(struct ubifs_compressor *compr,
+			    struct ubifs_compr_pool *pool)
+{
+	int i, cnt = num_online_cpus();
+
+	spin_lock_init(&pool->lock);
+	init_waitqueue_head(&pool->wait);
+
+	pool->cc = kcalloc(cnt, sizeof(struct crypto_comp *), GFP_KERNEL);
+	if (!pool->cc)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		struct crypto_comp *cc;
+
+		cc = crypto_alloc_comp(compr->capi_name, 0, 0);
+		if (IS_ERR(cc)) {
+			ubifs_err("cannot initialize compressor %s, error %ld",
+				  compr->name, PTR_ERR(cc));
+			free_pool(pool);
+			return PTR_ERR(cc);
+		}
+		pool->cc[pool->size++] = cc;
+	}
+	pool->free = pool->size;
+	return 0;
+}
+
 /**
  * compr_init - initialize a compressor.
  * @compr: compressor description object
  *
- * This function initializes the requested compressor and returns zero in case
- * of success or a negative error code in case of failure.
+ * This function initializes the requested compressor and allocates its
+ * cryptoapi handles. Returns zero in case of success or a negative error code
+ * in case of failure.
  */
 static int __init compr_init(struct ubifs_compressor *compr)
 {
+	int err;
+
 	if (compr->capi_name) {
-		compr->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
-		if (IS_ERR(compr->cc)) {
-			ubifs_err("cannot initialize compressor %s, error %ld",
-				  compr->name, PTR_ERR(compr->cc));
-			return PTR_ERR(compr->cc);
+		err = init_pool(compr, &compr->comp);
+		if (err)
+			return err;
+		if (compr->decomp_pool) {
+			err = init_pool(compr, &compr->decomp);
+			if (err) {
+				free_pool(&compr->comp);
+				return err;
+			}
 		}
 	}
 
@@ -212,8 +301,11 @@ static int __init compr_init(struct ubifs_compressor *compr)
  */
 static void compr_exit(struct ubifs_compressor *compr)
 {
-	if (compr->capi_name)
-		crypto_free_comp(compr->cc);
+	if (compr->capi_name) {
+		free_pool(&compr->comp);
+		if (compr->decomp_pool)
+			free_pool(&compr->decomp);
+	}
 	return;
 }
 
@@ -44,8 +44,8 @@
  *
  * Similarly, 'i_mutex' does not have to be locked in readpage(), e.g.,
  * readahead path does not have it locked ("sys_read -> generic_file_aio_read
- * -> ondemand_readahead -> readpage"). In case of readahead, 'I_LOCK' flag is
- * not set as well. However, UBIFS disables readahead.
+ * -> ondemand_readahead -> readpages"). In case of readahead, 'I_LOCK' flag is
+ * not set as well. UBIFS enables readahead only with bulk-read.
  *
  * This, for example means that there might be 2 concurrent '->writepage()'
  * calls for the same inode, but different inode dirty pages.
@@ -584,6 +584,229 @@ static int ubifs_readpage(struct file *file, struct page *page)
 	return 0;
 }
 
+/**
+ * populate_page - copy data nodes into a page for bulk-read.
+ * @c: UBIFS file-system description object
+ * @page: page
+ * @bu: bulk-read information
+ * @n: next zbranch slot
+ *
+ * This function returns %0 on success and a negative error code on failure.
+ */
+static int populate_page(struct ubifs_info *c, struct page *page,
+			 struct bu_info *bu, int *n)
+{
+	int i = 0, nn = *n, offs = bu->zbranch[0].offs, hole = 0, read = 0;
+	struct inode *inode = page->mapping->host;
+	loff_t i_size = i_size_read(inode);
+	unsigned int page_block;
+	void *addr, *zaddr;
+	pgoff_t end_index;
+
+	dbg_gen("ino %lu, pg %lu, i_size %lld, flags %#lx",
+		inode->i_ino, page->index, i_size, page->flags);
+
+	addr = zaddr = kmap(page);
+
+	end_index = (i_size - 1) >> PAGE_CACHE_SHIFT;
+	if (!i_size || page->index > end_index) {
+		/* Reading beyond inode */
+		hole = 1;
+		memset(addr, 0, PAGE_CACHE_SIZE);
+		goto out_hole;
+	}
+
+	page_block = page->index << UBIFS_BLOCKS_PER_PAGE_SHIFT;
+	while (1) {
+		int err, len, out_len, dlen;
+
+		if (nn >= bu->cnt) {
+			hole = 1;
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		} else if (key_block(c, &bu->zbranch[nn].key) == page_block) {
+			struct ubifs_data_node *dn;
+
+			dn = bu->buf + (bu->zbranch[nn].offs - offs);
+
+			ubifs_assert(le64_to_cpu(dn->ch.sqnum) >
+				     ubifs_inode(inode)->creat_sqnum);
+
+			len = le32_to_cpu(dn->size);
+			if (len <= 0 || len > UBIFS_BLOCK_SIZE)
+				goto out_err;
+
+			dlen = le32_to_cpu(dn->ch.len) - UBIFS_DATA_NODE_SZ;
+			out_len = UBIFS_BLOCK_SIZE;
+			err = ubifs_decompress(&dn->data, dlen, addr, &out_len,
+					       le16_to_cpu(dn->compr_type));
+			if (err || len != out_len)
+				goto out_err;
+
+			if (len < UBIFS_BLOCK_SIZE)
+				memset(addr + len, 0, UBIFS_BLOCK_SIZE - len);
+
+			nn += 1;
+			read = (i << UBIFS_BLOCK_SHIFT) + len;
+		} else if (key_block(c, &bu->zbranch[nn].key) < page_block) {
+			nn += 1;
+			continue;
+		} else {
+			hole = 1;
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		}
+		if (++i >= UBIFS_BLOCKS_PER_PAGE)
+			break;
+		addr += UBIFS_BLOCK_SIZE;
+		page_block += 1;
+	}
+
+	if (end_index == page->index) {
+		int len = i_size & (PAGE_CACHE_SIZE - 1);
+
+		/* Zero out the data of blocks beyond the inode size */
+		if (len && len < read)
+			memset(zaddr + len, 0, read - len);
+	}
+
+out_hole:
+	if (hole) {
+		SetPageChecked(page);
+		dbg_gen("hole");
+	}
+
+	SetPageUptodate(page);
+	ClearPageError(page);
+	flush_dcache_page(page);
+	kunmap(page);
+	*n = nn;
+	return 0;
+
+out_err:
+	ClearPageUptodate(page);
+	SetPageError(page);
+	flush_dcache_page(page);
+	kunmap(page);
+	ubifs_err("bad data node (block %u, inode %lu)",
+		  page_block, inode->i_ino);
+	return -EINVAL;
+}
+
+/**
+ * bulk_read_pages - read a run of consecutive pages.
+ * @c: UBIFS file-system description object
+ * @bu: bulk-read information, or %NULL if the bulk-read buffer is busy
+ * @pages: locked pages with consecutive indexes, already in the page cache
+ * @cnt: number of pages, at most %UBIFS_BULK_READ_PAGES
+ *
+ * This function looks up the data nodes of the pages in the TNC, reads those
+ * which are consecutive on the media with a single I/O and decompresses them
+ * into the pages. Pages which cannot be bulk-read are read one at a time, and
+ * so is everything after a page whose data nodes turn out to be bad. All
+ * pages are unlocked and released.
+ */
+static void bulk_read_pages(struct ubifs_info *c, struct bu_info *bu,
+			    struct page **pages, int cnt)
+{
+	struct inode *inode = pages[0]->mapping->host;
+	int i = 0, j, err, n, covered;
+
+	while (i < cnt) {
+		covered = 0;
+		if (bu) {
+			data_key_init(c, &bu->key, inode->i_ino,
+				pages[i]->index << UBIFS_BLOCKS_PER_PAGE_SHIFT);
+			bu->blk_max = (cnt - i) << UBIFS_BLOCKS_PER_PAGE_SHIFT;
+			err = ubifs_tnc_get_bu_keys(c, bu);
+			if (!err && bu->cnt)
+				err = ubifs_tnc_bulk_read(c, bu);
+			if (!err)
+				covered = bu->blk_cnt >> UBIFS_BLOCKS_PER_PAGE_SHIFT;
+			else if (err != -EAGAIN)
+				ubifs_err("bulk-read of inode %lu failed, "
+					  "error %d", inode->i_ino, err);
+		}
+
+		if (!covered) {
+			/* Lost a race with GC, or nothing to bulk-read */
+			do_readpage(pages[i]);
+			unlock_page(pages[i]);
+			page_cache_release(pages[i]);
+			i += 1;
+			continue;
+		}
+
+		n = err = 0;
+		for (j = 0; j < covered; j++, i++) {
+			if (!err)
+				err = populate_page(c, pages[i], bu, &n);
+			if (err)
+				do_readpage(pages[i]);
+			unlock_page(pages[i]);
+			page_cache_release(pages[i]);
+		}
+		if (err)
+			bu = NULL;
+	}
+}
+
+/**
+ * ubifs_readpages - read-ahead a number of pages.
+ * @file: file to read
+ * @mapping: address space of the file
+ * @pages: pages to read, in reverse index order
+ * @nr_pages: number of pages
+ *
+ * This is the '->readpages()' address space operation. It is only called when
+ * bulk-read is enabled, because otherwise read-ahead is disabled. The size of
+ * the read-ahead window decided by 'ondemand_readahead()' is the size of the
+ * bulk-reads, up to %UBIFS_BULK_READ_PAGES pages. The bulk-read buffer is
+ * shared by the whole file-system; if somebody else is using it, the pages
+ * are read one at a time rather than waiting for it.
+ */
+static int ubifs_readpages(struct file *file, struct address_space *mapping,
+			   struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct page *run[UBIFS_BULK_READ_PAGES];
+	int cnt = 0, max_pages;
+	struct bu_info *bu = NULL;
+
+	max_pages = min_t(int, nr_pages, UBIFS_BULK_READ_PAGES);
+
+	if (mutex_trylock(&c->bu_mutex)) {
+		if (c->bu.buf)
+			bu = &c->bu;
+		else
+			mutex_unlock(&c->bu_mutex);
+	}
+
+	while (!list_empty(pages)) {
+		struct page *page = list_entry(pages->prev, struct page, lru);
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+					  GFP_NOFS)) {
+			/* Somebody else has read the page in already */
+			page_cache_release(page);
+			continue;
+		}
+
+		if (cnt && (cnt == max_pages ||
+			    run[cnt - 1]->index + 1 != page->index)) {
+			bulk_read_pages(c, bu, run, cnt);
+			cnt = 0;
+		}
+		run[cnt++] = page;
+	}
+	if (cnt)
+		bulk_read_pages(c, bu, run, cnt);
+
+	if (bu)
+		mutex_unlock(&c->bu_mutex);
+	return 0;
+}
+
 static int do_writepage(struct page *page, int len)
 {
 	int err = 0, i, blen;
@@ -1247,6 +1470,7 @@ static int ubifs_file_mmap(struct file *file, struct vm_area_struct *vma)
 
 struct address_space_operations ubifs_file_address_operations = {
 	.readpage       = ubifs_readpage,
+	.readpages      = ubifs_readpages,
 	.writepage      = ubifs_writepage,
 	.write_begin    = ubifs_write_begin,
 	.write_end      = ubifs_write_end,
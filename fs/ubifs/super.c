@@ -401,6 +401,11 @@ static int ubifs_show_options(struct seq_file *s, struct vfsmount *mnt)
 	else if (c->mount_opts.unmount_mode == 1)
 		seq_printf(s, ",norm_unmount");
 
+	if (c->mount_opts.bulk_read == 2)
+		seq_printf(s, ",bulk_read");
+	else if (c->mount_opts.bulk_read == 1)
+		seq_printf(s, ",no_bulk_read");
+
 	return 0;
 }
 
@@ -840,17 +845,23 @@ static int check_volume_empty(struct ubifs_info *c)
  *
  * Opt_fast_unmount: do not run a journal commit before un-mounting
  * Opt_norm_unmount: run a journal commit before un-mounting
+ * Opt_bulk_read: enable read-ahead and bulk-read
+ * Opt_no_bulk_read: disable read-ahead and bulk-read
  * Opt_err: just end of array marker
  */
 enum {
 	Opt_fast_unmount,
 	Opt_norm_unmount,
+	Opt_bulk_read,
+	Opt_no_bulk_read,
 	Opt_err,
 };
 
 static match_table_t tokens = {
 	{Opt_fast_unmount, "fast_unmount"},
 	{Opt_norm_unmount, "norm_unmount"},
+	{Opt_bulk_read, "bulk_read"},
+	{Opt_no_bulk_read, "no_bulk_read"},
 	{Opt_err, NULL},
 };
 
@@ -888,6 +899,14 @@ static int ubifs_parse_options(struct ubifs_info *c, char *options,
 			c->mount_opts.unmount_mode = 1;
 			c->fast_unmount = 0;
 			break;
+		case Opt_bulk_read:
+			c->mount_opts.bulk_read = 2;
+			c->bulk_read = 1;
+			break;
+		case Opt_no_bulk_read:
+			c->mount_opts.bulk_read = 1;
+			c->bulk_read = 0;
+			break;
 		default:
 			ubifs_err("unrecognized mount option \"%s\" "
 				  "or missing value", p);
@@ -928,6 +947,33 @@ static void destroy_journal(struct ubifs_info *c)
 	free_buds(c);
 }
 
+/**
+ * bu_init - initialize bulk-read information.
+ * @c: UBIFS file-system description object
+ *
+ * The bulk-read buffer is allocated once per file-system and shared by all
+ * readers. Since bulk-read is only an optimization, bulk-read is disabled if
+ * the buffer cannot be allocated.
+ */
+static void bu_init(struct ubifs_info *c)
+{
+	ubifs_assert(c->bulk_read == 1);
+
+	if (c->bu.buf)
+		return; /* Already initialized */
+
+	c->bu.buf_len = UBIFS_MAX_BULK_READ * UBIFS_MAX_DATA_NODE_SZ;
+	if (c->bu.buf_len > c->leb_size)
+		c->bu.buf_len = c->leb_size;
+	c->bu.buf = kmalloc(c->bu.buf_len, GFP_KERNEL | __GFP_NOWARN);
+	if (!c->bu.buf) {
+		ubifs_warn("cannot allocate %d bytes of memory for bulk-read, "
+			   "disabling it", c->bu.buf_len);
+		c->mount_opts.bulk_read = 1;
+		c->bulk_read = 0;
+	}
+}
+
 /**
  * mount_ubifs - mount UBIFS file-system.
  * @c: UBIFS file-system description object
@@ -1024,6 +1070,9 @@ static int mount_ubifs(struct ubifs_info *c)
 		goto out_dereg;
 	}
 
+	if (c->bulk_read)
+		bu_init(c);
+
 	sprintf(c->bgt_name, BGT_NAME_PATTERN, c->vi.ubi_num, c->vi.vol_id);
 	if (!mounted_read_only) {
 		err = alloc_wbufs(c);
@@ -1166,6 +1215,7 @@ static int mount_ubifs(struct ubifs_info *c)
 	       c->uuid[8], c->uuid[9], c->uuid[10], c->uuid[11],
 	       c->uuid[12], c->uuid[13], c->uuid[14], c->uuid[15]);
 	dbg_msg("fast unmount:        %d", c->fast_unmount);
+	dbg_msg("bulk read:           %d", c->bulk_read);
 	dbg_msg("big_lpt              %d", c->big_lpt);
 	dbg_msg("log LEBs:            %d (%d - %d)",
 		c->log_lebs, UBIFS_LOG_LNUM, c->log_last);
@@ -1218,6 +1268,7 @@ out_master:
 out_wbufs:
 	free_wbufs(c);
 out_cbuf:
+	kfree(c->bu.buf);
 	kfree(c->cbuf);
 out_dereg:
 	dbg_failure_mode_deregistration(c);
@@ -1255,6 +1306,7 @@ static void ubifs_umount(struct ubifs_info *c)
 	free_orphans(c);
 	ubifs_lpt_free(c, 0);
 
+	kfree(c->bu.buf);
 	kfree(c->cbuf);
 	kfree(c->rcvrd_mst_node);
 	kfree(c->mst_node);
@@ -1559,6 +1611,10 @@ static int ubifs_remount_fs(struct super_block *sb, int *flags, char *data)
 		ubifs_err("invalid or unknown remount parameter");
 		return err;
 	}
+	if (c->bulk_read)
+		bu_init(c);
+	/* Files which are already open keep their read-ahead settings */
+	c->bdi.ra_pages = c->bulk_read ? UBIFS_BULK_READ_PAGES : 0;
 	if ((sb->s_flags & MS_RDONLY) && !(*flags & MS_RDONLY)) {
 		err = ubifs_remount_rw(c);
 		if (err)
@@ -1653,6 +1709,7 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 	init_rwsem(&c->commit_sem);
 	mutex_init(&c->lp_mutex);
 	mutex_init(&c->tnc_mutex);
+	mutex_init(&c->bu_mutex);
 	mutex_init(&c->log_mutex);
 	mutex_init(&c->mst_mutex);
 	mutex_init(&c->umount_mutex);
@@ -1688,12 +1745,14 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 	}
 
 	/*
-	 * UBIFS provides 'backing_dev_info' in order to disable read-ahead. For
+	 * UBIFS provides 'backing_dev_info' in order to control read-ahead. For
 	 * UBIFS, I/O is not deferred, it is done immediately in readpage,
 	 * which means the user would have to wait not just for their own I/O
-	 * but the read-ahead I/O as well i.e. completely pointless.
-	 *
-	 * Read-ahead will be disabled because @c->bdi.ra_pages is 0.
+	 * but the read-ahead I/O as well. This only pays off with bulk-read,
+	 * where '->readpages()' reads the whole read-ahead window of
+	 * consecutive data nodes with one I/O, so read-ahead is disabled (by
+	 * @c->bdi.ra_pages being 0) unless bulk-read is enabled. Bulk-read is
+	 * off by default, the "bulk_read" mount option enables it.
 	 */
 	c->bdi.capabilities = BDI_CAP_MAP_COPY;
 	c->bdi.unplug_io_fn = default_unplug_io_fn;
@@ -1723,6 +1782,8 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 		ubifs_assert(err < 0);
 		goto out_unlock;
 	}
+	/* 'mount_ubifs()' disables bulk-read if it has no buffer for it */
+	c->bdi.ra_pages = c->bulk_read ? UBIFS_BULK_READ_PAGES : 0;
 
 	/* Read the root inode */
 	root = ubifs_iget(sb, UBIFS_ROOT_INO);
@@ -59,6 +59,12 @@
 #define UBIFS_BLOCKS_PER_PAGE (PAGE_CACHE_SIZE / UBIFS_BLOCK_SIZE)
 #define UBIFS_BLOCKS_PER_PAGE_SHIFT (PAGE_CACHE_SHIFT - UBIFS_BLOCK_SHIFT)
 
+/* Maximum number of data blocks a single bulk-read may cover */
+#define UBIFS_MAX_BULK_READ 32
+
+/* Read-ahead window used when bulk-read is enabled, in VFS pages */
+#define UBIFS_BULK_READ_PAGES (UBIFS_MAX_BULK_READ >> UBIFS_BLOCKS_PER_PAGE_SHIFT)
+
 /* "File system end of life" sequence number watermark */
 #define SQNUM_WARN_WATERMARK 0xFFFFFFFF00000000ULL
 #define SQNUM_WATERMARK      0xFFFFFFFFFF000000ULL
@@ -759,24 +765,71 @@ struct ubifs_node_range {
 	int max_len;
 };
 
+/**
+ * struct ubifs_compr_pool - a pool of cryptoapi compressor handles.
+ * @cc: the handles
+ * @size: number of handles in the pool
+ * @free: number of unused handles, which are @cc[0 ... @free - 1]
+ * @lock: protects @cc and @free
+ * @wait: tasks waiting for an unused handle sleep here
+ *
+ * Each cryptoapi handle carries its own compression workspace and can only be
+ * used by one task at a time. There is one handle per online CPU.
+ */
+struct ubifs_compr_pool {
+	struct crypto_comp **cc;
+	int size;
+	int free;
+	spinlock_t lock;
+	wait_queue_head_t wait;
+};
+
 /**
  * struct ubifs_compressor - UBIFS compressor description structure.
  * @compr_type: compressor type (%UBIFS_COMPR_LZO, etc)
- * @cc: cryptoapi compressor handle
- * @comp_mutex: mutex used during compression
- * @decomp_mutex: mutex used during decompression
+ * @comp: handles used for compression
+ * @decomp: handles used for decompression
+ * @decomp_pool: decompression uses a workspace, so it needs @decomp
  * @name: compressor name
  * @capi_name: cryptoapi compressor name
+ *
+ * Compression and decompression have separate pools, so that readers never
+ * wait for write-back. Decompressors without a workspace (LZO) have no
+ * @decomp pool at all and use any compression handle without taking it.
  */
 struct ubifs_compressor {
 	int compr_type;
-	struct crypto_comp *cc;
-	struct mutex *comp_mutex;
-	struct mutex *decomp_mutex;
+	struct ubifs_compr_pool comp;
+	struct ubifs_compr_pool decomp;
+	int decomp_pool;
 	const char *name;
 	const char *capi_name;
 };
 
+/**
+ * struct bu_info - bulk-read information.
+ * @key: first data node key
+ * @zbranch: zbranches of data nodes to bulk read
+ * @buf: buffer to read into
+ * @buf_len: buffer length
+ * @gc_seq: GC sequence number to detect races with GC
+ * @cnt: number of data nodes for bulk read
+ * @blk_cnt: number of data blocks covered, including holes
+ * @blk_max: maximum number of data blocks to cover
+ * @eof: end of file reached
+ */
+struct bu_info {
+	union ubifs_key key;
+	struct ubifs_zbranch zbranch[UBIFS_MAX_BULK_READ];
+	void *buf;
+	int buf_len;
+	int gc_seq;
+	int cnt;
+	int blk_cnt;
+	int blk_max;
+	int eof;
+};
+
 /**
  * struct ubifs_budget_req - budget requirements of an operation.
  *
@@ -862,16 +915,18 @@ struct ubifs_orphan {
 /**
  * struct ubifs_mount_opts - UBIFS-specific mount options information.
  * @unmount_mode: selected unmount mode (%0 default, %1 normal, %2 fast)
+ * @bulk_read: enable bulk-reads (%0 default, %1 disable, %2 enable)
  */
 struct ubifs_mount_opts {
 	unsigned int unmount_mode:2;
+	unsigned int bulk_read:2;
 };
 
 /**
  * struct ubifs_info - UBIFS file-system description data structure
  * (per-superblock).
  * @vfs_sb: VFS @struct super_block object
- * @bdi: backing device info object to make VFS happy and disable read-ahead
+ * @bdi: backing device info object to make VFS happy and control read-ahead
  *
  * @highest_inum: highest used inode number
  * @max_sqnum: current global sequence number
@@ -906,6 +961,7 @@ struct ubifs_mount_opts {
  * @cs_lock: commit state lock
  * @cmt_wq: wait queue to sleep on if the log is full and a commit is running
  * @fast_unmount: do not run journal commit before un-mounting
+ * @bulk_read: read ahead and read consecutive data nodes in one go
  * @big_lpt: flag that LPT is too big to write whole during commit
  * @check_lpt_free: flag that indicates LPT GC may be needed
  * @nospace: non-zero if the file-system does not have flash space (used as
@@ -913,6 +969,9 @@ struct ubifs_mount_opts {
  * @nospace_rp: the same as @nospace, but additionally means that even reserved
  *              pool is full
  *
+ * @bu_mutex: protects the pre-allocated bulk-read buffer and @c->bu
+ * @bu: pre-allocated bulk-read information
+ *
  * @tnc_mutex: protects the Tree Node Cache (TNC), @zroot, @cnext, @enext, and
  *             @calc_idx_sz
  * @zroot: zbranch which points to the root index node and znode
@@ -1147,11 +1206,15 @@ struct ubifs_info {
 	spinlock_t cs_lock;
 	wait_queue_head_t cmt_wq;
 	unsigned int fast_unmount:1;
+	unsigned int bulk_read:1;
 	unsigned int big_lpt:1;
 	unsigned int check_lpt_free:1;
 	unsigned int nospace:1;
 	unsigned int nospace_rp:1;
 
+	struct mutex bu_mutex;
+	struct bu_info bu;
+
 	struct mutex tnc_mutex;
 	struct ubifs_zbranch zroot;
 	struct ubifs_znode *cnext;
@@ -1465,6 +1528,8 @@ int ubifs_tnc_lookup_nm(struct ubifs_info *c, const union ubifs_key *key,
 			void *node, const struct qstr *nm);
 int ubifs_tnc_locate(struct ubifs_info *c, const union ubifs_key *key,
 		     void *node, int *lnum, int *offs);
+int ubifs_tnc_get_bu_keys(struct ubifs_info *c, struct bu_info *bu);
+int ubifs_tnc_bulk_read(struct ubifs_info *c, struct bu_info *bu);
 int ubifs_tnc_add(struct ubifs_info *c, const union ubifs_key *key, int lnum,
 		  int offs, int len);
 int ubifs_tnc_replace(struct ubifs_info *c, const union ubifs_key *key,
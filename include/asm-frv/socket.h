@@ -54,5 +54,7 @@
 
 #define SO_MARK			36
 
+#define SO_BUSY_POLL		46
+
 #endif /* _ASM_SOCKET_H */
 
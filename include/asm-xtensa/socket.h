@@ -65,4 +65,6 @@
 
 #define SO_MARK			36
 
+#define SO_BUSY_POLL		46
+
 #endif	/* _XTENSA_SOCKET_H */
@@ -0,0 +1,69 @@
+/*
+ * include/linux/bch.h
+ *
+ * Overview:
+ *   Generic binary BCH encoder / decoder library
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _BCH_H_
+#define _BCH_H_
+
+#include <linux/types.h>
+
+/**
+ * struct bch_control - BCH control structure
+ *
+ * @m:		Galois field order, the code length is 2^m-1 bits
+ * @n:		Number of elements in the field (= (1<<m)-1)
+ * @t:		Number of correctable bit errors
+ * @ecc_bits:	Number of ecc bits (= degree of the generator polynomial)
+ * @ecc_bytes:	Number of ecc bytes, ecc_bits rounded up
+ * @ecc_words:	Number of 32-bit words holding the ecc bits
+ * @a_pow_tab:	Antilog lookup table, alpha^i
+ * @a_log_tab:	Log lookup table
+ * @mod8_tab:	Remainder tables for the encoder, one per byte position
+ * @ecc_buf:	Encoder / decoder work buffer
+ * @ecc_buf2:	Encoder / decoder work buffer
+ * @syn:	Syndrome buffer, 2t entries
+ * @elp:	Error locator polynomial work buffers, 3 x (2t+1) entries
+*/
+struct bch_control {
+	unsigned int	m;
+	unsigned int	n;
+	unsigned int	t;
+	unsigned int	ecc_bits;
+	unsigned int	ecc_bytes;
+	unsigned int	ecc_words;
+	uint16_t	*a_pow_tab;
+	uint16_t	*a_log_tab;
+	uint32_t	*mod8_tab;
+	uint32_t	*ecc_buf;
+	uint32_t	*ecc_buf2;
+	unsigned int	*syn;
+	unsigned int	*elp;
+};
+
+/* Create a control structure for a t-error correcting code over GF(2^m) */
+struct bch_control *init_bch(int m, int t, unsigned int prim_poly);
+
+/* Release a bch control structure */
+void free_bch(struct bch_control *bch);
+
+/* Compute or update the ecc of a data buffer */
+void encode_bch(struct bch_control *bch, const uint8_t *data,
+		unsigned int len, uint8_t *ecc);
+
+/* Locate the bit errors in a data buffer and its ecc */
+int decode_bch(struct bch_control *bch, const uint8_t *data, unsigned int len,
+	       const uint8_t *recv_ecc, const uint8_t *calc_ecc,
+	       unsigned int *errloc);
+
+/* Flip the data bits reported by decode_bch() */
+void correct_bch(struct bch_control *bch, uint8_t *data, unsigned int len,
+		 unsigned int *errloc, int nerr);
+
+#endif
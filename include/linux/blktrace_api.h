@@ -47,6 +47,8 @@ enum blktrace_act {
 	__BLK_TA_SPLIT,			/* bio was split */
 	__BLK_TA_BOUNCE,		/* bio was bounced */
 	__BLK_TA_REMAP,			/* bio was remapped */
+	__BLK_TA_PLUG_FLUSH,		/* task plug list was flushed */
+	__BLK_TA_PLUG_FLUSH_SCHED,	/* task plug list was flushed by sleep */
 };
 
 /*
@@ -77,6 +79,8 @@ enum blktrace_notify {
 #define BLK_TA_SPLIT		(__BLK_TA_SPLIT)
 #define BLK_TA_BOUNCE		(__BLK_TA_BOUNCE)
 #define BLK_TA_REMAP		(__BLK_TA_REMAP | BLK_TC_ACT(BLK_TC_QUEUE))
+#define BLK_TA_PLUG_FLUSH	(__BLK_TA_PLUG_FLUSH | BLK_TC_ACT(BLK_TC_QUEUE))
+#define BLK_TA_PLUG_FLUSH_SCHED	(__BLK_TA_PLUG_FLUSH_SCHED | BLK_TC_ACT(BLK_TC_QUEUE))
 
 #define BLK_TN_PROCESS		(__BLK_TN_PROCESS | BLK_TC_ACT(BLK_TC_NOTIFY))
 #define BLK_TN_TIMESTAMP	(__BLK_TN_TIMESTAMP | BLK_TC_ACT(BLK_TC_NOTIFY))
@@ -307,6 +311,25 @@ static inline void blk_add_trace_remap(struct request_queue *q, struct bio *bio,
 	__blk_add_trace(bt, from, bio->bi_size, bio->bi_rw, BLK_TA_REMAP, !bio_flagged(bio, BIO_UPTODATE), sizeof(r), &r);
 }
 
+/**
+ * blk_add_trace_plug_flush - Add a trace for a task plug list flush
+ * @q:		queue the requests are for
+ * @depth:	number of requests handed to @q
+ * @from_schedule: the task is going to sleep
+ *
+ * Description:
+ *     Records a batch of plugged requests being moved from a task plug
+ *     list to the queue, with the number of requests as the payload.
+ *
+ **/
+static inline void blk_add_trace_plug_flush(struct request_queue *q,
+					    unsigned int depth,
+					    int from_schedule)
+{
+	blk_add_trace_pdu_int(q, from_schedule ? BLK_TA_PLUG_FLUSH_SCHED :
+			      BLK_TA_PLUG_FLUSH, NULL, depth);
+}
+
 extern int blk_trace_setup(struct request_queue *q, char *name, dev_t dev,
 			   char __user *arg);
 extern int blk_trace_startstop(struct request_queue *q, int start);
@@ -320,6 +343,7 @@ extern int blk_trace_remove(struct request_queue *q);
 #define blk_add_trace_generic(q, rq, rw, what)	do { } while (0)
 #define blk_add_trace_pdu_int(q, what, bio, pdu)	do { } while (0)
 #define blk_add_trace_remap(q, bio, dev, f, t)	do {} while (0)
+#define blk_add_trace_plug_flush(q, depth, s)	do { } while (0)
 #define do_blk_trace_setup(q, name, dev, buts)	(-ENOTTY)
 #define blk_trace_setup(q, name, dev, arg)	(-ENOTTY)
 #define blk_trace_startstop(q, start)		(-ENOTTY)
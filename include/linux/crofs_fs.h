@@ -0,0 +1,108 @@
+#ifndef __CROFS_FS_H
+#define __CROFS_FS_H
+
+/*
+ * On-disk format of crofs, the compressed read-only file system.
+ * See Documentation/filesystems/crofs.txt for a description of the
+ * image layout.  All fields are little endian.
+ */
+
+#include <linux/types.h>
+
+#define CROFS_MAGIC		0x464f5243	/* "CROF" */
+#define CROFS_MAJOR		1
+#define CROFS_MINOR		0
+
+/* Data block size limits, as log2 of the size in bytes */
+#define CROFS_MIN_BLOCK_LOG	12
+#define CROFS_MAX_BLOCK_LOG	20
+#define CROFS_DEFAULT_BLOCK_LOG	17		/* 128KiB */
+
+#define CROFS_ROOT_INO		1
+#define CROFS_NO_FRAGMENT	0xffffffff
+#define CROFS_MAX_NAMELEN	255
+
+/*
+ * Data and fragment blocks are described by a 32-bit block word: the
+ * low 24 bits are the length of the block on disk, the top 8 bits the
+ * compressor it was packed with.  A zero length block is a hole.
+ */
+#define CROFS_BLOCK_LEN_MASK	0x00ffffff
+#define CROFS_BLOCK_COMPR_SHIFT	24
+
+#define CROFS_BLOCK_LEN(w)	((w) & CROFS_BLOCK_LEN_MASK)
+#define CROFS_BLOCK_COMPR(w)	((w) >> CROFS_BLOCK_COMPR_SHIFT)
+
+#define CROFS_COMPR_NONE	0
+#define CROFS_COMPR_ZLIB	1
+#define CROFS_COMPR_LZO		2
+
+/*
+ * Feature flags.  We refuse to mount images with flags outside
+ * CROFS_SUPPORTED_FLAGS.
+ */
+#define CROFS_SUPPORTED_FLAGS	0
+
+struct crofs_super_block {
+	__le32 s_magic;			/* CROFS_MAGIC */
+	__le16 s_major;			/* CROFS_MAJOR */
+	__le16 s_minor;			/* CROFS_MINOR */
+	__le32 s_block_log;		/* log2 of the data block size */
+	__le32 s_flags;			/* feature flags */
+	__le32 s_inodes;		/* number of inodes */
+	__le32 s_fragments;		/* number of fragment table entries */
+	__le32 s_mkfs_time;		/* image creation time */
+	__le32 s_padding;
+	__le64 s_bytes_used;		/* image size in bytes */
+	__le64 s_inode_table;		/* offset of the inode table */
+	__le64 s_dir_table;		/* offset of the directory table */
+	__le64 s_frag_table;		/* offset of the fragment table */
+	__u8 s_name[16];		/* volume name */
+	__u8 s_unused[48];
+};
+
+/*
+ * Inodes are stored in a table of fixed size records, inode number N
+ * at s_inode_table + (N - 1) * sizeof(struct crofs_inode).
+ */
+struct crofs_inode {
+	__le16 i_mode;
+	__le16 i_nlink;
+	__le32 i_uid;
+	__le32 i_gid;
+	__le32 i_mtime;
+	__le64 i_size;
+	/*
+	 * Regular files: offset of the block word list, which is
+	 * immediately followed by the data blocks.  Directories: offset of
+	 * the entries in the directory table.  Symlinks: offset of the
+	 * target.
+	 */
+	__le64 i_start;
+	__le32 i_parent;		/* directories: parent inode number */
+	__le32 i_rdev;			/* device files: new_encode_dev() */
+	__le32 i_fragment;		/* fragment holding the tail, or
+					   CROFS_NO_FRAGMENT */
+	__le32 i_frag_offset;		/* offset of the tail in it */
+	__u8 i_unused[16];
+};
+
+/*
+ * Directory entries, sorted by name (memcmp order).  The name is
+ * padded with zeroes to a multiple of 4 bytes.
+ */
+struct crofs_dirent {
+	__le32 d_ino;
+	__le16 d_name_len;
+	__u8 d_type;			/* DT_* */
+	__u8 d_unused;
+	char d_name[0];
+};
+
+struct crofs_fragment {
+	__le64 f_start;			/* offset of the fragment block */
+	__le32 f_size;			/* block word */
+	__le32 f_unused;
+};
+
+#endif /* __CROFS_FS_H */
@@ -83,6 +83,25 @@ struct disk_stats {
 	unsigned long io_ticks;
 	unsigned long time_in_queue;
 };
+
+#ifdef CONFIG_BLK_DEV_IO_LATENCY
+/*
+ * log2 latency histograms. Bucket n counts requests that took at least
+ * 2^n microseconds (bucket 0 from 0), the last one has all slower ones.
+ */
+#define DISK_LAT_BUCKETS	24
+
+enum {
+	DISK_LAT_QUEUE,		/* queued until issued to the driver */
+	DISK_LAT_SERVICE,	/* issued until completed */
+	DISK_LAT_TOTAL,		/* queued until completed */
+	DISK_LAT_NR,
+};
+
+struct disk_latency {
+	unsigned long hist[2][DISK_LAT_NR][DISK_LAT_BUCKETS];
+};
+#endif
 	
 struct hd_struct {
 	sector_t start_sect;
@@ -143,6 +162,9 @@ struct gendisk {
 #ifdef  CONFIG_BLK_DEV_INTEGRITY
 	struct blk_integrity *integrity;
 #endif
+#ifdef CONFIG_BLK_DEV_IO_LATENCY
+	struct disk_latency latency;	/* protected by the queue lock */
+#endif
 };
 
 /* 
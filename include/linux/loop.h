@@ -27,6 +27,7 @@ enum {
 };
 
 struct loop_func_table;
+struct loop_extent;
 
 struct loop_device {
 	int		lo_number;
@@ -66,6 +67,14 @@ struct loop_device {
 	struct request_queue	*lo_queue;
 	struct gendisk		*lo_disk;
 	struct list_head	lo_list;
+
+	/* LO_FLAGS_DIRECT_IO: where the backing file lives */
+	struct block_device	*lo_dio_bdev;
+	struct loop_extent	*lo_extents;
+	unsigned int		lo_nr_extents;
+	mempool_t		*lo_dio_pool;
+	struct bio_set		*lo_bio_set;
+	atomic_t		lo_pending;	/* bios in flight */
 };
 
 #endif /* __KERNEL__ */
@@ -77,6 +86,7 @@ enum {
 	LO_FLAGS_READ_ONLY	= 1,
 	LO_FLAGS_USE_AOPS	= 2,
 	LO_FLAGS_AUTOCLEAR	= 4,
+	LO_FLAGS_DIRECT_IO	= 16,	/* bypass the file page cache */
 };
 
 #include <asm/posix_types.h>	/* for __kernel_old_dev_t */
@@ -50,6 +50,19 @@ struct mmc_ios {
 };
 
 struct mmc_host_ops {
+	/*
+	 * pre_req() and post_req() are optional.  pre_req() is called
+	 * before request() and may run while another request is still
+	 * being processed by the host, so it can be used to prepare
+	 * (e.g. dma_map_sg) the next request in parallel with the current
+	 * transfer.  is_first_req is set when no request is ongoing.
+	 * post_req() undoes what pre_req() did once the request has
+	 * completed, or when it is abandoned (err is non zero).
+	 */
+	void	(*pre_req)(struct mmc_host *host, struct mmc_request *req,
+			   bool is_first_req);
+	void	(*post_req)(struct mmc_host *host, struct mmc_request *req,
+			    int err);
 	void	(*request)(struct mmc_host *host, struct mmc_request *req);
 	/*
 	 * Avoid calling these three functions too often or in a "fast path",
@@ -146,6 +159,8 @@ struct mmc_host {
 
 	struct delayed_work	detect;
 
+	struct mmc_async_req	*areq;		/* active async req */
+
 	const struct mmc_bus_ops *bus_ops;	/* current bus driver */
 	unsigned int		bus_refs;	/* reference counter */
 
@@ -123,6 +123,11 @@ struct tc_prio_qopt
 	__u8	priomap[TC_PRIO_MAX+1];	/* Map: logical priority -> PRIO band */
 };
 
+struct tc_pfifo_fast_xstats
+{
+	__u32	bypassed;		/* Packets sent while the queue was empty */
+};
+
 /* TBF section */
 
 struct tc_tbf_qopt
@@ -382,6 +382,10 @@ struct tcp_sock {
 
 	unsigned long last_synq_overflow; 
 
+/* TCP Small Queues: see tcp_small_queue_check() */
+	unsigned long		tsq_flags;
+	struct list_head	tsq_node; /* anchor in tsq_tasklet.head list */
+
 /* Receiver side RTT estimation */
 	struct {
 		u32	rtt;
@@ -413,6 +417,12 @@ struct tcp_sock {
 	int			linger2;
 };
 
+enum tsq_flags {
+	TSQ_THROTTLED,	/* transmit stopped below the TCP layer */
+	TSQ_QUEUED,	/* socket is queued on the per-cpu tsq tasklet */
+	TSQ_OWNED,	/* tcp_tasklet_func() found socket owned by user */
+};
+
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
 {
 	return (struct tcp_sock *)sk;
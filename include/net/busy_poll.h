@@ -0,0 +1,68 @@
+/*
+ * Busy polling of device receive queues from socket receive calls.
+ *
+ * A socket remembers the NAPI context its last packet arrived on.  A
+ * blocking receive on an empty socket may then call that context's poll
+ * routine directly, for up to sk_ll_usec microseconds, instead of going
+ * to sleep and waiting for the interrupt, the softirq and the wakeup.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _NET_BUSY_POLL_H
+#define _NET_BUSY_POLL_H
+
+#include <linux/netdevice.h>
+#include <net/sock.h>
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+
+extern unsigned int sysctl_net_busy_read __read_mostly;
+
+/* NAPI context currently polled on this cpu, see net_rx_action() */
+DECLARE_PER_CPU(unsigned int, napi_poll_id);
+
+static inline int sk_can_busy_loop(struct sock *sk)
+{
+	return sk->sk_ll_usec && sk->sk_napi_id &&
+	       !need_resched() && !signal_pending(current);
+}
+
+/* Called from netif_receive_skb() */
+static inline void skb_mark_napi_id(struct sk_buff *skb)
+{
+	skb->napi_id = __get_cpu_var(napi_poll_id);
+}
+
+/* Called by the protocols once the receiving socket is known */
+static inline void sk_mark_napi_id(struct sock *sk, struct sk_buff *skb)
+{
+	sk->sk_napi_id = skb->napi_id;
+}
+
+extern int sk_busy_loop(struct sock *sk, int nonblock);
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+
+static inline int sk_can_busy_loop(struct sock *sk)
+{
+	return 0;
+}
+
+static inline void skb_mark_napi_id(struct sk_buff *skb)
+{
+}
+
+static inline void sk_mark_napi_id(struct sock *sk, struct sk_buff *skb)
+{
+}
+
+static inline int sk_busy_loop(struct sock *sk, int nonblock)
+{
+	return 0;
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+#endif /* _NET_BUSY_POLL_H */
@@ -103,6 +103,7 @@ struct rt_cache_stat
         unsigned int gc_dst_overflow;
         unsigned int in_hlist_search;
         unsigned int out_hlist_search;
+        unsigned int gc_chain_trim;
 };
 
 extern struct ip_rt_acct *ip_rt_acct;
@@ -0,0 +1,597 @@
+/*
+ * lib/bch.c
+ *
+ * Overview:
+ *   Generic binary BCH encoder / decoder library
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Description:
+ *
+ * A binary BCH code over GF(2^m) corrects up to t bit errors in a
+ * codeword of at most 2^m-1 bits, data and ecc included, with at most
+ * m*t ecc bits.  For NAND flash m = 13 covers a 512 byte sector and
+ * t = 4, 8 or 16 costs 7, 13 or 26 ecc bytes per sector.
+ *
+ * Each user calls init_bch() once, which builds the field and encoder
+ * tables.  This takes a while, so don't do it from a time critical path.
+ *
+ * The encoder divides the data by the generator polynomial.  Rather than
+ * clocking a bitwise LFSR, the remainder is kept in 32-bit words and the
+ * data is consumed a big endian word at a time: the remainder of each
+ * byte of the word is looked up in one of four precomputed tables, so a
+ * word costs four lookups and four XORs per ecc word.
+ *
+ * The decoder computes the syndromes from the difference between the
+ * received and the calculated ecc, which is much shorter than the whole
+ * codeword.  The error locator polynomial is found with the simplified
+ * binary Berlekamp-Massey algorithm and its roots with a Chien search.
+ * All field arithmetic goes through log / antilog tables.  The common
+ * single bit error is located directly without a search.
+ *
+ * The control structure holds the work buffers, so callers must
+ * serialize encode_bch() and decode_bch() calls on one bch_control.
+ */
+
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/bch.h>
+#include <asm/unaligned.h>
+
+#define BCH_MIN_M	5
+#define BCH_MAX_M	15
+
+/* Default primitive polynomials for m = BCH_MIN_M .. BCH_MAX_M */
+static const unsigned int prim_poly_tab[] = {
+	0x25, 0x43, 0x83, 0x11d, 0x211, 0x409, 0x805, 0x1053, 0x201b,
+	0x402b, 0x8003,
+};
+
+/* Reduce an exponent below 2n modulo n */
+static inline unsigned int mod_n(struct bch_control *bch, unsigned int v)
+{
+	return v >= bch->n ? v - bch->n : v;
+}
+
+static inline unsigned int gf_mul(struct bch_control *bch, unsigned int a,
+				  unsigned int b)
+{
+	if (!a || !b)
+		return 0;
+	return bch->a_pow_tab[mod_n(bch, bch->a_log_tab[a] +
+				    bch->a_log_tab[b])];
+}
+
+static inline unsigned int gf_sqr(struct bch_control *bch, unsigned int a)
+{
+	return a ? bch->a_pow_tab[mod_n(bch, 2 * bch->a_log_tab[a])] : 0;
+}
+
+/*
+ * The ecc is kept left aligned in ecc_words big endian words: the
+ * coefficient of X^(ecc_bits-1) is the top bit of word 0 and the unused
+ * bits at the end of the last word are zero.
+ */
+static void load_ecc(struct bch_control *bch, uint32_t *dst,
+		     const uint8_t *src)
+{
+	unsigned int i, nwords = bch->ecc_bytes / 4;
+	unsigned int rem = bch->ecc_bits & 31;
+	uint8_t pad[4] = { 0, 0, 0, 0 };
+
+	for (i = 0; i < nwords; i++, src += 4)
+		dst[i] = get_unaligned_be32(src);
+	if (bch->ecc_bytes & 3) {
+		memcpy(pad, src, bch->ecc_bytes & 3);
+		dst[i] = get_unaligned_be32(pad);
+	}
+	if (rem)
+		dst[bch->ecc_words - 1] &= ~0U << (32 - rem);
+}
+
+static void store_ecc(struct bch_control *bch, uint8_t *dst,
+		      const uint32_t *src)
+{
+	unsigned int i, nwords = bch->ecc_bytes / 4;
+	uint8_t pad[4];
+
+	for (i = 0; i < nwords; i++, dst += 4)
+		put_unaligned_be32(src[i], dst);
+	if (bch->ecc_bytes & 3) {
+		put_unaligned_be32(src[i], pad);
+		memcpy(dst, pad, bch->ecc_bytes & 3);
+	}
+}
+
+/*
+ * Shift @len bytes of data into the remainder @r.  Whole words go
+ * through the four byte tables at once, trailing bytes one by one
+ * through the table of the last byte.
+ */
+static void __encode_bch(struct bch_control *bch, const uint8_t *data,
+			 unsigned int len, uint32_t *r)
+{
+	const unsigned int l = bch->ecc_words;
+	const uint32_t *tab0 = bch->mod8_tab;
+	const uint32_t *tab1 = tab0 + 256 * l;
+	const uint32_t *tab2 = tab1 + 256 * l;
+	const uint32_t *tab3 = tab2 + 256 * l;
+	const uint32_t *p0, *p1, *p2, *p3;
+	unsigned int i;
+	uint32_t w;
+
+	for (; len >= 4; len -= 4, data += 4) {
+		w = r[0] ^ get_unaligned_be32(data);
+		p0 = tab0 + l * (w >> 24);
+		p1 = tab1 + l * ((w >> 16) & 0xff);
+		p2 = tab2 + l * ((w >> 8) & 0xff);
+		p3 = tab3 + l * (w & 0xff);
+		for (i = 0; i < l - 1; i++)
+			r[i] = r[i + 1] ^ p0[i] ^ p1[i] ^ p2[i] ^ p3[i];
+		r[l - 1] = p0[l - 1] ^ p1[l - 1] ^ p2[l - 1] ^ p3[l - 1];
+	}
+
+	for (; len; len--, data++) {
+		p3 = tab3 + l * ((r[0] >> 24) ^ *data);
+		for (i = 0; i < l - 1; i++)
+			r[i] = ((r[i] << 8) | (r[i + 1] >> 24)) ^ p3[i];
+		r[l - 1] = (r[l - 1] << 8) ^ p3[l - 1];
+	}
+}
+
+/**
+ * encode_bch - calculate the ecc of a data buffer
+ * @bch:	the bch control structure
+ * @data:	data to protect
+ * @len:	length of @data in bytes
+ * @ecc:	ecc bytes, bch->ecc_bytes long
+ *
+ * @ecc must be zeroed by the caller before the first call.  Calling
+ * encode_bch() again with the same @ecc continues the calculation, so
+ * the ecc of a buffer can be built from several pieces.
+ */
+void encode_bch(struct bch_control *bch, const uint8_t *data,
+		unsigned int len, uint8_t *ecc)
+{
+	load_ecc(bch, bch->ecc_buf, ecc);
+	__encode_bch(bch, data, len, bch->ecc_buf);
+	store_ecc(bch, ecc, bch->ecc_buf);
+}
+EXPORT_SYMBOL_GPL(encode_bch);
+
+/*
+ * The remainder r(X) of the received codeword equals e(X) mod g(X), so
+ * r(a^j) = e(a^j) for all roots a^j of g(X).  Evaluate the odd
+ * syndromes from the set bits of r(X) and square them for the even
+ * ones, S(2j) = S(j)^2.
+ */
+static void compute_syndromes(struct bch_control *bch, const uint32_t *r,
+			      unsigned int *syn)
+{
+	const unsigned int t = bch->t;
+	unsigned int i, j, b, k, exp, step;
+	uint32_t w;
+
+	memset(syn, 0, 2 * t * sizeof(*syn));
+
+	for (i = 0; i < bch->ecc_words; i++) {
+		for (w = r[i]; w; w &= ~(1U << b)) {
+			b = fls(w) - 1;
+			k = bch->ecc_bits - 1 - (32 * i + 31 - b);
+			/* syn[j] = S(j+1) += a^((j+1)k) for even j */
+			exp = k;
+			step = mod_n(bch, 2 * k);
+			for (j = 0; j < 2 * t; j += 2) {
+				syn[j] ^= bch->a_pow_tab[exp];
+				exp = mod_n(bch, exp + step);
+			}
+		}
+	}
+
+	for (j = 0; j < t; j++)
+		syn[2 * j + 1] = gf_sqr(bch, syn[j]);
+}
+
+/*
+ * Simplified Berlekamp-Massey algorithm for binary codes, which only
+ * needs t iterations.  Leaves the error locator polynomial in bch->elp
+ * and returns its degree, or -1 if there are more than t errors.
+ */
+static int compute_error_locator(struct bch_control *bch,
+				 const unsigned int *syn)
+{
+	const unsigned int t = bch->t, n = bch->n;
+	const unsigned int size = (2 * t + 1) * sizeof(*bch->elp);
+	unsigned int *elp = bch->elp;
+	unsigned int *pelp = elp + 2 * t + 1;
+	unsigned int *elp_copy = pelp + 2 * t + 1;
+	unsigned int d = syn[0], pd = 1, tmp;
+	int deg = 0, pdeg = 0, pp = -1, i, j, k;
+
+	memset(elp, 0, size);
+	memset(pelp, 0, size);
+	elp[0] = 1;
+	pelp[0] = 1;
+
+	for (i = 0; i < t && deg <= t; i++) {
+		if (d) {
+			/* elp(X) += d / pd * X^(2i-pp) * pelp(X) */
+			k = 2 * i - pp;
+			memcpy(elp_copy, elp, size);
+			tmp = bch->a_log_tab[d] + n - bch->a_log_tab[pd];
+			for (j = 0; j <= pdeg; j++) {
+				if (pelp[j])
+					elp[j + k] ^= bch->a_pow_tab[
+						(tmp + bch->a_log_tab[pelp[j]]) % n];
+			}
+			if (pdeg + k > deg) {
+				memcpy(pelp, elp_copy, size);
+				tmp = deg;
+				deg = pdeg + k;
+				pdeg = tmp;
+				pd = d;
+				pp = 2 * i;
+			}
+		}
+		/* next discrepancy */
+		if (i < t - 1 && deg <= t) {
+			d = syn[2 * i + 2];
+			for (j = 1; j <= deg; j++)
+				d ^= gf_mul(bch, elp[j], syn[2 * i + 2 - j]);
+		}
+	}
+
+	if (deg > t)
+		return -1;
+	while (deg > 0 && !elp[deg])
+		deg--;
+	return deg;
+}
+
+/*
+ * Find the roots a^-k of the error locator polynomial for all bit
+ * positions k < @nbits of the codeword.  Returns the number of roots,
+ * which must match the degree, or -1.
+ */
+static int find_roots(struct bch_control *bch, unsigned int nbits, int deg,
+		      unsigned int *roots)
+{
+	const unsigned int n = bch->n;
+	unsigned int *elp = bch->elp;
+	unsigned int *exp = elp + 2 * (2 * bch->t + 1);
+	unsigned int k, sum;
+	int i, nroots = 0;
+
+	/* 1 + e1 X has the single root X = a^-k with a^k = e1 */
+	if (deg == 1) {
+		k = bch->a_log_tab[elp[1]];
+		if (k >= nbits)
+			return -1;
+		roots[0] = k;
+		return 1;
+	}
+
+	/* Chien search: exp[i] tracks the exponent of elp[i] * a^(-ik) */
+	for (i = 1; i <= deg; i++)
+		exp[i] = elp[i] ? bch->a_log_tab[elp[i]] : n;
+
+	for (k = 0; k < nbits && nroots < deg; k++) {
+		sum = 1;
+		for (i = 1; i <= deg; i++) {
+			if (exp[i] == n)
+				continue;
+			sum ^= bch->a_pow_tab[exp[i]];
+			exp[i] = exp[i] >= i ? exp[i] - i : exp[i] + n - i;
+		}
+		if (!sum)
+			roots[nroots++] = k;
+	}
+
+	return nroots == deg ? nroots : -1;
+}
+
+/**
+ * decode_bch - locate the bit errors in a data buffer and its ecc
+ * @bch:	the bch control structure
+ * @data:	received data, only used if @calc_ecc is NULL
+ * @len:	length of the data in bytes
+ * @recv_ecc:	received ecc bytes
+ * @calc_ecc:	ecc calculated from the received data, or NULL
+ * @errloc:	array of at least bch->t entries for the error locations
+ *
+ * Returns the number of bit errors found, 0 if there are none, -EBADMSG
+ * if the data can't be corrected or -EINVAL if @len is too long for the
+ * code.
+ *
+ * For every error, bit errloc[i] & 7 of byte errloc[i] >> 3 is flipped.
+ * Locations below 8 * @len are in the data, see correct_bch(), higher
+ * ones in the ecc, counted from 8 * @len.
+ */
+int decode_bch(struct bch_control *bch, const uint8_t *data, unsigned int len,
+	       const uint8_t *recv_ecc, const uint8_t *calc_ecc,
+	       unsigned int *errloc)
+{
+	const unsigned int l = bch->ecc_words;
+	uint32_t *r = bch->ecc_buf, *recv = bch->ecc_buf2;
+	unsigned int i, k, sum = 0;
+	int nerr;
+
+	if (8 * len > bch->n - bch->ecc_bits)
+		return -EINVAL;
+
+	if (calc_ecc) {
+		load_ecc(bch, r, calc_ecc);
+	} else {
+		if (!data)
+			return -EINVAL;
+		memset(r, 0, l * sizeof(*r));
+		__encode_bch(bch, data, len, r);
+	}
+	load_ecc(bch, recv, recv_ecc);
+
+	for (i = 0; i < l; i++) {
+		r[i] ^= recv[i];
+		sum |= r[i];
+	}
+	if (!sum)
+		return 0;
+
+	compute_syndromes(bch, r, bch->syn);
+	nerr = compute_error_locator(bch, bch->syn);
+	if (nerr <= 0)
+		return -EBADMSG;
+	nerr = find_roots(bch, 8 * len + bch->ecc_bits, nerr, errloc);
+	if (nerr < 0)
+		return -EBADMSG;
+
+	/* Turn codeword bit positions into byte / bit locations */
+	for (i = 0; i < nerr; i++) {
+		k = errloc[i];
+		if (k >= bch->ecc_bits) {
+			k -= bch->ecc_bits;
+			errloc[i] = 8 * (len - 1 - k / 8) + (k & 7);
+		} else {
+			k = bch->ecc_bits - 1 - k;
+			errloc[i] = 8 * len + (k & ~7) + 7 - (k & 7);
+		}
+	}
+	return nerr;
+}
+EXPORT_SYMBOL_GPL(decode_bch);
+
+/**
+ * correct_bch - flip the data bits located by decode_bch()
+ * @bch:	the bch control structure
+ * @data:	data to correct
+ * @len:	length of @data in bytes
+ * @errloc:	error locations from decode_bch()
+ * @nerr:	number of errors returned by decode_bch()
+ *
+ * Errors located in the ecc are ignored.
+ */
+void correct_bch(struct bch_control *bch, uint8_t *data, unsigned int len,
+		 unsigned int *errloc, int nerr)
+{
+	int i;
+
+	for (i = 0; i < nerr; i++) {
+		if (errloc[i] < 8 * len)
+			data[errloc[i] >> 3] ^= 1 << (errloc[i] & 7);
+	}
+}
+EXPORT_SYMBOL_GPL(correct_bch);
+
+static int build_gf_tables(struct bch_control *bch, unsigned int poly)
+{
+	unsigned int i, x = 1;
+
+	if (fls(poly) != bch->m + 1)
+		return -EINVAL;
+
+	for (i = 0; i < bch->n; i++) {
+		/* a^i = 1 for some 0 < i < n: poly is not primitive */
+		if (i && x == 1)
+			return -EINVAL;
+		bch->a_pow_tab[i] = x;
+		bch->a_log_tab[x] = i;
+		x <<= 1;
+		if (x & (1 << bch->m))
+			x ^= poly;
+	}
+	bch->a_pow_tab[bch->n] = 1;
+	bch->a_log_tab[0] = 0;
+	return 0;
+}
+
+/*
+ * g(X) is the product of (X - a^r) over the roots a^1, a^3, ...,
+ * a^(2t-1) and their conjugates a^(2r), a^(4r), ...  Its coefficients
+ * are binary.  Returns them as an array of ecc_bits + 1 entries.
+ */
+static unsigned int *compute_generator_polynomial(struct bch_control *bch)
+{
+	const unsigned int n = bch->n, t = bch->t;
+	unsigned int i, j, r, deg = 0;
+	unsigned long *roots;
+	unsigned int *g;
+
+	roots = kzalloc(BITS_TO_LONGS(n) * sizeof(long), GFP_KERNEL);
+	g = kzalloc((bch->m * t + 1) * sizeof(*g), GFP_KERNEL);
+	if (!roots || !g) {
+		kfree(g);
+		g = NULL;
+		goto out;
+	}
+
+	for (i = 0; i < t; i++) {
+		for (j = 0, r = 2 * i + 1; j < bch->m; j++) {
+			__set_bit(r, roots);
+			r = mod_n(bch, 2 * r);
+		}
+	}
+
+	g[0] = 1;
+	for (i = 0; i < n; i++) {
+		if (!test_bit(i, roots))
+			continue;
+		r = bch->a_pow_tab[i];
+		g[deg + 1] = 1;
+		for (j = deg; j > 0; j--)
+			g[j] = gf_mul(bch, g[j], r) ^ g[j - 1];
+		g[0] = gf_mul(bch, g[0], r);
+		deg++;
+	}
+	bch->ecc_bits = deg;
+out:
+	kfree(roots);
+	return g;
+}
+
+/*
+ * mod8_tab holds four tables of 256 remainders, table i giving
+ * b(X) * X^(8*(3-i)) * X^ecc_bits mod g(X) for byte b at position i of
+ * a big endian data word.
+ */
+static int build_mod8_tables(struct bch_control *bch, const unsigned int *g)
+{
+	const unsigned int l = bch->ecc_words, d = bch->ecc_bits;
+	uint32_t *glow = bch->ecc_buf2, *basis, *prev, *cur, *tab;
+	unsigned int i, j, b, k, e;
+
+	basis = kmalloc(32 * l * sizeof(*basis), GFP_KERNEL);
+	if (!basis)
+		return -ENOMEM;
+
+	/* X^d mod g(X) is g(X) without its leading term */
+	memset(glow, 0, l * sizeof(*glow));
+	for (k = 0; k < d; k++) {
+		if (g[k]) {
+			e = d - 1 - k;
+			glow[e / 32] |= 1U << (31 - (e & 31));
+		}
+	}
+
+	/* basis[e] = X^(d+e) mod g(X) */
+	memcpy(basis, glow, l * sizeof(*basis));
+	for (e = 1; e < 32; e++) {
+		prev = basis + (e - 1) * l;
+		cur = basis + e * l;
+		for (i = 0; i < l - 1; i++)
+			cur[i] = (prev[i] << 1) | (prev[i + 1] >> 31);
+		cur[l - 1] = prev[l - 1] << 1;
+		if (prev[0] >> 31) {
+			for (i = 0; i < l; i++)
+				cur[i] ^= glow[i];
+		}
+	}
+
+	for (i = 0; i < 4; i++) {
+		for (b = 0; b < 256; b++) {
+			tab = bch->mod8_tab + (i * 256 + b) * l;
+			memset(tab, 0, l * sizeof(*tab));
+			for (j = 0; j < 8; j++) {
+				if (!(b & (1 << j)))
+					continue;
+				cur = basis + (8 * (3 - i) + j) * l;
+				for (k = 0; k < l; k++)
+					tab[k] ^= cur[k];
+			}
+		}
+	}
+
+	kfree(basis);
+	return 0;
+}
+
+/**
+ * init_bch - create a bch control structure
+ * @m:		Galois field order, BCH_MIN_M (5) to BCH_MAX_M (15)
+ * @t:		number of correctable bit errors
+ * @prim_poly:	primitive polynomial of degree @m, or 0 for the default
+ *
+ * The code protects at most 2^@m - 1 - bch->ecc_bits data bits.
+ * Returns NULL if the parameters are invalid or memory is short.
+ */
+struct bch_control *init_bch(int m, int t, unsigned int prim_poly)
+{
+	struct bch_control *bch;
+	unsigned int *g = NULL;
+
+	if (m < BCH_MIN_M || m > BCH_MAX_M)
+		return NULL;
+	if (t < 1 || m * t >= (1 << m) - 1)
+		return NULL;
+	if (!prim_poly)
+		prim_poly = prim_poly_tab[m - BCH_MIN_M];
+
+	bch = kzalloc(sizeof(*bch), GFP_KERNEL);
+	if (!bch)
+		return NULL;
+
+	bch->m = m;
+	bch->t = t;
+	bch->n = (1 << m) - 1;
+	bch->a_pow_tab = kmalloc((bch->n + 1) * sizeof(uint16_t), GFP_KERNEL);
+	bch->a_log_tab = kmalloc((bch->n + 1) * sizeof(uint16_t), GFP_KERNEL);
+	bch->syn = kmalloc(2 * t * sizeof(*bch->syn), GFP_KERNEL);
+	bch->elp = kmalloc(3 * (2 * t + 1) * sizeof(*bch->elp), GFP_KERNEL);
+	if (!bch->a_pow_tab || !bch->a_log_tab || !bch->syn || !bch->elp)
+		goto fail;
+
+	if (build_gf_tables(bch, prim_poly))
+		goto fail;
+
+	g = compute_generator_polynomial(bch);
+	if (!g)
+		goto fail;
+
+	bch->ecc_bytes = DIV_ROUND_UP(bch->ecc_bits, 8);
+	bch->ecc_words = DIV_ROUND_UP(bch->ecc_bits, 32);
+	bch->ecc_buf = kmalloc(bch->ecc_words * sizeof(uint32_t), GFP_KERNEL);
+	bch->ecc_buf2 = kmalloc(bch->ecc_words * sizeof(uint32_t), GFP_KERNEL);
+	bch->mod8_tab = kmalloc(4 * 256 * bch->ecc_words * sizeof(uint32_t),
+				GFP_KERNEL);
+	if (!bch->ecc_buf || !bch->ecc_buf2 || !bch->mod8_tab)
+		goto fail;
+
+	if (build_mod8_tables(bch, g))
+		goto fail;
+
+	kfree(g);
+	return bch;
+
+fail:
+	kfree(g);
+	free_bch(bch);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(init_bch);
+
+/**
+ * free_bch - free a bch control structure
+ * @bch:	the bch control structure
+ */
+void free_bch(struct bch_control *bch)
+{
+	if (!bch)
+		return;
+	kfree(bch->a_pow_tab);
+	kfree(bch->a_log_tab);
+	kfree(bch->mod8_tab);
+	kfree(bch->ecc_buf);
+	kfree(bch->ecc_buf2);
+	kfree(bch->syn);
+	kfree(bch->elp);
+	kfree(bch);
+}
+EXPORT_SYMBOL_GPL(free_bch);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Binary BCH encoder / decoder");
@@ -0,0 +1,246 @@
+/*
+ * lib/bch_test.c
+ *
+ * Self test and benchmark for the BCH library
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * For each code below, random data is encoded, 0 to t random bits of the
+ * data and ecc are flipped, and decode_bch() must locate exactly those
+ * bits.  Then the encoder throughput and the time to decode a codeword
+ * with t errors are measured.  Results go to the kernel log; loading the
+ * module fails if a test does.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/bch.h>
+
+static int iterations = 1000;
+module_param(iterations, int, S_IRUGO);
+MODULE_PARM_DESC(iterations, "random error patterns per error count");
+
+static int bench_ms = 200;
+module_param(bench_ms, int, S_IRUGO);
+MODULE_PARM_DESC(bench_ms, "duration of each benchmark in milliseconds");
+
+static const struct {
+	int m;
+	int t;
+	unsigned int len;	/* data bytes per codeword */
+} codes[] = {
+	{  8,  2,   16 },
+	{ 13,  4,  512 },
+	{ 13,  8,  512 },
+	{ 13, 16,  512 },
+	{ 14,  8, 1024 },
+	{ 14, 24, 1024 },
+};
+
+struct bch_test {
+	struct bch_control *bch;
+	unsigned int len;
+	unsigned int bits;	/* of data and ecc, the codeword */
+	uint8_t *good;		/* data followed by its ecc */
+	uint8_t *bad;
+	unsigned int *errloc;
+	unsigned int *flipped;
+};
+
+/* Bit @k of the codeword: the data bits, then the ecc bits, msb first */
+static void flip_bit(struct bch_test *bt, uint8_t *buf, unsigned int k)
+{
+	if (k < 8 * bt->len) {
+		buf[k >> 3] ^= 1 << (k & 7);
+	} else {
+		k -= 8 * bt->len;
+		buf[bt->len + (k >> 3)] ^= 0x80 >> (k & 7);
+	}
+}
+
+static void random_codeword(struct bch_test *bt)
+{
+	struct bch_control *bch = bt->bch;
+
+	get_random_bytes(bt->good, bt->len);
+	memset(bt->good + bt->len, 0, bch->ecc_bytes);
+	encode_bch(bch, bt->good, bt->len, bt->good + bt->len);
+}
+
+/* Flip @nerr distinct random bits of the codeword */
+static void add_errors(struct bch_test *bt, int nerr)
+{
+	int i, j;
+
+	memcpy(bt->bad, bt->good, bt->len + bt->bch->ecc_bytes);
+	for (i = 0; i < nerr; i++) {
+again:
+		bt->flipped[i] = random32() % bt->bits;
+		for (j = 0; j < i; j++)
+			if (bt->flipped[j] == bt->flipped[i])
+				goto again;
+		flip_bit(bt, bt->bad, bt->flipped[i]);
+	}
+}
+
+static int check_pattern(struct bch_test *bt, int nerr)
+{
+	struct bch_control *bch = bt->bch;
+	unsigned int total = bt->len + bch->ecc_bytes;
+	int i, ret;
+
+	add_errors(bt, nerr);
+	ret = decode_bch(bch, bt->bad, bt->len, bt->bad + bt->len, NULL,
+			 bt->errloc);
+	if (ret != nerr) {
+		printk(KERN_ERR "bch_test: m=%d t=%d: %d errors, "
+		       "decode_bch() returned %d\n", bch->m, bch->t, nerr, ret);
+		return -EINVAL;
+	}
+
+	/* the reported locations index the data followed by the ecc */
+	for (i = 0; i < ret; i++) {
+		if (bt->errloc[i] >= 8 * total) {
+			printk(KERN_ERR "bch_test: m=%d t=%d: location %u out "
+			       "of range\n", bch->m, bch->t, bt->errloc[i]);
+			return -EINVAL;
+		}
+		bt->bad[bt->errloc[i] >> 3] ^= 1 << (bt->errloc[i] & 7);
+	}
+	if (memcmp(bt->bad, bt->good, total)) {
+		printk(KERN_ERR "bch_test: m=%d t=%d: %d errors not "
+		       "corrected\n", bch->m, bch->t, nerr);
+		return -EINVAL;
+	}
+
+	/* correct_bch() must fix the data and skip errors in the ecc */
+	for (i = 0; i < nerr; i++)
+		flip_bit(bt, bt->bad, bt->flipped[i]);
+	correct_bch(bch, bt->bad, bt->len, bt->errloc, ret);
+	if (memcmp(bt->bad, bt->good, bt->len)) {
+		printk(KERN_ERR "bch_test: m=%d t=%d: correct_bch() failed "
+		       "with %d errors\n", bch->m, bch->t, nerr);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int test_patterns(struct bch_test *bt)
+{
+	int nerr, i, err;
+
+	for (nerr = 0; nerr <= bt->bch->t; nerr++) {
+		for (i = 0; i < iterations; i++) {
+			random_codeword(bt);
+			err = check_pattern(bt, nerr);
+			if (err)
+				return err;
+			cond_resched();
+		}
+	}
+	return 0;
+}
+
+static void bench(struct bch_test *bt)
+{
+	struct bch_control *bch = bt->bch;
+	s64 limit = (s64)bench_ms * NSEC_PER_MSEC;
+	u64 n, ns, rate;
+	ktime_t start;
+
+	random_codeword(bt);
+
+	n = 0;
+	start = ktime_get();
+	do {
+		memset(bt->bad + bt->len, 0, bch->ecc_bytes);
+		encode_bch(bch, bt->good, bt->len, bt->bad + bt->len);
+		n++;
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	} while (ns < limit);
+	rate = div64_u64(n * bt->len * 1000, ns);
+
+	/* time the decoding of t errors, the worst case */
+	add_errors(bt, bch->t);
+	n = 0;
+	start = ktime_get();
+	do {
+		decode_bch(bch, bt->bad, bt->len, bt->bad + bt->len, NULL,
+			   bt->errloc);
+		n++;
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	} while (ns < limit);
+
+	printk(KERN_INFO "bch_test: m=%d t=%d len=%u: encode %llu MB/s, "
+	       "decode %d errors %llu ns\n", bch->m, bch->t, bt->len,
+	       (unsigned long long)rate, bch->t,
+	       (unsigned long long)div64_u64(ns, n));
+}
+
+static int test_code(int m, int t, unsigned int len)
+{
+	struct bch_test bt;
+	int err = -ENOMEM;
+
+	memset(&bt, 0, sizeof(bt));
+	bt.bch = init_bch(m, t, 0);
+	if (!bt.bch) {
+		printk(KERN_ERR "bch_test: init_bch(%d, %d) failed\n", m, t);
+		return -EINVAL;
+	}
+	bt.len = len;
+	bt.bits = 8 * len + bt.bch->ecc_bits;
+	bt.good = kmalloc(len + bt.bch->ecc_bytes, GFP_KERNEL);
+	bt.bad = kmalloc(len + bt.bch->ecc_bytes, GFP_KERNEL);
+	bt.errloc = kmalloc(t * sizeof(*bt.errloc), GFP_KERNEL);
+	bt.flipped = kmalloc(t * sizeof(*bt.flipped), GFP_KERNEL);
+	if (!bt.good || !bt.bad || !bt.errloc || !bt.flipped)
+		goto out;
+
+	err = test_patterns(&bt);
+	if (!err) {
+		printk(KERN_INFO "bch_test: m=%d t=%d len=%u: 0 to %d errors "
+		       "x %d patterns ok\n", m, t, len, t, iterations);
+		bench(&bt);
+	}
+out:
+	kfree(bt.flipped);
+	kfree(bt.errloc);
+	kfree(bt.bad);
+	kfree(bt.good);
+	free_bch(bt.bch);
+	return err;
+}
+
+static int __init bch_test_init(void)
+{
+	int i, err;
+
+	for (i = 0; i < ARRAY_SIZE(codes); i++) {
+		err = test_code(codes[i].m, codes[i].t, codes[i].len);
+		if (err)
+			return err;
+	}
+	printk(KERN_INFO "bch_test: all tests passed\n");
+	return 0;
+}
+
+static void __exit bch_test_exit(void)
+{
+}
+
+module_init(bch_test_init);
+module_exit(bch_test_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("BCH library self test and benchmark");
@@ -615,6 +615,47 @@ int __lock_page_killable(struct page *page)
 					sync_page_killable, TASK_KILLABLE);
 }
 
+/*
+ * lock_page_async - lock a page for a buffered AIO read without sleeping
+ * @page: the page to lock
+ * @wait: the iocb's wait entry
+ *
+ * If the page is locked, queue @wait on the page's wait queue, make sure
+ * the I/O holding the lock is not left plugged and return -EIOCBRETRY.
+ * unlock_page() then kicks the iocb and the read is retried from the aio
+ * workqueue.  Returns 0 with the page locked otherwise.
+ */
+static int lock_page_async(struct page *page, struct wait_bit_queue *wait)
+{
+	wait_queue_head_t *wq = page_waitqueue(page);
+	struct address_space *mapping;
+	unsigned long flags;
+
+	if (trylock_page(page))
+		return 0;
+
+	wait->key.flags = &page->flags;
+	wait->key.bit_nr = PG_locked;
+	spin_lock_irqsave(&wq->lock, flags);
+	__add_wait_queue(wq, &wait->wait);
+	spin_unlock_irqrestore(&wq->lock, flags);
+
+	/* The unlock may have happened before we were queued */
+	if (trylock_page(page)) {
+		spin_lock_irqsave(&wq->lock, flags);
+		list_del_init(&wait->wait.task_list);
+		spin_unlock_irqrestore(&wq->lock, flags);
+		return 0;
+	}
+
+	/* See sync_page() for why page_mapping() is safe here */
+	smp_mb();
+	mapping = page_mapping(page);
+	if (mapping && mapping->a_ops && mapping->a_ops->sync_page)
+		mapping->a_ops->sync_page(page);
+	return -EIOCBRETRY;
+}
+
 /**
  * __lock_page_nosync - get a lock on the page, without calling sync_page()
  * @page: the page to lock
@@ -975,15 +1016,21 @@ static void shrink_readahead_size_eio(struct file *filp,
  * @ppos:	current file position
  * @desc:	read_descriptor
  * @actor:	read method
+ * @wait:	wait entry of an async kiocb, or NULL to block
  *
  * This is a generic file read routine, and uses the
  * mapping->a_ops->readpage() function for the actual low-level stuff.
  *
+ * With @wait, a read that would sleep on a locked page stops instead:
+ * it returns what it has copied so far, or, if nothing, queues @wait on
+ * the page and sets desc->error to -EIOCBRETRY.
+ *
  * This is really ugly. But the goto's actually try to clarify some
  * of the logic when it comes to error handling etc.
  */
 static void do_generic_file_read(struct file *filp, loff_t *ppos,
-		read_descriptor_t *desc, read_actor_t actor)
+		read_descriptor_t *desc, read_actor_t actor,
+		struct wait_bit_queue *wait)
 {
 	struct address_space *mapping = filp->f_mapping;
 	struct inode *inode = mapping->host;
@@ -1100,7 +1147,13 @@ page_ok:
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		if (lock_page_killable(page))
+		if (wait) {
+			if (desc->written)
+				goto page_wait_async;
+			error = lock_page_async(page, wait);
+			if (error)
+				goto readpage_error;
+		} else if (lock_page_killable(page))
 			goto readpage_eio;
 
 page_not_up_to_date_locked:
@@ -1130,7 +1183,13 @@ readpage:
 		}
 
 		if (!PageUptodate(page)) {
-			if (lock_page_killable(page))
+			if (wait) {
+				if (desc->written)
+					goto page_wait_async;
+				error = lock_page_async(page, wait);
+				if (error)
+					goto readpage_error;
+			} else if (lock_page_killable(page))
 				goto readpage_eio;
 			if (!PageUptodate(page)) {
 				if (page->mapping == NULL) {
@@ -1150,6 +1209,11 @@ readpage:
 
 		goto page_ok;
 
+page_wait_async:
+		/* Hand back what we have rather than queue behind this page */
+		page_cache_release(page);
+		goto out;
+
 readpage_eio:
 		error = -EIO;
 readpage_error:
@@ -1327,7 +1391,8 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		if (desc.count == 0)
 			continue;
 		desc.error = 0;
-		do_generic_file_read(filp, ppos, &desc, file_read_actor);
+		do_generic_file_read(filp, ppos, &desc, file_read_actor,
+				     is_sync_kiocb(iocb) ? NULL : &iocb->ki_wait);
 		retval += desc.written;
 		if (desc.error) {
 			retval = retval ?: desc.error;
@@ -1335,6 +1400,13 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		}
 		if (desc.count > 0)
 			break;
+		/*
+		 * An async read may only queue its wait entry while nothing
+		 * has been copied, so return after each segment and let
+		 * aio_rw_vect_retry() come back for the rest.
+		 */
+		if (!is_sync_kiocb(iocb))
+			break;
 	}
 out:
 	return retval;
@@ -104,6 +104,7 @@
 #include <net/dst.h>
 #include <net/pkt_sched.h>
 #include <net/checksum.h>
+#include <net/busy_poll.h>
 #include <linux/highmem.h>
 #include <linux/init.h>
 #include <linux/kmod.h>
@@ -1729,6 +1730,45 @@ static struct netdev_queue *dev_pick_tx(struct net_device *dev,
 	return netdev_get_tx_queue(dev, queue_index);
 }
 
+static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
+				 struct net_device *dev,
+				 struct netdev_queue *txq)
+{
+	spinlock_t *root_lock = qdisc_lock(q);
+	int rc;
+
+	spin_lock(root_lock);
+	if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+		kfree_skb(skb);
+		rc = NET_XMIT_DROP;
+	} else if ((q->flags & TCQ_F_CAN_BYPASS) && !q->q.qlen &&
+		   !q->gso_skb &&
+		   !test_and_set_bit(__QDISC_STATE_RUNNING, &q->state)) {
+		/*
+		 * This is a work-conserving queue; there are no old skbs
+		 * waiting to be sent out; and the qdisc is not running -
+		 * xmit the skb directly.  Ordering is preserved because
+		 * anything arriving meanwhile is queued behind the RUNNING
+		 * bit and drained by __qdisc_run() below.
+		 */
+		qdisc_skb_cb(skb)->pkt_len = skb->len;
+		q->bypassed++;
+		q->bstats.bytes += skb->len;
+		q->bstats.packets++;
+		if (sch_direct_xmit(skb, q, dev, txq, root_lock))
+			__qdisc_run(q);
+		else
+			clear_bit(__QDISC_STATE_RUNNING, &q->state);
+		rc = NET_XMIT_SUCCESS;
+	} else {
+		rc = qdisc_enqueue_root(skb, q);
+		qdisc_run(q);
+	}
+	spin_unlock(root_lock);
+
+	return rc;
+}
+
 /**
  *	dev_queue_xmit - transmit a buffer
  *	@skb: buffer to transmit
@@ -1802,19 +1842,7 @@ gso:
 	skb->tc_verd = SET_TC_AT(skb->tc_verd,AT_EGRESS);
 #endif
 	if (q->enqueue) {
-		spinlock_t *root_lock = qdisc_lock(q);
-
-		spin_lock(root_lock);
-
-		if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
-			kfree_skb(skb);
-			rc = NET_XMIT_DROP;
-		} else {
-			rc = qdisc_enqueue_root(skb, q);
-			qdisc_run(q);
-		}
-		spin_unlock(root_lock);
-
+		rc = __dev_xmit_skb(skb, q, dev, txq);
 		goto out;
 	}
 
@@ -2197,6 +2225,8 @@ int netif_receive_skb(struct sk_buff *skb)
 	if (!skb->iif)
 		skb->iif = skb->dev->ifindex;
 
+	skb_mark_napi_id(skb);
+
 	null_or_orig = NULL;
 	orig_dev = skb->dev;
 	if (orig_dev->master) {
@@ -2334,6 +2364,199 @@ void __napi_schedule(struct napi_struct *n)
 EXPORT_SYMBOL(__napi_schedule);
 
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+
+/* NAPI contexts are hashed by id, so that a socket can find the context
+ * its packets arrive on without pinning the device.  Id 0 means "none".
+ */
+#define NAPI_HASH_SIZE		256
+#define NAPI_HASH_MASK		(NAPI_HASH_SIZE - 1)
+#define BUSY_POLL_BUDGET	8
+
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+static struct hlist_head napi_hash[NAPI_HASH_SIZE];
+
+unsigned int sysctl_net_busy_read __read_mostly;
+DEFINE_PER_CPU(unsigned int, napi_poll_id);
+
+static inline void napi_set_poll_id(struct napi_struct *napi)
+{
+	__get_cpu_var(napi_poll_id) = napi ? napi->napi_id : 0;
+}
+
+static struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	struct napi_struct *napi;
+	struct hlist_node *node;
+
+	hlist_for_each_entry_rcu(napi, node, &napi_hash[napi_id & NAPI_HASH_MASK],
+				 napi_hash_node)
+		if (napi->napi_id == napi_id)
+			return napi;
+
+	return NULL;
+}
+
+static void napi_hash_add(struct napi_struct *napi)
+{
+	spin_lock(&napi_hash_lock);
+	do {
+		if (unlikely(++napi_gen_id == 0))
+			napi_gen_id = 1;
+	} while (napi_by_id(napi_gen_id));
+
+	napi->napi_id = napi_gen_id;
+	hlist_add_head_rcu(&napi->napi_hash_node,
+			   &napi_hash[napi->napi_id & NAPI_HASH_MASK]);
+	spin_unlock(&napi_hash_lock);
+}
+
+/* Returns 1 if the caller must wait for an RCU grace period before
+ * freeing @napi.
+ */
+static int napi_hash_del(struct napi_struct *napi)
+{
+	int hashed = 0;
+
+	spin_lock(&napi_hash_lock);
+	if (napi->napi_id) {
+		hlist_del_rcu(&napi->napi_hash_node);
+		napi->napi_id = 0;
+		hashed = 1;
+	}
+	spin_unlock(&napi_hash_lock);
+	return hashed;
+}
+
+/*
+ * Run one round of @napi's poll routine on behalf of a busy polling
+ * socket.  Called with BHs disabled.
+ */
+static int napi_busy_poll(struct napi_struct *napi)
+{
+	LIST_HEAD(owner);
+	void *have;
+	int work;
+
+	/* Whoever sets NAPI_STATE_SCHED owns the context.  If the interrupt
+	 * already did, net_rx_action() is about to deliver the packets.
+	 */
+	if (test_and_set_bit(NAPI_STATE_SCHED, &napi->state))
+		return 0;
+
+	if (unlikely(napi_disable_pending(napi))) {
+		smp_mb__before_clear_bit();
+		clear_bit(NAPI_STATE_SCHED, &napi->state);
+		return 0;
+	}
+
+	/* ->poll() unlinks poll_list in napi_complete() once it runs out
+	 * of work, so give it a private list to be unlinked from.
+	 */
+	list_add(&napi->poll_list, &owner);
+
+	have = netpoll_poll_lock(napi);
+	napi_set_poll_id(napi);
+	work = napi->poll(napi, BUSY_POLL_BUDGET);
+	napi_set_poll_id(NULL);
+	netpoll_poll_unlock(have);
+
+	/* Budget consumed: the context is still ours, so hand it over to
+	 * net_rx_action() as if the interrupt had scheduled it.
+	 */
+	if (!list_empty(&owner)) {
+		list_del(&napi->poll_list);
+		__napi_schedule(napi);
+	}
+
+	return work;
+}
+
+static inline u64 busy_loop_us_clock(void)
+{
+	return cpu_clock(raw_smp_processor_id()) >> 10;
+}
+
+/**
+ *	sk_busy_loop - busy poll the device queue feeding a socket
+ *	@sk: socket with an empty receive queue
+ *	@nonblock: poll once only
+ *
+ *	Polls the NAPI context that last delivered to @sk until a packet is
+ *	queued on @sk, sk_ll_usec microseconds have passed, or the task
+ *	must reschedule or handle a signal.  Returns 1 if the receive queue
+ *	is no longer empty.
+ */
+int sk_busy_loop(struct sock *sk, int nonblock)
+{
+	u64 end_time = busy_loop_us_clock() + ACCESS_ONCE(sk->sk_ll_usec);
+	struct napi_struct *napi;
+	int rc = 0;
+
+	rcu_read_lock();
+
+	napi = napi_by_id(sk->sk_napi_id);
+	if (!napi)
+		goto out;
+
+	do {
+		local_bh_disable();
+		napi_busy_poll(napi);
+		local_bh_enable();
+
+		rc = !skb_queue_empty(&sk->sk_receive_queue);
+	} while (!rc && !nonblock && !need_resched() &&
+		 !signal_pending(current) && busy_loop_us_clock() < end_time);
+
+out:
+	rcu_read_unlock();
+	return rc;
+}
+EXPORT_SYMBOL(sk_busy_loop);
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+
+static inline void napi_set_poll_id(struct napi_struct *napi)
+{
+}
+
+static inline void napi_hash_add(struct napi_struct *napi)
+{
+}
+
+static inline int napi_hash_del(struct napi_struct *napi)
+{
+	return 0;
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
+void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
+		    int (*poll)(struct napi_struct *, int), int weight)
+{
+	INIT_LIST_HEAD(&napi->poll_list);
+	napi->poll = poll;
+	napi->weight = weight;
+	napi->dev = dev;
+	list_add(&napi->dev_list, &dev->napi_list);
+#ifdef CONFIG_NETPOLL
+	spin_lock_init(&napi->poll_lock);
+	napi->poll_owner = -1;
+#endif
+	napi_hash_add(napi);
+	set_bit(NAPI_STATE_SCHED, &napi->state);
+}
+EXPORT_SYMBOL(netif_napi_add);
+
+void netif_napi_del(struct napi_struct *napi)
+{
+	list_del(&napi->dev_list);
+	if (napi_hash_del(napi))
+		synchronize_net();
+}
+EXPORT_SYMBOL(netif_napi_del);
+
 static void net_rx_action(struct softirq_action *h)
 {
 	struct list_head *list = &__get_cpu_var(softnet_data).poll_list;
@@ -2377,8 +2600,11 @@ static void net_rx_action(struct softirq_action *h)
 		 * accidently calling ->poll() when NAPI is not scheduled.
 		 */
 		work = 0;
-		if (test_bit(NAPI_STATE_SCHED, &n->state))
+		if (test_bit(NAPI_STATE_SCHED, &n->state)) {
+			napi_set_poll_id(n);
 			work = n->poll(n, weight);
+			napi_set_poll_id(NULL);
+		}
 
 		WARN_ON_ONCE(work > weight);
 
@@ -4277,7 +4503,7 @@ struct net_device *alloc_netdev_mq(int sizeof_priv, const char *name,
 	netdev_init_queues(dev);
 
 	dev->get_stats = internal_stats;
-	netpoll_netdev_init(dev);
+	INIT_LIST_HEAD(&dev->napi_list);
 	setup(dev);
 	strcpy(dev->name, name);
 	return dev;
@@ -4294,10 +4520,21 @@ EXPORT_SYMBOL(alloc_netdev_mq);
  */
 void free_netdev(struct net_device *dev)
 {
+	struct napi_struct *p, *n;
+	int hashed = 0;
+
 	release_net(dev_net(dev));
 
 	kfree(dev->_tx);
 
+	/* Drivers are not required to delete their NAPI contexts */
+	list_for_each_entry_safe(p, n, &dev->napi_list, dev_list) {
+		list_del(&p->dev_list);
+		hashed |= napi_hash_del(p);
+	}
+	if (hashed)
+		synchronize_net();
+
 	/*  Compatibility with error handling in drivers */
 	if (dev->reg_state == NETREG_UNINITIALIZED) {
 		kfree((char *)dev - dev->padded);
@@ -90,6 +90,8 @@
 #include <linux/jhash.h>
 #include <linux/rcupdate.h>
 #include <linux/times.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
 #include <net/dst.h>
 #include <net/net_namespace.h>
 #include <net/protocol.h>
@@ -129,9 +131,15 @@ static int ip_rt_mtu_expires __read_mostly	= 10 * 60 * HZ;
 static int ip_rt_min_pmtu __read_mostly		= 512 + 20 + 20;
 static int ip_rt_min_advmss __read_mostly	= 256;
 static int ip_rt_secret_interval __read_mostly	= 10 * 60 * HZ;
+static int ip_rt_max_chain_length __read_mostly	= 20;
+
+/* Chains are walked with the bucket lock held, in softirq context */
+#define RT_MAX_CHAIN_LENGTH	256
 
 static void rt_worker_func(struct work_struct *work);
 static DECLARE_DELAYED_WORK(expires_work, rt_worker_func);
+static void rt_resize_func(struct work_struct *work);
+static DECLARE_WORK(rt_resize_work, rt_resize_func);
 
 /*
  *	Interface to generic destination cache.
@@ -196,11 +204,22 @@ const __u8 ip_tos2prio[16] = {
  * 3) Only readers acquire references to rtable entries,
  *    they do so with atomic increments and with the
  *    lock held.
+ * 4) The hash table itself can be replaced at run time (see
+ *    rt_hash_resize()).  Readers find it through rt_hash_tbl under
+ *    rcu_read_lock(_bh); writers must only look it up after taking
+ *    the bucket lock.  The bucket lock is picked from the unmasked
+ *    hash, so it covers the same entries in the old and new table.
  */
 
 struct rt_hash_bucket {
 	struct rtable	*chain;
 };
+
+struct rt_hash_table {
+	unsigned int		mask;
+	unsigned int		log;
+	struct rt_hash_bucket	*buckets;
+};
 #if defined(CONFIG_SMP) || defined(CONFIG_DEBUG_SPINLOCK) || \
 	defined(CONFIG_PROVE_LOCKING)
 /*
@@ -224,6 +243,9 @@ struct rt_hash_bucket {
 # endif
 #endif
 
+/* Every bucket of a table must map to exactly one lock, see rt_hash_resize() */
+# define RT_HASH_MIN_SZ	RT_HASH_LOCK_SZ
+
 static spinlock_t	*rt_hash_locks;
 # define rt_hash_lock_addr(slot) &rt_hash_locks[(slot) & (RT_HASH_LOCK_SZ - 1)]
 
@@ -240,6 +262,7 @@ static __init void rt_hash_lock_init(void)
 		spin_lock_init(&rt_hash_locks[i]);
 }
 #else
+# define RT_HASH_MIN_SZ	256
 # define rt_hash_lock_addr(slot) NULL
 
 static inline void rt_hash_lock_init(void)
@@ -247,21 +270,73 @@ static inline void rt_hash_lock_init(void)
 }
 #endif
 
-static struct rt_hash_bucket 	*rt_hash_table __read_mostly;
-static unsigned			rt_hash_mask __read_mostly;
-static unsigned int		rt_hash_log  __read_mostly;
+static struct rt_hash_table	*rt_hash_tbl __read_mostly;
+static unsigned int		rt_hash_log_min __read_mostly;
+static unsigned int		rt_hash_log_max __read_mostly;
+static unsigned int		rt_hash_grows;
+static unsigned int		rt_hash_shrinks;
+static int			rt_hash_grow_thresh __read_mostly;
+static DEFINE_MUTEX(rt_hash_resize_mutex);
 
 static DEFINE_PER_CPU(struct rt_cache_stat, rt_cache_stat);
 #define RT_CACHE_STAT_INC(field) \
 	(__raw_get_cpu_var(rt_cache_stat).field++)
 
+/*
+ * Returns the unmasked hash of a flow.  The bucket is only selected once
+ * the caller holds a reference to the current table, because the mask
+ * changes when the table is resized.
+ */
 static inline unsigned int rt_hash(__be32 daddr, __be32 saddr, int idx,
 		int genid)
 {
 	return jhash_3words((__force u32)(__be32)(daddr),
 			    (__force u32)(__be32)(saddr),
-			    idx, genid)
-		& rt_hash_mask;
+			    idx, genid);
+}
+
+/* Recompute the hash an entry was inserted with */
+static inline unsigned int rt_hash_entry(struct rtable *rt)
+{
+	return rt_hash(rt->fl.fl4_dst, rt->fl.fl4_src,
+		       rt->fl.iif ? rt->fl.iif : rt->fl.oif, rt->rt_genid);
+}
+
+/* Called under rcu_read_lock(_bh) */
+static inline struct rtable *rt_hash_chain_rcu(unsigned int hash)
+{
+	struct rt_hash_table *tbl = rcu_dereference(rt_hash_tbl);
+
+	return rcu_dereference(tbl->buckets[hash & tbl->mask].chain);
+}
+
+/* Called with rt_hash_lock_addr(hash) held */
+static inline struct rt_hash_bucket *rt_hash_bucket(unsigned int hash)
+{
+	struct rt_hash_table *tbl = rt_hash_tbl;
+
+	return &tbl->buckets[hash & tbl->mask];
+}
+
+/* Current table size; only a hint unless the caller holds a bucket lock */
+static inline unsigned int rt_hash_mask(void)
+{
+	unsigned int mask;
+
+	rcu_read_lock_bh();
+	mask = rcu_dereference(rt_hash_tbl)->mask;
+	rcu_read_unlock_bh();
+	return mask;
+}
+
+static inline int rt_hash_bucket_empty(unsigned int hash)
+{
+	int empty;
+
+	rcu_read_lock_bh();
+	empty = rt_hash_chain_rcu(hash) == NULL;
+	rcu_read_unlock_bh();
+	return empty;
 }
 
 static inline int rt_genid(struct net *net)
@@ -281,9 +356,9 @@ static struct rtable *rt_cache_get_first(struct seq_file *seq)
 	struct rt_cache_iter_state *st = seq->private;
 	struct rtable *r = NULL;
 
-	for (st->bucket = rt_hash_mask; st->bucket >= 0; --st->bucket) {
+	for (st->bucket = rt_hash_mask(); st->bucket >= 0; --st->bucket) {
 		rcu_read_lock_bh();
-		r = rcu_dereference(rt_hash_table[st->bucket].chain);
+		r = rt_hash_chain_rcu(st->bucket);
 		while (r) {
 			if (dev_net(r->u.dst.dev) == seq_file_net(seq) &&
 			    r->rt_genid == st->genid)
@@ -299,15 +374,15 @@ static struct rtable *__rt_cache_get_next(struct seq_file *seq,
 					  struct rtable *r)
 {
 	struct rt_cache_iter_state *st = seq->private;
-	r = r->u.dst.rt_next;
+	r = rcu_dereference(r->u.dst.rt_next);
 	while (!r) {
 		rcu_read_unlock_bh();
 		if (--st->bucket < 0)
 			break;
 		rcu_read_lock_bh();
-		r = rt_hash_table[st->bucket].chain;
+		r = rt_hash_chain_rcu(st->bucket);
 	}
-	return rcu_dereference(r);
+	return r;
 }
 
 static struct rtable *rt_cache_get_next(struct seq_file *seq,
@@ -455,12 +530,12 @@ static int rt_cpu_seq_show(struct seq_file *seq, void *v)
 	struct rt_cache_stat *st = v;
 
 	if (v == SEQ_START_TOKEN) {
-		seq_printf(seq, "entries  in_hit in_slow_tot in_slow_mc in_no_route in_brd in_martian_dst in_martian_src  out_hit out_slow_tot out_slow_mc  gc_total gc_ignored gc_goal_miss gc_dst_overflow in_hlist_search out_hlist_search\n");
+		seq_printf(seq, "entries  in_hit in_slow_tot in_slow_mc in_no_route in_brd in_martian_dst in_martian_src  out_hit out_slow_tot out_slow_mc  gc_total gc_ignored gc_goal_miss gc_dst_overflow in_hlist_search out_hlist_search gc_chain_trim\n");
 		return 0;
 	}
 
 	seq_printf(seq,"%08x  %08x %08x %08x %08x %08x %08x %08x "
-		   " %08x %08x %08x %08x %08x %08x %08x %08x %08x \n",
+		   " %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x \n",
 		   atomic_read(&ipv4_dst_ops.entries),
 		   st->in_hit,
 		   st->in_slow_tot,
@@ -479,7 +554,8 @@ static int rt_cpu_seq_show(struct seq_file *seq, void *v)
 		   st->gc_goal_miss,
 		   st->gc_dst_overflow,
 		   st->in_hlist_search,
-		   st->out_hlist_search
+		   st->out_hlist_search,
+		   st->gc_chain_trim
 		);
 	return 0;
 }
@@ -545,6 +621,56 @@ static int ip_rt_acct_read(char *buffer, char **start, off_t offset,
 }
 #endif
 
+#define RT_CHAIN_HIST_SZ	16
+
+static int rt_chain_seq_show(struct seq_file *seq, void *v)
+{
+	unsigned int hist[RT_CHAIN_HIST_SZ + 1];
+	unsigned int i, mask, log;
+
+	memset(hist, 0, sizeof(hist));
+
+	mask = rt_hash_mask();
+	for (i = 0; i <= mask; i++) {
+		struct rtable *rth;
+		unsigned int len = 0;
+
+		rcu_read_lock_bh();
+		for (rth = rt_hash_chain_rcu(i); rth;
+		     rth = rcu_dereference(rth->u.dst.rt_next))
+			len++;
+		rcu_read_unlock_bh();
+
+		hist[min(len, (unsigned int)RT_CHAIN_HIST_SZ)]++;
+		if (need_resched())
+			cond_resched();
+	}
+
+	log = ilog2(mask + 1);
+	seq_printf(seq, "buckets %u log %u min_log %u max_log %u "
+		   "grows %u shrinks %u\n", mask + 1, log,
+		   rt_hash_log_min, rt_hash_log_max,
+		   rt_hash_grows, rt_hash_shrinks);
+	seq_puts(seq, "chain_length buckets\n");
+	for (i = 0; i < RT_CHAIN_HIST_SZ; i++)
+		seq_printf(seq, "%u %u\n", i, hist[i]);
+	seq_printf(seq, "%u+ %u\n", RT_CHAIN_HIST_SZ, hist[RT_CHAIN_HIST_SZ]);
+	return 0;
+}
+
+static int rt_chain_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, rt_chain_seq_show, NULL);
+}
+
+static const struct file_operations rt_chain_seq_fops = {
+	.owner	 = THIS_MODULE,
+	.open	 = rt_chain_seq_open,
+	.read	 = seq_read,
+	.llseek	 = seq_lseek,
+	.release = single_release,
+};
+
 static int __net_init ip_rt_do_proc_init(struct net *net)
 {
 	struct proc_dir_entry *pde;
@@ -559,18 +685,25 @@ static int __net_init ip_rt_do_proc_init(struct net *net)
 	if (!pde)
 		goto err2;
 
+	pde = proc_create("rt_cache_chains", S_IRUGO,
+			  net->proc_net_stat, &rt_chain_seq_fops);
+	if (!pde)
+		goto err3;
+
 #ifdef CONFIG_NET_CLS_ROUTE
 	pde = create_proc_read_entry("rt_acct", 0, net->proc_net,
 			ip_rt_acct_read, NULL);
 	if (!pde)
-		goto err3;
+		goto err4;
 #endif
 	return 0;
 
 #ifdef CONFIG_NET_CLS_ROUTE
+err4:
+	remove_proc_entry("rt_cache_chains", net->proc_net_stat);
+#endif
 err3:
 	remove_proc_entry("rt_cache", net->proc_net_stat);
-#endif
 err2:
 	remove_proc_entry("rt_cache", net->proc_net);
 err1:
@@ -579,6 +712,7 @@ err1:
 
 static void __net_exit ip_rt_do_proc_exit(struct net *net)
 {
+	remove_proc_entry("rt_cache_chains", net->proc_net_stat);
 	remove_proc_entry("rt_cache", net->proc_net_stat);
 	remove_proc_entry("rt_cache", net->proc_net);
 	remove_proc_entry("rt_acct", net->proc_net);
@@ -701,29 +835,31 @@ static void rt_do_flush(int process_context)
 	struct rtable *rth, *next;
 	struct rtable * tail;
 
-	for (i = 0; i <= rt_hash_mask; i++) {
+	for (i = 0; i <= rt_hash_mask(); i++) {
+		struct rt_hash_bucket *b;
+
 		if (process_context && need_resched())
 			cond_resched();
-		rth = rt_hash_table[i].chain;
-		if (!rth)
+		if (rt_hash_bucket_empty(i))
 			continue;
 
 		spin_lock_bh(rt_hash_lock_addr(i));
+		b = rt_hash_bucket(i);
 #ifdef CONFIG_NET_NS
 		{
 		struct rtable ** prev, * p;
 
-		rth = rt_hash_table[i].chain;
+		rth = b->chain;
 
 		/* defer releasing the head of the list after spin_unlock */
 		for (tail = rth; tail; tail = tail->u.dst.rt_next)
 			if (!rt_is_expired(tail))
 				break;
 		if (rth != tail)
-			rt_hash_table[i].chain = tail;
+			b->chain = tail;
 
 		/* call rt_free on entries after the tail requiring flush */
-		prev = &rt_hash_table[i].chain;
+		prev = &b->chain;
 		for (p = *prev; p; p = next) {
 			next = p->u.dst.rt_next;
 			if (!rt_is_expired(p)) {
@@ -735,8 +871,8 @@ static void rt_do_flush(int process_context)
 		}
 		}
 #else
-		rth = rt_hash_table[i].chain;
-		rt_hash_table[i].chain = NULL;
+		rth = b->chain;
+		b->chain = NULL;
 		tail = NULL;
 #endif
 		spin_unlock_bh(rt_hash_lock_addr(i));
@@ -755,24 +891,24 @@ static void rt_check_expire(void)
 	struct rtable *rth, **rthp;
 	u64 mult;
 
-	mult = ((u64)ip_rt_gc_interval) << rt_hash_log;
+	mult = ((u64)ip_rt_gc_interval) << ilog2(rt_hash_mask() + 1);
 	if (ip_rt_gc_timeout > 1)
 		do_div(mult, ip_rt_gc_timeout);
 	goal = (unsigned int)mult;
-	if (goal > rt_hash_mask)
-		goal = rt_hash_mask + 1;
+	if (goal > rt_hash_mask())
+		goal = rt_hash_mask() + 1;
 	for (; goal > 0; goal--) {
 		unsigned long tmo = ip_rt_gc_timeout;
 
-		i = (i + 1) & rt_hash_mask;
-		rthp = &rt_hash_table[i].chain;
+		i = (i + 1) & rt_hash_mask();
 
 		if (need_resched())
 			cond_resched();
 
-		if (*rthp == NULL)
+		if (rt_hash_bucket_empty(i))
 			continue;
 		spin_lock_bh(rt_hash_lock_addr(i));
+		rthp = &rt_hash_bucket(i)->chain;
 		while ((rth = *rthp) != NULL) {
 			if (rt_is_expired(rth)) {
 				*rthp = rth->u.dst.rt_next;
@@ -801,6 +937,161 @@ static void rt_check_expire(void)
 	rover = i;
 }
 
+static struct rt_hash_table *rt_hash_alloc(unsigned int log)
+{
+	struct rt_hash_table *tbl;
+	unsigned long size = sizeof(struct rt_hash_bucket) << log;
+
+	tbl = kmalloc(sizeof(*tbl), GFP_KERNEL);
+	if (!tbl)
+		return NULL;
+
+	if (size <= PAGE_SIZE)
+		tbl->buckets = kzalloc(size, GFP_KERNEL);
+	else {
+		tbl->buckets = (struct rt_hash_bucket *)
+			__get_free_pages(GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN,
+					 get_order(size));
+		if (!tbl->buckets) {
+			tbl->buckets = vmalloc(size);
+			if (tbl->buckets)
+				memset(tbl->buckets, 0, size);
+		}
+	}
+	if (!tbl->buckets) {
+		kfree(tbl);
+		return NULL;
+	}
+
+	tbl->log = log;
+	tbl->mask = (1U << log) - 1;
+	return tbl;
+}
+
+static void rt_hash_free(struct rt_hash_table *tbl)
+{
+	unsigned long size = sizeof(struct rt_hash_bucket) << tbl->log;
+
+	if (size <= PAGE_SIZE)
+		kfree(tbl->buckets);
+	else if (is_vmalloc_addr(tbl->buckets))
+		vfree(tbl->buckets);
+	else
+		free_pages((unsigned long)tbl->buckets, get_order(size));
+	kfree(tbl);
+}
+
+/* Grow once the average chain is half of what makes GC aggressive */
+static void rt_hash_set_thresh(struct rt_hash_table *tbl)
+{
+	rt_hash_grow_thresh = (tbl->mask + 1) * ip_rt_gc_elasticity / 2;
+}
+
+static synchronize_rcu_xxx(rt_synchronize_rcu_bh, call_rcu_bh)
+
+/*
+ * Replace the hash table with one of 2^new_log buckets.
+ *
+ * The new table is published first, so lookups and insertions move over
+ * to it straight away; lookups simply miss until their entry has been
+ * migrated.  Then every old bucket is emptied into the new table under
+ * its bucket lock.  Since both tables have at least RT_HASH_MIN_SZ
+ * buckets, the old bucket and all new buckets its entries land in share
+ * that lock, and a writer that raced with us finds the new table once it
+ * gets the lock.  Such a writer may already have inserted a fresh entry
+ * for a flow that still sits in the old bucket, so the old copy is
+ * dropped rather than moved when the new chain holds the same key.
+ * Readers walking an old chain may follow a moved entry into its new
+ * chain; that can only make them miss, never loop.
+ */
+static void rt_hash_resize(unsigned int new_log)
+{
+	struct rt_hash_table *old, *new;
+	unsigned int i;
+
+	new = rt_hash_alloc(new_log);
+	if (!new)
+		return;
+
+	old = rt_hash_tbl;
+	rcu_assign_pointer(rt_hash_tbl, new);
+	rt_hash_set_thresh(new);
+
+	for (i = 0; i <= old->mask; i++) {
+		struct rtable *rth, *next;
+
+		spin_lock_bh(rt_hash_lock_addr(i));
+		rth = old->buckets[i].chain;
+		old->buckets[i].chain = NULL;
+		for (; rth; rth = next) {
+			struct rt_hash_bucket *b;
+			struct rtable *dup;
+
+			next = rth->u.dst.rt_next;
+			if (rt_is_expired(rth)) {
+				rt_free(rth);
+				continue;
+			}
+			b = &new->buckets[rt_hash_entry(rth) & new->mask];
+			for (dup = b->chain; dup; dup = dup->u.dst.rt_next)
+				if (compare_keys(&dup->fl, &rth->fl) &&
+				    compare_netns(dup, rth))
+					break;
+			if (dup) {
+				rt_free(rth);
+				continue;
+			}
+			rcu_assign_pointer(rth->u.dst.rt_next, b->chain);
+			rcu_assign_pointer(b->chain, rth);
+		}
+		spin_unlock_bh(rt_hash_lock_addr(i));
+
+		if (need_resched())
+			cond_resched();
+	}
+
+	if (new_log > old->log)
+		rt_hash_grows++;
+	else
+		rt_hash_shrinks++;
+
+	/* Wait for everybody who may still look at the old buckets */
+	rt_synchronize_rcu_bh();
+	rt_hash_free(old);
+}
+
+/*
+ * Grow the table while the cache holds more entries than the grow
+ * threshold, shrink it when it is less than a quarter full.
+ */
+static void rt_hash_check_resize(void)
+{
+	unsigned int log, new_log;
+	int entries = atomic_read(&ipv4_dst_ops.entries);
+
+	mutex_lock(&rt_hash_resize_mutex);
+	new_log = log = rt_hash_tbl->log;
+	if (entries > rt_hash_grow_thresh && log < rt_hash_log_max)
+		new_log = log + 1;
+	else if (entries < (1 << log) / 4 && log > rt_hash_log_min)
+		new_log = log - 1;
+	if (new_log != log)
+		rt_hash_resize(new_log);
+	mutex_unlock(&rt_hash_resize_mutex);
+}
+
+static void rt_resize_func(struct work_struct *work)
+{
+	rt_hash_check_resize();
+}
+
+/* May be called from softirq context */
+static void rt_hash_kick_resize(void)
+{
+	if (rt_hash_log_min != rt_hash_log_max)
+		schedule_work(&rt_resize_work);
+}
+
 /*
  * rt_worker_func() is run in process context.
  * we call rt_check_expire() to scan part of the hash table
@@ -808,6 +1099,7 @@ static void rt_check_expire(void)
 static void rt_worker_func(struct work_struct *work)
 {
 	rt_check_expire();
+	rt_hash_check_resize();
 	schedule_delayed_work(&expires_work, ip_rt_gc_interval);
 }
 
@@ -867,6 +1159,7 @@ static int rt_garbage_collect(struct dst_ops *ops)
 	static int equilibrium;
 	struct rtable *rth, **rthp;
 	unsigned long now = jiffies;
+	unsigned int mask;
 	int goal;
 
 	/*
@@ -883,21 +1176,22 @@ static int rt_garbage_collect(struct dst_ops *ops)
 	}
 
 	/* Calculate number of entries, which we want to expire now. */
+	mask = rt_hash_mask();
 	goal = atomic_read(&ipv4_dst_ops.entries) -
-		(ip_rt_gc_elasticity << rt_hash_log);
+		(ip_rt_gc_elasticity * (mask + 1));
 	if (goal <= 0) {
 		if (equilibrium < ipv4_dst_ops.gc_thresh)
 			equilibrium = ipv4_dst_ops.gc_thresh;
 		goal = atomic_read(&ipv4_dst_ops.entries) - equilibrium;
 		if (goal > 0) {
-			equilibrium += min_t(unsigned int, goal >> 1, rt_hash_mask + 1);
+			equilibrium += min_t(unsigned int, goal >> 1, mask + 1);
 			goal = atomic_read(&ipv4_dst_ops.entries) - equilibrium;
 		}
 	} else {
 		/* We are in dangerous area. Try to reduce cache really
 		 * aggressively.
 		 */
-		goal = max_t(unsigned int, goal >> 1, rt_hash_mask + 1);
+		goal = max_t(unsigned int, goal >> 1, mask + 1);
 		equilibrium = atomic_read(&ipv4_dst_ops.entries) - goal;
 	}
 
@@ -912,12 +1206,12 @@ static int rt_garbage_collect(struct dst_ops *ops)
 	do {
 		int i, k;
 
-		for (i = rt_hash_mask, k = rover; i >= 0; i--) {
+		for (i = mask, k = rover; i >= 0; i--) {
 			unsigned long tmo = expire;
 
-			k = (k + 1) & rt_hash_mask;
-			rthp = &rt_hash_table[k].chain;
+			k = (k + 1) & mask;
 			spin_lock_bh(rt_hash_lock_addr(k));
+			rthp = &rt_hash_bucket(k)->chain;
 			while ((rth = *rthp) != NULL) {
 				if (!rt_is_expired(rth) &&
 					!rt_may_expire(rth, tmo, expire)) {
@@ -981,9 +1275,32 @@ work_done:
 out:	return 0;
 }
 
+/*
+ * Free unreferenced entries beyond the first ip_rt_gc_elasticity ones.
+ * Hits are moved to the head of their chain, so the tail holds the
+ * least recently used entries.  Called with the bucket lock held.
+ */
+static void rt_trim_chain(struct rt_hash_bucket *b)
+{
+	struct rtable *rth, **rthp = &b->chain;
+	int chain_length = 0;
+
+	while ((rth = *rthp) != NULL) {
+		if (++chain_length > ip_rt_gc_elasticity &&
+		    !atomic_read(&rth->u.dst.__refcnt)) {
+			*rthp = rth->u.dst.rt_next;
+			rt_free(rth);
+			RT_CACHE_STAT_INC(gc_chain_trim);
+			continue;
+		}
+		rthp = &rth->u.dst.rt_next;
+	}
+}
+
 static int rt_intern_hash(unsigned hash, struct rtable *rt, struct rtable **rp)
 {
 	struct rtable	*rth, **rthp;
+	struct rt_hash_bucket *b;
 	unsigned long	now;
 	struct rtable *cand, **candp;
 	u32 		min_score;
@@ -997,9 +1314,9 @@ restart:
 	candp = NULL;
 	now = jiffies;
 
-	rthp = &rt_hash_table[hash].chain;
-
 	spin_lock_bh(rt_hash_lock_addr(hash));
+	b = rt_hash_bucket(hash);
+	rthp = &b->chain;
 	while ((rth = *rthp) != NULL) {
 		if (rt_is_expired(rth)) {
 			*rthp = rth->u.dst.rt_next;
@@ -1014,13 +1331,12 @@ restart:
 			 * must be visible to another weakly ordered CPU before
 			 * the insertion at the start of the hash chain.
 			 */
-			rcu_assign_pointer(rth->u.dst.rt_next,
-					   rt_hash_table[hash].chain);
+			rcu_assign_pointer(rth->u.dst.rt_next, b->chain);
 			/*
 			 * Since lookup is lockfree, the update writes
 			 * must be ordered for consistency on SMP.
 			 */
-			rcu_assign_pointer(rt_hash_table[hash].chain, rth);
+			rcu_assign_pointer(b->chain, rth);
 
 			dst_use(&rth->u.dst, now);
 			spin_unlock_bh(rt_hash_lock_addr(hash));
@@ -1055,9 +1371,18 @@ restart:
 		if (chain_length > ip_rt_gc_elasticity) {
 			*candp = cand->u.dst.rt_next;
 			rt_free(cand);
+			chain_length--;
 		}
 	}
 
+	/* A single bucket must not grow without bound: evict actively
+	 * and ask for a bigger table.
+	 */
+	if (chain_length > ip_rt_max_chain_length) {
+		rt_trim_chain(b);
+		rt_hash_kick_resize();
+	}
+
 	/* Try to bind route to arp only if it is output
 	   route or unicast forwarding path.
 	 */
@@ -1093,19 +1418,22 @@ restart:
 		}
 	}
 
-	rt->u.dst.rt_next = rt_hash_table[hash].chain;
+	rt->u.dst.rt_next = b->chain;
 #if RT_CACHE_DEBUG >= 2
 	if (rt->u.dst.rt_next) {
 		struct rtable *trt;
-		printk(KERN_DEBUG "rt_cache @%02x: " NIPQUAD_FMT, hash,
-		       NIPQUAD(rt->rt_dst));
+		printk(KERN_DEBUG "rt_cache @%02x: " NIPQUAD_FMT,
+		       hash & rt_hash_tbl->mask, NIPQUAD(rt->rt_dst));
 		for (trt = rt->u.dst.rt_next; trt; trt = trt->u.dst.rt_next)
 			printk(" . " NIPQUAD_FMT, NIPQUAD(trt->rt_dst));
 		printk("\n");
 	}
 #endif
-	rt_hash_table[hash].chain = rt;
+	rcu_assign_pointer(b->chain, rt);
 	spin_unlock_bh(rt_hash_lock_addr(hash));
+
+	if (atomic_read(&ipv4_dst_ops.entries) > rt_hash_grow_thresh)
+		rt_hash_kick_resize();
 	*rp = rt;
 	return 0;
 }
@@ -1173,8 +1501,8 @@ static void rt_del(unsigned hash, struct rtable *rt)
 {
 	struct rtable **rthp, *aux;
 
-	rthp = &rt_hash_table[hash].chain;
 	spin_lock_bh(rt_hash_lock_addr(hash));
+	rthp = &rt_hash_bucket(hash)->chain;
 	ip_rt_put(rt);
 	while ((aux = *rthp) != NULL) {
 		if (aux == rt || rt_is_expired(aux)) {
@@ -1192,7 +1520,7 @@ void ip_rt_redirect(__be32 old_gw, __be32 daddr, __be32 new_gw,
 {
 	int i, k;
 	struct in_device *in_dev = in_dev_get(dev);
-	struct rtable *rth, **rthp;
+	struct rtable *rth;
 	__be32  skeys[2] = { saddr, 0 };
 	int  ikeys[2] = { dev->ifindex, 0 };
 	struct netevent_redirect netevent;
@@ -1222,10 +1550,9 @@ void ip_rt_redirect(__be32 old_gw, __be32 daddr, __be32 new_gw,
 			unsigned hash = rt_hash(daddr, skeys[i], ikeys[k],
 						rt_genid(net));
 
-			rthp=&rt_hash_table[hash].chain;
-
 			rcu_read_lock();
-			while ((rth = rcu_dereference(*rthp)) != NULL) {
+			rth = rt_hash_chain_rcu(hash);
+			while (rth != NULL) {
 				struct rtable *rt;
 
 				if (rth->fl.fl4_dst != daddr ||
@@ -1234,7 +1561,7 @@ void ip_rt_redirect(__be32 old_gw, __be32 daddr, __be32 new_gw,
 				    rth->fl.iif != 0 ||
 				    rt_is_expired(rth) ||
 				    !net_eq(dev_net(rth->u.dst.dev), net)) {
-					rthp = &rth->u.dst.rt_next;
+					rth = rcu_dereference(rth->u.dst.rt_next);
 					continue;
 				}
 
@@ -1490,7 +1817,7 @@ unsigned short ip_rt_frag_needed(struct net *net, struct iphdr *iph,
 						rt_genid(net));
 
 			rcu_read_lock();
-			for (rth = rcu_dereference(rt_hash_table[hash].chain); rth;
+			for (rth = rt_hash_chain_rcu(hash); rth;
 			     rth = rcu_dereference(rth->u.dst.rt_next)) {
 				unsigned short mtu = new_mtu;
 
@@ -2124,7 +2451,7 @@ int ip_route_input(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 	hash = rt_hash(daddr, saddr, iif, rt_genid(net));
 
 	rcu_read_lock();
-	for (rth = rcu_dereference(rt_hash_table[hash].chain); rth;
+	for (rth = rt_hash_chain_rcu(hash); rth;
 	     rth = rcu_dereference(rth->u.dst.rt_next)) {
 		if (((rth->fl.fl4_dst ^ daddr) |
 		     (rth->fl.fl4_src ^ saddr) |
@@ -2526,7 +2853,7 @@ int __ip_route_output_key(struct net *net, struct rtable **rp,
 	hash = rt_hash(flp->fl4_dst, flp->fl4_src, flp->oif, rt_genid(net));
 
 	rcu_read_lock_bh();
-	for (rth = rcu_dereference(rt_hash_table[hash].chain); rth;
+	for (rth = rt_hash_chain_rcu(hash); rth;
 		rth = rcu_dereference(rth->u.dst.rt_next)) {
 		if (rth->fl.fl4_dst == flp->fl4_dst &&
 		    rth->fl.fl4_src == flp->fl4_src &&
@@ -2840,9 +3167,9 @@ int ip_rt_dump(struct sk_buff *skb,  struct netlink_callback *cb)
 	if (s_h < 0)
 		s_h = 0;
 	s_idx = idx = cb->args[1];
-	for (h = s_h; h <= rt_hash_mask; h++) {
+	for (h = s_h; h <= rt_hash_mask(); h++) {
 		rcu_read_lock_bh();
-		for (rt = rcu_dereference(rt_hash_table[h].chain), idx = 0; rt;
+		for (rt = rt_hash_chain_rcu(h), idx = 0; rt;
 		     rt = rcu_dereference(rt->u.dst.rt_next), idx++) {
 			if (!net_eq(dev_net(rt->u.dst.dev), net) || idx < s_idx)
 				continue;
@@ -2976,6 +3303,19 @@ static int ipv4_sysctl_rt_secret_interval_strategy(ctl_table *table,
 	return ret;
 }
 
+static int ipv4_sysctl_rt_max_chain_length(ctl_table *ctl, int write,
+					   struct file *filp,
+					   void __user *buffer, size_t *lenp,
+					   loff_t *ppos)
+{
+	int ret = proc_dointvec(ctl, write, filp, buffer, lenp, ppos);
+
+	if (write && !ret)
+		ip_rt_max_chain_length = clamp(ip_rt_max_chain_length, 1,
+					       RT_MAX_CHAIN_LENGTH);
+	return ret;
+}
+
 static ctl_table ipv4_route_table[] = {
 	{
 		.ctl_name	= NET_IPV4_ROUTE_GC_THRESH,
@@ -3079,6 +3419,14 @@ static ctl_table ipv4_route_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dointvec,
 	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "max_chain_length",
+		.data		= &ip_rt_max_chain_length,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &ipv4_sysctl_rt_max_chain_length,
+	},
 	{
 		.ctl_name	= NET_IPV4_ROUTE_MTU_EXPIRES,
 		.procname	= "mtu_expires",
@@ -3254,21 +3602,38 @@ int __init ip_rt_init(void)
 
 	ipv4_dst_blackhole_ops.kmem_cachep = ipv4_dst_ops.kmem_cachep;
 
-	rt_hash_table = (struct rt_hash_bucket *)
-		alloc_large_system_hash("IP route cache",
-					sizeof(struct rt_hash_bucket),
-					rhash_entries,
-					(num_physpages >= 128 * 1024) ?
-					15 : 17,
-					0,
-					&rt_hash_log,
-					&rt_hash_mask,
-					0);
-	memset(rt_hash_table, 0, (rt_hash_mask + 1) * sizeof(struct rt_hash_bucket));
+	/*
+	 * The table starts at an eighth of the size that used to be
+	 * allocated at boot and grows on demand up to that size.
+	 * rhash_entries= pins the size and disables resizing.
+	 */
+	if (rhash_entries) {
+		rt_hash_log_max = ilog2(roundup_pow_of_two(rhash_entries));
+		rt_hash_log_min = rt_hash_log_max;
+	} else {
+		unsigned long entries = num_physpages;
+		int scale = (num_physpages >= 128 * 1024) ? 15 : 17;
+
+		entries = (entries << PAGE_SHIFT) >> scale;
+		rt_hash_log_max = ilog2(roundup_pow_of_two(max(entries, 1UL)));
+		rt_hash_log_min = rt_hash_log_max > 3 ?
+				  rt_hash_log_max - 3 : 0;
+	}
+	rt_hash_log_min = max_t(unsigned int, rt_hash_log_min,
+				ilog2(RT_HASH_MIN_SZ));
+	rt_hash_log_max = max(rt_hash_log_max, rt_hash_log_min);
+
+	rt_hash_tbl = rt_hash_alloc(rt_hash_log_min);
+	if (!rt_hash_tbl)
+		panic("IP: failed to allocate the route cache hash table\n");
+	printk(KERN_INFO "IP route cache hash table entries: %u "
+	       "(order: %u, max order: %u)\n", rt_hash_tbl->mask + 1,
+	       rt_hash_log_min, rt_hash_log_max);
 	rt_hash_lock_init();
 
-	ipv4_dst_ops.gc_thresh = (rt_hash_mask + 1);
-	ip_rt_max_size = (rt_hash_mask + 1) * 16;
+	rt_hash_set_thresh(rt_hash_tbl);
+	ipv4_dst_ops.gc_thresh = 1 << rt_hash_log_max;
+	ip_rt_max_size = (1 << rt_hash_log_max) * 16;
 
 	devinet_init();
 	ip_fib_init();
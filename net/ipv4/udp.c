@@ -102,6 +102,7 @@
 #include <net/route.h>
 #include <net/checksum.h>
 #include <net/xfrm.h>
+#include <net/busy_poll.h>
 #include "udp_impl.h"
 
 /*
@@ -993,6 +994,8 @@ int udp_queue_rcv_skb(struct sock * sk, struct sk_buff *skb)
 		goto drop;
 	nf_reset(skb);
 
+	sk_mark_napi_id(sk, skb);
+
 	if (up->encap_type) {
 		/*
 		 * This is an encapsulation socket so pass the skb to